@@ -0,0 +1,43 @@
+/**
+ * @file ac_state.h
+ * @brief The whole state of an AC unit, as its own remote sends it
+ *
+ * Remotes of stateful AC protocols carry every setting in every frame:
+ * power, mode, setpoint, fan and swing. Holding that state lets one
+ * command go out as one frame that sets all of it, where learned codes
+ * replay one button press each and only what was pressed at the time.
+ *
+ * Encoding belongs to the board (hal::IrTx::sendAc(), IRremoteESP8266's
+ * IRac on the ESP32), so like ir_code.h this stays free of library
+ * headers: protocol is the numeric decode_type_t, as logged when a code
+ * is learned, and model the library's model number for brands that have
+ * several.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct AcState {
+  enum class Mode : uint8_t { AUTO, COOL, HEAT, DRY, FAN };
+  enum class Fan : uint8_t { AUTO, SLOW, MEDIUM, FAST };
+  enum class Swing : uint8_t { OFF, ON };
+
+  static constexpr uint8_t MODE_COUNT  = 5;
+  static constexpr uint8_t FAN_COUNT   = 4;
+  static constexpr uint8_t SWING_COUNT = 2;
+  static const char* const MODE_NAMES[MODE_COUNT];    // "auto", "cool", "heat", "dry", "fan"
+  static const char* const FAN_NAMES[FAN_COUNT];      // "auto", "low", "medium", "high"
+  static const char* const SWING_NAMES[SWING_COUNT];  // "off", "on"
+
+  // What common remotes accept in Celsius
+  static constexpr float MIN_C = 16.0f;
+  static constexpr float MAX_C = 30.0f;
+
+  int16_t  protocol;  // decode_type_t
+  uint16_t model;     // 0 for the brand's default
+  bool     power;
+  Mode     mode;
+  float    tempC;
+  Fan      fan;
+  Swing    swing;  // vertical
+};
@@ -0,0 +1,78 @@
+/**
+ * @file app.h
+ * @brief The controller application: scheduling, learning, auto control and MQTT commands
+ *
+ * Everything here reaches the hardware through a hal::Board, so the same
+ * code runs on the ESP32 (src/main.cpp) and on the host (src/native/).
+ * Like the logger, the application is a single instance with file-level
+ * state; begin() binds it to a board and registers its scheduler tasks.
+ *
+ * The tasks form two domains with a scheduler each:
+ *
+ *   NETWORK  WiFi, MQTT, telemetry publishing and log output
+ *   CONTROL  button, learning, sensors, thermostat and IR
+ *
+ * They share no mutable state. Commands and settings writes cross from
+ * NETWORK to CONTROL, settings echoes and telemetry samples the other way,
+ * each through a bounded SpscQueue; the logger is the one shared service.
+ * So each domain may run in its own thread: on the ESP32 one FreeRTOS task
+ * per core, on the host one std::thread each. loop() runs both in turn for
+ * a single-threaded caller.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "ir_code.h"
+#include "record_store.h"
+#include "scheduler.h"
+#include "sensor_service.h"
+#include "thermostat.h"
+#include "topics.h"
+
+namespace app {
+
+enum class Domain : uint8_t { NETWORK, CONTROL };
+constexpr uint8_t DOMAIN_COUNT = 2;
+
+// Called after a message is queued for domain, from the other domain's thread
+using WakeFn = void (*)(Domain domain);
+
+// IR code slots (record names in the code store)
+extern const char* const SLOT_ON;
+extern const char* const SLOT_OFF;
+extern const char* const SLOT_SET;
+
+// Attaches the MQTT log sink, mounts the code store (board.storage must be
+// ready) and registers the tasks. Call once, after the serial log sink.
+void begin(const hal::Board& board);
+
+// One scheduler pass of each domain; call from a single-threaded main loop
+void loop();
+
+// One pass of domain's scheduler, only ever from that domain's thread.
+// Returns the microseconds it may sleep unless woken.
+uint32_t loop(Domain domain);
+
+// Lets a threaded runner wake a sleeping domain; set before the threads start
+void onWake(WakeFn fn);
+
+// Control domain
+bool autoMode();
+void setMode(bool autoMode);
+
+// Code store access, also used by board-specific migrations before the
+// domains run
+bool saveCode(const char* slot, const IrCode& code);
+// Queues the learned code for the control domain's IR task; false when
+// the slot has none
+bool sendCode(const char* slot);
+
+const RecordStore& codeStore();
+const Scheduler&   scheduler(Domain domain);
+const Thermostat&  thermostat();
+const Topics&      topics();
+const SensorService& sensors();
+
+}  // namespace app
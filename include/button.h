@@ -0,0 +1,75 @@
+/**
+ * @file button.h
+ * @brief Debounce and gesture detection over interrupt-stamped button edges
+ *
+ * The button's interrupt handler only queues timestamped edges
+ * (hal::EdgeQueue). service() drains them later, so a press that happens
+ * while the main task is busy in a reconnect or an IR send is still seen,
+ * and its timing is still exact.
+ *
+ * Debounce: a level counts once it has held for debounceMs without another
+ * edge. The transition is dated to when the level was first seen, not to
+ * when it was confirmed. The current pin level is passed in as well, so a
+ * lost edge (queue overflow) or a board without edge interrupts cannot
+ * desynchronise the state.
+ *
+ * Gestures, for an active-low button:
+ *
+ *   SHORT   press and release, and no second press within doubleMs
+ *   DOUBLE  a second press starting within doubleMs of a short release
+ *   LONG    held for longMs; reported while still held, or on release if
+ *           the holder was blocked that long
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+class Button {
+public:
+  enum class Gesture : uint8_t { SHORT, DOUBLE, LONG };
+  using GestureFn = void (*)(Gesture gesture);
+
+  struct Stats {
+    uint32_t edges;
+    uint32_t bounces;   // edges that did not survive debouncing
+    uint32_t presses;
+    uint32_t gestures;
+  };
+
+  Button(uint32_t debounceMs, uint32_t longMs, uint32_t doubleMs, GestureFn onGesture)
+    : debounceUs_(debounceMs * 1000UL), longUs_(longMs * 1000UL), doubleUs_(doubleMs * 1000UL),
+      onGesture_(onGesture) {}
+
+  // Drains the queued edges, then checks timeouts against nowUs. level is
+  // the pin as read now.
+  void service(hal::EdgeQueue& edges, uint32_t nowUs, bool level);
+
+  void         setDebounceMs(uint32_t ms) { debounceUs_ = ms * 1000UL; }
+  bool         pressed() const { return !stable_; }
+  const Stats& stats() const { return stats_; }
+
+private:
+  void edge(bool level, uint32_t atUs);
+  void settle(uint32_t nowUs);
+  void commit(bool level, uint32_t atUs);
+  void emit(Gesture gesture);
+
+  uint32_t  debounceUs_;
+  uint32_t  longUs_;
+  uint32_t  doubleUs_;
+  GestureFn onGesture_;
+
+  bool     stable_      = true;  // released
+  bool     candidate_   = true;
+  uint32_t candidateUs_ = 0;
+
+  uint32_t pressUs_     = 0;
+  uint32_t releaseUs_   = 0;
+  bool     longSent_    = false;
+  bool     shortHeld_   = false;  // a short press waits for a possible second one
+  bool     second_      = false;  // the current press is the second of a double
+
+  Stats stats_ = {};
+};
@@ -0,0 +1,159 @@
+/**
+ * @file commands.h
+ * @brief Compile-time command table with perfect-hash dispatch over raw MQTT payloads
+ *
+ * A command is a name optionally followed by '=' or ' ' and an argument,
+ * e.g. "on", "mode=learn". Payloads are parsed in place, without copying
+ * or NUL-termination. Lookup hashes (name length, first char) into a slot
+ * table built at compile time; makeTable() callers static_assert that the
+ * hash is collision-free, so a lookup is one hash, one length check and one
+ * memcmp however many commands are registered.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace cmd {
+
+// Non-owning view of the argument. It points into the control domain's
+// copy of the message (app.cpp's Inbound, popped off the inbox queue),
+// which lives until the handler returns: parse or copy it there, and keep
+// no pointer into it.
+struct Arg {
+  const char* data = nullptr;
+  uint8_t     len  = 0;
+
+  bool empty() const { return len == 0; }
+
+  bool equals(const char* s) const {
+    size_t n = strlen(s);
+    return n == len && memcmp(data, s, n) == 0;
+  }
+
+  // Whole-argument decimal integer, optionally signed
+  bool toInt(int32_t& out) const {
+    if (len == 0 || len > 11) return false;
+    uint8_t i   = (data[0] == '-' || data[0] == '+') ? 1 : 0;
+    bool    neg = data[0] == '-';
+    if (i == len) return false;
+    int64_t v = 0;
+    for (; i < len; i++) {
+      if (data[i] < '0' || data[i] > '9') return false;
+      v = v * 10 + (data[i] - '0');
+    }
+    if (neg) v = -v;
+    if (v < INT32_MIN || v > INT32_MAX) return false;
+    out = static_cast<int32_t>(v);
+    return true;
+  }
+
+  // Decimal number with an optional fraction, e.g. "24" or "-1.5". Only
+  // that: strtof alone would also take "nan", "inf", "1e3" and hex.
+  bool toFloat(float& out) const {
+    char tmp[16];
+    if (len == 0 || len >= sizeof(tmp)) return false;
+    uint8_t i      = (data[0] == '-' || data[0] == '+') ? 1 : 0;
+    uint8_t digits = 0;
+    bool    point  = false;
+    for (; i < len; i++) {
+      if (data[i] >= '0' && data[i] <= '9') {
+        digits++;
+      } else if (data[i] == '.' && !point) {
+        point = true;
+      } else {
+        return false;
+      }
+    }
+    if (digits == 0) return false;
+    memcpy(tmp, data, len);
+    tmp[len] = '\0';
+    char* end = nullptr;
+    out = strtof(tmp, &end);
+    return end == tmp + len;
+  }
+};
+
+// Returns false when the argument is missing or invalid
+using Handler = bool (*)(Arg arg);
+
+struct Command {
+  const char* name;
+  Handler     fn;
+};
+
+enum class Result : uint8_t { OK, UNKNOWN, BAD_ARG };
+
+constexpr uint8_t MAX_NAME = 16;
+
+constexpr uint8_t nameLength(const char* s) {
+  uint8_t n = 0;
+  while (s[n]) n++;
+  return n;
+}
+
+template <size_t N, size_t SLOTS>
+struct Table {
+  static_assert(SLOTS >= N, "slot table smaller than command list");
+  static_assert(SLOTS <= 128, "slot index must fit in int8_t");
+
+  Command cmds[N]      = {};
+  uint8_t lens[N]      = {};
+  int8_t  slots[SLOTS] = {};
+  bool    perfect      = true;
+
+  static constexpr size_t hash(uint8_t len, char first) {
+    return (static_cast<size_t>(len) * 31u + static_cast<uint8_t>(first)) % SLOTS;
+  }
+
+  constexpr explicit Table(const Command (&list)[N]) {
+    for (size_t s = 0; s < SLOTS; s++) slots[s] = -1;
+    for (size_t i = 0; i < N; i++) {
+      cmds[i] = list[i];
+      lens[i] = nameLength(list[i].name);
+      if (lens[i] == 0 || lens[i] > MAX_NAME) perfect = false;
+      size_t s = hash(lens[i], list[i].name[0]);
+      if (slots[s] >= 0) perfect = false;
+      slots[s] = static_cast<int8_t>(i);
+    }
+  }
+
+  const Command* find(const char* name, uint8_t len) const {
+    if (len == 0 || len > MAX_NAME) return nullptr;
+    int8_t i = slots[hash(len, name[0])];
+    if (i < 0 || lens[i] != len || memcmp(cmds[i].name, name, len) != 0) return nullptr;
+    return &cmds[i];
+  }
+
+  // Splits "name[=| ]arg" in place and runs the matching handler
+  Result dispatch(const char* payload, size_t size) const {
+    while (size && (payload[size - 1] == '\r' || payload[size - 1] == '\n' || payload[size - 1] == ' '))
+      size--;
+
+    size_t nameLen = 0;
+    while (nameLen < size && payload[nameLen] != '=' && payload[nameLen] != ' ') nameLen++;
+    if (nameLen > MAX_NAME) return Result::UNKNOWN;
+
+    const Command* c = find(payload, static_cast<uint8_t>(nameLen));
+    if (c == nullptr) return Result::UNKNOWN;
+
+    Arg arg;
+    size_t pos = nameLen < size ? nameLen + 1 : size;
+    while (pos < size && payload[pos] == ' ') pos++;
+    if (size - pos > UINT8_MAX) return Result::BAD_ARG;
+    arg.data = payload + pos;
+    arg.len  = static_cast<uint8_t>(size - pos);
+
+    return c->fn(arg) ? Result::OK : Result::BAD_ARG;
+  }
+};
+
+// The slot count should be a small multiple of N to keep the hash perfect
+template <size_t SLOTS, size_t N>
+constexpr Table<N, SLOTS> makeTable(const Command (&list)[N]) {
+  return Table<N, SLOTS>(list);
+}
+
+}  // namespace cmd
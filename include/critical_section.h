@@ -0,0 +1,45 @@
+/**
+ * @file critical_section.h
+ * @brief Short mutual exclusion between tasks, on either core or on the host
+ *
+ * On the ESP32 this is a FreeRTOS spinlock critical section: it also masks
+ * interrupts on the calling core, so it must only cover a few microseconds
+ * of copying, never I/O. On the host it is a std::mutex. The SPSC queues
+ * need no lock; this is for the few places with several producers.
+ */
+#pragma once
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif
+
+class CriticalSection {
+public:
+#if defined(ESP_PLATFORM)
+  void lock() { portENTER_CRITICAL(&mux_); }
+  void unlock() { portEXIT_CRITICAL(&mux_); }
+
+private:
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+#else
+  void lock() { mutex_.lock(); }
+  void unlock() { mutex_.unlock(); }
+
+private:
+  std::mutex mutex_;
+#endif
+};
+
+// Scoped lock
+class CriticalGuard {
+public:
+  explicit CriticalGuard(CriticalSection& cs) : cs_(cs) { cs_.lock(); }
+  ~CriticalGuard() { cs_.unlock(); }
+  CriticalGuard(const CriticalGuard&)            = delete;
+  CriticalGuard& operator=(const CriticalGuard&) = delete;
+
+private:
+  CriticalSection& cs_;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file flash.h
+ * @brief Sector-erasable flash backend interface and a RAM simulation of it
+ *
+ * Semantics follow NOR flash: erase() sets a whole sector to 0xFF and
+ * write() can only clear bits. SimFlash enforces the same rules and counts
+ * erase cycles per sector so wear behaviour can be checked off-device.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class Flash {
+public:
+  virtual ~Flash() = default;
+
+  virtual uint32_t sectorSize() const = 0;
+  virtual uint16_t sectorCount() const = 0;
+
+  // Addresses are byte offsets from the start of the region
+  virtual bool read(uint32_t addr, void* dst, size_t len) = 0;
+  virtual bool write(uint32_t addr, const void* src, size_t len) = 0;
+  virtual bool erase(uint16_t sector) = 0;
+};
+
+template <uint16_t SECTORS, uint32_t SECTOR_SIZE = 4096>
+class SimFlash : public Flash {
+public:
+  SimFlash() { memset(mem_, 0xFF, sizeof(mem_)); }
+
+  uint32_t sectorSize() const override { return SECTOR_SIZE; }
+  uint16_t sectorCount() const override { return SECTORS; }
+
+  bool read(uint32_t addr, void* dst, size_t len) override {
+    if (!inRange(addr, len)) return false;
+    memcpy(dst, mem_ + addr, len);
+    return true;
+  }
+
+  bool write(uint32_t addr, const void* src, size_t len) override {
+    if (!inRange(addr, len)) return false;
+    // Power-cut simulation: the write stops part-way
+    size_t n = len;
+    if (failAfterBytes_ >= 0 && static_cast<size_t>(failAfterBytes_) < n) n = failAfterBytes_;
+
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < n; i++) mem_[addr + i] &= p[i];
+    writes_++;
+
+    if (failAfterBytes_ >= 0) failAfterBytes_ -= static_cast<long>(n);
+    return n == len;
+  }
+
+  bool erase(uint16_t sector) override {
+    if (sector >= SECTORS) return false;
+    memset(mem_ + static_cast<uint32_t>(sector) * SECTOR_SIZE, 0xFF, SECTOR_SIZE);
+    erases_[sector]++;
+    return true;
+  }
+
+  uint32_t erases(uint16_t sector) const { return sector < SECTORS ? erases_[sector] : 0; }
+  uint32_t totalErases() const {
+    uint32_t n = 0;
+    for (uint16_t s = 0; s < SECTORS; s++) n += erases_[s];
+    return n;
+  }
+  uint32_t writes() const { return writes_; }
+
+  // Fails every write once this many more bytes have been written (-1 = never)
+  void failAfter(long bytes) { failAfterBytes_ = bytes; }
+
+private:
+  bool inRange(uint32_t addr, size_t len) const {
+    return addr <= sizeof(mem_) && len <= sizeof(mem_) - addr;
+  }
+
+  uint8_t  mem_[SECTORS * SECTOR_SIZE];
+  uint32_t erases_[SECTORS] = {};
+  uint32_t writes_          = 0;
+  long     failAfterBytes_  = -1;
+};
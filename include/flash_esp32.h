@@ -0,0 +1,28 @@
+/**
+ * @file flash_esp32.h
+ * @brief Flash backend over an ESP32 data partition
+ */
+#pragma once
+
+#include <esp_partition.h>
+
+#include "flash.h"
+
+class PartitionFlash : public Flash {
+public:
+  explicit PartitionFlash(const char* label) : label_(label) {}
+
+  // Looks the partition up by label; false if the partition table lacks it
+  bool begin();
+
+  uint32_t sectorSize() const override { return SPI_FLASH_SEC_SIZE; }
+  uint16_t sectorCount() const override;
+
+  bool read(uint32_t addr, void* dst, size_t len) override;
+  bool write(uint32_t addr, const void* src, size_t len) override;
+  bool erase(uint16_t sector) override;
+
+private:
+  const char*            label_;
+  const esp_partition_t* part_ = nullptr;
+};
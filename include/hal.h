@@ -0,0 +1,166 @@
+/**
+ * @file hal.h
+ * @brief Hardware abstraction interfaces between the application and the board
+ *
+ * The application (app.h) only talks to the board through these interfaces,
+ * so the same control, learning and command code runs on the ESP32
+ * (hal_esp32.h) and on a Linux host against fakes (hal_fake.h).
+ * Persistent storage is the Flash interface from flash.h.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ac_state.h"
+#include "flash.h"
+#include "ir_code.h"
+#include "spsc_queue.h"
+
+namespace hal {
+
+class Clock {
+public:
+  virtual ~Clock() = default;
+
+  // Monotonic, may wrap
+  virtual uint32_t millis() = 0;
+  virtual uint32_t micros() = 0;
+
+  // A cheaper, finer counter for short spans within one task, and its rate;
+  // micros() unless the board has a cycle counter
+  virtual uint32_t cycles() { return micros(); }
+  virtual uint32_t cyclesPerUs() { return 1; }
+};
+
+// A level change on an input, stamped in the interrupt handler
+struct Edge {
+  uint32_t atUs;   // Clock::micros() time base
+  bool     level;  // level after the change
+};
+using EdgeQueue = SpscQueue<Edge, 32>;
+
+class Gpio {
+public:
+  enum Mode : uint8_t { IN, IN_PULLUP, OUT };
+
+  virtual ~Gpio() = default;
+
+  virtual void setMode(uint8_t pin, Mode mode) = 0;
+  virtual bool read(uint8_t pin) = 0;
+  virtual void write(uint8_t pin, bool level) = 0;
+
+  // Pushes every change of the input onto queue from its interrupt
+  // handler; false if the board cannot, and the pin has to be polled
+  virtual bool watch(uint8_t pin, EdgeQueue& queue) {
+    (void)pin, (void)queue;
+    return false;
+  }
+};
+
+// Room temperature (C) and relative humidity (%). A read is split in two so
+// slow conversions never block: start() triggers one and returns how long
+// it takes, collect() fetches the result once that time has passed. NaN
+// marks a failed read or a channel the sensor does not have.
+class ClimateSensor {
+public:
+  virtual ~ClimateSensor() = default;
+
+  virtual void begin() = 0;
+  // ms until collect() may be called; 0 when collect() does the whole read
+  virtual uint32_t start() { return 0; }
+  virtual void collect(float& tempC, float& humidity) = 0;
+
+  virtual const char* name() const = 0;
+  virtual bool hasHumidity() const { return true; }
+  // Bit-banged buses mask interrupts during start()/collect(), which
+  // corrupts an IR capture running at the same time
+  virtual bool masksInterrupts() const { return false; }
+};
+
+// A sensor and its weight in the fused room estimate
+struct SensorSlot {
+  ClimateSensor& sensor;
+  float          weight;
+};
+
+class IrTx {
+public:
+  virtual ~IrTx() = default;
+
+  virtual void begin() = 0;
+  // false if the code's protocol cannot be sent
+  virtual bool send(const IrCode& code) = 0;
+  // Encodes state as one frame of its protocol's remote; false if the
+  // board has no encoder for that protocol
+  virtual bool sendAc(const AcState& state) {
+    (void)state;
+    return false;
+  }
+};
+
+class IrRx {
+public:
+  virtual ~IrRx() = default;
+
+  virtual void enable() = 0;
+  virtual void disable() = 0;
+
+  // Takes the next captured frame, if any. Raw timings are written to
+  // code.raw (code.rawCap entries). Repeats and unusable frames are dropped.
+  virtual bool receive(IrCode& code) = 0;
+  // Captures dropped so far because they overflowed the receive buffer
+  virtual uint32_t overflows() const { return 0; }
+};
+
+class MqttTransport {
+public:
+  using MessageFn = void (*)(char* topic, uint8_t* payload, unsigned int len);
+
+  virtual ~MqttTransport() = default;
+
+  virtual void setCallback(MessageFn fn) = 0;
+  // Blocks for at most the transport's connect timeout
+  virtual bool connect(const char* clientId) = 0;
+  virtual void disconnect() = 0;
+  virtual bool connected() = 0;
+  // Services the session and delivers incoming messages; false once it dropped
+  virtual bool loop() = 0;
+  virtual bool subscribe(const char* topic) = 0;
+  virtual bool publish(const char* topic, const uint8_t* payload, unsigned int len) = 0;
+  virtual int  state() = 0;
+
+  bool publish(const char* topic, const char* text) {
+    return publish(topic, reinterpret_cast<const uint8_t*>(text), strlen(text));
+  }
+};
+
+// Link layer under MQTT (Wi-Fi on the ESP32)
+class Network {
+public:
+  virtual ~Network() = default;
+
+  virtual void service(uint32_t nowMs) = 0;
+  virtual bool up() = 0;
+  // Board-specific counters, reported with the stats command
+  virtual void logStats() {}
+};
+
+struct Board {
+  Clock&         clock;
+  Gpio&          gpio;
+  const SensorSlot* sensors;
+  uint8_t        sensorCount;
+  IrTx&          irTx;
+  IrRx&          irRx;
+  Flash&         storage;  // learned IR codes
+  MqttTransport& mqtt;
+  Network&       network;
+  uint32_t (*random)();
+  void     (*macAddress)(uint8_t mac[6]);
+  uint8_t        buttonPin;
+  const char*    deviceId;  // MQTT namespace and client ID; null derives one from the MAC
+  const char*    zone;      // fleet group for fleet/<zone>/cmd; null for none
+};
+
+}  // namespace hal
@@ -0,0 +1,252 @@
+/**
+ * @file hal_esp32.h
+ * @brief HAL implementations over the Arduino core and the board's libraries
+ *
+ * Climate sensor drivers are compiled in with SENSOR_DHT, SENSOR_SHT3X,
+ * SENSOR_BME280 and SENSOR_DS18B20 (1 or 0); only the DHT is on by default.
+ * IR_SEND_AC (default 1) builds the AC state encoder on IRac, which links
+ * the encoder of every AC protocol the library enables: with the library's
+ * defaults that is all of them, far more flash than the rest of the IR
+ * code. The esp32dev build enables only the protocols in ir_protocols.h;
+ * widen that list with the build flags, or set IR_SEND_AC to 0 to drop the
+ * encoder and send only learned codes.
+ */
+#pragma once
+
+#ifndef SENSOR_DHT
+#define SENSOR_DHT 1
+#endif
+#ifndef SENSOR_SHT3X
+#define SENSOR_SHT3X 0
+#endif
+#ifndef SENSOR_BME280
+#define SENSOR_BME280 0
+#endif
+#ifndef SENSOR_DS18B20
+#define SENSOR_DS18B20 0
+#endif
+#ifndef IR_SEND_AC
+#define IR_SEND_AC 1
+#endif
+
+#if IR_SEND_AC
+#include <IRac.h>
+#endif
+#include <IRrecv.h>
+#include <IRsend.h>
+#include <PubSubClient.h>
+#if SENSOR_DHT
+#include <DHT.h>
+#endif
+#if SENSOR_SHT3X || SENSOR_BME280
+#include <Wire.h>
+#endif
+#if SENSOR_BME280
+#include <Adafruit_BME280.h>
+#endif
+#if SENSOR_DS18B20
+#include <DallasTemperature.h>
+#include <OneWire.h>
+#endif
+
+#include "hal.h"
+#include "wifi_manager.h"
+
+// cycles() is the CCOUNT register of the calling core
+class ArduinoClock : public hal::Clock {
+public:
+  uint32_t millis() override;
+  uint32_t micros() override;
+  uint32_t cycles() override;
+  uint32_t cyclesPerUs() override;
+};
+
+// Edge interrupts run from IRAM and read the level from the GPIO input
+// registers, so they keep working while the flash cache is off
+class ArduinoGpio : public hal::Gpio {
+public:
+  static constexpr uint8_t MAX_WATCHED = 4;
+
+  void setMode(uint8_t pin, Mode mode) override;
+  bool read(uint8_t pin) override;
+  void write(uint8_t pin, bool level) override;
+  bool watch(uint8_t pin, hal::EdgeQueue& queue) override;
+
+private:
+  struct Watch {
+    hal::EdgeQueue* queue;
+    uint8_t         pin;
+  };
+  static void onEdge(void* arg);
+
+  Watch   watches_[MAX_WATCHED];
+  uint8_t watchCount_ = 0;
+};
+
+#if SENSOR_DHT
+// Synchronous: collect() bit-bangs the whole transfer with interrupts
+// masked. At least 2 s between reads.
+class DhtSensor : public hal::ClimateSensor {
+public:
+  DhtSensor(uint8_t pin, uint8_t type) : dht_(pin, type) {}
+
+  void begin() override { dht_.begin(); }
+  void collect(float& tempC, float& humidity) override;
+
+  const char* name() const override { return "dht"; }
+  bool masksInterrupts() const override { return true; }
+
+private:
+  DHT dht_;
+};
+#endif
+
+#if SENSOR_SHT3X
+// Single-shot, high repeatability, no clock stretching; CRC-checked
+class Sht3xSensor : public hal::ClimateSensor {
+public:
+  static constexpr uint8_t DEFAULT_ADDR = 0x44;
+
+  explicit Sht3xSensor(TwoWire& wire, uint8_t addr = DEFAULT_ADDR) : wire_(wire), addr_(addr) {}
+
+  void     begin() override {}
+  uint32_t start() override;
+  void     collect(float& tempC, float& humidity) override;
+
+  const char* name() const override { return "sht3x"; }
+
+private:
+  TwoWire& wire_;
+  uint8_t  addr_;
+  bool     started_ = false;
+};
+#endif
+
+#if SENSOR_BME280
+// Forced mode with 1x temperature and humidity oversampling, pressure off
+class Bme280Sensor : public hal::ClimateSensor {
+public:
+  static constexpr uint8_t DEFAULT_ADDR = 0x76;
+
+  explicit Bme280Sensor(TwoWire& wire, uint8_t addr = DEFAULT_ADDR) : wire_(wire), addr_(addr) {}
+
+  void     begin() override;
+  uint32_t start() override;
+  void     collect(float& tempC, float& humidity) override;
+
+  const char* name() const override { return "bme280"; }
+
+private:
+  TwoWire&        wire_;
+  uint8_t         addr_;
+  bool            ok_ = false;
+  Adafruit_BME280 bme_;
+};
+#endif
+
+#if SENSOR_DS18B20
+// First probe on the bus; the conversion (750 ms at 12 bits) runs between
+// start() and collect(). 1-Wire slots are timed with interrupts masked.
+class Ds18b20Sensor : public hal::ClimateSensor {
+public:
+  explicit Ds18b20Sensor(uint8_t pin) : wire_(pin), probes_(&wire_) {}
+
+  void     begin() override;
+  uint32_t start() override;
+  void     collect(float& tempC, float& humidity) override;
+
+  const char* name() const override { return "ds18b20"; }
+  bool hasHumidity() const override { return false; }
+  bool masksInterrupts() const override { return true; }
+
+private:
+  OneWire           wire_;
+  DallasTemperature probes_;
+};
+#endif
+
+// Sends through a table indexed by protocol (ir_protocols.h), built at
+// compile time from the protocols the build enables. AC states go through
+// IRac, which also keeps the previous state for protocols whose frames
+// toggle a setting rather than set it.
+class IrSender : public hal::IrTx {
+public:
+#if IR_SEND_AC
+  explicit IrSender(uint8_t pin) : irsend_(pin), ac_(pin) {}
+#else
+  explicit IrSender(uint8_t pin) : irsend_(pin) {}
+#endif
+
+  void begin() override { irsend_.begin(); }
+  bool send(const IrCode& code) override;
+#if IR_SEND_AC
+  bool sendAc(const AcState& state) override;
+#endif
+
+  // True if a decoded code of protocol in format can be sent again
+  static bool supports(int16_t protocol, uint8_t format);
+
+private:
+  IRsend irsend_;
+#if IR_SEND_AC
+  IRac   ac_;
+#endif
+};
+
+// Keeps the decoded form when the protocol is known and IrSender can send
+// it (full state array for AC protocols), otherwise falls back to the raw
+// mark/space timings
+class IrReceiver : public hal::IrRx {
+public:
+  static constexpr uint16_t MIN_RAW_TIMINGS = 12;  // shorter unknown captures are noise
+
+  IrReceiver(uint8_t pin, uint16_t bufferSize, uint8_t timeoutMs, uint8_t carrierKHz)
+    : irrecv_(pin, bufferSize, timeoutMs, true), bufferSize_(bufferSize), carrierKHz_(carrierKHz) {}
+
+  void enable() override { irrecv_.enableIRIn(); }
+  void disable() override { irrecv_.disableIRIn(); }
+  bool receive(IrCode& code) override;
+  uint32_t overflows() const override { return overflows_; }
+
+private:
+  bool capture(IrCode& code);
+
+  IRrecv         irrecv_;
+  decode_results results_;
+  uint16_t       bufferSize_;
+  uint8_t        carrierKHz_;
+  uint32_t       overflows_ = 0;
+};
+
+class PubSubTransport : public hal::MqttTransport {
+public:
+  explicit PubSubTransport(PubSubClient& client) : client_(client) {}
+
+  void setCallback(MessageFn fn) override { client_.setCallback(fn); }
+  bool connect(const char* clientId) override { return client_.connect(clientId); }
+  void disconnect() override { client_.disconnect(); }
+  bool connected() override { return client_.connected(); }
+  bool loop() override { return client_.loop(); }
+  bool subscribe(const char* topic) override { return client_.subscribe(topic); }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int len) override {
+    return client_.publish(topic, payload, len);
+  }
+  int state() override { return client_.state(); }
+
+  using hal::MqttTransport::publish;
+
+private:
+  PubSubClient& client_;
+};
+
+class WifiNetwork : public hal::Network {
+public:
+  explicit WifiNetwork(WifiManager& wifi) : wifi_(wifi) {}
+
+  void service(uint32_t nowMs) override { wifi_.service(nowMs); }
+  bool up() override { return wifi_.connected(); }
+  void logStats() override;
+
+private:
+  WifiManager& wifi_;
+};
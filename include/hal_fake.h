@@ -0,0 +1,324 @@
+/**
+ * @file hal_fake.h
+ * @brief In-memory HAL implementations for running the application on a host
+ *
+ * Time only moves when the owner advances FakeClock, so runs are
+ * deterministic and hours of device time simulate in seconds. SimFlash
+ * (flash.h) provides the storage side.
+ *
+ * With the application's domains on their own threads, HostClock gives
+ * real time instead. The inputs a test drives from its own thread (pin
+ * levels, sensor values, broker messages) are then safe to change while
+ * the domains run; everything else belongs to one domain.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "hal.h"
+#include "spsc_queue.h"
+
+class FakeClock : public hal::Clock {
+public:
+  uint32_t millis() override { return static_cast<uint32_t>(us_ / 1000); }
+  uint32_t micros() override { return static_cast<uint32_t>(us_); }
+
+  void     advanceMs(uint32_t ms) { us_ += static_cast<uint64_t>(ms) * 1000; }
+  void     advanceUs(uint32_t us) { us_ += us; }
+  uint64_t nowUs() const { return us_; }
+
+private:
+  uint64_t us_ = 0;
+};
+
+// Monotonic time since construction
+class HostClock : public hal::Clock {
+public:
+  uint32_t millis() override { return static_cast<uint32_t>(elapsed<std::chrono::milliseconds>()); }
+  uint32_t micros() override { return static_cast<uint32_t>(elapsed<std::chrono::microseconds>()); }
+
+private:
+  template <typename Unit>
+  uint64_t elapsed() const {
+    return std::chrono::duration_cast<Unit>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+class FakeGpio : public hal::Gpio {
+public:
+  static constexpr uint8_t PINS = 40;
+
+  // Edges are stamped with clock, if given
+  explicit FakeGpio(hal::Clock* clock = nullptr) : clock_(clock) {
+    for (auto& level : levels_) level = true;
+    memset(watch_, 0, sizeof(watch_));
+  }
+
+  void setMode(uint8_t pin, Mode mode) override {
+    if (pin < PINS) modes_[pin] = mode;
+  }
+  bool read(uint8_t pin) override { return pin < PINS && levels_[pin]; }
+  void write(uint8_t pin, bool level) override { set(pin, level); }
+  bool watch(uint8_t pin, hal::EdgeQueue& queue) override {
+    if (pin >= PINS) return false;
+    watch_[pin] = &queue;
+    return true;
+  }
+
+  // Drives an input from the outside, e.g. a button press; a change on a
+  // watched pin is queued as the interrupt handler would. One thread only.
+  void set(uint8_t pin, bool level) {
+    if (pin >= PINS || levels_[pin] == level) return;
+    levels_[pin] = level;
+    if (watch_[pin]) watch_[pin]->push({ clock_ ? clock_->micros() : 0, level });
+  }
+  Mode mode(uint8_t pin) const { return pin < PINS ? modes_[pin] : IN; }
+
+private:
+  hal::Clock*       clock_;
+  std::atomic<bool> levels_[PINS];
+  Mode            modes_[PINS] = {};
+  hal::EdgeQueue* watch_[PINS];
+};
+
+// A simulated driver: conversionMs stands in for an asynchronous
+// conversion, and a sensor without humidity always reports NaN for it
+class FakeSensor : public hal::ClimateSensor {
+public:
+  explicit FakeSensor(const char* name = "fake", uint32_t conversionMs = 0, bool humidity = true)
+    : name_(name), conversionMs_(conversionMs), humidity_(humidity) {}
+
+  void     begin() override {}
+  uint32_t start() override {
+    starts_++;
+    return conversionMs_;
+  }
+  void collect(float& tempC, float& humidity) override {
+    reads_++;
+    tempC    = temp_ + offset_;
+    humidity = humidity_ ? hum_.load() : NAN;
+    if (nanEvery_ && reads_ % nanEvery_ == 0) tempC = humidity = NAN;
+    if (spikeEvery_ && reads_ % spikeEvery_ == 0) tempC += spikeC_;
+  }
+
+  const char* name() const override { return name_; }
+  bool        hasHumidity() const override { return humidity_; }
+
+  void     set(float tempC, float humidity) { temp_ = tempC, hum_ = humidity; }
+  // Constant calibration error added to every temperature
+  void     setOffset(float c) { offset_ = c; }
+  // Every nanEvery-th read fails, every spikeEvery-th is off by spikeC; 0 disables
+  void     setFaults(uint32_t nanEvery, uint32_t spikeEvery, float spikeC) {
+    nanEvery_ = nanEvery, spikeEvery_ = spikeEvery, spikeC_ = spikeC;
+  }
+  uint32_t reads() const { return reads_; }
+  uint32_t starts() const { return starts_; }
+
+private:
+  const char* name_;
+  uint32_t    conversionMs_;
+  bool        humidity_;
+  std::atomic<float> temp_{ 25.0f };
+  std::atomic<float> hum_{ 50.0f };
+  float       offset_     = 0;
+  uint32_t    starts_     = 0;
+  uint32_t    reads_      = 0;
+  uint32_t    nanEvery_   = 0;
+  uint32_t    spikeEvery_ = 0;
+  float       spikeC_     = 0;
+};
+
+// Keeps a copy of the last code sent, including its raw timings, and of
+// the last AC state, which it encodes for any protocol. A frame time makes
+// send() block for real, as the bit-banged carrier does.
+class FakeIrTx : public hal::IrTx {
+public:
+  using SendHook = void (*)(const IrCode& code);
+
+  void begin() override {}
+  bool send(const IrCode& code) override {
+    if (frameUs_) std::this_thread::sleep_for(std::chrono::microseconds(frameUs_));
+    copyCode(code, last_, raw_);
+    sent_++;
+    if (hook_) hook_(code);
+    return true;
+  }
+  bool sendAc(const AcState& state) override {
+    if (frameUs_) std::this_thread::sleep_for(std::chrono::microseconds(frameUs_));
+    lastAc_ = state;
+    acSent_++;
+    return true;
+  }
+
+  // Called from send() once the frame is out
+  void onSend(SendHook fn) { hook_ = fn; }
+  void setFrameUs(uint32_t us) { frameUs_ = us; }
+
+  const IrCode&  last() const { return last_; }
+  uint32_t       sent() const { return sent_; }
+  const AcState& lastAc() const { return lastAc_; }
+  uint32_t       acSent() const { return acSent_; }
+
+  static void copyCode(const IrCode& from, IrCode& to, uint16_t* rawBuf) {
+    uint16_t* dst = to.raw;
+    uint16_t  cap = to.rawCap;
+    to = from;
+    to.raw    = rawBuf ? rawBuf : dst;
+    to.rawCap = rawBuf ? ircode::MAX_RAW : cap;
+    to.rawLen = 0;
+    if (from.format == ircode::FORMAT_RAW && from.raw && to.raw) {
+      to.rawLen = from.rawLen < to.rawCap ? from.rawLen : to.rawCap;
+      memcpy(to.raw, from.raw, to.rawLen * sizeof(uint16_t));
+    }
+  }
+
+private:
+  IrCode   last_ = {};
+  uint16_t raw_[ircode::MAX_RAW];
+  uint32_t sent_    = 0;
+  AcState  lastAc_  = {};
+  uint32_t acSent_  = 0;
+  uint32_t frameUs_ = 0;
+  SendHook hook_    = nullptr;
+};
+
+// Delivers injected frames one per receive() call while enabled
+class FakeIrRx : public hal::IrRx {
+public:
+  void enable() override { enabled_ = true; }
+  void disable() override { enabled_ = false; }
+
+  bool receive(IrCode& code) override {
+    if (!enabled_ || !pending_) return false;
+    pending_ = false;
+    FakeIrTx::copyCode(frame_, code, nullptr);
+    return true;
+  }
+
+  // Replaces any frame not yet received
+  void inject(const IrCode& code) {
+    FakeIrTx::copyCode(code, frame_, raw_);
+    pending_ = true;
+  }
+  bool enabled() const { return enabled_; }
+
+private:
+  IrCode   frame_   = {};
+  uint16_t raw_[ircode::MAX_RAW];
+  bool     pending_ = false;
+  bool     enabled_ = false;
+};
+
+// In-process broker session. Injected messages are delivered from loop(),
+// like a real client, and may be injected from another thread; publishes
+// go to an optional hook and are counted.
+class FakeMqtt : public hal::MqttTransport {
+public:
+  using PublishHook = void (*)(const char* topic, const uint8_t* payload, unsigned int len);
+
+  static constexpr uint8_t  MAX_TOPIC   = 48;
+  static constexpr uint16_t MAX_PAYLOAD = 256;
+
+  void setCallback(MessageFn fn) override { callback_ = fn; }
+  bool connect(const char*) override {
+    connected_ = brokerUp_;
+    if (!connected_ && timeoutClock_) timeoutClock_->advanceMs(timeoutMs_);
+    return connected_;
+  }
+  void disconnect() override { connected_ = false; }
+  bool connected() override { return connected_; }
+
+  bool loop() override {
+    if (!brokerUp_) connected_ = false;
+    if (!connected_) return false;
+    Message m;
+    while (inbox_.pop(m)) {
+      if (callback_) callback_(m.topic, m.payload, m.len);
+    }
+    return true;
+  }
+
+  bool subscribe(const char*) override {
+    if (!connected_) return false;
+    if (failSubscribes_) {
+      failSubscribes_--;
+      return false;
+    }
+    subscribes_++;
+    return true;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, unsigned int len) override {
+    if (!connected_) return false;
+    published_++;
+    bytes_ += len;
+    if (hook_) hook_(topic, payload, len);
+    return true;
+  }
+  using hal::MqttTransport::publish;
+
+  int state() override { return connected_ ? 0 : -2; }
+
+  // Queues a message from the broker side; false if it does not fit
+  bool inject(const char* topic, const char* payload) {
+    Message m;
+    size_t tl = strlen(topic), pl = strlen(payload);
+    if (tl >= MAX_TOPIC || pl > MAX_PAYLOAD) return false;
+    memcpy(m.topic, topic, tl + 1);
+    memcpy(m.payload, payload, pl);
+    m.len = static_cast<uint16_t>(pl);
+    return inbox_.push(m);
+  }
+
+  void     setBrokerUp(bool up) { brokerUp_ = up; }
+  // The broker ends the session, e.g. for a duplicate client ID; the
+  // next connect is accepted again
+  void     kick() { connected_ = false; }
+  // A connect to a down broker advances clock by ms, as a client blocking
+  // for its socket timeout would
+  void     setConnectTimeout(FakeClock* clock, uint32_t ms) { timeoutClock_ = clock, timeoutMs_ = ms; }
+  // The next n subscribes are refused
+  void     failSubscribes(uint8_t n) { failSubscribes_ = n; }
+  void     onPublish(PublishHook fn) { hook_ = fn; }
+  uint32_t published() const { return published_; }
+  uint32_t subscribes() const { return subscribes_; }
+  uint32_t bytes() const { return bytes_; }
+
+private:
+  struct Message {
+    char     topic[MAX_TOPIC];
+    uint8_t  payload[MAX_PAYLOAD];
+    uint16_t len;
+  };
+
+  SpscQueue<Message, 8> inbox_;
+  MessageFn   callback_  = nullptr;
+  PublishHook hook_      = nullptr;
+  bool        brokerUp_  = true;
+  bool        connected_ = false;
+  FakeClock*  timeoutClock_   = nullptr;
+  uint32_t    timeoutMs_      = 0;
+  uint8_t     failSubscribes_ = 0;
+  uint32_t    subscribes_     = 0;
+  uint32_t    published_ = 0;
+  uint32_t    bytes_     = 0;
+};
+
+class FakeNetwork : public hal::Network {
+public:
+  void service(uint32_t) override {}
+  bool up() override { return up_; }
+
+  void setUp(bool up) { up_ = up; }
+
+private:
+  bool up_ = true;
+};
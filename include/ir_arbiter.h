@@ -0,0 +1,130 @@
+/**
+ * @file ir_arbiter.h
+ * @brief Sole owner of the IR transmitter and receiver: prioritised transmit queue, capture paused around sends
+ *
+ * Everything that sends or captures IR goes through the arbiter, so the
+ * two never overlap. The receiver only runs while someone listens (learn
+ * mode) and nothing holds it off: a transmission stops it for the frame
+ * and for guardMs after, which keeps the unit from decoding its own
+ * transmission, and disable()/enable() hold it off for callers that mask
+ * interrupts (bit-banged sensors). The arbiter is the hal::IrRx the rest
+ * of the application sees.
+ *
+ * Outgoing frames wait in a fixed queue per priority and go out from
+ * service(), one per call, all MANUAL ones before any AUTO one and in
+ * order within a priority, so a frame never waits behind more than the one
+ * on the air. A frame names what to send rather than carrying it: a learned
+ * code slot, loaded through LoadFn only when its turn comes (a raw code
+ * needs the large timing buffer), or a whole AC state. When a queue is
+ * full its oldest frame is dropped for the new one, which is an overrun.
+ *
+ * Frames of one nonzero group are different states of the same thing (the
+ * AC's power, say), so only the newest is worth sending: it takes the
+ * place of its group's frame still queued at its priority and supersedes
+ * those at lower ones, while a frame queued behind a higher priority one
+ * of its group is superseded at once. Every frame's outcome is handed to
+ * DoneFn.
+ *
+ * Collisions (a transmission that had to stop a live capture) and
+ * overruns of either direction are counted here and in metrics.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "ring_buffer.h"
+
+class IrArbiter : public hal::IrRx {
+public:
+  enum class Priority : uint8_t { MANUAL, AUTO };
+  static constexpr uint8_t PRIORITY_COUNT = 2;
+  static constexpr uint8_t DEPTH          = 4;   // frames per priority
+  static constexpr uint8_t MAX_SLOT       = 15;  // RecordStore::MAX_NAME
+
+  struct Frame {
+    enum Kind : uint8_t { CODE, AC };
+    Kind     kind;
+    Priority priority;
+    uint8_t  group;     // 0: never coalesced
+    uint8_t  tag;       // the caller's, handed back to DoneFn
+    uint32_t atUs;      // the caller's request time, handed back as well
+    uint32_t queuedUs;  // set by queue()
+    char     slot[MAX_SLOT + 1];  // CODE
+    AcState  ac;                  // AC
+  };
+
+  // Loads the learned code for slot, raw timings into a buffer of its own
+  // that code.raw is pointed at
+  using LoadFn = bool (*)(const char* slot, IrCode& code);
+  enum class Outcome : uint8_t {
+    SENT,
+    FAILED,      // not loaded, or refused by the transmitter
+    DROPPED,     // pushed out of a full queue
+    SUPERSEDED,  // a newer frame of its group goes instead
+  };
+  using DoneFn = void (*)(const Frame& frame, Outcome outcome);
+
+  struct Stats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t failed;      // not loaded, or refused by the transmitter
+    uint32_t overruns;    // frames dropped from a full queue
+    uint32_t coalesced;   // frames superseded within their group
+    uint32_t collisions;
+    uint32_t rxOverruns;  // captures that overflowed the receiver
+    uint8_t  maxDepth;
+  };
+
+  IrArbiter(hal::IrTx& tx, hal::IrRx& rx, hal::Clock& clock, LoadFn load, DoneFn done,
+            uint32_t guardMs)
+    : tx_(tx), rx_(rx), clock_(clock), load_(load), done_(done), guardMs_(guardMs) {}
+
+  void begin() { tx_.begin(); }
+
+  // Queues frame; false if an older one was dropped to make room
+  bool queue(const Frame& frame);
+  bool pending() const;
+  // Sends the most urgent frame, blocking for its airtime; true if more
+  // are waiting
+  bool service();
+
+  // Capture wanted (learn mode) or not
+  void listen(bool on);
+  bool listening() const { return listening_; }
+
+  // hal::IrRx: disable() holds capture off until the matching enable().
+  // receive() also resumes capture once a transmission's guard is over.
+  void enable() override;
+  void disable() override;
+  bool receive(IrCode& code) override;
+  uint32_t overflows() const override { return stats_.rxOverruns; }
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  bool send(const Frame& frame);
+  bool holds(uint8_t priority, uint8_t group) const;
+  bool replace(uint8_t priority, uint8_t group, const Frame* with);
+  void finish(const Frame& frame, Outcome outcome);
+  void apply();
+  void pollOverflows();
+
+  hal::IrTx&  tx_;
+  hal::IrRx&  rx_;
+  hal::Clock& clock_;
+  LoadFn      load_;
+  DoneFn      done_;
+  uint32_t    guardMs_;
+
+  RingBuffer<Frame, DEPTH> queues_[PRIORITY_COUNT];
+
+  bool     listening_   = false;
+  uint8_t  holds_       = 0;      // disable() calls not yet enabled again
+  bool     guarding_    = false;  // a transmission ended less than guardMs ago
+  uint32_t sentMs_      = 0;
+  bool     capturing_   = false;  // the receiver is on
+  uint32_t rxOverflows_ = 0;      // the receiver's count at the last poll
+
+  Stats stats_ = {};
+};
@@ -0,0 +1,64 @@
+/**
+ * @file ir_code.h
+ * @brief Learned IR code and its versioned serialisation for the record store
+ *
+ * A code is kept in one of three forms:
+ *  - VALUE  protocol, bit count and value, for simple protocols such as NEC
+ *  - STATE  protocol and the full state array, for stateful AC protocols
+ *  - RAW    mark/space timings, for remotes the decoder does not recognise
+ *
+ * Raw timings are compressed before storage. Durations are clustered into
+ * at most 16 representative values (capture jitter is well under the
+ * clustering tolerance), each mark/space pair is replaced by an index into
+ * a dictionary of distinct pairs, and the indices are bit-packed at 2, 4 or
+ * 8 bits each. A few hundred timings of an AC frame shrink to roughly one
+ * byte per pair or less.
+ *
+ * Kept free of IRremoteESP8266 headers: the protocol is stored as the
+ * numeric decode_type_t value.
+ */
+#pragma once
+
+#include <stdint.h>
+
+namespace ircode {
+
+// First byte of every stored code; bump when a payload layout changes
+constexpr uint8_t FORMAT_VALUE = 1;
+constexpr uint8_t FORMAT_STATE = 2;
+constexpr uint8_t FORMAT_RAW   = 3;
+
+constexpr uint8_t  MAX_STATE    = 53;    // kStateSizeMax in IRremoteESP8266
+constexpr uint16_t MAX_RAW      = 1024;  // timings, matches the capture buffer
+constexpr uint8_t  MAX_CLUSTERS = 16;
+
+}  // namespace ircode
+
+struct IrCode {
+  uint8_t  format;    // ircode::FORMAT_*
+  int16_t  protocol;  // decode_type_t
+  uint16_t bits;
+  uint64_t value;                       // FORMAT_VALUE
+  uint8_t  state[ircode::MAX_STATE];    // FORMAT_STATE, (bits + 7) / 8 bytes
+  uint16_t* raw;      // FORMAT_RAW: caller-owned buffer of microsecond timings
+  uint16_t rawLen;
+  uint16_t rawCap;
+  uint8_t  freqKHz;
+
+  uint16_t stateBytes() const { return (bits + 7) / 8; }
+};
+
+namespace ircode {
+
+// Returns the number of bytes written, 0 if the code does not fit in cap or
+// its raw timings are too irregular to cluster
+uint16_t encode(const IrCode& code, uint8_t* out, uint16_t cap);
+
+// Raw timings are expanded into code.raw, which must hold code.rawCap entries
+bool decode(const uint8_t* in, uint16_t len, IrCode& code);
+
+// True if two captures carry the same code: equal decoded contents, or as
+// many raw timings, each within the clustering tolerance of the other's
+bool same(const IrCode& a, const IrCode& b);
+
+}  // namespace ircode
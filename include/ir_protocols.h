@@ -0,0 +1,153 @@
+/**
+ * @file ir_protocols.h
+ * @brief The IR protocols this firmware can send, as an X-macro list
+ *
+ *   IR_SEND_PROTOCOLS(X)   expands X(name, format, sender, repeat) per protocol
+ *
+ * name is the decode_type_t enumerator, format the ircode::FORMAT_* suffix
+ * the code is stored in, sender the IRsend member that transmits it and
+ * repeat the number of repeats the remote itself sends. IrSender builds its
+ * per-protocol dispatch table from this list at compile time.
+ *
+ * An entry is compiled in only while the library's SEND_<name> is enabled,
+ * so restricting the library in build_flags shrinks the table with it and
+ * the senders left out are never linked. The esp32dev build enables exactly
+ * this list; a site with only LG TVs and Daikin units could go further:
+ *
+ *   -D_IR_ENABLE_DEFAULT_=false
+ *   -DSEND_NEC=true -DDECODE_NEC=true -DSEND_DAIKIN=true -DDECODE_DAIKIN=true
+ *
+ * Protocols the library knows but this list does not are sent through the
+ * library's generic IRsend::send() only with IR_SEND_ANY=1, which links
+ * every enabled sender. Without it they are learned as raw timings.
+ */
+#pragma once
+
+#include <IRremoteESP8266.h>
+
+#ifndef IR_SEND_ANY
+#define IR_SEND_ANY 0
+#endif
+
+// ---- simple protocols, stored as value + bits ----
+#if SEND_NEC
+#define IR_SEND_NEC(X) X(NEC, VALUE, sendNEC, kNoRepeat)
+#else
+#define IR_SEND_NEC(X)
+#endif
+
+#if SEND_SONY
+#define IR_SEND_SONY(X) X(SONY, VALUE, sendSony, kSonyMinRepeat)
+#else
+#define IR_SEND_SONY(X)
+#endif
+
+#if SEND_SAMSUNG
+#define IR_SEND_SAMSUNG(X) X(SAMSUNG, VALUE, sendSAMSUNG, kNoRepeat)
+#else
+#define IR_SEND_SAMSUNG(X)
+#endif
+
+#if SEND_LG
+#define IR_SEND_LG(X) X(LG, VALUE, sendLG, kNoRepeat) X(LG2, VALUE, sendLG2, kNoRepeat)
+#else
+#define IR_SEND_LG(X)
+#endif
+
+#if SEND_RC5
+#define IR_SEND_RC5(X) X(RC5, VALUE, sendRC5, kNoRepeat) X(RC5X, VALUE, sendRC5, kNoRepeat)
+#else
+#define IR_SEND_RC5(X)
+#endif
+
+#if SEND_RC6
+#define IR_SEND_RC6(X) X(RC6, VALUE, sendRC6, kNoRepeat)
+#else
+#define IR_SEND_RC6(X)
+#endif
+
+#if SEND_PANASONIC
+#define IR_SEND_PANASONIC(X) X(PANASONIC, VALUE, sendPanasonic64, kNoRepeat)
+#else
+#define IR_SEND_PANASONIC(X)
+#endif
+
+#if SEND_COOLIX
+#define IR_SEND_COOLIX(X) X(COOLIX, VALUE, sendCOOLIX, kCoolixDefaultRepeat)
+#else
+#define IR_SEND_COOLIX(X)
+#endif
+
+#if SEND_MIDEA
+#define IR_SEND_MIDEA(X) X(MIDEA, VALUE, sendMidea, kMideaMinRepeat)
+#else
+#define IR_SEND_MIDEA(X)
+#endif
+
+// ---- AC protocols, stored as their full state ----
+#if SEND_DAIKIN
+#define IR_SEND_DAIKIN(X) X(DAIKIN, STATE, sendDaikin, kDaikinDefaultRepeat)
+#else
+#define IR_SEND_DAIKIN(X)
+#endif
+
+#if SEND_MITSUBISHI_AC
+#define IR_SEND_MITSUBISHI_AC(X) X(MITSUBISHI_AC, STATE, sendMitsubishiAC, kMitsubishiACMinRepeat)
+#else
+#define IR_SEND_MITSUBISHI_AC(X)
+#endif
+
+#if SEND_GREE
+#define IR_SEND_GREE(X) X(GREE, STATE, sendGree, kGreeDefaultRepeat)
+#else
+#define IR_SEND_GREE(X)
+#endif
+
+#if SEND_FUJITSU_AC
+#define IR_SEND_FUJITSU_AC(X) X(FUJITSU_AC, STATE, sendFujitsuAC, kFujitsuAcMinRepeat)
+#else
+#define IR_SEND_FUJITSU_AC(X)
+#endif
+
+#if SEND_HAIER_AC
+#define IR_SEND_HAIER_AC(X) X(HAIER_AC, STATE, sendHaierAC, kHaierAcDefaultRepeat)
+#else
+#define IR_SEND_HAIER_AC(X)
+#endif
+
+#if SEND_TOSHIBA_AC
+#define IR_SEND_TOSHIBA_AC(X) X(TOSHIBA_AC, STATE, sendToshibaAC, kToshibaACMinRepeat)
+#else
+#define IR_SEND_TOSHIBA_AC(X)
+#endif
+
+#if SEND_SAMSUNG_AC
+#define IR_SEND_SAMSUNG_AC(X) X(SAMSUNG_AC, STATE, sendSamsungAC, kSamsungAcDefaultRepeat)
+#else
+#define IR_SEND_SAMSUNG_AC(X)
+#endif
+
+#if SEND_PANASONIC_AC
+#define IR_SEND_PANASONIC_AC(X) X(PANASONIC_AC, STATE, sendPanasonicAC, kPanasonicAcDefaultRepeat)
+#else
+#define IR_SEND_PANASONIC_AC(X)
+#endif
+
+#if SEND_KELVINATOR
+#define IR_SEND_KELVINATOR(X) X(KELVINATOR, STATE, sendKelvinator, kKelvinatorDefaultRepeat)
+#else
+#define IR_SEND_KELVINATOR(X)
+#endif
+
+#if SEND_WHIRLPOOL_AC
+#define IR_SEND_WHIRLPOOL_AC(X) X(WHIRLPOOL_AC, STATE, sendWhirlpoolAC, kWhirlpoolAcDefaultRepeat)
+#else
+#define IR_SEND_WHIRLPOOL_AC(X)
+#endif
+
+#define IR_SEND_PROTOCOLS(X)                                                                   \
+  IR_SEND_NEC(X) IR_SEND_SONY(X) IR_SEND_SAMSUNG(X) IR_SEND_LG(X) IR_SEND_RC5(X)              \
+  IR_SEND_RC6(X) IR_SEND_PANASONIC(X) IR_SEND_COOLIX(X) IR_SEND_MIDEA(X) IR_SEND_DAIKIN(X)    \
+  IR_SEND_MITSUBISHI_AC(X) IR_SEND_GREE(X) IR_SEND_FUJITSU_AC(X) IR_SEND_HAIER_AC(X)          \
+  IR_SEND_TOSHIBA_AC(X) IR_SEND_SAMSUNG_AC(X) IR_SEND_PANASONIC_AC(X) IR_SEND_KELVINATOR(X)   \
+  IR_SEND_WHIRLPOOL_AC(X)
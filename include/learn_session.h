@@ -0,0 +1,91 @@
+/**
+ * @file learn_session.h
+ * @brief Learn-mode state machine: named slots, verified captures and per-step timeouts
+ *
+ * A session learns one or more named slots in turn. Each slot is a step:
+ * the remote's button is pressed until `required` consecutive captures
+ * agree (ircode::same()), and only then is the code handed over to be
+ * saved. A capture that disagrees starts the count again from itself, so
+ * a stray frame or a wrong button costs one more press rather than a bad
+ * code. Frames within gapMs of the previous one belong to the same press
+ * (held buttons, remotes that send each frame twice) and are ignored, also
+ * across the start of the next step.
+ *
+ * Each step has timeoutMs to complete, counted from when it started; an
+ * expired step ends the session. The object does no I/O: the caller feeds
+ * it frames and the time, and reports what each call returns.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "ir_code.h"
+
+class LearnSession {
+public:
+  enum class Result : uint8_t {
+    IGNORED,   // part of the previous press, or no session
+    CAPTURED,  // counted towards the step
+    MISMATCH,  // differed from the previous captures; counting restarted
+    ACCEPTED,  // enough agreeing captures: code() is the slot's code
+  };
+
+  static constexpr uint8_t MAX_STEPS    = 4;
+  static constexpr uint8_t MAX_SLOT     = 15;  // RecordStore::MAX_NAME
+  static constexpr uint8_t MAX_REQUIRED = 5;
+
+  struct Stats {
+    uint32_t sessions;
+    uint32_t accepted;
+    uint32_t mismatches;
+    uint32_t ignored;
+    uint32_t timeouts;
+  };
+
+  explicit LearnSession(uint32_t gapMs) : gapMs_(gapMs) { reference_.raw = raw_; }
+
+  // Starts a session over count slots (at most MAX_STEPS); names are
+  // copied. Replaces any session in progress.
+  bool start(const char* const* slots, uint8_t count, uint8_t required, uint32_t timeoutMs,
+             uint32_t nowMs);
+
+  Result offer(const IrCode& code, uint32_t nowMs);
+
+  // Moves on after an accepted step; false when that was the last one and
+  // the session is over
+  bool next(uint32_t nowMs);
+
+  // True once the current step ran out of time; the session is over then
+  bool expired(uint32_t nowMs);
+
+  void cancel() { active_ = false; }
+
+  bool          active() const { return active_; }
+  const char*   slot() const { return slots_[step_]; }
+  uint8_t       step() const { return step_; }  // 0-based
+  uint8_t       steps() const { return steps_; }
+  uint8_t       captures() const { return captures_; }
+  uint8_t       required() const { return required_; }
+  const IrCode& code() const { return reference_; }
+  const Stats&  stats() const { return stats_; }
+
+private:
+  void beginStep(uint32_t nowMs);
+
+  uint32_t gapMs_;
+  char     slots_[MAX_STEPS][MAX_SLOT + 1] = {};
+  uint8_t  steps_     = 0;
+  uint8_t  step_      = 0;
+  uint8_t  required_  = 1;
+  uint8_t  captures_  = 0;
+  bool     active_    = false;
+  bool     heard_     = false;  // a frame arrived in this session
+  uint32_t timeoutMs_ = 0;
+  uint32_t stepMs_    = 0;
+  uint32_t lastMs_    = 0;  // last frame, accepted or not
+
+  IrCode   reference_ = {};  // the first of the agreeing captures
+  uint16_t raw_[ircode::MAX_RAW];
+
+  Stats stats_ = {};
+};
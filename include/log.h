@@ -0,0 +1,141 @@
+/**
+ * @file log.h
+ * @brief Levelled logging with deferred formatting and serial/MQTT/RAM sinks
+ *
+ * LOG_DEBUG() .. LOG_ERROR() capture the format pointer and arguments into a
+ * fixed RAM queue; nothing is formatted on the calling path. logger::service()
+ * later formats queued records and fans them out to the sinks, each with its
+ * own runtime level. The MQTT sink is rate limited by a token bucket so log
+ * traffic cannot starve control messages.
+ *
+ * Statements below LOG_MIN_LEVEL compile to nothing, arguments included.
+ * Format strings must be literals; string arguments are copied at capture.
+ *
+ * Any task may log (interrupt handlers may not): a capture holds a short
+ * critical section while it copies its arguments in. service(), history()
+ * and stats() belong to the one task that drains the queue.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_LVL_DEBUG 0
+#define LOG_LVL_INFO  1
+#define LOG_LVL_WARN  2
+#define LOG_LVL_ERROR 3
+#define LOG_LVL_NONE  4
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LVL_DEBUG
+#endif
+
+#define LOG_AT(lvl, fmt, ...)                                              \
+  do {                                                                     \
+    if ((lvl) >= LOG_MIN_LEVEL) logger::write((lvl), fmt, ##__VA_ARGS__); \
+  } while (0)
+
+#define LOG_DEBUG(fmt, ...) LOG_AT(LOG_LVL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  LOG_AT(LOG_LVL_INFO,  fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  LOG_AT(LOG_LVL_WARN,  fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_AT(LOG_LVL_ERROR, fmt, ##__VA_ARGS__)
+
+namespace logger {
+
+enum Sink : uint8_t { SINK_SERIAL, SINK_MQTT, SINK_RAM, SINK_COUNT };
+
+constexpr uint8_t  MAX_ARGS      = 8;
+constexpr uint8_t  TEXT_BYTES    = 48;   // copied string arguments per record
+constexpr uint8_t  QUEUE_DEPTH   = 32;
+constexpr uint8_t  RAM_LINES     = 16;   // history kept by the RAM sink
+constexpr uint8_t  LINE_BYTES    = 128;
+constexpr uint8_t  DRAIN_BATCH   = 8;    // records formatted per service()
+constexpr uint16_t MQTT_RATE_MS  = 250;  // one MQTT token per interval
+constexpr uint8_t  MQTT_BURST    = 16;
+
+struct Value {
+  enum Type : uint8_t { INT, UINT, FLOAT, TEXT };
+  Type type;
+  union {
+    int64_t  i;
+    uint64_t u;
+    double   f;
+    uint8_t  text;  // offset into Record::text
+  };
+};
+
+struct Record {
+  uint32_t    ms;
+  const char* fmt;
+  uint8_t     level;
+  uint8_t     argc;
+  uint8_t     textLen;
+  Value       args[MAX_ARGS];
+  char        text[TEXT_BYTES];
+};
+
+struct Stats {
+  uint32_t queued;
+  uint32_t overflowed;     // evicted before they were drained
+  uint32_t mqttThrottled;  // dropped by the MQTT rate limiter
+};
+
+// Delivers one formatted line; returns false if it could not be sent
+using LineFn  = bool (*)(const char* line);
+using ClockFn = uint32_t (*)();
+
+void begin(ClockFn clockMs);
+void attach(Sink sink, LineFn fn);  // the RAM sink needs no function
+
+void    setLevel(Sink sink, uint8_t level);
+uint8_t level(Sink sink);
+bool    parseLevel(const char* s, size_t len, uint8_t& out);
+const char* levelName(uint8_t level);
+
+// Formats and delivers up to DRAIN_BATCH queued records
+void service();
+
+// Oldest first; returns false past the end of the RAM history
+bool history(uint8_t i, const char*& line);
+
+Stats stats();
+
+// ---- capture internals, used by the LOG_* macros ----
+bool    enabled(uint8_t level);
+Record* reserve(uint8_t level, const char* fmt);
+void    commit();
+
+inline void captureInt(Record& r, int64_t v)   { r.args[r.argc].type = Value::INT;   r.args[r.argc].i = v; }
+inline void captureUint(Record& r, uint64_t v) { r.args[r.argc].type = Value::UINT;  r.args[r.argc].u = v; }
+inline void captureFloat(Record& r, double v)  { r.args[r.argc].type = Value::FLOAT; r.args[r.argc].f = v; }
+void captureText(Record& r, const char* s);
+
+inline void capture(Record& r, int v)                { captureInt(r, v); }
+inline void capture(Record& r, long v)               { captureInt(r, v); }
+inline void capture(Record& r, long long v)          { captureInt(r, v); }
+inline void capture(Record& r, unsigned v)           { captureUint(r, v); }
+inline void capture(Record& r, unsigned long v)      { captureUint(r, v); }
+inline void capture(Record& r, unsigned long long v) { captureUint(r, v); }
+inline void capture(Record& r, double v)             { captureFloat(r, v); }
+inline void capture(Record& r, const char* s)        { captureText(r, s); }
+
+inline void captureAll(Record&) {}
+
+template <typename T, typename... Rest>
+inline void captureAll(Record& r, T v, Rest... rest) {
+  if (r.argc >= MAX_ARGS) return;
+  capture(r, v);
+  r.argc++;
+  captureAll(r, rest...);
+}
+
+template <typename... Args>
+inline void write(uint8_t level, const char* fmt, Args... args) {
+  static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+  if (!enabled(level)) return;
+  Record* r = reserve(level, fmt);
+  captureAll(*r, args...);
+  commit();
+}
+
+}  // namespace logger
@@ -0,0 +1,105 @@
+/**
+ * @file metrics.h
+ * @brief Allocation-free latency histograms for the hot paths, published as compact JSON
+ *
+ * Each stage owns a fixed histogram of power-of-two microsecond buckets:
+ * bucket 0 counts 0 us, bucket b counts [2^(b-1), 2^b) us and the last one
+ * everything longer. Recording is a clz and two relaxed counter updates.
+ * Percentiles are read back as bucket upper bounds, so they are within a
+ * factor of two; the maximum is exact.
+ *
+ * Spans inside one task are timed with hal::Clock::cycles(), the CPU cycle
+ * counter on the ESP32. That counter is per core and wraps after ~18 s at
+ * 240 MHz, so the cross-domain latency (command to IR) and the loop stages
+ * use micros() instead.
+ *
+ * A stage is recorded by one domain only; the counters are atomics so the
+ * publisher in the other domain reads them without a lock. toJson() reports
+ * the window since its previous call:
+ *
+ *   {"ms":<uptime>,"mqtt":[n,p50,p99,max],"auto":[...],...}
+ *
+ * n counts the window, p50 and p99 are its percentiles in us, and max is the
+ * worst since boot. For the loop stages, "*_jit" is how much later than
+ * requested a domain's pass started, and the max of "*_gap" (time between
+ * passes) is the domain's longest stall.
+ *
+ * Events that are counted rather than timed follow the stages as
+ * "name":[n,total], the window's count and the count since boot.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+namespace metrics {
+
+enum Stage : uint8_t {
+  MQTT_LOOP,       // MqttLink::service(), the client's loop() and reconnects included
+  AUTO_CONTROL,    // one control decision, its IR frame queued
+  IR_SEND,
+  IR_WAIT,         // an IR frame queued to its send starting
+  STORE_WRITE,     // a code or settings record written to flash
+  SENSOR_READ,     // one sensor's start() + collect(), IR pause included
+  COMMAND_TO_IR,   // MQTT message received to its IR code sent
+  NET_JITTER,
+  CONTROL_JITTER,
+  NET_GAP,
+  CONTROL_GAP,
+  STAGE_COUNT
+};
+
+enum Counter : uint8_t {
+  IR_COLLISION,    // a transmission stopped an IR capture in progress
+  IR_TX_OVERRUN,   // a queued IR frame dropped for a newer one
+  IR_RX_OVERRUN,   // an IR capture that overflowed the receive buffer
+  IR_COALESCED,    // an IR frame superseded by a newer one of its group
+  COUNTER_COUNT
+};
+
+constexpr uint8_t BUCKETS = 24;  // the last one starts at 2^22 us, ~4 s
+
+// Longest toJson() output and its NUL, with every number at ten digits.
+// metrics.cpp checks the names against NAME_MAX.
+constexpr size_t NAME_MAX = 7;
+constexpr size_t JSON_MAX = sizeof("{\"ms\":") - 1 + 10 +
+                            STAGE_COUNT * (sizeof(",\"\":[,,,]") - 1 + NAME_MAX + 4 * 10) +
+                            COUNTER_COUNT * (sizeof(",\"\":[,]") - 1 + NAME_MAX + 2 * 10) +
+                            sizeof("}");
+
+// Before any recording
+void begin(hal::Clock& clock);
+
+// Cycle counter stamp, and the microseconds since one
+uint32_t now();
+uint32_t elapsedUs(uint32_t since);
+
+void record(Stage stage, uint32_t us);
+void increment(Counter counter);
+
+// Totals since boot
+uint32_t count(Stage stage);
+uint32_t maxUs(Stage stage);
+uint32_t total(Counter counter);
+
+// Writes the window since the previous call; returns its length, 0 if it
+// did not fit, which cannot happen with cap >= JSON_MAX. Only ever from
+// one task.
+size_t toJson(uint32_t nowMs, char* out, size_t cap);
+
+// Times its own scope
+class Span {
+public:
+  explicit Span(Stage stage) : stage_(stage), start_(now()) {}
+  ~Span() { record(stage_, elapsedUs(start_)); }
+  Span(const Span&)            = delete;
+  Span& operator=(const Span&) = delete;
+
+private:
+  Stage    stage_;
+  uint32_t start_;
+};
+
+}  // namespace metrics
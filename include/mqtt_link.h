@@ -0,0 +1,76 @@
+/**
+ * @file mqtt_link.h
+ * @brief Non-blocking MQTT connection state machine with jittered exponential backoff
+ *
+ * service() is called from the scheduler and never waits: it performs at most
+ * one bounded connect attempt per call and otherwise just services the
+ * client. Subscriptions registered through the link are restored on every
+ * reconnect.
+ *
+ * The backoff only starts over once a session has stayed up for the
+ * maximum delay: a broker that accepts sessions and drops them at once
+ * (duplicate client ID, ACL kick) is backed off like one that refuses
+ * them. A retry pending when the network drops still holds when it comes
+ * back, so a flapping access point does not skip the backoff either.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+class MqttLink {
+public:
+  enum class State : uint8_t { OFFLINE, BACKOFF, CONNECTED };
+
+  using RandomFn  = uint32_t (*)();
+  using ConnectFn = void (*)();
+
+  static constexpr uint8_t MAX_SUBSCRIPTIONS = 8;
+
+  struct Stats {
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t connects;
+    uint32_t lastAttemptMs;  // wall time spent inside the last connect()
+    uint32_t maxAttemptMs;
+  };
+
+  MqttLink(hal::MqttTransport& client, hal::Clock& clock, const char* clientId, RandomFn rnd);
+
+  void setBackoff(uint32_t minMs, uint32_t maxMs);
+  void onConnect(ConnectFn fn) { onConnect_ = fn; }
+
+  // Remembered and (re)subscribed whenever the session comes up
+  bool subscribe(const char* topic);
+
+  // networkUp gates connect attempts, e.g. on Wi-Fi association
+  void service(uint32_t nowMs, bool networkUp);
+
+  bool  connected() const { return state_ == State::CONNECTED; }
+  State state() const { return state_; }
+  uint32_t retryInMs(uint32_t nowMs) const;
+  const Stats& stats() const { return stats_; }
+
+private:
+  void attempt(uint32_t nowMs);
+  void scheduleRetry(uint32_t nowMs);
+
+  hal::MqttTransport& client_;
+  hal::Clock&         clock_;
+  const char*         clientId_;
+  RandomFn            rnd_;
+  ConnectFn           onConnect_ = nullptr;
+
+  State    state_        = State::OFFLINE;
+  uint32_t minBackoffMs_ = 500;
+  uint32_t maxBackoffMs_ = 30000;
+  uint8_t  failStreak_   = 0;
+  uint32_t retryAtMs_    = 0;
+  uint32_t upSinceMs_    = 0;
+
+  const char* subs_[MAX_SUBSCRIPTIONS] = {};
+  uint8_t     subCount_ = 0;
+
+  Stats stats_ = {};
+};
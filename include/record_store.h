@@ -0,0 +1,99 @@
+/**
+ * @file record_store.h
+ * @brief Wear-levelled, CRC-protected named record store on a Flash backend
+ *
+ * The flash region is used as a circular log of sectors. Every put() appends
+ * a complete new copy of the record; the previous copy stays valid until the
+ * new one is fully written with a matching CRC, so an interrupted update
+ * leaves the old value in place. When the head sector fills, the log moves
+ * to the next sector and the oldest sector is compacted: its still-live
+ * records are re-appended from the RAM cache and the sector is erased. One
+ * erased sector is always kept in reserve for this, and erases rotate
+ * evenly over the whole region.
+ *
+ * On-flash layout (little endian, all entries 4-byte aligned):
+ *
+ *   sector header  u32 magic | u16 layout | u16 0xFFFF | u32 seq | u32 crc
+ *   record         u16 magic | u8 nameLen | u8 flags | u16 dataLen | u16 0xFFFF
+ *                  | u32 crc (header fields + name + data) | name | data | pad
+ *
+ * All values are mirrored in RAM, so get() never touches flash.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "flash.h"
+
+#ifndef RECORD_STORE_MAX_RECORDS
+#define RECORD_STORE_MAX_RECORDS 24
+#endif
+#ifndef RECORD_STORE_MAX_VALUE
+#define RECORD_STORE_MAX_VALUE 256
+#endif
+
+class RecordStore {
+public:
+  static constexpr uint8_t  MAX_NAME    = 15;
+  static constexpr uint8_t  MAX_RECORDS = RECORD_STORE_MAX_RECORDS;
+  static constexpr uint16_t MAX_VALUE   = RECORD_STORE_MAX_VALUE;
+  static constexpr uint16_t LAYOUT      = 1;
+
+  struct Stats {
+    uint32_t writes;       // records appended, including relocations
+    uint32_t erases;
+    uint32_t compactions;
+    uint32_t relocated;    // live records copied out of compacted sectors
+    uint32_t crcErrors;    // torn or corrupt entries skipped at mount
+  };
+
+  explicit RecordStore(Flash& flash) : flash_(flash) {}
+
+  // Mounts the log, formatting the region if it holds no valid sector.
+  // Returns false if the region uses an unknown layout or cannot be written.
+  bool begin();
+
+  bool put(const char* name, const void* data, uint16_t len);
+  bool remove(const char* name);
+
+  // Served from RAM; nullptr if absent
+  const uint8_t* get(const char* name, uint16_t& len) const;
+
+  uint8_t     count() const { return count_; }
+  const char* nameAt(uint8_t i) const { return i < count_ ? cache_[i].name : nullptr; }
+  uint32_t    liveBytes() const;
+  uint32_t    capacity() const;
+  const Stats& stats() const { return stats_; }
+
+private:
+  struct Entry {
+    char     name[MAX_NAME + 1];
+    uint16_t len;
+    uint16_t sector;  // sector holding the latest copy
+    uint8_t  data[MAX_VALUE];
+  };
+
+  static uint32_t recordSize(uint8_t nameLen, uint16_t dataLen);
+
+  int  find(const char* name, uint8_t nameLen) const;
+  void apply(const char* name, uint8_t nameLen, bool tombstone, const uint8_t* data,
+             uint16_t len, uint16_t sector);
+  bool blank(uint32_t addr, uint32_t len);
+  bool scanSector(uint16_t sector);
+  bool openSector(uint16_t sector, uint32_t seq);
+  bool advanceHead();
+  bool append(const char* name, uint8_t nameLen, bool tombstone, const uint8_t* data, uint16_t len);
+  bool appendRaw(const char* name, uint8_t nameLen, bool tombstone, const uint8_t* data,
+                 uint16_t len);
+  bool compact(uint16_t sector);
+  bool sectorValid(uint16_t sector, uint32_t& seq);
+
+  Flash&   flash_;
+  Entry    cache_[MAX_RECORDS];
+  uint8_t  count_    = 0;
+  uint16_t head_     = 0;   // sector being appended to
+  uint32_t headSeq_  = 0;
+  uint32_t headPos_  = 0;   // append offset within the head sector
+  bool     mounted_  = false;
+  Stats    stats_    = {};
+};
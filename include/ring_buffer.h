@@ -0,0 +1,63 @@
+/**
+ * @file ring_buffer.h
+ * @brief Fixed-capacity FIFO ring buffer with no heap allocation
+ *
+ * Single-context use only (no locking). When full, push() evicts the oldest
+ * element and counts it as dropped, so the newest data always survives.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class RingBuffer {
+  static_assert(N > 0, "RingBuffer capacity must be non-zero");
+
+public:
+  // Returns false if the oldest element had to be evicted
+  bool push(const T& item) {
+    bool kept = true;
+    if (count_ == N) {
+      head_ = next(head_);
+      count_--;
+      dropped_++;
+      kept = false;
+    }
+    buf_[(head_ + count_) % N] = item;
+    count_++;
+    return kept;
+  }
+
+  bool pop(T& out) {
+    if (count_ == 0) return false;
+    out   = buf_[head_];
+    head_ = next(head_);
+    count_--;
+    return true;
+  }
+
+  // i = 0 is the oldest element
+  const T& peek(size_t i = 0) const { return buf_[(head_ + i) % N]; }
+  void drop(size_t n = 1) {
+    if (n > count_) n = count_;
+    head_   = (head_ + n) % N;
+    count_ -= n;
+  }
+
+  void clear() { head_ = count_ = 0; }
+
+  size_t   size() const { return count_; }
+  bool     empty() const { return count_ == 0; }
+  bool     full() const { return count_ == N; }
+  uint32_t dropped() const { return dropped_; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  static size_t next(size_t i) { return (i + 1) % N; }
+
+  T        buf_[N];
+  size_t   head_    = 0;
+  size_t   count_   = 0;
+  uint32_t dropped_ = 0;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file scheduler.h
+ * @brief Cooperative run-to-completion scheduler with periodic and event-driven tasks
+ *
+ * Tasks are plain functions that must return quickly. Each pass of run()
+ * executes every ready task once, in registration order, so register the
+ * latency-sensitive work (MQTT servicing, input handling) first.
+ *
+ * Time comes from an injected microsecond clock, which keeps this file free
+ * of Arduino dependencies so it also builds for the host.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class Scheduler {
+public:
+  using TaskFn  = void (*)();
+  using ClockFn = uint32_t (*)();  // monotonic microseconds, may wrap
+  using TaskId  = int8_t;
+
+  static constexpr TaskId  INVALID_TASK = -1;
+  static constexpr uint8_t MAX_TASKS    = 12;
+
+  // Per-task accounting, all times in microseconds
+  struct TaskStats {
+    uint32_t runs;
+    uint64_t totalUs;         // summed runtime
+    uint32_t lastUs;          // runtime of the latest run
+    uint32_t maxUs;           // worst runtime
+    uint32_t maxLateUs;       // worst delay between release and start
+    uint32_t deadlineMisses;  // runs that finished after release + deadline
+  };
+
+  explicit Scheduler(ClockFn clock);
+
+  // Runs fn every periodMs (0 = every pass). The first release is one
+  // period after registration. deadlineUs = 0 disables deadline checking.
+  TaskId addPeriodic(const char* name, TaskFn fn, uint32_t periodMs, uint32_t deadlineUs = 0);
+
+  // Runs fn once per signal(); signals raised before it runs are merged.
+  TaskId addEvent(const char* name, TaskFn fn, uint32_t deadlineUs = 0);
+
+  void signal(TaskId id);
+  void setEnabled(TaskId id, bool enabled);
+  // Takes effect from now: the next release is one new period away
+  void setPeriod(TaskId id, uint32_t periodMs);
+  bool enabled(TaskId id) const;
+
+  // Executes one pass over all tasks; returns the number of tasks run.
+  uint8_t run();
+
+  // Microseconds until the next periodic release; 0 when a task is ready
+  // now. A thread running this scheduler may sleep that long, unless it is
+  // woken for an event it is told about.
+  uint32_t idleUs() const;
+
+  uint8_t taskCount() const { return count_; }
+  const char* name(TaskId id) const;
+  const TaskStats* stats(TaskId id) const;
+  void resetStats();
+
+private:
+  struct Task {
+    const char* name;
+    TaskFn   fn;
+    uint32_t periodUs;
+    uint32_t deadlineUs;
+    uint32_t releaseUs;        // when the task (last) became ready
+    bool     periodic;
+    bool     enabled;
+    volatile bool pending;     // event tasks only
+    TaskStats stats;
+  };
+
+  TaskId add(const char* name, TaskFn fn, bool periodic, uint32_t periodUs, uint32_t deadlineUs);
+  bool valid(TaskId id) const { return id >= 0 && id < count_; }
+  void execute(Task& t, uint32_t now);
+
+  ClockFn clock_;
+  Task    tasks_[MAX_TASKS];
+  uint8_t count_ = 0;
+};
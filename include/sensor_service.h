@@ -0,0 +1,135 @@
+/**
+ * @file sensor_service.h
+ * @brief Non-blocking multi-sensor sampling with validation, filtering and fusion
+ *
+ * Sensors are registered with a weight and read in rounds, one round per
+ * period. service() is polled: it starts a conversion on every sensor at
+ * the top of the round and collects each one once its own conversion time
+ * has passed, so a 750 ms DS18B20 conversion costs no more loop time than
+ * an SHT3x one. Everything else, the control loop included, only looks at
+ * the cache.
+ *
+ * Sensors on bit-banged buses (DHT, 1-Wire) mask interrupts while they
+ * talk, which corrupts any IR frame being captured at the same time, so IR
+ * capture is paused around their start() and collect(). The calls are
+ * timed per sensor.
+ *
+ * Each channel of each sensor is validated on its own: NaN and values
+ * outside the plausible range are rejected, the rest enter a window of the
+ * last WINDOW accepted values and the sensor's value is their median, so
+ * isolated spikes never get further. A raw value further than the
+ * channel's step limit from the current median counts as an outlier.
+ *
+ * At the end of a round the sensors with a temperature no older than
+ * staleMs are fused into one room estimate by weighted mean. With three or
+ * more of them, a sensor further than FUSE_SPREAD_C from their median is
+ * left out. The estimate is stale when no sensor has contributed for
+ * staleMs.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+class SensorService {
+public:
+  static constexpr uint8_t MAX_SENSORS = 4;
+  static constexpr uint8_t WINDOW      = 5;
+
+  // Plausible room values and change per sample
+  static constexpr float TEMP_MIN_C    = -40.0f;
+  static constexpr float TEMP_MAX_C    = 80.0f;
+  static constexpr float TEMP_STEP_C   = 3.0f;
+  static constexpr float HUMIDITY_MIN  = 0.0f;
+  static constexpr float HUMIDITY_MAX  = 100.0f;
+  static constexpr float HUMIDITY_STEP = 10.0f;
+  static constexpr float FUSE_SPREAD_C = 2.0f;
+
+  struct Reading {
+    float    tempC;     // NaN until a temperature is accepted
+    float    humidity;  // NaN while no sensor has one
+    uint32_t atMs;      // time of the last estimate
+  };
+
+  struct Stats {
+    uint32_t rounds;
+    uint32_t estimates;  // rounds that produced a temperature
+    uint32_t excluded;   // sensor temperatures left out of fusion
+  };
+
+  struct SensorStats {
+    uint32_t reads;
+    uint32_t rejected;   // channel values that were NaN or out of range
+    uint32_t outliers;   // accepted values far from the median they joined
+    uint32_t lastUs;     // start() + collect() of the last round, IR pause included
+    uint32_t maxUs;
+    uint64_t totalUs;
+  };
+
+  SensorService(hal::Clock& clock, hal::IrRx& irRx, uint32_t periodMs, uint32_t staleMs)
+    : clock_(clock), irRx_(irRx), periodMs_(periodMs), staleMs_(staleMs) {}
+
+  // Registration, before begin(); false when full
+  bool add(hal::ClimateSensor& sensor, float weight);
+  void begin();
+
+  // Poll often; true when a round just finished. latest() then holds its
+  // estimate, unless no sensor delivered and the estimate is going stale.
+  bool service(uint32_t nowMs);
+
+  const Reading& latest() const { return latest_; }
+  bool           stale(uint32_t nowMs) const;
+  void           setPeriodMs(uint32_t ms) { periodMs_ = ms; }
+  void           setStaleMs(uint32_t ms) { staleMs_ = ms; }
+  const Stats&   stats() const { return stats_; }
+
+  uint8_t            sensorCount() const { return count_; }
+  const char*        sensorName(uint8_t i) const { return sensors_[i].sensor->name(); }
+  const SensorStats& sensorStats(uint8_t i) const { return sensors_[i].stats; }
+  // The sensor's own filtered temperature; NaN before its first accepted value
+  float              sensorTempC(uint8_t i) const { return sensors_[i].temp.median(); }
+
+private:
+  struct Channel {
+    float   values[WINDOW];
+    uint8_t count = 0;
+    uint8_t next  = 0;
+
+    bool  accept(float v, float lo, float hi, float step, SensorStats& stats);
+    float median() const;
+  };
+
+  struct Source {
+    hal::ClimateSensor* sensor;
+    float               weight;
+    Channel             temp;
+    Channel             humidity;
+    uint32_t            readyAtMs;
+    uint32_t            tempAtMs;
+    uint32_t            startUs;  // duration of this round's start()
+    bool                pending;
+    bool                haveTemp;
+    SensorStats         stats;
+  };
+
+  void startRound(uint32_t nowMs);
+  void collect(Source& s, uint32_t nowMs);
+  void fuse(uint32_t nowMs);
+
+  hal::Clock& clock_;
+  hal::IrRx&  irRx_;
+  uint32_t    periodMs_;
+  uint32_t    staleMs_;
+
+  Source   sensors_[MAX_SENSORS];
+  uint8_t  count_       = 0;
+  bool     started_     = false;
+  bool     converting_  = false;
+  uint32_t nextRoundMs_ = 0;
+
+  Reading latest_   = { NAN, NAN, 0 };
+  bool    haveTemp_ = false;
+  Stats   stats_    = {};
+};
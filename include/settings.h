@@ -0,0 +1,82 @@
+/**
+ * @file settings.h
+ * @brief Typed registry of runtime settings with validation, text/JSON formatting and live apply
+ *
+ * Every entry points at the RAM variable the application already reads, so
+ * the hot path keeps using plain variables and never parses anything.
+ * Writes go through set(): the value is parsed and range-checked, the
+ * registry-wide check (cross-field rules such as low < high) runs against
+ * the new value, and on success the entry's apply hook pushes it into
+ * whatever caches it (a scheduler period, a controller's config). A
+ * rejected write leaves the old value in place. Persisted text is restored
+ * with load() instead, which checks only the complete result.
+ *
+ * Text form, used both on the wire and for persistence:
+ *
+ *   key=value[;key=value...]      separators ';' or newline
+ *
+ * Floats and unsigned integers are written in decimal, enums by name.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Settings {
+public:
+  enum class Type : uint8_t { FLOAT, UINT, ENUM };
+  enum class Result : uint8_t { OK, UNKNOWN_KEY, BAD_VALUE, REJECTED };
+
+  using ApplyFn = void (*)();
+  using CheckFn = bool (*)();
+
+  struct Entry {
+    const char*        key;
+    Type               type;
+    void*              value;   // float*, uint32_t* or uint8_t* (enum index)
+    float              min;     // FLOAT/UINT inclusive range
+    float              max;
+    const char* const* names;   // ENUM value names
+    uint8_t            nameCount;
+    ApplyFn            apply;   // optional, called after a successful write
+  };
+
+  static constexpr uint8_t MAX_KEY = 15;
+
+  Settings(const Entry* entries, uint8_t count, CheckFn check)
+    : entries_(entries), count_(count), check_(check) {}
+
+  Result set(const char* key, size_t keyLen, const char* value, size_t valueLen);
+
+  // Applies every pair in text; stops at the first failure, reporting the
+  // offending key. Pairs before it stay applied.
+  Result setAll(const char* text, size_t len, const char*& badKey, size_t& badKeyLen);
+
+  // Restores persisted text, possibly written by another firmware version.
+  // Pairs with an unknown key or a bad value are skipped, the first one
+  // reported, and the rest still load. The registry-wide check runs once on
+  // the result, since text saved in registry order can pass through states
+  // it rejects (temp_high=20 before temp_low=15 against the defaults).
+  // REJECTED means the result fails it; the values are left as loaded.
+  // Apply hooks are not called: follow with applyAll().
+  Result load(const char* text, size_t len, const char*& badKey, size_t& badKeyLen);
+
+  // Calls every apply hook, e.g. after loading persisted values
+  void applyAll() const;
+
+  // key=value;... text, or a flat JSON object; returns the length written
+  // (0 if cap is too small)
+  size_t toText(char* out, size_t cap) const;
+  size_t toJson(char* out, size_t cap) const;
+
+  uint8_t      count() const { return count_; }
+  const Entry* find(const char* key, size_t keyLen) const;
+
+private:
+  Result assign(const Entry& e, const char* value, size_t valueLen, bool check);
+  size_t format(const Entry& e, char* out, size_t cap, bool json) const;
+
+  const Entry* entries_;
+  uint8_t      count_;
+  CheckFn      check_;
+};
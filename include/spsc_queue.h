@@ -0,0 +1,63 @@
+/**
+ * @file spsc_queue.h
+ * @brief Lock-free single-producer/single-consumer FIFO, safe to fill from an ISR
+ *
+ * One context pushes (typically an interrupt handler), one other context
+ * pops. Each index is written by one side only and published with
+ * release/acquire ordering, so no lock or critical section is needed.
+ * Unlike RingBuffer, a full queue rejects the new element: the consumer
+ * owns the old ones and may be reading them. Rejections are counted.
+ *
+ * push() is forced inline so it lands in the caller's section, e.g. an
+ * IRAM interrupt handler on the ESP32, and stays callable while the flash
+ * cache is off.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define SPSC_INLINE __attribute__((always_inline)) inline
+
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+  // Producer side; false if full
+  SPSC_INLINE bool push(const T& item) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == N) {
+      overflows_.store(overflows_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    buf_[tail & (N - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T& out) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+    out = buf_[head & (N - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Either side; a snapshot that may be stale by the time it is used
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+  bool     empty() const { return size() == 0; }
+  uint32_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T                     buf_[N];
+  std::atomic<uint32_t> head_{ 0 };  // written by the consumer only
+  std::atomic<uint32_t> tail_{ 0 };  // written by the producer only
+  std::atomic<uint32_t> overflows_{ 0 };
+};
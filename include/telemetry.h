@@ -0,0 +1,135 @@
+/**
+ * @file telemetry.h
+ * @brief Store-and-forward telemetry queue for temperature/humidity samples
+ *
+ * Samples are timestamped and queued in a fixed RAM ring. While the broker
+ * is reachable the queue drains immediately; during an outage it fills up
+ * and is replayed oldest-first on reconnect, a bounded number of messages
+ * per service() call so the backlog cannot crowd out command traffic.
+ *
+ * Building with TELEMETRY_FLASH_SPILL=1 moves the oldest RAM samples to a
+ * LittleFS file instead of evicting them when the ring is full.
+ *
+ * In batch mode up to batchSize samples are delta-encoded into one binary
+ * message on <topic>/batch, flushed when the batch is full or its oldest
+ * sample is flushMs old. Format (varint = unsigned LEB128, zz = zigzag):
+ *
+ *   u8      version (BATCH_VERSION)
+ *   u8      sample count
+ *   varint  age of the first sample in ms at publication
+ *   per sample:
+ *     varint  (dt << 2) | tempMissing << 1 | humMissing
+ *             dt = 10 ms ticks since the previous sample (0 for the first)
+ *     zz      temperature delta in tenths vs. the last present value (if present)
+ *     zz      humidity delta in tenths vs. the last present value (if present)
+ *
+ * The first present value of each channel is a delta against 0. A steady
+ * 5 s cadence costs 4 bytes per sample versus ~35 for the JSON message.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "ring_buffer.h"
+
+#ifndef TELEMETRY_FLASH_SPILL
+#define TELEMETRY_FLASH_SPILL 0
+#endif
+
+// Batch mode defaults, overridable from build_flags; at run time the
+// application's batch and batch_ms settings call setBatching()
+#ifndef TELEMETRY_BATCH
+#define TELEMETRY_BATCH 0
+#endif
+#ifndef TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_SIZE 12
+#endif
+#ifndef TELEMETRY_FLUSH_MS
+#define TELEMETRY_FLUSH_MS 60000
+#endif
+
+class Telemetry {
+public:
+  using PublishFn = bool (*)(const char* topic, const uint8_t* payload, unsigned int len);
+
+  // 8 bytes; temperature/humidity in tenths, NO_VALUE for a failed read
+  struct Sample {
+    uint32_t ms;
+    int16_t  temp10;
+    int16_t  hum10;
+  };
+
+  static constexpr int16_t  NO_VALUE            = INT16_MIN;
+  static constexpr uint16_t RAM_SAMPLES         = 256;   // ~21 min at one sample per 5 s
+  static constexpr uint8_t  REPLAY_BATCH        = 8;     // JSON messages per service() call
+  static constexpr uint8_t  BATCHES_PER_SERVICE = 2;     // batch messages per service() call
+  static constexpr uint16_t SPILL_CHUNK         = 64;    // samples moved to flash at once
+  static constexpr uint32_t SPILL_MAX           = 4096;  // samples kept in flash
+  static constexpr uint8_t  MAX_BATCH_SIZE      = 64;
+  static constexpr uint8_t  BATCH_VERSION       = 1;
+  static constexpr uint16_t BATCH_BYTES         = 7 + MAX_BATCH_SIZE * 11;  // worst case
+
+  struct Stats {
+    uint32_t recorded;
+    uint32_t published;  // samples
+    uint32_t messages;
+    uint32_t bytes;      // payload bytes
+    uint32_t dropped;    // lost to a full RAM ring or spill file
+    uint32_t spilled;
+    uint32_t maxBacklog;
+  };
+
+  explicit Telemetry(PublishFn publish) : publish_(publish) {}
+
+  // Samples go to topic, batches to <topic>/batch; the string must outlive
+  // the queue
+  void begin(const char* topic);
+
+  // batchSize 0 or 1 selects one JSON message per sample
+  void setBatching(uint8_t batchSize, uint32_t flushMs);
+  bool batching() const { return batchSize_ > 1; }
+
+  // Encodes n samples in the batch format above; returns bytes written
+  static uint16_t encodeBatch(const Sample* samples, uint8_t n, uint32_t nowMs,
+                              uint8_t* out, uint16_t cap);
+  // The reference decoder for the receiving side: times come back on the
+  // 10 ms grid, relative to the nowMs the message was received at. Returns
+  // the sample count, 0 for a malformed message or more than max samples.
+  static uint8_t decodeBatch(const uint8_t* in, uint16_t len, uint32_t nowMs, Sample* out,
+                             uint8_t max);
+
+  void record(uint32_t nowMs, float temp, float hum);
+
+  // Publishes queued samples oldest first, at a bounded rate per call
+  void service(uint32_t nowMs, bool online);
+
+  uint32_t backlog() const;
+  const Stats& stats() const { return stats_; }
+
+private:
+  uint8_t loadOldest(Sample* out, uint8_t max);
+  void    consumeOldest(uint8_t n, bool fromFlash);
+  bool    publishSample(const Sample& s, uint32_t nowMs);
+  void    serviceJson(uint32_t nowMs);
+  void    serviceBatch(uint32_t nowMs);
+#if TELEMETRY_FLASH_SPILL
+  void    spill();
+#endif
+
+  const char* topic_ = nullptr;
+  PublishFn   publish_;
+  char        batchTopic_[48];
+  uint8_t     batchSize_ = TELEMETRY_BATCH ? TELEMETRY_BATCH_SIZE : 0;
+  uint32_t    flushMs_   = TELEMETRY_FLUSH_MS;
+
+  Sample  scratch_[MAX_BATCH_SIZE];
+  uint8_t encoded_[BATCH_BYTES];
+
+  RingBuffer<Sample, RAM_SAMPLES> ram_;
+#if TELEMETRY_FLASH_SPILL
+  uint32_t spillCount_   = 0;   // unread samples in the spill file
+  uint32_t spillReadPos_ = 0;   // byte offset of the oldest unread sample
+#endif
+
+  Stats stats_ = {};
+};
@@ -0,0 +1,126 @@
+/**
+ * @file thermostat.h
+ * @brief Cooling thermostat with selectable control laws, compressor dwell times and a believed AC state
+ *
+ * The AC gives no feedback, so the thermostat tracks what it last told it
+ * to do and only asks for a command when that belief has to change. The
+ * control law decides which state is wanted:
+ *
+ *  - HYSTERESIS  on at or above onAboveC, off at or below offBelowC
+ *  - PID         a PID on (temp - setpoint) gives a duty cycle, applied as
+ *                on-time within a fixed window (time-proportioning)
+ *  - PREDICTIVE  a first-order room model, fitted online, predicts the
+ *                temperature leadMs ahead; the AC is switched when the
+ *                prediction leaves setpoint +- bandC, so it turns off
+ *                before the room overshoots and on before it drifts out
+ *
+ * Whatever the law, a transition is held back until the AC has been in its
+ * current state for the minimum on or off time, which keeps the
+ * compressor from short-cycling. After boot (or reset()) the state is
+ * unknown and the first decision is sent regardless of dwell to
+ * resynchronise.
+ *
+ * The room model dT/dt = a + b*T + c*on is fitted by recursive least squares
+ * on one sample per MODEL_SAMPLE_MS in every mode, so switching to the
+ * predictive law starts warm. Its time constant is -1/b. Everything is
+ * float state inside the object; nothing is allocated.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class Thermostat {
+public:
+  enum class State : uint8_t { UNKNOWN, OFF, ON };
+  enum class Action : uint8_t { NONE, TURN_ON, TURN_OFF };
+  enum class Law : uint8_t { HYSTERESIS, PID, PREDICTIVE };
+
+  static constexpr uint8_t  LAW_COUNT       = 3;
+  static const char* const  LAW_NAMES[LAW_COUNT];  // "hysteresis", "pid", "predictive"
+
+  static constexpr uint32_t MODEL_SAMPLE_MS = 60000;
+  static constexpr uint16_t MODEL_MIN_FITS  = 30;   // samples before predictions are trusted
+
+  struct Config {
+    Law      law;
+    float    onAboveC;   // HYSTERESIS: turn on at or above
+    float    offBelowC;  // HYSTERESIS: turn off at or below; lower than onAboveC
+    uint32_t minOnMs;
+    uint32_t minOffMs;
+    float    setpointC;  // PID and PREDICTIVE
+    float    bandC;      // PREDICTIVE tolerance either side of the setpoint
+    float    kp;         // PID gains on error in C, output is duty 0..1
+    float    ki;         // per second
+    float    kd;         // seconds
+    uint32_t windowMs;   // PID time-proportioning window
+    uint32_t leadMs;     // PREDICTIVE look-ahead
+  };
+
+  struct Stats {
+    uint32_t evaluations;
+    uint32_t turnOns;
+    uint32_t turnOffs;
+    uint32_t dwellHolds;  // evaluations that wanted a transition but had to wait
+    uint32_t invalid;     // NaN readings ignored
+    uint32_t modelFits;   // room model samples taken
+  };
+
+  explicit Thermostat(const Config& cfg) : cfg_(cfg) { resetModel(); }
+
+  // Call with each new reading; the returned action has been applied to the
+  // believed state already
+  Action update(uint32_t nowMs, float tempC);
+
+  // Records a state set from elsewhere (manual command); starts its dwell
+  void assume(State state, uint32_t nowMs);
+  // Forgets the believed state, e.g. after a command failed to send
+  void reset() { state_ = State::UNKNOWN; }
+
+  // Replaces the configuration live; a law change restarts the PID state.
+  // The believed AC state, its dwell and the room model are kept.
+  void configure(const Config& cfg);
+
+  State         state() const { return state_; }
+  uint32_t      inStateMs(uint32_t nowMs) const { return nowMs - sinceMs_; }
+  const Config& config() const { return cfg_; }
+  const Stats&  stats() const { return stats_; }
+  float         duty() const { return duty_; }
+
+  // Fitted room time constant in seconds; 0 until the model is trusted
+  float timeConstantS() const;
+  // Model prediction of the temperature aheadMs from now with the AC held
+  // on or off; returns tempC unchanged until the model is trusted
+  float predict(float tempC, bool acOn, uint32_t aheadMs) const;
+
+  static const char* lawName(Law law);
+
+private:
+  State wantHysteresis(float tempC) const;
+  State wantPid(uint32_t nowMs, float tempC);
+  State wantPredictive(float tempC) const;
+  void  fitModel(uint32_t nowMs, float tempC);
+  void  resetModel();
+  bool  modelReady() const;
+
+  Config   cfg_;
+  State    state_   = State::UNKNOWN;
+  uint32_t sinceMs_ = 0;
+  Stats    stats_   = {};
+
+  // PID
+  bool     pidStarted_  = false;
+  uint32_t lastMs_      = 0;
+  float    lastTemp_    = 0;
+  float    integral_    = 0;  // in duty units
+  float    duty_        = 0;
+  uint32_t windowStart_ = 0;
+  uint32_t onTimeMs_    = 0;
+
+  // Room model (RLS over theta = [a, b, c])
+  bool     sampled_      = false;
+  uint32_t sampleMs_     = 0;
+  float    sampleTemp_   = 0;
+  bool     sampleOn_     = false;
+  float    theta_[3];
+  float    p_[3][3];
+};
@@ -0,0 +1,46 @@
+/**
+ * @file topics.h
+ * @brief MQTT topic namespace of one device, built once from its ID
+ *
+ * Every topic lives in a fixed buffer filled at startup, so handlers compare
+ * and publish against plain strings and nothing is formatted per message:
+ *
+ *   <id>/cmd, <id>/log, <id>/status, <id>/metrics, <id>/config, <id>/config/set
+ *   <id>/learn           learn session progress events
+ *   fleet/all/cmd         commands for every unit on the broker
+ *   fleet/<zone>/cmd      commands for every unit in the zone (if one is set)
+ *
+ * The ID doubles as the MQTT client ID, which the broker requires to be
+ * unique. Without a configured ID it is "ac-" plus the six MAC bytes in
+ * hex. IDs and zones may not contain '/', '+' or '#'.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Topics {
+  static constexpr uint8_t MAX_ID    = 23;
+  static constexpr uint8_t MAX_TOPIC = MAX_ID + 16;
+
+  char id[MAX_ID + 1];
+  char cmd[MAX_TOPIC];
+  char log[MAX_TOPIC];
+  char status[MAX_TOPIC];
+  char metrics[MAX_TOPIC];
+  char learn[MAX_TOPIC];
+  char config[MAX_TOPIC];
+  char configSet[MAX_TOPIC];
+  char fleetCmd[MAX_TOPIC];
+  char zoneCmd[MAX_TOPIC];  // empty without a zone
+
+  // Falls back to the MAC-derived ID when deviceId is null, empty or
+  // invalid, and drops the zone topic when the zone is
+  void build(const char* deviceId, const uint8_t mac[6], const char* zone);
+
+  // True for the device, fleet and zone command topics
+  bool isCommand(const char* topic) const;
+
+  // A single topic level of 1..MAX_ID characters without MQTT wildcards
+  static bool validLevel(const char* s);
+};
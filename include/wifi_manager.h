@@ -0,0 +1,65 @@
+/**
+ * @file wifi_manager.h
+ * @brief Background Wi-Fi station manager with a cached BSSID/channel fast path
+ *
+ * The manager never waits for association. begin() kicks off the first
+ * attempt and service() advances the state machine from the scheduler.
+ * After a successful join the AP's BSSID and channel are stored in NVS so
+ * later connects (including after a reboot) skip the full channel scan.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class WifiManager {
+public:
+  enum class State : uint8_t { IDLE, FAST_CONNECT, SCAN_CONNECT, CONNECTED, BACKOFF };
+
+  using EventFn = void (*)(bool connected);
+
+  struct Stats {
+    uint32_t connects;
+    uint32_t fastConnects;     // joins that used the cached BSSID/channel
+    uint32_t fastMisses;       // cached AP did not answer, fell back to a scan
+    uint32_t failures;         // scan attempts that timed out
+    uint32_t lastConnectMs;    // time-to-connect of the latest join
+    uint32_t maxConnectMs;
+    uint32_t totalConnectMs;
+    bool     lastFast;         // latest join used the fast path
+  };
+
+  // Attempt timeouts and the retry pause after a failed scan attempt
+  static constexpr uint32_t FAST_TIMEOUT_MS = 3000;
+  static constexpr uint32_t SCAN_TIMEOUT_MS = 15000;
+  static constexpr uint32_t RETRY_DELAY_MS  = 5000;
+
+  WifiManager(const char* ssid, const char* pass);
+
+  void begin(uint32_t nowMs);
+  void service(uint32_t nowMs);
+  void onChange(EventFn fn) { onChange_ = fn; }
+
+  bool  connected() const { return state_ == State::CONNECTED; }
+  State state() const { return state_; }
+  bool  cacheValid() const { return cacheValid_; }
+  const Stats& stats() const { return stats_; }
+
+private:
+  void loadCache();
+  void storeCache();
+  void startAttempt(uint32_t nowMs, bool fast);
+  void joined(uint32_t nowMs);
+
+  const char* ssid_;
+  const char* pass_;
+  EventFn     onChange_ = nullptr;
+
+  State    state_       = State::IDLE;
+  uint32_t stateAtMs_   = 0;   // when the current attempt or backoff began
+  uint32_t outageAtMs_  = 0;   // when the link was last lost, for time-to-connect
+  bool     cacheValid_  = false;
+  uint8_t  bssid_[6]    = {};
+  uint8_t  channel_     = 0;
+
+  Stats stats_ = {};
+};
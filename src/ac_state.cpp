@@ -0,0 +1,10 @@
+/**
+ * @file ac_state.cpp
+ * @brief AC state value names
+ */
+
+#include "ac_state.h"
+
+const char* const AcState::MODE_NAMES[MODE_COUNT]   = { "auto", "cool", "heat", "dry", "fan" };
+const char* const AcState::FAN_NAMES[FAN_COUNT]     = { "auto", "low", "medium", "high" };
+const char* const AcState::SWING_NAMES[SWING_COUNT] = { "off", "on" };
@@ -0,0 +1,1245 @@
+/**
+ * @file app.cpp
+ * @brief Controller application logic, independent of the board
+ */
+
+#include "app.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "button.h"
+#include "commands.h"
+#include "ir_arbiter.h"
+#include "learn_session.h"
+#include "log.h"
+#include "metrics.h"
+#include "mqtt_link.h"
+#include "sensor_service.h"
+#include "settings.h"
+#include "spsc_queue.h"
+#include "telemetry.h"
+#include "thermostat.h"
+#include "topics.h"
+
+namespace app {
+
+// ======================= Configuration ======================
+// MQTT Reconnect Policy
+static constexpr uint32_t MQTT_BACKOFF_MIN_MS = 500;
+static constexpr uint32_t MQTT_BACKOFF_MAX_MS = 30000;
+
+const char* const SLOT_ON  = "on";
+const char* const SLOT_OFF = "off";
+const char* const SLOT_SET = "set";
+
+// Record holding the persisted settings, next to the codes
+static const char* const CONFIG_RECORD = "cfg";
+
+// Defaults for the runtime settings below. Thermostat: the hysteresis law
+// cools above TEMP_HIGH until TEMP_LOW, the PID and predictive laws hold
+// SETPOINT_C; dwell times protect the compressor
+static constexpr Thermostat::Law CONTROL_LAW = Thermostat::Law::HYSTERESIS;
+static constexpr float    TEMP_HIGH        = 35.0;
+static constexpr float    TEMP_LOW         = 23.0;
+static constexpr uint32_t MIN_ON_MS        = 3 * 60 * 1000UL;
+static constexpr uint32_t MIN_OFF_MS       = 3 * 60 * 1000UL;
+static constexpr float    SETPOINT_C       = 26.0;
+static constexpr float    SETPOINT_MIN_C   = 16.0;
+static constexpr float    SETPOINT_MAX_C   = 32.0;
+static constexpr float    PREDICT_BAND_C   = 1.25;
+static constexpr uint32_t PREDICT_LEAD_MS  = 2 * 60 * 1000UL;  // longer stops short of the band: more cycles
+static constexpr float    PID_KP           = 0.5;      // duty per C
+static constexpr float    PID_KI           = 0.0003;   // duty per C*s
+static constexpr float    PID_KD           = 0.0;
+static constexpr uint32_t PID_WINDOW_MS    = 20 * 60 * 1000UL;
+static_assert(PID_WINDOW_MS >= MIN_ON_MS + MIN_OFF_MS, "the PID window must fit both dwell times");
+
+// AC state model: off (protocol 0) until the unit's protocol is set, and
+// on/off use the learned codes meanwhile
+static constexpr AcState::Mode AC_MODE    = AcState::Mode::COOL;
+static constexpr float         AC_TEMP_C  = 24.0;
+static constexpr AcState::Fan  AC_FAN     = AcState::Fan::AUTO;
+static constexpr uint32_t      AC_PROTOCOL_MAX = INT16_MAX;
+static constexpr uint32_t      AC_MODEL_MAX    = 255;
+
+// Button: a short press toggles the mode, a long one enters learn mode and
+// a double press toggles the AC by hand
+static constexpr uint32_t DEBOUNCE_MS     = 50;
+static constexpr uint32_t LONG_PRESS_MS   = 1500;
+static constexpr uint32_t DOUBLE_PRESS_MS = 400;
+
+// Learning: each code takes LEARN_CAPTURES agreeing presses, within
+// LEARN_STEP_MS per slot. Frames closer than LEARN_GAP_MS are one press.
+static constexpr uint32_t LEARN_CAPTURES  = 2;
+static constexpr uint32_t LEARN_STEP_MS   = 30000;
+static constexpr uint32_t LEARN_GAP_MS    = 250;
+
+// Capture stays off this long after a transmission ends, so the receiver
+// never decodes the unit's own frame or its echo
+static constexpr uint32_t IR_GUARD_MS     = 100;
+
+// Room for the settings as key=value text or JSON
+static constexpr size_t CONFIG_TEXT_MAX = 512;
+
+// Cross-domain queue depths
+static constexpr size_t INBOX_DEPTH  = 4;   // MQTT messages for the control domain
+static constexpr size_t OUTBOX_DEPTH = 4;   // settings echoes for the network domain
+static constexpr size_t SAMPLE_DEPTH = 8;   // sensor estimates for telemetry
+static constexpr size_t LEARN_DEPTH  = 8;   // learn progress events
+
+// Task Periods (ms) and Deadlines (us)
+static constexpr uint32_t MQTT_PERIOD_MS       = 0;    // every scheduler pass
+static constexpr uint32_t WIFI_PERIOD_MS       = 100;
+static constexpr uint32_t BUTTON_PERIOD_MS     = 10;   // gesture latency only; edges are stamped
+static constexpr uint32_t LEARN_PERIOD_MS      = 10;
+static constexpr uint32_t SENSOR_POLL_MS       = 10;   // collects finished conversions
+static constexpr uint32_t SENSOR_PERIOD_MS     = 5000; // between rounds; DHT21 needs 2 s or more
+static constexpr uint32_t TELEMETRY_PERIOD_MS  = 250;  // replay rate: REPLAY_BATCH per period
+static constexpr uint32_t LOG_PERIOD_MS        = 20;
+static constexpr uint32_t METRICS_PERIOD_MS    = 60000;
+static constexpr uint32_t MQTT_DEADLINE_US     = 20000;
+static constexpr uint32_t INBOX_DEADLINE_US    = 20000;
+static constexpr uint32_t BUTTON_DEADLINE_US   = 10000;
+static constexpr uint32_t LEARN_DEADLINE_US    = 50000;
+static constexpr uint32_t SENSOR_DEADLINE_US   = 30000;
+static constexpr uint32_t AUTO_DEADLINE_US     = 20000;
+static constexpr uint32_t IR_DEADLINE_US       = 200000; // one frame, long AC ones included
+
+// A reading is stale after this many sample periods without a valid temperature
+static constexpr uint8_t  SENSOR_STALE_PERIODS = 3;
+
+// ======================= State ==============================
+static const hal::Board* board_ = nullptr;
+static MqttLink*         link_  = nullptr;
+static RecordStore*      store_ = nullptr;
+static SensorService*    sensors_ = nullptr;
+static IrArbiter*        ir_      = nullptr;
+
+static Topics topics_;  // built in begin() from the board's ID or MAC
+
+static Scheduler netSched_([]() -> uint32_t { return board_->clock.micros(); });
+static Scheduler ctrlSched_([]() -> uint32_t { return board_->clock.micros(); });
+static Telemetry telemetry_([](const char* t, const uint8_t* p, unsigned int n) {
+  return board_->mqtt.publish(t, p, n);
+});
+
+// Runtime settings: the tasks read these variables directly; the registry
+// below writes them and pushes changes on
+static Thermostat::Config thermoCfg_ = { CONTROL_LAW, TEMP_HIGH, TEMP_LOW, MIN_ON_MS, MIN_OFF_MS,
+                                         SETPOINT_C, PREDICT_BAND_C, PID_KP, PID_KI, PID_KD,
+                                         PID_WINDOW_MS, PREDICT_LEAD_MS };
+static uint32_t samplePeriodMs_ = SENSOR_PERIOD_MS;
+static uint32_t debounceMs_     = DEBOUNCE_MS;
+// Sent whole with every AC frame; power is the thermostat's belief
+static AcState  acState_        = { 0, 0, false, AC_MODE, AC_TEMP_C, AC_FAN, AcState::Swing::OFF };
+static uint32_t acProtocol_     = 0;
+static uint32_t acModel_        = 0;
+static uint32_t learnCaptures_  = LEARN_CAPTURES;
+static uint32_t learnStepMs_    = LEARN_STEP_MS;
+static uint32_t batchSize_      = TELEMETRY_BATCH ? TELEMETRY_BATCH_SIZE : 0;
+static uint32_t batchFlushMs_   = TELEMETRY_FLUSH_MS;
+
+static Thermostat thermostat_(thermoCfg_);
+
+static uint16_t rawTimings_[ircode::MAX_RAW];  // shared by capture and replay of raw codes
+
+static bool mode_ = true;  // true = Auto, false = Learn
+
+// Scheduler Tasks: network domain
+static Scheduler::TaskId wifiTask      = Scheduler::INVALID_TASK;
+static Scheduler::TaskId mqttTask      = Scheduler::INVALID_TASK;
+static Scheduler::TaskId relayTask     = Scheduler::INVALID_TASK;
+static Scheduler::TaskId telemetryTask = Scheduler::INVALID_TASK;
+static Scheduler::TaskId logTask       = Scheduler::INVALID_TASK;
+static Scheduler::TaskId metricsTask   = Scheduler::INVALID_TASK;
+// Control domain
+static Scheduler::TaskId inboxTask     = Scheduler::INVALID_TASK;
+static Scheduler::TaskId buttonTask    = Scheduler::INVALID_TASK;
+static Scheduler::TaskId modeTask      = Scheduler::INVALID_TASK;
+static Scheduler::TaskId learnTask     = Scheduler::INVALID_TASK;
+static Scheduler::TaskId sensorTask    = Scheduler::INVALID_TASK;
+static Scheduler::TaskId autoTask      = Scheduler::INVALID_TASK;
+static Scheduler::TaskId irTask        = Scheduler::INVALID_TASK;
+
+// Domain queues. An MQTT message is copied out of the client's receive
+// buffer, since the control domain reads it later.
+struct Inbound {
+  enum Kind : uint8_t { COMMAND, CONFIG };
+  Kind     kind;
+  uint16_t len;
+  uint32_t atUs;  // received
+  char     text[CONFIG_TEXT_MAX];
+};
+
+struct Outbound {
+  uint16_t len;
+  char     json[CONFIG_TEXT_MAX];
+};
+
+// Published on <id>/learn as
+//   {"event":"capture","slot":"on","step":1,"steps":3,"n":1,"of":2}
+struct LearnEvent {
+  enum Kind : uint8_t { START, CAPTURE, MISMATCH, SAVED, FAILED, TIMEOUT, DONE, CANCEL };
+  Kind    kind;
+  uint8_t step;  // 1-based
+  uint8_t steps;
+  uint8_t captures;
+  uint8_t required;
+  char    slot[LearnSession::MAX_SLOT + 1];
+};
+
+static SpscQueue<Inbound, INBOX_DEPTH>                   inbox_;    // NETWORK -> CONTROL
+static SpscQueue<Outbound, OUTBOX_DEPTH>                 outbox_;   // CONTROL -> NETWORK
+static SpscQueue<SensorService::Reading, SAMPLE_DEPTH>   samples_;  // CONTROL -> NETWORK
+static SpscQueue<LearnEvent, LEARN_DEPTH>                learnEvents_;  // CONTROL -> NETWORK
+// Requests from a control-domain command for network-domain output
+static std::atomic<bool> statsDue_{ false };
+static std::atomic<bool> dumpDue_{ false };
+// Telemetry batching as last set, for the network domain: batch size in
+// the low byte, flush interval in ms above it
+static std::atomic<uint32_t> batching_{ 0 };
+
+// Receipt time of the command being dispatched, until it queues IR
+static bool     inCommand_   = false;
+static uint32_t commandAtUs_ = 0;
+
+// Power frames, learned on/off presses and AC states alike, coalesce:
+// only the newest state queued goes out
+static constexpr uint8_t GROUP_POWER = 1;
+
+// IrArbiter::Frame::tag bits: what the frame means once it is out
+enum FrameTag : uint8_t {
+  TAG_POWER_ON  = 1 << 0,
+  TAG_POWER_OFF = 1 << 1,
+  TAG_COMMAND   = 1 << 2,  // atUs is a command's receipt time
+};
+
+// Per domain, written by its own thread: when its last pass started and
+// when it asked to run next
+static uint32_t passAtUs_[DOMAIN_COUNT] = {};
+static uint32_t dueAtUs_[DOMAIN_COUNT]  = {};
+static bool     passed_[DOMAIN_COUNT]   = {};
+
+static WakeFn wake_ = nullptr;
+static void wake(Domain domain) {
+  if (wake_) wake_(domain);
+}
+
+// Button edges, filled by the GPIO interrupt
+static hal::EdgeQueue buttonEdges_;
+static void onGesture(Button::Gesture gesture);
+static Button button_(DEBOUNCE_MS, LONG_PRESS_MS, DOUBLE_PRESS_MS, onGesture);
+
+// Learn mode runs a session over these slots unless one was named
+static const char* const LEARN_SLOTS[] = { SLOT_ON, SLOT_OFF, SLOT_SET };
+static LearnSession learn_(LEARN_GAP_MS);
+
+static void learnMode();
+static void sampleSensor();
+static void autoControlMode();
+static void applyMode();
+static void serviceWifi();
+static void serviceMqtt();
+static void pollButton();
+static void serviceTelemetry();
+static void serviceLog();
+static void serviceRelay();
+static void serviceInbox();
+static void publishMetrics();
+static void serviceIr();
+static bool loadCode(const char* slot, IrCode& code);
+static void onIrDone(const IrArbiter::Frame& f, IrArbiter::Outcome outcome);
+static void sendPower(bool on, IrArbiter::Priority priority);
+static void startLearning(const char* const* slots, uint8_t count);
+static void learnEvent(LearnEvent::Kind kind);
+static void publishLearnEvent(const LearnEvent& e);
+static void logControlStats();
+static void logNetworkStats();
+static void onMqttConnected();
+static bool updateSettings(const char* text, size_t len);
+
+// ======================= Settings ===========================
+static void applyThermostat() { thermostat_.configure(thermoCfg_); }
+static void applySamplePeriod() {
+  sensors_->setPeriodMs(samplePeriodMs_);
+  sensors_->setStaleMs(SENSOR_STALE_PERIODS * samplePeriodMs_);
+}
+
+static void applyDebounce() { button_.setDebounceMs(debounceMs_); }
+
+static void applyBatching() { batching_ = (batchFlushMs_ << 8) | batchSize_; }
+
+static bool thresholdsValid() { return thermoCfg_.offBelowC < thermoCfg_.onAboveC; }
+
+// A PID window must fit a minimum on-time and a minimum off-time
+static bool windowValid() {
+  return thermoCfg_.windowMs >= thermoCfg_.minOnMs + thermoCfg_.minOffMs;
+}
+
+static bool checkSettings() { return thresholdsValid() && windowValid(); }
+
+static constexpr uint32_t HOUR_MS = 60 * 60 * 1000UL;
+
+static const Settings::Entry SETTING_LIST[] = {
+  // key            type                     value                  min      max                    names                   count                   apply
+  { "law",          Settings::Type::ENUM,  &thermoCfg_.law,        0,       0,                     Thermostat::LAW_NAMES,  Thermostat::LAW_COUNT,  applyThermostat },
+  { "temp_high",    Settings::Type::FLOAT, &thermoCfg_.onAboveC,   10,      45,                    nullptr,                0,                      applyThermostat },
+  { "temp_low",     Settings::Type::FLOAT, &thermoCfg_.offBelowC,  10,      45,                    nullptr,                0,                      applyThermostat },
+  { "setpoint",     Settings::Type::FLOAT, &thermoCfg_.setpointC,  SETPOINT_MIN_C, SETPOINT_MAX_C, nullptr,                0,                      applyThermostat },
+  { "band",         Settings::Type::FLOAT, &thermoCfg_.bandC,      0.1f,    5,                     nullptr,                0,                      applyThermostat },
+  { "min_on_ms",    Settings::Type::UINT,  &thermoCfg_.minOnMs,    0,       HOUR_MS,               nullptr,                0,                      applyThermostat },
+  { "min_off_ms",   Settings::Type::UINT,  &thermoCfg_.minOffMs,   0,       HOUR_MS,               nullptr,                0,                      applyThermostat },
+  { "kp",           Settings::Type::FLOAT, &thermoCfg_.kp,         0,       10,                    nullptr,                0,                      applyThermostat },
+  { "ki",           Settings::Type::FLOAT, &thermoCfg_.ki,         0,       0.1f,                  nullptr,                0,                      applyThermostat },
+  { "kd",           Settings::Type::FLOAT, &thermoCfg_.kd,         0,       10000,                 nullptr,                0,                      applyThermostat },
+  { "window_ms",    Settings::Type::UINT,  &thermoCfg_.windowMs,   60000,   4 * HOUR_MS,           nullptr,                0,                      applyThermostat },
+  { "lead_ms",      Settings::Type::UINT,  &thermoCfg_.leadMs,     0,       HOUR_MS,               nullptr,                0,                      applyThermostat },
+  { "sample_ms",    Settings::Type::UINT,  &samplePeriodMs_,       2000,    600000,                nullptr,                0,                      applySamplePeriod },
+  { "debounce_ms",  Settings::Type::UINT,  &debounceMs_,           5,       1000,                  nullptr,                0,                      applyDebounce   },
+  { "ac_protocol",  Settings::Type::UINT,  &acProtocol_,           0,       AC_PROTOCOL_MAX,       nullptr,                0,                      nullptr         },
+  { "ac_model",     Settings::Type::UINT,  &acModel_,              0,       AC_MODEL_MAX,          nullptr,                0,                      nullptr         },
+  { "ac_mode",      Settings::Type::ENUM,  &acState_.mode,         0,       0,                     AcState::MODE_NAMES,    AcState::MODE_COUNT,    nullptr         },
+  { "ac_temp",      Settings::Type::FLOAT, &acState_.tempC,        AcState::MIN_C, AcState::MAX_C, nullptr,                0,                      nullptr         },
+  { "ac_fan",       Settings::Type::ENUM,  &acState_.fan,          0,       0,                     AcState::FAN_NAMES,     AcState::FAN_COUNT,     nullptr         },
+  { "ac_swing",     Settings::Type::ENUM,  &acState_.swing,        0,       0,                     AcState::SWING_NAMES,   AcState::SWING_COUNT,   nullptr         },
+  { "learn_count",  Settings::Type::UINT,  &learnCaptures_,        1,       LearnSession::MAX_REQUIRED, nullptr,           0,                      nullptr         },
+  { "learn_ms",     Settings::Type::UINT,  &learnStepMs_,          5000,    600000,                nullptr,                0,                      nullptr         },
+  { "batch",        Settings::Type::UINT,  &batchSize_,            0,       Telemetry::MAX_BATCH_SIZE, nullptr,            0,                      applyBatching   },
+  { "batch_ms",     Settings::Type::UINT,  &batchFlushMs_,         1000,    HOUR_MS,               nullptr,                0,                      applyBatching   },
+};
+static_assert(sizeof(Thermostat::Law) == sizeof(uint8_t), "law is stored as an enum index");
+static_assert(sizeof(AcState::Mode) == sizeof(uint8_t) && sizeof(AcState::Fan) == sizeof(uint8_t) &&
+                  sizeof(AcState::Swing) == sizeof(uint8_t),
+              "AC settings are stored as enum indices");
+
+static Settings settings_(SETTING_LIST, sizeof(SETTING_LIST) / sizeof(SETTING_LIST[0]), checkSettings);
+
+// ======================= Command Handlers ===================
+// Handlers run in the control domain, on the inbox's copy of the message.
+static bool cmdOn(cmd::Arg) {
+  LOG_INFO("Received ON command.");
+  sendPower(true, IrArbiter::Priority::MANUAL);
+  return true;
+}
+
+static bool cmdOff(cmd::Arg) {
+  LOG_INFO("Received OFF command.");
+  sendPower(false, IrArbiter::Priority::MANUAL);
+  return true;
+}
+
+// set                  the learned "set" press, or without learned codes
+//                      the current AC state
+// set <token> ...      changes the AC state and sends it as one frame,
+//                      e.g. "set 24 cool auto-fan". Tokens, any order:
+//   <C>                          setpoint
+//   auto|cool|heat|dry|fan       mode
+//   auto|low|medium|high-fan     fan speed
+//   swing | no-swing             vertical swing
+//   on | off                     power, on unless given
+// The state is written through the ac_* settings, so it is validated,
+// persisted and echoed like them.
+static bool cmdSet(cmd::Arg arg) {
+  LOG_INFO("Received SET command.");
+  if (arg.empty() && acProtocol_ == 0) {
+    sendCode(SLOT_SET);
+    return true;
+  }
+  if (acProtocol_ == 0) {
+    LOG_WARN("No AC protocol configured; set ac_protocol first");
+    return false;
+  }
+
+  static const char FAN_SUFFIX[] = "-fan";
+  constexpr uint8_t FAN_SUFFIX_LEN = sizeof(FAN_SUFFIX) - 1;
+  char   text[CONFIG_TEXT_MAX];
+  size_t len = 0;
+  bool   on  = true;
+  for (uint8_t i = 0; i < arg.len;) {
+    while (i < arg.len && arg.data[i] == ' ') i++;
+    uint8_t end = i;
+    while (end < arg.len && arg.data[end] != ' ') end++;
+    cmd::Arg t = { arg.data + i, static_cast<uint8_t>(end - i) };
+    i = end;
+    if (t.empty()) continue;
+
+    int n;
+    if (t.equals("on") || t.equals("off")) {
+      on = t.equals("on");
+      continue;
+    } else if ((t.data[0] >= '0' && t.data[0] <= '9') || t.data[0] == '.') {
+      n = snprintf(text + len, sizeof(text) - len, "ac_temp=%.*s;", t.len, t.data);
+    } else if (t.equals("swing") || t.equals("no-swing")) {
+      n = snprintf(text + len, sizeof(text) - len, "ac_swing=%s;", t.equals("swing") ? "on" : "off");
+    } else if (t.len > FAN_SUFFIX_LEN &&
+               memcmp(t.data + t.len - FAN_SUFFIX_LEN, FAN_SUFFIX, FAN_SUFFIX_LEN) == 0) {
+      n = snprintf(text + len, sizeof(text) - len, "ac_fan=%.*s;", t.len - FAN_SUFFIX_LEN, t.data);
+    } else {
+      n = snprintf(text + len, sizeof(text) - len, "ac_mode=%.*s;", t.len, t.data);
+    }
+    if (n < 0 || static_cast<size_t>(n) >= sizeof(text) - len) return false;
+    len += static_cast<size_t>(n);
+  }
+  if (len && !updateSettings(text, len)) return false;
+
+  sendPower(on, IrArbiter::Priority::MANUAL);
+  return true;
+}
+
+static bool cmdAuto(cmd::Arg) {
+  setMode(true);
+  LOG_INFO("Switched to AUTO MODE from MQTT.");
+  return true;
+}
+
+// A slot name the code store takes and that is not the settings record
+static bool slotName(cmd::Arg arg, char (&name)[LearnSession::MAX_SLOT + 1]) {
+  if (arg.empty() || arg.len > LearnSession::MAX_SLOT) return false;
+  for (uint8_t i = 0; i < arg.len; i++) {
+    const char c = arg.data[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-')) return false;
+  }
+  memcpy(name, arg.data, arg.len);
+  name[arg.len] = '\0';
+  return strcmp(name, CONFIG_RECORD) != 0;
+}
+
+// learn          learns the on, off and set codes in turn
+// learn=<slot>   learns one named slot, e.g. learn=swing; [a-z0-9_-], up
+//                to 15 characters
+static bool cmdLearn(cmd::Arg arg) {
+  if (!arg.empty()) {
+    char slot[LearnSession::MAX_SLOT + 1];
+    if (!slotName(arg, slot)) return false;
+    const char* const slots[] = { slot };
+    startLearning(slots, 1);
+  }
+  setMode(false);
+  LOG_INFO("Switched to LEARN MODE from MQTT.");
+  return true;
+}
+
+// send=<slot>    sends a learned code as it is; on and off do not change
+//                what the thermostat believes
+static bool cmdSend(cmd::Arg arg) {
+  char slot[LearnSession::MAX_SLOT + 1];
+  if (!slotName(arg, slot)) return false;
+  sendCode(slot);
+  return true;
+}
+
+// mode=auto | mode=learn
+static bool cmdMode(cmd::Arg arg) {
+  if (arg.equals("auto")) return cmdAuto(arg);
+  if (arg.equals("learn")) return cmdLearn(cmd::Arg());
+  return false;
+}
+
+// Shorthands for the "law" and "setpoint" settings, persisted like them
+static bool setOne(const char* key, cmd::Arg arg) {
+  char text[Settings::MAX_KEY + 1 + UINT8_MAX + 1];
+  int n = snprintf(text, sizeof(text), "%s=%.*s", key, arg.len, arg.data);
+  return n > 0 && static_cast<size_t>(n) < sizeof(text) && updateSettings(text, n);
+}
+
+// control=hysteresis | control=pid | control=predictive
+static bool cmdControl(cmd::Arg arg) {
+  return setOne("law", arg);
+}
+
+// setpoint=<C>, used by the pid and predictive laws
+static bool cmdSetpoint(cmd::Arg arg) {
+  return setOne("setpoint", arg);
+}
+
+// Each domain logs its own statistics
+static bool cmdStats(cmd::Arg) {
+  logControlStats();
+  statsDue_ = true;
+  wake(Domain::NETWORK);
+  return true;
+}
+
+// log=<level> | log=<sink>:<level> | log=dump
+// sinks: serial, mqtt, ram; levels: debug, info, warn, error, none
+static bool cmdLog(cmd::Arg arg) {
+  if (arg.equals("dump")) {
+    dumpDue_ = true;  // the history belongs to the network domain, which drains the log
+    wake(Domain::NETWORK);
+    return true;
+  }
+
+  static const char* const SINK_NAMES[logger::SINK_COUNT] = { "serial", "mqtt", "ram" };
+  const char* colon = static_cast<const char*>(memchr(arg.data, ':', arg.len));
+  uint8_t level;
+  if (colon == nullptr) {
+    if (!logger::parseLevel(arg.data, arg.len, level)) return false;
+    for (uint8_t s = 0; s < logger::SINK_COUNT; s++) logger::setLevel(static_cast<logger::Sink>(s), level);
+    LOG_INFO("Log level set to %s", logger::levelName(level));
+    return true;
+  }
+
+  cmd::Arg sink  = { arg.data, static_cast<uint8_t>(colon - arg.data) };
+  const char* lv = colon + 1;
+  if (!logger::parseLevel(lv, arg.len - sink.len - 1, level)) return false;
+  for (uint8_t s = 0; s < logger::SINK_COUNT; s++) {
+    if (!sink.equals(SINK_NAMES[s])) continue;
+    logger::setLevel(static_cast<logger::Sink>(s), level);
+    LOG_INFO("Log level of %s set to %s", SINK_NAMES[s], logger::levelName(level));
+    return true;
+  }
+  return false;
+}
+
+static constexpr cmd::Command COMMAND_LIST[] = {
+  { "on",       cmdOn       },
+  { "off",      cmdOff      },
+  { "set",      cmdSet      },
+  { "auto",     cmdAuto     },
+  { "learn",    cmdLearn    },
+  { "send",     cmdSend     },
+  { "mode",     cmdMode     },
+  { "control",  cmdControl  },
+  { "setpoint", cmdSetpoint },
+  { "stats",    cmdStats    },
+  { "log",      cmdLog      },
+};
+// 32 slots no longer hash this list without a collision
+static constexpr auto COMMANDS = cmd::makeTable<64>(COMMAND_LIST);
+static_assert(COMMANDS.perfect, "command hash collision: grow the slot table");
+
+// ======================= Settings I/O =======================
+// Queued for the network domain, which drops it while offline
+static void publishSettings() {
+  Outbound out;
+  out.len = static_cast<uint16_t>(settings_.toJson(out.json, sizeof(out.json)));
+  if (out.len == 0) return;
+  if (outbox_.push(out)) wake(Domain::NETWORK);
+}
+
+// The logger copies strings but knows no %.*s, so keys are cut out first
+static const char* keyText(const char* key, size_t len, char (&buf)[Settings::MAX_KEY + 1]) {
+  if (len > Settings::MAX_KEY) len = Settings::MAX_KEY;
+  memcpy(buf, key, len);
+  buf[len] = '\0';
+  return buf;
+}
+
+static void saveSettings() {
+  char text[CONFIG_TEXT_MAX];
+  size_t n = settings_.toText(text, sizeof(text));
+  uint16_t len;
+  const uint8_t* stored = store_->get(CONFIG_RECORD, len);
+  if (n && stored && len == n && memcmp(stored, text, n) == 0) return;  // spare the flash
+  const uint32_t t0 = metrics::now();
+  const bool saved  = n && store_->put(CONFIG_RECORD, reinterpret_cast<const uint8_t*>(text), n);
+  metrics::record(metrics::STORE_WRITE, metrics::elapsedUs(t0));
+  if (!saved) LOG_ERROR("Failed to save settings");
+}
+
+// Restores persisted values over the defaults. Keys this firmware does not
+// know and values it refuses keep their defaults; the rest still load.
+static void loadSettings() {
+  uint16_t len;
+  const uint8_t* data = store_->get(CONFIG_RECORD, len);
+  if (data != nullptr) {
+    const char* bad;
+    size_t badLen;
+    const Settings::Result r = settings_.load(reinterpret_cast<const char*>(data), len, bad, badLen);
+    if (r == Settings::Result::REJECTED) {
+      if (!thresholdsValid()) {
+        LOG_WARN("Stored temp_low/temp_high inconsistent; using defaults");
+        thermoCfg_.onAboveC  = TEMP_HIGH;
+        thermoCfg_.offBelowC = TEMP_LOW;
+      }
+      if (!windowValid()) {
+        LOG_WARN("Stored window_ms shorter than min_on_ms + min_off_ms; using defaults");
+        thermoCfg_.minOnMs  = MIN_ON_MS;
+        thermoCfg_.minOffMs = MIN_OFF_MS;
+        thermoCfg_.windowMs = PID_WINDOW_MS;
+      }
+    } else if (r != Settings::Result::OK) {
+      char key[Settings::MAX_KEY + 1];
+      LOG_WARN("Stored setting '%s' ignored", keyText(bad, badLen, key));
+    }
+  }
+  settings_.applyAll();
+}
+
+// Applies, persists and echoes a key=value;... write
+static bool updateSettings(const char* text, size_t len) {
+  static const char* const REASONS[] = { "ok", "unknown key", "bad value", "rejected" };
+  const char* bad;
+  size_t badLen;
+  Settings::Result r = settings_.setAll(text, len, bad, badLen);
+  if (r != Settings::Result::OK) {
+    char key[Settings::MAX_KEY + 1];
+    LOG_WARN("Setting '%s': %s", keyText(bad, badLen, key), REASONS[static_cast<uint8_t>(r)]);
+  }
+  // Earlier pairs of a failed write did apply, so save and echo either way
+  saveSettings();
+  publishSettings();
+  if (r == Settings::Result::OK) LOG_INFO("Settings updated");
+  return r == Settings::Result::OK;
+}
+
+// ======================= MQTT Handlers ======================
+static void queueInbound(const Inbound& in) {
+  if (inbox_.push(in)) {
+    wake(Domain::CONTROL);
+  } else {
+    LOG_WARN("Command queue full; MQTT message dropped.");
+  }
+}
+
+// Network domain: classifies the message and hands a copy to the control domain
+static void mqttCallback(char* topic, uint8_t* payload, unsigned int len) {
+  LOG_DEBUG("MQTT Topic: %s", topic);
+
+  Inbound in;
+  if (strcmp(topic, topics_.configSet) == 0) {
+    in.kind = Inbound::CONFIG;
+  } else if (topics_.isCommand(topic)) {  // device, zone and fleet commands share one table
+    in.kind = Inbound::COMMAND;
+  } else {
+    return;
+  }
+  if (len > sizeof(in.text)) {
+    LOG_WARN("MQTT message of %u bytes dropped: too long.", len);
+    return;
+  }
+  in.len  = static_cast<uint16_t>(len);
+  in.atUs = board_->clock.micros();
+  memcpy(in.text, payload, len);
+  queueInbound(in);
+}
+
+// The settings are the control domain's, so they are asked for like a remote would
+static void onMqttConnected() {
+  LOG_INFO("MQTT connected as %s, subscribed to %s.", topics_.id, topics_.cmd);
+  Inbound get;
+  get.kind = Inbound::CONFIG;
+  get.len  = 0;
+  get.atUs = board_->clock.micros();
+  queueInbound(get);
+}
+
+// Control domain. An empty settings write (or "get") only asks for the
+// current settings.
+static void serviceInbox() {
+  Inbound in;
+  while (inbox_.pop(in)) {
+    if (in.kind == Inbound::CONFIG) {
+      cmd::Arg text = { in.text, static_cast<uint8_t>(in.len) };
+      if (in.len == 0 || (in.len <= UINT8_MAX && text.equals("get"))) {
+        publishSettings();
+      } else {
+        updateSettings(in.text, in.len);
+      }
+      continue;
+    }
+
+    inCommand_   = true;
+    commandAtUs_ = in.atUs;
+    switch (COMMANDS.dispatch(in.text, in.len)) {
+      case cmd::Result::OK:
+        break;
+      case cmd::Result::BAD_ARG:
+        LOG_WARN("Invalid MQTT command argument.");
+        break;
+      case cmd::Result::UNKNOWN:
+        LOG_WARN("Unknown MQTT command received (%u bytes).", in.len);
+        break;
+    }
+    inCommand_ = false;
+  }
+}
+
+// Network domain: publishes what the control domain queued
+static void serviceRelay() {
+  SensorService::Reading r;
+  while (samples_.pop(r)) telemetry_.record(r.atMs, r.tempC, r.humidity);
+
+  LearnEvent e;
+  while (learnEvents_.pop(e)) {
+    if (link_->connected()) publishLearnEvent(e);
+  }
+
+  Outbound out;
+  while (outbox_.pop(out)) {
+    if (link_->connected()) {
+      board_->mqtt.publish(topics_.config, reinterpret_cast<const uint8_t*>(out.json), out.len);
+    }
+  }
+
+  if (dumpDue_.exchange(false)) {
+    const char* line;
+    for (uint8_t i = 0; logger::history(i, line); i++) board_->mqtt.publish(topics_.log, line);
+  }
+  if (statsDue_.exchange(false)) logNetworkStats();
+}
+
+static void publishLearnEvent(const LearnEvent& e) {
+  static const char* const KINDS[] = { "start", "capture", "mismatch", "saved",
+                                       "failed", "timeout", "done", "cancel" };
+  char json[128];
+  int n = snprintf(json, sizeof(json),
+                   "{\"event\":\"%s\",\"slot\":\"%s\",\"step\":%u,\"steps\":%u,\"n\":%u,\"of\":%u}",
+                   KINDS[e.kind], e.slot, e.step, e.steps, e.captures, e.required);
+  if (n > 0 && static_cast<size_t>(n) < sizeof(json)) {
+    board_->mqtt.publish(topics_.learn, reinterpret_cast<const uint8_t*>(json), n);
+  }
+}
+
+// Network domain; a window that cannot be published stays open
+static void publishMetrics() {
+  if (!link_->connected()) return;
+  char json[metrics::JSON_MAX];
+  size_t n = metrics::toJson(board_->clock.millis(), json, sizeof(json));
+  if (n) board_->mqtt.publish(topics_.metrics, reinterpret_cast<const uint8_t*>(json), n);
+}
+
+// ======================= Setup ==============================
+void begin(const hal::Board& board) {
+  board_ = &board;
+  metrics::begin(board.clock);
+
+  uint8_t mac[6];
+  board.macAddress(mac);
+  topics_.build(board.deviceId, mac, board.zone);
+
+  static MqttLink    link(board.mqtt, board.clock, topics_.id, board.random);
+  static RecordStore store(board.storage);
+  // The sensors pause capture through the arbiter like everyone else
+  static IrArbiter   ir(board.irTx, board.irRx, board.clock, loadCode, onIrDone, IR_GUARD_MS);
+  static SensorService sensors(board.clock, ir, samplePeriodMs_,
+                               SENSOR_STALE_PERIODS * samplePeriodMs_);
+  link_    = &link;
+  store_   = &store;
+  ir_      = &ir;
+  sensors_ = &sensors;
+
+  logger::begin([]() -> uint32_t { return board_->clock.millis(); });
+  logger::attach(logger::SINK_MQTT, [](const char* line) {
+    return link_->connected() && board_->mqtt.publish(topics_.log, line);
+  });
+
+  board.mqtt.setCallback(mqttCallback);
+  link.setBackoff(MQTT_BACKOFF_MIN_MS, MQTT_BACKOFF_MAX_MS);
+  link.onConnect(onMqttConnected);
+  link.subscribe(topics_.cmd);
+  link.subscribe(topics_.configSet);
+  link.subscribe(topics_.fleetCmd);
+  if (topics_.zoneCmd[0]) link.subscribe(topics_.zoneCmd);
+
+  if (store.begin()) {
+    LOG_INFO("Code store mounted: %u records, %lu/%lu bytes", store.count(), store.liveBytes(),
+             store.capacity());
+  } else {
+    LOG_ERROR("Code store unavailable");
+  }
+  ir.begin();
+  for (uint8_t i = 0; i < board.sensorCount; i++) {
+    if (!sensors.add(board.sensors[i].sensor, board.sensors[i].weight)) {
+      LOG_ERROR("Sensor %s not registered", board.sensors[i].sensor.name());
+    }
+  }
+  sensors.begin();
+  telemetry_.begin(topics_.status);
+  board.gpio.setMode(board.buttonPin, hal::Gpio::IN_PULLUP);
+  if (!board.gpio.watch(board.buttonPin, buttonEdges_)) {
+    LOG_WARN("No edge interrupt on the button pin; polling it");
+  }
+
+  // Registration order is run order within a pass: commands first
+  mqttTask = netSched_.addPeriodic("mqtt", serviceMqtt, MQTT_PERIOD_MS, MQTT_DEADLINE_US);
+  relayTask = netSched_.addEvent("relay", serviceRelay);
+  wifiTask = netSched_.addPeriodic("wifi", serviceWifi, WIFI_PERIOD_MS);
+  telemetryTask = netSched_.addPeriodic("telemetry", serviceTelemetry, TELEMETRY_PERIOD_MS);
+  logTask = netSched_.addPeriodic("log", serviceLog, LOG_PERIOD_MS);
+  metricsTask = netSched_.addPeriodic("metrics", publishMetrics, METRICS_PERIOD_MS);
+
+  inboxTask = ctrlSched_.addEvent("inbox", serviceInbox, INBOX_DEADLINE_US);
+  buttonTask = ctrlSched_.addPeriodic("button", pollButton, BUTTON_PERIOD_MS, BUTTON_DEADLINE_US);
+  modeTask = ctrlSched_.addEvent("mode", applyMode);
+  learnTask = ctrlSched_.addPeriodic("learn", learnMode, LEARN_PERIOD_MS, LEARN_DEADLINE_US);
+  sensorTask = ctrlSched_.addPeriodic("sensor", sampleSensor, SENSOR_POLL_MS, SENSOR_DEADLINE_US);
+  autoTask = ctrlSched_.addEvent("auto", autoControlMode, AUTO_DEADLINE_US);
+  irTask = ctrlSched_.addEvent("ir", serviceIr, IR_DEADLINE_US);
+  loadSettings();
+  applyMode();
+}
+
+void onWake(WakeFn fn) { wake_ = fn; }
+
+// Each domain notices its own incoming queues, so only its thread ever
+// touches its scheduler
+uint32_t loop(Domain domain) {
+  static const metrics::Stage JITTER[DOMAIN_COUNT] = { metrics::NET_JITTER, metrics::CONTROL_JITTER };
+  static const metrics::Stage GAP[DOMAIN_COUNT]    = { metrics::NET_GAP, metrics::CONTROL_GAP };
+  const uint8_t  d   = static_cast<uint8_t>(domain);
+  const uint32_t now = board_->clock.micros();
+  if (passed_[d]) {
+    const int32_t late = static_cast<int32_t>(now - dueAtUs_[d]);
+    metrics::record(JITTER[d], late > 0 ? static_cast<uint32_t>(late) : 0);
+    metrics::record(GAP[d], now - passAtUs_[d]);
+  }
+
+  Scheduler& sched = domain == Domain::NETWORK ? netSched_ : ctrlSched_;
+  if (domain == Domain::NETWORK) {
+    if (!samples_.empty() || !outbox_.empty() || !learnEvents_.empty() || statsDue_ || dumpDue_) {
+      sched.signal(relayTask);
+    }
+  } else if (!inbox_.empty()) {
+    sched.signal(inboxTask);
+  }
+  sched.run();
+
+  // Waits past an hour are not a wrap-safe due time, and nothing asks for one
+  uint32_t idleUs = sched.idleUs();
+  if (idleUs > 0x7FFFFFFFUL) idleUs = 0x7FFFFFFFUL;
+  passAtUs_[d] = now;
+  dueAtUs_[d]  = board_->clock.micros() + idleUs;
+  passed_[d]   = true;
+  return idleUs;
+}
+
+void loop() {
+  loop(Domain::NETWORK);
+  loop(Domain::CONTROL);
+}
+
+bool autoMode() { return mode_; }
+
+const RecordStore& codeStore() { return *store_; }
+const Scheduler&   scheduler(Domain domain) {
+  return domain == Domain::NETWORK ? netSched_ : ctrlSched_;
+}
+const Thermostat&  thermostat() { return thermostat_; }
+const Topics&      topics() { return topics_; }
+const SensorService& sensors() { return *sensors_; }
+
+// ======================= Tasks ==============================
+static void serviceWifi() {
+  board_->network.service(board_->clock.millis());
+}
+
+// Never blocks beyond one bounded connect attempt; control tasks keep
+// running while the broker is unreachable.
+static void serviceMqtt() {
+  uint32_t failures = link_->stats().failures;
+  const uint32_t t0 = metrics::now();
+  link_->service(board_->clock.millis(), board_->network.up());
+  metrics::record(metrics::MQTT_LOOP, metrics::elapsedUs(t0));
+
+  if (link_->stats().failures != failures) {
+    LOG_WARN("Failed MQTT connection. State: %d, retry in %lu ms", board_->mqtt.state(),
+             (unsigned long)link_->retryInMs(board_->clock.millis()));
+  }
+}
+
+static void serviceTelemetry() {
+  static uint32_t applied = 0;
+  const uint32_t batching = batching_;
+  if (batching != applied) {
+    telemetry_.setBatching(batching & 0xFF, batching >> 8);
+    applied = batching;
+  }
+  telemetry_.service(board_->clock.millis(), link_->connected());
+}
+
+static void serviceLog() {
+  logger::service();
+}
+
+// Buttons idle high (pull-up). Without edge interrupts the level read here
+// is all the button gets, which still works at this period.
+static void pollButton() {
+  const bool level = board_->gpio.read(board_->buttonPin);
+  button_.service(buttonEdges_, board_->clock.micros(), level);
+}
+
+static void onGesture(Button::Gesture gesture) {
+  switch (gesture) {
+    case Button::Gesture::SHORT:
+      setMode(!mode_);
+      LOG_INFO(mode_ ? "Switched to AUTO CONTROL Mode" : "Switched to LEARNING Mode");
+      break;
+    case Button::Gesture::LONG:
+      setMode(false);
+      LOG_INFO("Long press: switched to LEARNING Mode");
+      break;
+    case Button::Gesture::DOUBLE: {
+      const bool on = thermostat_.state() != Thermostat::State::ON;
+      LOG_INFO("Double press: turning AC %s", on ? "ON" : "OFF");
+      sendPower(on, IrArbiter::Priority::MANUAL);
+      break;
+    }
+  }
+}
+
+void setMode(bool autoMode) {
+  mode_ = autoMode;
+  ctrlSched_.signal(modeTask);
+}
+
+// Only one of the two modes is scheduled at a time. Learning also keeps
+// the sensor quiet, so it never pauses a capture, and is the only time the
+// receiver listens. Entering learn mode
+// starts the default session unless a slot was named; leaving it ends
+// whatever session is still open.
+static void applyMode() {
+  if (!mode_ && !learn_.active()) {
+    startLearning(LEARN_SLOTS, sizeof(LEARN_SLOTS) / sizeof(LEARN_SLOTS[0]));
+  } else if (mode_ && learn_.active()) {
+    learnEvent(LearnEvent::CANCEL);
+    learn_.cancel();
+    LOG_INFO("Learn session for '%s' cancelled", learn_.slot());
+  }
+  ctrlSched_.setEnabled(sensorTask, mode_);
+  ctrlSched_.setEnabled(autoTask, mode_);
+  ctrlSched_.setEnabled(learnTask, !mode_);
+  ir_->listen(!mode_);
+}
+
+static void logTaskStats(const Scheduler& sched) {
+  for (Scheduler::TaskId id = 0; id < sched.taskCount(); id++) {
+    const Scheduler::TaskStats* st = sched.stats(id);
+    unsigned long avg = st->runs ? (unsigned long)(st->totalUs / st->runs) : 0;
+    LOG_INFO("Task %s: runs=%lu avg=%luus max=%luus late=%luus miss=%lu",
+             sched.name(id), st->runs, avg, st->maxUs, st->maxLateUs, st->deadlineMisses);
+  }
+}
+
+static void logNetworkStats() {
+  logTaskStats(netSched_);
+
+  const MqttLink::Stats& ls = link_->stats();
+  LOG_INFO("MQTT link: attempts=%lu failures=%lu connects=%lu maxAttempt=%lums",
+           ls.attempts, ls.failures, ls.connects, ls.maxAttemptMs);
+
+  board_->network.logStats();
+
+  const Telemetry::Stats& ts = telemetry_.stats();
+  LOG_INFO("Telemetry: recorded=%lu published=%lu msgs=%lu bytes=%lu backlog=%lu max=%lu dropped=%lu spilled=%lu",
+           ts.recorded, ts.published, ts.messages, ts.bytes, telemetry_.backlog(), ts.maxBacklog,
+           ts.dropped, ts.spilled);
+
+  const logger::Stats gs = logger::stats();
+  LOG_INFO("Log: queued=%lu overflowed=%lu throttled=%lu", gs.queued, gs.overflowed, gs.mqttThrottled);
+  LOG_INFO("Queues: inbox dropped=%lu, outbox dropped=%lu, samples dropped=%lu", inbox_.overflows(),
+           outbox_.overflows(), samples_.overflows());
+}
+
+static void logControlStats() {
+  logTaskStats(ctrlSched_);
+
+  const RecordStore::Stats& cs = store_->stats();
+  LOG_INFO("Code store: codes=%u live=%lu/%lu writes=%lu erases=%lu compactions=%lu crcErrors=%lu",
+           store_->count(), store_->liveBytes(), store_->capacity(), cs.writes, cs.erases,
+           cs.compactions, cs.crcErrors);
+
+  const Thermostat::Stats& hs = thermostat_.stats();
+  LOG_INFO("Thermostat: law=%s state=%d evals=%lu on=%lu off=%lu held=%lu invalid=%lu",
+           Thermostat::lawName(thermostat_.config().law), (int)thermostat_.state(), hs.evaluations,
+           hs.turnOns, hs.turnOffs, hs.dwellHolds, hs.invalid);
+  LOG_INFO("Room model: fits=%lu tau=%.0fs duty=%.2f", hs.modelFits, thermostat_.timeConstantS(),
+           thermostat_.duty());
+
+  publishSettings();
+
+  const SensorService::Stats& ss = sensors_->stats();
+  LOG_INFO("Sensors: rounds=%lu estimates=%lu excluded=%lu temp=%.1fC stale=%d", ss.rounds,
+           ss.estimates, ss.excluded, sensors_->latest().tempC,
+           (int)sensors_->stale(board_->clock.millis()));
+  for (uint8_t i = 0; i < sensors_->sensorCount(); i++) {
+    const SensorService::SensorStats& st = sensors_->sensorStats(i);
+    LOG_INFO("Sensor %s: temp=%.1fC reads=%lu rejected=%lu outliers=%lu last=%luus max=%luus",
+             sensors_->sensorName(i), sensors_->sensorTempC(i), st.reads, st.rejected, st.outliers,
+             st.lastUs, st.maxUs);
+  }
+
+  const LearnSession::Stats& ls = learn_.stats();
+  LOG_INFO("Learn: sessions=%lu accepted=%lu mismatches=%lu ignored=%lu timeouts=%lu", ls.sessions,
+           ls.accepted, ls.mismatches, ls.ignored, ls.timeouts);
+
+  const IrArbiter::Stats& is = ir_->stats();
+  LOG_INFO("IR: queued=%lu sent=%lu failed=%lu overruns=%lu collisions=%lu rxOverruns=%lu depth=%u",
+           is.queued, is.sent, is.failed, is.overruns, is.collisions, is.rxOverruns, is.maxDepth);
+
+  const Button::Stats& bs = button_.stats();
+  LOG_INFO("Button: edges=%lu bounces=%lu presses=%lu gestures=%lu overflows=%lu", bs.edges,
+           bs.bounces, bs.presses, bs.gestures, buttonEdges_.overflows());
+}
+
+// ======================= Learn Mode =========================
+// Queued for the network domain as the session stands now
+static void learnEvent(LearnEvent::Kind kind) {
+  LearnEvent e;
+  e.kind     = kind;
+  e.step     = static_cast<uint8_t>(learn_.step() + 1);
+  e.steps    = learn_.steps();
+  e.captures = learn_.captures();
+  e.required = learn_.required();
+  strcpy(e.slot, learn_.slot());
+  if (learnEvents_.push(e)) wake(Domain::NETWORK);
+}
+
+static void startLearning(const char* const* slots, uint8_t count) {
+  if (!learn_.start(slots, count, static_cast<uint8_t>(learnCaptures_), learnStepMs_,
+                    board_->clock.millis())) {
+    return;
+  }
+  learnEvent(LearnEvent::START);
+  LOG_INFO("Learning %u code(s), %u agreeing presses each; press '%s'", count, learn_.required(),
+           learn_.slot());
+}
+
+// Any way out of the session returns to auto mode
+static void learnMode() {
+  const uint32_t now = board_->clock.millis();
+  if (learn_.expired(now)) {
+    learnEvent(LearnEvent::TIMEOUT);
+    LOG_WARN("No code learned for '%s' in time; back to AUTO", learn_.slot());
+    setMode(true);
+    return;
+  }
+
+  IrCode code = {};
+  code.raw    = rawTimings_;
+  code.rawCap = ircode::MAX_RAW;
+  if (!ir_->receive(code)) return;
+
+  switch (learn_.offer(code, now)) {
+    case LearnSession::Result::IGNORED:
+      return;
+    case LearnSession::Result::CAPTURED:
+      learnEvent(LearnEvent::CAPTURE);
+      LOG_DEBUG("Capture %u/%u for '%s'", learn_.captures(), learn_.required(), learn_.slot());
+      return;
+    case LearnSession::Result::MISMATCH:
+      learnEvent(LearnEvent::MISMATCH);
+      LOG_INFO("Capture for '%s' differs from the previous; counting again", learn_.slot());
+      return;
+    case LearnSession::Result::ACCEPTED:
+      break;
+  }
+
+  if (!saveCode(learn_.slot(), learn_.code())) {
+    learnEvent(LearnEvent::FAILED);
+    learn_.cancel();
+    setMode(true);
+    return;
+  }
+  learnEvent(LearnEvent::SAVED);
+  if (learn_.next(now)) {
+    LOG_INFO("Press '%s'", learn_.slot());
+    return;
+  }
+  learnEvent(LearnEvent::DONE);
+  LOG_INFO("All signals saved. Switching to AUTO.");
+  setMode(true);
+}
+
+// =================== Auto Control Mode ======================
+// Polled by the scheduler; every sample_ms a sensor round completes and
+// the control decision runs on the fused, filtered estimate
+static void sampleSensor() {
+  const uint32_t now = board_->clock.millis();
+  if (!sensors_->service(now)) return;
+  if (!sensors_->stale(now)) {
+    // Recorded by the network domain, published by the telemetry task and
+    // replayed after outages
+    if (samples_.push(sensors_->latest())) wake(Domain::NETWORK);
+  }
+  ctrlSched_.signal(autoTask);
+}
+
+static void autoControlMode() {
+  static bool wasStale = false;
+  const uint32_t now = board_->clock.millis();
+  const bool stale   = sensors_->stale(now);
+  if (stale != wasStale) {
+    if (stale) LOG_WARN("Sensor reading stale; holding AC state");
+    else LOG_INFO("Sensor reading valid again");
+    wasStale = stale;
+  }
+  if (stale) {
+    thermostat_.update(now, NAN);  // counted as invalid; the state holds
+    return;
+  }
+  const float temp = sensors_->latest().tempC;
+  LOG_DEBUG("Temp: %.1fC, Hum: %.1f%%", temp, sensors_->latest().humidity);
+
+  // IR goes out only when the believed AC state changes; a frame that
+  // never leaves resets the thermostat (onIrDone())
+  metrics::Span span(metrics::AUTO_CONTROL);
+  switch (thermostat_.update(now, temp)) {
+    case Thermostat::Action::NONE:
+      return;
+    case Thermostat::Action::TURN_ON:
+      LOG_INFO("Temp %.1fC. Turning AC ON (%s).", temp, Thermostat::lawName(thermostat_.config().law));
+      sendPower(true, IrArbiter::Priority::AUTO);
+      break;
+    case Thermostat::Action::TURN_OFF:
+      LOG_INFO("Temp %.1fC. Turning AC OFF (%s).", temp, Thermostat::lawName(thermostat_.config().law));
+      sendPower(false, IrArbiter::Priority::AUTO);
+      break;
+  }
+}
+
+// ======================= Code Store I/O =====================
+bool saveCode(const char* slot, const IrCode& code) {
+  uint8_t buf[RecordStore::MAX_VALUE];
+  uint16_t len = ircode::encode(code, buf, sizeof(buf));
+  if (len == 0) {
+    LOG_ERROR("IR code for '%s' does not fit in %u bytes", slot, sizeof(buf));
+    return false;
+  }
+  const uint32_t t0 = metrics::now();
+  const bool saved  = store_->put(slot, buf, len);
+  metrics::record(metrics::STORE_WRITE, metrics::elapsedUs(t0));
+  if (!saved) {
+    LOG_ERROR("Failed to save IR code '%s'", slot);
+    return false;
+  }
+
+  switch (code.format) {
+    case ircode::FORMAT_VALUE:
+      LOG_INFO("Saved IR 0x%08X (%d bits, protocol %d) as '%s'", (uint32_t)code.value, code.bits,
+               code.protocol, slot);
+      break;
+    case ircode::FORMAT_STATE:
+      LOG_INFO("Saved IR state (%d bits, protocol %d) as '%s'", code.bits, code.protocol, slot);
+      break;
+    default:
+      LOG_INFO("Saved raw IR (%u timings in %u bytes) as '%s'", code.rawLen, len, slot);
+      break;
+  }
+  return true;
+}
+
+// ======================= IR Transmit ========================
+// Served from the store's RAM cache when the frame's turn comes; never
+// touches flash
+static bool loadCode(const char* slot, IrCode& code) {
+  uint16_t len;
+  const uint8_t* data = store_->get(slot, len);
+  code.raw    = rawTimings_;
+  code.rawCap = ircode::MAX_RAW;
+  if (data == nullptr || !ircode::decode(data, len, code)) {
+    LOG_WARN("No IR code learned for '%s'", slot);
+    return false;
+  }
+  return true;
+}
+
+// The first frame a command queues closes its command-to-IR span
+static void queueFrame(IrArbiter::Frame& f) {
+  if (inCommand_) {
+    f.tag     |= TAG_COMMAND;
+    f.atUs     = commandAtUs_;
+    inCommand_ = false;
+  } else {
+    f.atUs = board_->clock.micros();
+  }
+  if (f.tag & (TAG_POWER_ON | TAG_POWER_OFF)) f.group = GROUP_POWER;
+  ir_->queue(f);
+  ctrlSched_.signal(irTask);
+}
+
+static void queueCode(const char* slot, IrArbiter::Priority priority, uint8_t tag) {
+  IrArbiter::Frame f = {};
+  f.kind     = IrArbiter::Frame::CODE;
+  f.priority = priority;
+  f.tag      = tag;
+  strncpy(f.slot, slot, sizeof(f.slot) - 1);
+  queueFrame(f);
+}
+
+// The whole AC state in one frame; power comes from the caller, the rest
+// from the ac_* settings as they are now
+static void queueAc(bool power, IrArbiter::Priority priority, uint8_t tag) {
+  IrArbiter::Frame f = {};
+  f.kind        = IrArbiter::Frame::AC;
+  f.priority    = priority;
+  f.tag         = tag;
+  f.ac          = acState_;
+  f.ac.protocol = static_cast<int16_t>(acProtocol_);
+  f.ac.model    = static_cast<uint16_t>(acModel_);
+  f.ac.power    = power;
+  queueFrame(f);
+}
+
+bool sendCode(const char* slot) {
+  uint16_t len;
+  if (store_->get(slot, len) == nullptr) {
+    LOG_WARN("No IR code learned for '%s'", slot);
+    return false;
+  }
+  queueCode(slot, IrArbiter::Priority::MANUAL, 0);
+  return true;
+}
+
+// One frame with the AC model, otherwise the learned press. What the
+// thermostat believes follows once the frame is out (onIrDone()).
+static void sendPower(bool on, IrArbiter::Priority priority) {
+  const uint8_t tag = on ? TAG_POWER_ON : TAG_POWER_OFF;
+  if (acProtocol_ != 0) {
+    queueAc(on, priority, tag);
+  } else {
+    queueCode(on ? SLOT_ON : SLOT_OFF, priority, tag);
+  }
+}
+
+// A manual power frame becomes the thermostat's belief once it is out. An
+// automatic one already is. Losing either makes the thermostat resend on
+// the next reading: the lost frame may have superseded the automatic one
+// the belief came from, so what the AC last received is unknown. A
+// superseded frame changes nothing: the newer one of its group has its
+// own outcome.
+static void onIrDone(const IrArbiter::Frame& f, IrArbiter::Outcome outcome) {
+  const bool power = f.tag & (TAG_POWER_ON | TAG_POWER_OFF);
+  if (outcome == IrArbiter::Outcome::SUPERSEDED) {
+    LOG_DEBUG("IR power frame superseded");
+    return;
+  }
+  if (outcome != IrArbiter::Outcome::SENT) {
+    if (outcome == IrArbiter::Outcome::DROPPED) {
+      LOG_WARN("IR queue full; frame dropped");
+    } else if (f.kind == IrArbiter::Frame::AC) {
+      LOG_WARN("AC protocol %d is not supported for sending", f.ac.protocol);
+    } else {
+      LOG_WARN("IR code '%s' not sent", f.slot);
+    }
+    if (f.group == GROUP_POWER) thermostat_.reset();
+    return;
+  }
+
+  if (f.tag & TAG_COMMAND) metrics::record(metrics::COMMAND_TO_IR, board_->clock.micros() - f.atUs);
+  if (power && f.priority == IrArbiter::Priority::MANUAL) {
+    thermostat_.assume(f.tag & TAG_POWER_ON ? Thermostat::State::ON : Thermostat::State::OFF,
+                       board_->clock.millis());
+  }
+
+  if (f.kind == IrArbiter::Frame::AC) {
+    LOG_DEBUG("Sent AC state: %s %s %.1fC fan %s swing %s", f.ac.power ? "on" : "off",
+              AcState::MODE_NAMES[static_cast<uint8_t>(f.ac.mode)], f.ac.tempC,
+              AcState::FAN_NAMES[static_cast<uint8_t>(f.ac.fan)],
+              AcState::SWING_NAMES[static_cast<uint8_t>(f.ac.swing)]);
+  } else {
+    LOG_DEBUG("Sent IR code '%s'", f.slot);
+  }
+}
+
+// One frame per run, so commands and the button are served between the
+// frames of a burst
+static void serviceIr() {
+  if (ir_->service()) ctrlSched_.signal(irTask);
+}
+
+}  // namespace app
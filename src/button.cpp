@@ -0,0 +1,73 @@
+/**
+ * @file button.cpp
+ * @brief Button debounce and gesture state machine
+ */
+
+#include "button.h"
+
+void Button::service(hal::EdgeQueue& edges, uint32_t nowUs, bool level) {
+  bool drained = false;
+  hal::Edge e;
+  while (edges.pop(e)) {
+    stats_.edges++;
+    edge(e.level, e.atUs);
+    drained = true;
+  }
+  // The level was read before draining, so it is only trusted when no edge
+  // was queued: then a mismatch means one was lost, or nothing is queued
+  if (!drained && level != candidate_) edge(level, nowUs);
+  settle(nowUs);
+
+  // A transition still debouncing may date from before either deadline
+  if (candidate_ != stable_) return;
+  if (!stable_ && !longSent_ && !second_ && nowUs - pressUs_ >= longUs_) {
+    longSent_ = true;
+    emit(Gesture::LONG);
+  }
+  if (shortHeld_ && stable_ && nowUs - releaseUs_ > doubleUs_) {
+    shortHeld_ = false;
+    emit(Gesture::SHORT);
+  }
+}
+
+void Button::edge(bool level, uint32_t atUs) {
+  if (level == candidate_) return;
+  settle(atUs);
+  if (candidate_ != stable_) stats_.bounces++;  // replaced before it settled
+  candidate_   = level;
+  candidateUs_ = atUs;
+}
+
+void Button::settle(uint32_t nowUs) {
+  if (candidate_ != stable_ && nowUs - candidateUs_ >= debounceUs_) commit(candidate_, candidateUs_);
+}
+
+void Button::commit(bool level, uint32_t atUs) {
+  stable_ = level;
+  if (!level) {
+    stats_.presses++;
+    pressUs_  = atUs;
+    longSent_ = false;
+    second_   = shortHeld_ && atUs - releaseUs_ <= doubleUs_;
+    // A short press whose window ran out while nobody was looking
+    if (shortHeld_ && !second_) emit(Gesture::SHORT);
+    shortHeld_ = false;
+    return;
+  }
+
+  if (second_) {
+    second_ = false;
+    emit(Gesture::DOUBLE);
+  } else if (!longSent_ && atUs - pressUs_ >= longUs_) {
+    longSent_ = true;
+    emit(Gesture::LONG);
+  } else if (!longSent_) {
+    shortHeld_ = true;
+    releaseUs_ = atUs;
+  }
+}
+
+void Button::emit(Gesture gesture) {
+  stats_.gestures++;
+  if (onGesture_) onGesture_(gesture);
+}
@@ -0,0 +1,28 @@
+/**
+ * @file flash_esp32.cpp
+ * @brief Flash backend over an ESP32 data partition
+ */
+
+#include "flash_esp32.h"
+
+bool PartitionFlash::begin() {
+  part_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label_);
+  return part_ != nullptr;
+}
+
+uint16_t PartitionFlash::sectorCount() const {
+  return part_ ? part_->size / SPI_FLASH_SEC_SIZE : 0;
+}
+
+bool PartitionFlash::read(uint32_t addr, void* dst, size_t len) {
+  return part_ && esp_partition_read(part_, addr, dst, len) == ESP_OK;
+}
+
+bool PartitionFlash::write(uint32_t addr, const void* src, size_t len) {
+  return part_ && esp_partition_write(part_, addr, src, len) == ESP_OK;
+}
+
+bool PartitionFlash::erase(uint16_t sector) {
+  return part_ &&
+         esp_partition_erase_range(part_, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) == ESP_OK;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file hal_esp32.cpp
+ * @brief HAL implementations for the ESP32 board
+ */
+
+#include "hal_esp32.h"
+
+#include <Arduino.h>
+#include <IRutils.h>
+#include <esp_timer.h>
+#include <soc/gpio_struct.h>
+
+#include "ir_protocols.h"
+#include "log.h"
+
+// ---- clock / gpio ----
+uint32_t ArduinoClock::millis() { return ::millis(); }
+uint32_t ArduinoClock::micros() { return ::micros(); }
+uint32_t ArduinoClock::cycles() { return ESP.getCycleCount(); }
+uint32_t ArduinoClock::cyclesPerUs() { return ESP.getCpuFreqMHz(); }
+
+void ArduinoGpio::setMode(uint8_t pin, Mode mode) {
+  switch (mode) {
+    case IN:        pinMode(pin, INPUT);        break;
+    case IN_PULLUP: pinMode(pin, INPUT_PULLUP); break;
+    case OUT:       pinMode(pin, OUTPUT);       break;
+  }
+}
+
+bool ArduinoGpio::read(uint8_t pin) { return digitalRead(pin) == HIGH; }
+void ArduinoGpio::write(uint8_t pin, bool level) { digitalWrite(pin, level ? HIGH : LOW); }
+
+bool ArduinoGpio::watch(uint8_t pin, hal::EdgeQueue& queue) {
+  if (watchCount_ >= MAX_WATCHED || digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT) return false;
+  Watch& w = watches_[watchCount_++];
+  w.queue  = &queue;
+  w.pin    = pin;
+  attachInterruptArg(digitalPinToInterrupt(pin), onEdge, &w, CHANGE);
+  return true;
+}
+
+void IRAM_ATTR ArduinoGpio::onEdge(void* arg) {
+  const Watch& w   = *static_cast<const Watch*>(arg);
+  const bool level = w.pin < 32 ? (GPIO.in >> w.pin) & 1 : (GPIO.in1.val >> (w.pin - 32)) & 1;
+  w.queue->push({ static_cast<uint32_t>(esp_timer_get_time()), level });
+}
+
+// ---- sensors ----
+#if SENSOR_DHT
+void DhtSensor::collect(float& tempC, float& humidity) {
+  tempC    = dht_.readTemperature();
+  humidity = dht_.readHumidity();
+}
+#endif
+
+#if SENSOR_SHT3X
+static constexpr uint16_t SHT3X_MEASURE_HIGH = 0x2400;
+static constexpr uint32_t SHT3X_MEASURE_MS   = 16;  // 15.5 ms max at high repeatability
+
+// CRC-8, polynomial 0x31, init 0xFF (datasheet 4.12)
+static uint8_t sht3xCrc(const uint8_t* data) {
+  uint8_t crc = 0xFF;
+  for (uint8_t i = 0; i < 2; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+  }
+  return crc;
+}
+
+uint32_t Sht3xSensor::start() {
+  wire_.beginTransmission(addr_);
+  wire_.write(SHT3X_MEASURE_HIGH >> 8);
+  wire_.write(SHT3X_MEASURE_HIGH & 0xFF);
+  started_ = wire_.endTransmission() == 0;
+  return started_ ? SHT3X_MEASURE_MS : 0;
+}
+
+void Sht3xSensor::collect(float& tempC, float& humidity) {
+  tempC = humidity = NAN;
+  if (!started_) return;
+  uint8_t buf[6];
+  if (wire_.requestFrom(addr_, static_cast<uint8_t>(sizeof(buf))) != sizeof(buf)) return;
+  for (uint8_t i = 0; i < sizeof(buf); i++) buf[i] = wire_.read();
+  if (sht3xCrc(buf) != buf[2] || sht3xCrc(buf + 3) != buf[5]) return;
+
+  const uint16_t rawT = (buf[0] << 8) | buf[1];
+  const uint16_t rawH = (buf[3] << 8) | buf[4];
+  tempC    = -45.0f + 175.0f * rawT / 65535.0f;
+  humidity = 100.0f * rawH / 65535.0f;
+}
+#endif
+
+#if SENSOR_BME280
+static constexpr uint8_t  BME280_REG_CTRL_MEAS = 0xF4;
+static constexpr uint8_t  BME280_FORCED_T1_P0  = 0x21;  // osrs_t x1, osrs_p skip, forced
+static constexpr uint32_t BME280_MEASURE_MS    = 10;    // 1.25 + 2.3 + 2.3 + 0.575 ms max
+
+void Bme280Sensor::begin() {
+  ok_ = bme_.begin(addr_, &wire_);
+  if (!ok_) {
+    LOG_ERROR("BME280 not found at 0x%02X", addr_);
+    return;
+  }
+  bme_.setSampling(Adafruit_BME280::MODE_SLEEP, Adafruit_BME280::SAMPLING_X1,
+                   Adafruit_BME280::SAMPLING_NONE, Adafruit_BME280::SAMPLING_X1,
+                   Adafruit_BME280::FILTER_OFF);
+}
+
+// takeForcedMeasurement() would poll until done; writing ctrl_meas only
+// triggers the conversion (ctrl_hum is already latched by setSampling)
+uint32_t Bme280Sensor::start() {
+  if (!ok_) return 0;
+  wire_.beginTransmission(addr_);
+  wire_.write(BME280_REG_CTRL_MEAS);
+  wire_.write(BME280_FORCED_T1_P0);
+  return wire_.endTransmission() == 0 ? BME280_MEASURE_MS : 0;
+}
+
+void Bme280Sensor::collect(float& tempC, float& humidity) {
+  if (!ok_) {
+    tempC = humidity = NAN;
+    return;
+  }
+  tempC    = bme_.readTemperature();
+  humidity = bme_.readHumidity();
+}
+#endif
+
+#if SENSOR_DS18B20
+void Ds18b20Sensor::begin() {
+  probes_.begin();
+  probes_.setWaitForConversion(false);
+  if (probes_.getDeviceCount() == 0) LOG_ERROR("No DS18B20 on the bus");
+}
+
+uint32_t Ds18b20Sensor::start() {
+  probes_.requestTemperatures();
+  return probes_.millisToWaitForConversion(probes_.getResolution());
+}
+
+void Ds18b20Sensor::collect(float& tempC, float& humidity) {
+  const float t = probes_.getTempCByIndex(0);
+  tempC    = t == DEVICE_DISCONNECTED_C ? NAN : t;
+  humidity = NAN;
+}
+#endif
+
+// ---- IR ----
+// One wrapper per listed protocol; the member pointer picks the overload
+using ValueSender = void (IRsend::*)(uint64_t data, uint16_t nbits, uint16_t repeat);
+using StateSender = void (IRsend::*)(const uint8_t data[], uint16_t nbytes, uint16_t repeat);
+
+template <ValueSender SEND, uint16_t REPEAT>
+static void sendValue(IRsend& irsend, const IrCode& code) {
+  (irsend.*SEND)(code.value, code.bits, REPEAT);
+}
+
+template <StateSender SEND, uint16_t REPEAT>
+static void sendState(IRsend& irsend, const IrCode& code) {
+  (irsend.*SEND)(code.state, code.stateBytes(), REPEAT);
+}
+
+struct SendEntry {
+  void (*send)(IRsend& irsend, const IrCode& code);
+  uint8_t format;
+};
+
+struct SendTable {
+  SendEntry entries[kLastDecodeType + 1];
+};
+
+#define IR_SEND_VALUE(name, sender, repeat) sendValue<&IRsend::sender, repeat>
+#define IR_SEND_STATE(name, sender, repeat) sendState<&IRsend::sender, repeat>
+#define IR_SEND_ENTRY(name, format, sender, repeat)                                    \
+  t.entries[decode_type_t::name] = { IR_SEND_##format(name, sender, repeat), ircode::FORMAT_##format };
+
+static constexpr SendTable makeSendTable() {
+  SendTable t = {};
+  IR_SEND_PROTOCOLS(IR_SEND_ENTRY)
+  return t;
+}
+
+static constexpr SendTable SENDERS = makeSendTable();
+
+static const SendEntry* sender(int16_t protocol, uint8_t format) {
+  if (protocol < 0 || protocol > kLastDecodeType) return nullptr;
+  const SendEntry& e = SENDERS.entries[protocol];
+  return e.send && e.format == format ? &e : nullptr;
+}
+
+bool IrSender::supports(int16_t protocol, uint8_t format) {
+  if (format == ircode::FORMAT_RAW || sender(protocol, format)) return true;
+  return IR_SEND_ANY && protocol >= 0 && protocol <= kLastDecodeType &&
+         format == (hasACState(static_cast<decode_type_t>(protocol)) ? ircode::FORMAT_STATE
+                                                                     : ircode::FORMAT_VALUE);
+}
+
+bool IrSender::send(const IrCode& code) {
+  if (code.format == ircode::FORMAT_RAW) {
+    irsend_.sendRaw(code.raw, code.rawLen, code.freqKHz);
+    return true;
+  }
+  if (const SendEntry* e = sender(code.protocol, code.format)) {
+    e->send(irsend_, code);
+    return true;
+  }
+#if IR_SEND_ANY
+  // Everything the library enables, at the cost of linking all of it
+  const decode_type_t protocol = static_cast<decode_type_t>(code.protocol);
+  if (code.format == ircode::FORMAT_VALUE) return irsend_.send(protocol, code.value, code.bits);
+  if (code.format == ircode::FORMAT_STATE) return irsend_.send(protocol, code.state, code.stateBytes());
+#endif
+  return false;
+}
+
+#if IR_SEND_AC
+static const stdAc::opmode_t AC_MODES[AcState::MODE_COUNT] = {
+  stdAc::opmode_t::kAuto, stdAc::opmode_t::kCool, stdAc::opmode_t::kHeat, stdAc::opmode_t::kDry,
+  stdAc::opmode_t::kFan,
+};
+static const stdAc::fanspeed_t AC_FANS[AcState::FAN_COUNT] = {
+  stdAc::fanspeed_t::kAuto, stdAc::fanspeed_t::kLow, stdAc::fanspeed_t::kMedium,
+  stdAc::fanspeed_t::kHigh,
+};
+
+// Settings the state does not model keep IRac's defaults
+bool IrSender::sendAc(const AcState& state) {
+  const decode_type_t protocol = static_cast<decode_type_t>(state.protocol);
+  if (!IRac::isProtocolSupported(protocol)) return false;
+  stdAc::state_t& next = ac_.next;
+  next.protocol = protocol;
+  next.model    = state.model ? static_cast<int16_t>(state.model) : -1;
+  next.power    = state.power;
+  next.mode     = AC_MODES[static_cast<uint8_t>(state.mode) % AcState::MODE_COUNT];
+  next.celsius  = true;
+  next.degrees  = state.tempC;
+  next.fanspeed = AC_FANS[static_cast<uint8_t>(state.fan) % AcState::FAN_COUNT];
+  next.swingv   = state.swing == AcState::Swing::ON ? stdAc::swingv_t::kAuto : stdAc::swingv_t::kOff;
+  next.swingh   = stdAc::swingh_t::kOff;
+  return ac_.sendAc();
+}
+#endif
+
+bool IrReceiver::receive(IrCode& code) {
+  if (!irrecv_.decode(&results_)) return false;
+  bool ok = !results_.repeat && capture(code);
+  irrecv_.resume();
+  return ok;
+}
+
+bool IrReceiver::capture(IrCode& code) {
+  if (results_.overflow) {
+    overflows_++;
+    LOG_WARN("IR capture overflowed %u timings; ignored", bufferSize_);
+    return false;
+  }
+
+  code.protocol = static_cast<int16_t>(results_.decode_type);
+  code.bits     = results_.bits;
+
+  // A protocol this build cannot send is kept as timings, which it can
+  const bool ac = hasACState(results_.decode_type);
+  if (results_.decode_type != decode_type_t::UNKNOWN &&
+      IrSender::supports(code.protocol, ac ? ircode::FORMAT_STATE : ircode::FORMAT_VALUE)) {
+    if (ac) {
+      code.format = ircode::FORMAT_STATE;
+      if (code.stateBytes() > ircode::MAX_STATE) return false;
+      memcpy(code.state, results_.state, code.stateBytes());
+    } else {
+      code.format = ircode::FORMAT_VALUE;
+      code.value  = results_.value;
+    }
+    return true;
+  }
+
+  // rawbuf[0] is the gap before the frame; the rest alternate mark/space.
+  // A timing past UINT16_MAX us is split as resultToRawArray() does, into
+  // UINT16_MAX, a zero of the other kind and the rest, which sendRaw()
+  // plays back as one long mark or space. getCorrectedRawLength() counts
+  // those extra entries.
+  const uint16_t len = getCorrectedRawLength(&results_);
+  if (len < MIN_RAW_TIMINGS || code.raw == nullptr) return false;
+  if (len > code.rawCap) {
+    LOG_WARN("IR capture of %u timings, long gaps split, does not fit %u; ignored", len,
+             code.rawCap);
+    return false;
+  }
+
+  uint16_t n     = 0;
+  uint16_t split = 0;
+  bool     fits  = true;
+  for (uint16_t i = 1; fits && i < results_.rawlen; i++) {
+    uint32_t us = static_cast<uint32_t>(results_.rawbuf[i]) * kRawTick;
+    for (; us > UINT16_MAX && n + 3 <= len; us -= UINT16_MAX, split++) {
+      code.raw[n++] = UINT16_MAX;
+      code.raw[n++] = 0;
+    }
+    fits = us <= UINT16_MAX && n < len;
+    if (fits) code.raw[n++] = static_cast<uint16_t>(us);
+  }
+  if (!fits || n != len) {
+    LOG_WARN("IR capture came to %u timings, %u expected; ignored", n, len);
+    return false;
+  }
+  if (split) LOG_INFO("IR capture: %u long gap(s) split into 65 ms steps", split);
+  code.format  = ircode::FORMAT_RAW;
+  code.rawLen  = n;
+  code.freqKHz = carrierKHz_;
+  return true;
+}
+
+// ---- network ----
+void WifiNetwork::logStats() {
+  const WifiManager::Stats& ws = wifi_.stats();
+  unsigned long avgConnect = ws.connects ? ws.totalConnectMs / ws.connects : 0;
+  LOG_INFO("WiFi: connects=%lu fast=%lu fastMiss=%lu fail=%lu ttc last=%lums avg=%lums max=%lums",
+           ws.connects, ws.fastConnects, ws.fastMisses, ws.failures, ws.lastConnectMs, avgConnect,
+           ws.maxConnectMs);
+}
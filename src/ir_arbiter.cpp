@@ -0,0 +1,166 @@
+/**
+ * @file ir_arbiter.cpp
+ * @brief IR transmit queue and capture time-sharing
+ */
+
+#include "ir_arbiter.h"
+
+#include "metrics.h"
+
+bool IrArbiter::queue(const Frame& frame) {
+  const uint8_t p = static_cast<uint8_t>(frame.priority) % PRIORITY_COUNT;
+  Frame f    = frame;
+  f.queuedUs = clock_.micros();
+  stats_.queued++;
+
+  if (f.group != 0) {
+    for (uint8_t higher = 0; higher < p; higher++) {
+      if (holds(higher, f.group)) {
+        finish(f, Outcome::SUPERSEDED);
+        return true;
+      }
+    }
+    for (uint8_t lower = p + 1; lower < PRIORITY_COUNT; lower++) replace(lower, f.group, nullptr);
+    if (replace(p, f.group, &f)) return true;
+  }
+
+  RingBuffer<Frame, DEPTH>& q = queues_[p];
+  bool kept = true;
+  if (q.full()) {
+    Frame oldest;
+    q.pop(oldest);
+    stats_.overruns++;
+    metrics::increment(metrics::IR_TX_OVERRUN);
+    finish(oldest, Outcome::DROPPED);
+    kept = false;
+  }
+  q.push(f);
+  if (q.size() > stats_.maxDepth) stats_.maxDepth = static_cast<uint8_t>(q.size());
+  return kept;
+}
+
+bool IrArbiter::holds(uint8_t priority, uint8_t group) const {
+  const RingBuffer<Frame, DEPTH>& q = queues_[priority];
+  for (size_t i = 0; i < q.size(); i++) {
+    if (q.peek(i).group == group) return true;
+  }
+  return false;
+}
+
+// Rotates the queue once, so the order holds: the group's frame (there is
+// at most one) is superseded by with, in its place, or dropped when with
+// is null
+bool IrArbiter::replace(uint8_t priority, uint8_t group, const Frame* with) {
+  RingBuffer<Frame, DEPTH>& q = queues_[priority];
+  bool found = false;
+  Frame f;
+  for (size_t n = q.size(); n > 0 && q.pop(f); n--) {
+    if (f.group != group) {
+      q.push(f);
+      continue;
+    }
+    found = true;
+    finish(f, Outcome::SUPERSEDED);
+    if (with) q.push(*with);
+  }
+  return found;
+}
+
+void IrArbiter::finish(const Frame& frame, Outcome outcome) {
+  if (outcome == Outcome::SUPERSEDED) {
+    stats_.coalesced++;
+    metrics::increment(metrics::IR_COALESCED);
+  }
+  if (done_) done_(frame, outcome);
+}
+
+bool IrArbiter::pending() const {
+  for (const auto& q : queues_) {
+    if (!q.empty()) return true;
+  }
+  return false;
+}
+
+bool IrArbiter::service() {
+  for (auto& q : queues_) {
+    Frame f;
+    if (!q.pop(f)) continue;
+    finish(f, send(f) ? Outcome::SENT : Outcome::FAILED);
+    return pending();
+  }
+  return false;
+}
+
+// Capture is off for the frame and its guard, whoever else wants it
+bool IrArbiter::send(const Frame& frame) {
+  IrCode code = {};
+  if (frame.kind == Frame::CODE && !(load_ && load_(frame.slot, code))) {
+    stats_.failed++;
+    return false;
+  }
+
+  if (capturing_) {
+    stats_.collisions++;
+    metrics::increment(metrics::IR_COLLISION);
+  }
+  guarding_ = true;
+  apply();
+
+  metrics::record(metrics::IR_WAIT, clock_.micros() - frame.queuedUs);
+  const uint32_t t0 = metrics::now();
+  const bool sent = frame.kind == Frame::CODE ? tx_.send(code) : tx_.sendAc(frame.ac);
+  metrics::record(metrics::IR_SEND, metrics::elapsedUs(t0));
+  sentMs_ = clock_.millis();
+  if (!sent) {
+    stats_.failed++;
+    return false;
+  }
+  stats_.sent++;
+  return true;
+}
+
+void IrArbiter::listen(bool on) {
+  listening_ = on;
+  apply();
+}
+
+void IrArbiter::enable() {
+  if (holds_) holds_--;
+  apply();
+}
+
+void IrArbiter::disable() {
+  holds_++;
+  apply();
+}
+
+bool IrArbiter::receive(IrCode& code) {
+  if (guarding_ && clock_.millis() - sentMs_ >= guardMs_) {
+    guarding_ = false;
+    apply();
+  }
+  if (!capturing_) return false;
+  const bool got = rx_.receive(code);
+  pollOverflows();
+  return got;
+}
+
+void IrArbiter::apply() {
+  const bool want = listening_ && holds_ == 0 && !guarding_;
+  if (want == capturing_) return;
+  capturing_ = want;
+  if (want) {
+    rx_.enable();
+  } else {
+    rx_.disable();
+  }
+}
+
+void IrArbiter::pollOverflows() {
+  const uint32_t n = rx_.overflows();
+  while (rxOverflows_ != n) {
+    rxOverflows_++;
+    stats_.rxOverruns++;
+    metrics::increment(metrics::IR_RX_OVERRUN);
+  }
+}
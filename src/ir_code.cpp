@@ -0,0 +1,258 @@
+/**
+ * @file ir_code.cpp
+ * @brief IR code serialisation (little endian) and raw timing compression
+ *
+ * Payload layouts after the format byte:
+ *
+ *   VALUE  u16 protocol | u16 bits | u64 value
+ *   STATE  u16 protocol | u16 bits | state[(bits + 7) / 8]
+ *   RAW    u8 kHz | u16 timings | u8 clusters | u16 us[clusters]
+ *          | u8 pairs | u8 (mark << 4 | space)[pairs] | packed pair symbols
+ *
+ * Pair symbols are 2 bits wide for up to 4 distinct pairs, 4 bits for up to
+ * 16 and 8 bits otherwise, packed LSB first. An odd trailing mark is stored
+ * as a pair whose space is ignored on decode.
+ */
+
+#include "ir_code.h"
+
+#include <string.h>
+
+namespace ircode {
+
+static constexpr uint16_t VALUE_BYTES = 13;
+static constexpr uint16_t STATE_HEAD  = 5;
+
+static void putLE(uint8_t* out, uint64_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint64_t getLE(const uint8_t* in, uint8_t bytes) {
+  uint64_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++) v |= static_cast<uint64_t>(in[i]) << (8 * i);
+  return v;
+}
+
+// ---- raw compression ----
+static uint16_t tolerance(uint16_t us) {
+  return us / 5 > 100 ? us / 5 : 100;
+}
+
+static uint8_t nearest(const uint16_t* centres, uint8_t n, uint16_t us) {
+  uint8_t  best     = 0;
+  uint32_t bestDist = UINT32_MAX;
+  for (uint8_t c = 0; c < n; c++) {
+    uint32_t d = us > centres[c] ? us - centres[c] : centres[c] - us;
+    if (d < bestDist) {
+      bestDist = d;
+      best     = c;
+    }
+  }
+  return best;
+}
+
+// Greedy single-pass clustering; a running mean keeps each centre on the
+// middle of its group. Returns 0 if the timings need more than MAX_CLUSTERS.
+static uint8_t cluster(const uint16_t* raw, uint16_t len, uint16_t* centres) {
+  uint32_t sum[MAX_CLUSTERS];
+  uint16_t cnt[MAX_CLUSTERS];
+  uint8_t  n = 0;
+
+  for (uint16_t i = 0; i < len; i++) {
+    const uint16_t us = raw[i];
+    uint8_t c = n ? nearest(centres, n, us) : 0;
+    uint16_t d = n ? (us > centres[c] ? us - centres[c] : centres[c] - us) : UINT16_MAX;
+    if (n == 0 || d > tolerance(centres[c])) {
+      if (n == MAX_CLUSTERS) return 0;
+      c       = n++;
+      sum[c]  = 0;
+      cnt[c]  = 0;
+    }
+    sum[c] += us;
+    cnt[c]++;
+    centres[c] = static_cast<uint16_t>((sum[c] + cnt[c] / 2) / cnt[c]);
+  }
+  return n;
+}
+
+static uint8_t symbolBits(uint16_t pairs) {
+  return pairs <= 4 ? 2 : pairs <= 16 ? 4 : 8;
+}
+
+static uint16_t encodeRaw(const IrCode& code, uint8_t* out, uint16_t cap) {
+  if (code.raw == nullptr || code.rawLen == 0) return 0;
+
+  uint16_t centres[MAX_CLUSTERS];
+  const uint8_t nc = cluster(code.raw, code.rawLen, centres);
+  if (nc == 0) return 0;
+
+  // Pair dictionary, built in first-seen order
+  uint8_t        dict[255];
+  uint16_t       nd    = 0;
+  const uint16_t pairs = (code.rawLen + 1) / 2;
+  for (uint16_t p = 0; p < pairs; p++) {
+    const uint16_t i = p * 2;
+    uint8_t key = static_cast<uint8_t>(nearest(centres, nc, code.raw[i]) << 4);
+    if (i + 1 < code.rawLen) key |= nearest(centres, nc, code.raw[i + 1]);
+    uint16_t k = 0;
+    while (k < nd && dict[k] != key) k++;
+    if (k == nd) {
+      if (nd == sizeof(dict)) return 0;
+      dict[nd++] = key;
+    }
+  }
+
+  const uint8_t  bits = symbolBits(nd);
+  const uint32_t size = 1 + 1 + 2 + 1 + 2u * nc + 1 + nd + (static_cast<uint32_t>(pairs) * bits + 7) / 8;
+  if (size > cap) return 0;
+
+  uint8_t* p = out;
+  *p++ = FORMAT_RAW;
+  *p++ = code.freqKHz;
+  putLE(p, code.rawLen, 2);
+  p += 2;
+  *p++ = nc;
+  for (uint8_t c = 0; c < nc; c++, p += 2) putLE(p, centres[c], 2);
+  *p++ = static_cast<uint8_t>(nd);
+  memcpy(p, dict, nd);
+  p += nd;
+
+  memset(p, 0, out + size - p);
+  uint32_t bitPos = 0;
+  for (uint16_t q = 0; q < pairs; q++) {
+    const uint16_t i = q * 2;
+    uint8_t key = static_cast<uint8_t>(nearest(centres, nc, code.raw[i]) << 4);
+    if (i + 1 < code.rawLen) key |= nearest(centres, nc, code.raw[i + 1]);
+    uint8_t sym = 0;
+    while (dict[sym] != key) sym++;
+    p[bitPos / 8] |= static_cast<uint8_t>(sym << (bitPos % 8));
+    bitPos += bits;
+  }
+  return static_cast<uint16_t>(size);
+}
+
+static bool decodeRaw(const uint8_t* in, uint16_t len, IrCode& code) {
+  const uint8_t* end = in + len;
+  const uint8_t* p   = in + 1;
+  if (end - p < 4) return false;
+
+  code.freqKHz = *p++;
+  const uint16_t count = static_cast<uint16_t>(getLE(p, 2));
+  p += 2;
+  const uint8_t nc = *p++;
+  if (nc == 0 || nc > MAX_CLUSTERS || end - p < 2 * nc + 1) return false;
+
+  uint16_t centres[MAX_CLUSTERS];
+  for (uint8_t c = 0; c < nc; c++, p += 2) centres[c] = static_cast<uint16_t>(getLE(p, 2));
+
+  const uint8_t nd = *p++;
+  if (nd == 0 || end - p < nd) return false;
+  const uint8_t* dict = p;
+  p += nd;
+
+  const uint16_t pairs = (count + 1) / 2;
+  const uint8_t  bits  = symbolBits(nd);
+  if (static_cast<uint32_t>(end - p) != (static_cast<uint32_t>(pairs) * bits + 7) / 8) return false;
+  if (code.raw == nullptr || count > code.rawCap) return false;
+
+  const uint8_t mask   = static_cast<uint8_t>((1u << bits) - 1);
+  uint32_t      bitPos = 0;
+  for (uint16_t q = 0; q < pairs; q++, bitPos += bits) {
+    const uint8_t sym = (p[bitPos / 8] >> (bitPos % 8)) & mask;
+    if (sym >= nd) return false;
+    const uint8_t key = dict[sym];
+    if ((key >> 4) >= nc || (key & 0x0F) >= nc) return false;
+    code.raw[q * 2] = centres[key >> 4];
+    if (q * 2 + 1 < count) code.raw[q * 2 + 1] = centres[key & 0x0F];
+  }
+
+  code.format   = FORMAT_RAW;
+  code.protocol = -1;  // UNKNOWN
+  code.bits     = 0;
+  code.rawLen   = count;
+  return true;
+}
+
+// ---- public ----
+uint16_t encode(const IrCode& code, uint8_t* out, uint16_t cap) {
+  switch (code.format) {
+    case FORMAT_VALUE:
+      if (cap < VALUE_BYTES) return 0;
+      out[0] = FORMAT_VALUE;
+      putLE(out + 1, static_cast<uint16_t>(code.protocol), 2);
+      putLE(out + 3, code.bits, 2);
+      putLE(out + 5, code.value, 8);
+      return VALUE_BYTES;
+
+    case FORMAT_STATE: {
+      const uint16_t n = code.stateBytes();
+      if (n == 0 || n > MAX_STATE || cap < STATE_HEAD + n) return 0;
+      out[0] = FORMAT_STATE;
+      putLE(out + 1, static_cast<uint16_t>(code.protocol), 2);
+      putLE(out + 3, code.bits, 2);
+      memcpy(out + STATE_HEAD, code.state, n);
+      return STATE_HEAD + n;
+    }
+
+    case FORMAT_RAW:
+      return encodeRaw(code, out, cap);
+
+    default:
+      return 0;
+  }
+}
+
+bool decode(const uint8_t* in, uint16_t len, IrCode& code) {
+  if (len == 0) return false;
+  switch (in[0]) {
+    case FORMAT_VALUE:
+      if (len != VALUE_BYTES) return false;
+      code.format   = FORMAT_VALUE;
+      code.protocol = static_cast<int16_t>(getLE(in + 1, 2));
+      code.bits     = static_cast<uint16_t>(getLE(in + 3, 2));
+      code.value    = getLE(in + 5, 8);
+      return true;
+
+    case FORMAT_STATE: {
+      if (len < STATE_HEAD) return false;
+      code.format   = FORMAT_STATE;
+      code.protocol = static_cast<int16_t>(getLE(in + 1, 2));
+      code.bits     = static_cast<uint16_t>(getLE(in + 3, 2));
+      const uint16_t n = code.stateBytes();
+      if (n == 0 || n > MAX_STATE || len != STATE_HEAD + n) return false;
+      memcpy(code.state, in + STATE_HEAD, n);
+      return true;
+    }
+
+    case FORMAT_RAW:
+      return decodeRaw(in, len, code);
+
+    default:
+      return false;
+  }
+}
+
+bool same(const IrCode& a, const IrCode& b) {
+  if (a.format != b.format) return false;
+  switch (a.format) {
+    case FORMAT_VALUE:
+      return a.protocol == b.protocol && a.bits == b.bits && a.value == b.value;
+
+    case FORMAT_STATE:
+      return a.protocol == b.protocol && a.bits == b.bits && a.stateBytes() <= MAX_STATE &&
+             memcmp(a.state, b.state, a.stateBytes()) == 0;
+
+    case FORMAT_RAW:
+      if (a.rawLen != b.rawLen || a.raw == nullptr || b.raw == nullptr) return false;
+      for (uint16_t i = 0; i < a.rawLen; i++) {
+        const uint16_t d = a.raw[i] > b.raw[i] ? a.raw[i] - b.raw[i] : b.raw[i] - a.raw[i];
+        if (d > tolerance(a.raw[i])) return false;
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+}  // namespace ircode
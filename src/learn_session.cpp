@@ -0,0 +1,82 @@
+/**
+ * @file learn_session.cpp
+ * @brief Learn session steps, capture verification and timeouts
+ */
+
+#include "learn_session.h"
+
+#include <string.h>
+
+bool LearnSession::start(const char* const* slots, uint8_t count, uint8_t required,
+                         uint32_t timeoutMs, uint32_t nowMs) {
+  if (count == 0 || count > MAX_STEPS || required == 0 || required > MAX_REQUIRED) return false;
+  for (uint8_t i = 0; i < count; i++) {
+    const size_t len = strlen(slots[i]);
+    if (len == 0 || len > MAX_SLOT) return false;
+  }
+  for (uint8_t i = 0; i < count; i++) strcpy(slots_[i], slots[i]);
+  steps_     = count;
+  step_      = 0;
+  required_  = required;
+  timeoutMs_ = timeoutMs;
+  active_    = true;
+  heard_     = false;
+  stats_.sessions++;
+  beginStep(nowMs);
+  return true;
+}
+
+void LearnSession::beginStep(uint32_t nowMs) {
+  captures_ = 0;
+  stepMs_   = nowMs;
+}
+
+LearnSession::Result LearnSession::offer(const IrCode& code, uint32_t nowMs) {
+  if (!active_) return Result::IGNORED;
+  const bool samePress = heard_ && nowMs - lastMs_ < gapMs_;
+  heard_  = true;
+  lastMs_ = nowMs;
+  if (samePress) {
+    stats_.ignored++;
+    return Result::IGNORED;
+  }
+
+  const bool mismatch = captures_ > 0 && !ircode::same(code, reference_);
+  if (mismatch) {
+    stats_.mismatches++;
+    captures_ = 0;
+  }
+  if (captures_ == 0) {
+    const uint16_t len = code.format == ircode::FORMAT_RAW ? code.rawLen : 0;
+    if (len > ircode::MAX_RAW || (len && code.raw == nullptr)) return Result::IGNORED;
+    reference_        = code;
+    reference_.raw    = raw_;
+    reference_.rawCap = ircode::MAX_RAW;
+    reference_.rawLen = len;
+    if (len) memcpy(raw_, code.raw, len * sizeof(uint16_t));
+  }
+
+  if (++captures_ >= required_) {
+    stats_.accepted++;
+    return Result::ACCEPTED;
+  }
+  return mismatch ? Result::MISMATCH : Result::CAPTURED;
+}
+
+bool LearnSession::next(uint32_t nowMs) {
+  if (!active_) return false;
+  if (++step_ >= steps_) {
+    active_ = false;
+    step_   = steps_ - 1;
+    return false;
+  }
+  beginStep(nowMs);
+  return true;
+}
+
+bool LearnSession::expired(uint32_t nowMs) {
+  if (!active_ || nowMs - stepMs_ < timeoutMs_) return false;
+  active_ = false;
+  stats_.timeouts++;
+  return true;
+}
@@ -0,0 +1,296 @@
+/**
+ * @file log.cpp
+ * @brief Deferred log formatting, sink fan-out and MQTT rate limiting
+ */
+
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "critical_section.h"
+
+namespace logger {
+
+static const char* const LEVEL_NAMES[] = { "debug", "info", "warn", "error", "none" };
+static const char* const LEVEL_TAGS[]  = { "DEBUG", "INFO", "WARN", "ERROR", "NONE" };
+
+// ---- state ----
+static ClockFn clock_ = nullptr;
+static LineFn  sinks_[SINK_COUNT]  = {};
+// Levels change from any task while others capture
+static std::atomic<uint8_t> levels_[SINK_COUNT] = { { LOG_LVL_DEBUG }, { LOG_LVL_INFO }, { LOG_LVL_DEBUG } };
+static std::atomic<uint8_t> threshold_{ LOG_LVL_DEBUG };  // lowest level any active sink accepts
+
+// Held from reserve() to commit(), and while service() takes a record out
+static CriticalSection lock_;
+static Record  queue_[QUEUE_DEPTH];
+static uint8_t head_  = 0;
+static uint8_t count_ = 0;
+
+static char    history_[RAM_LINES][LINE_BYTES];
+static uint8_t historyHead_  = 0;
+static uint8_t historyCount_ = 0;
+
+static uint8_t  tokens_       = MQTT_BURST;
+static uint32_t lastRefillMs_ = 0;
+static uint32_t throttledRun_ = 0;  // drops not yet reported
+
+static char  line_[LINE_BYTES];
+static Stats stats_ = {};
+
+static void updateThreshold() {
+  uint8_t threshold = LOG_LVL_NONE;
+  for (uint8_t s = 0; s < SINK_COUNT; s++) {
+    bool active = s == SINK_RAM || sinks_[s] != nullptr;
+    if (active && levels_[s] < threshold) threshold = levels_[s];
+  }
+  threshold_ = threshold;
+}
+
+void begin(ClockFn clockMs) {
+  clock_        = clockMs;
+  lastRefillMs_ = clock_();
+  updateThreshold();
+}
+
+void attach(Sink sink, LineFn fn) {
+  if (sink >= SINK_COUNT) return;
+  sinks_[sink] = fn;
+  updateThreshold();
+}
+
+void setLevel(Sink sink, uint8_t level) {
+  if (sink >= SINK_COUNT || level > LOG_LVL_NONE) return;
+  levels_[sink] = level;
+  updateThreshold();
+}
+
+uint8_t level(Sink sink) {
+  return sink < SINK_COUNT ? levels_[sink].load() : LOG_LVL_NONE;
+}
+
+const char* levelName(uint8_t level) {
+  return level <= LOG_LVL_NONE ? LEVEL_NAMES[level] : "?";
+}
+
+bool parseLevel(const char* s, size_t len, uint8_t& out) {
+  for (uint8_t l = 0; l <= LOG_LVL_NONE; l++) {
+    if (strlen(LEVEL_NAMES[l]) == len && memcmp(LEVEL_NAMES[l], s, len) == 0) {
+      out = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+Stats stats() {
+  CriticalGuard guard(lock_);
+  return stats_;
+}
+
+// ---- capture ----
+bool enabled(uint8_t level) {
+  return level >= threshold_ && level < LOG_LVL_NONE;
+}
+
+// The newest record wins when the queue is full
+Record* reserve(uint8_t level, const char* fmt) {
+  lock_.lock();
+  if (count_ == QUEUE_DEPTH) {
+    head_ = (head_ + 1) % QUEUE_DEPTH;
+    count_--;
+    stats_.overflowed++;
+  }
+  Record& r = queue_[(head_ + count_) % QUEUE_DEPTH];
+  r.ms      = clock_ ? clock_() : 0;
+  r.fmt     = fmt;
+  r.level   = level;
+  r.argc    = 0;
+  r.textLen = 0;
+  return &r;
+}
+
+void commit() {
+  count_++;
+  stats_.queued++;
+  lock_.unlock();
+}
+
+void captureText(Record& r, const char* s) {
+  Value& v = r.args[r.argc];
+  v.type = Value::TEXT;
+  v.text = r.textLen;
+  if (s == nullptr) s = "(null)";
+  while (*s && r.textLen < TEXT_BYTES - 1) r.text[r.textLen++] = *s++;
+  r.text[r.textLen] = '\0';
+  if (r.textLen < TEXT_BYTES - 1) r.textLen++;
+}
+
+// ---- formatting ----
+static int64_t asInt(const Value& v) {
+  switch (v.type) {
+    case Value::INT:   return v.i;
+    case Value::UINT:  return static_cast<int64_t>(v.u);
+    case Value::FLOAT: return static_cast<int64_t>(v.f);
+    default:           return 0;
+  }
+}
+
+static double asFloat(const Value& v) {
+  switch (v.type) {
+    case Value::INT:   return static_cast<double>(v.i);
+    case Value::UINT:  return static_cast<double>(v.u);
+    case Value::FLOAT: return v.f;
+    default:           return 0;
+  }
+}
+
+// printf subset: flags, width, precision and d i u x X o c f e g E G s.
+// Length modifiers are ignored since arguments are stored widened.
+static void format(const Record& r, char* out, size_t cap) {
+  int    n   = snprintf(out, cap, "[%s] ", LEVEL_TAGS[r.level]);
+  size_t pos = n > 0 ? static_cast<size_t>(n) : 0;
+  uint8_t argi = 0;
+
+  for (const char* f = r.fmt; *f && pos + 1 < cap;) {
+    if (*f != '%') {
+      out[pos++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      out[pos++] = '%';
+      f += 2;
+      continue;
+    }
+
+    char   spec[16];
+    size_t sl = 0;
+    spec[sl++] = *f++;
+    while (*f && strchr("-+ #0123456789.", *f) && sl < sizeof(spec) - 4) spec[sl++] = *f++;
+    while (*f && strchr("hlLjzt", *f)) f++;
+    const char conv = *f;
+    if (!conv) break;
+    f++;
+
+    if (argi >= r.argc) {
+      out[pos++] = '?';
+      continue;
+    }
+    const Value& v = r.args[argi++];
+
+    switch (conv) {
+      case 'd': case 'i':
+        memcpy(spec + sl, "lld", 4);
+        n = snprintf(out + pos, cap - pos, spec, static_cast<long long>(asInt(v)));
+        break;
+      case 'u': case 'x': case 'X': case 'o':
+        spec[sl++] = 'l';
+        spec[sl++] = 'l';
+        spec[sl++] = conv;
+        spec[sl]   = '\0';
+        n = snprintf(out + pos, cap - pos, spec, static_cast<unsigned long long>(asInt(v)));
+        break;
+      case 'c':
+        spec[sl++] = 'c';
+        spec[sl]   = '\0';
+        n = snprintf(out + pos, cap - pos, spec, static_cast<int>(asInt(v)));
+        break;
+      case 'f': case 'e': case 'g': case 'E': case 'G':
+        spec[sl++] = conv;
+        spec[sl]   = '\0';
+        n = snprintf(out + pos, cap - pos, spec, asFloat(v));
+        break;
+      case 's':
+        spec[sl++] = 's';
+        spec[sl]   = '\0';
+        n = snprintf(out + pos, cap - pos, spec, v.type == Value::TEXT ? r.text + v.text : "?");
+        break;
+      default:
+        n = 0;
+        break;
+    }
+    if (n > 0) pos += static_cast<size_t>(n);
+    if (pos >= cap) pos = cap - 1;
+  }
+  out[pos] = '\0';
+}
+
+// ---- sinks ----
+static bool takeMqttToken() {
+  uint32_t now     = clock_();
+  uint32_t refills = (now - lastRefillMs_) / MQTT_RATE_MS;
+  if (refills) {
+    lastRefillMs_ += refills * MQTT_RATE_MS;
+    tokens_ = refills >= MQTT_BURST || tokens_ + refills >= MQTT_BURST
+                ? MQTT_BURST
+                : static_cast<uint8_t>(tokens_ + refills);
+  }
+  if (tokens_ == 0) return false;
+  tokens_--;
+  return true;
+}
+
+static void toMqtt(const char* line) {
+  if (!takeMqttToken()) {
+    stats_.mqttThrottled++;
+    throttledRun_++;
+    return;
+  }
+  // Report suppressed lines with the first token that becomes available
+  if (throttledRun_) {
+    char note[48];
+    snprintf(note, sizeof(note), "[WARN] %lu log lines throttled", (unsigned long)throttledRun_);
+    if (!sinks_[SINK_MQTT](note)) return;
+    throttledRun_ = 0;
+    if (!takeMqttToken()) {
+      stats_.mqttThrottled++;
+      throttledRun_++;
+      return;
+    }
+  }
+  sinks_[SINK_MQTT](line);
+}
+
+static void toHistory(const char* line) {
+  uint8_t slot = (historyHead_ + historyCount_) % RAM_LINES;
+  strncpy(history_[slot], line, LINE_BYTES - 1);
+  history_[slot][LINE_BYTES - 1] = '\0';
+  if (historyCount_ < RAM_LINES)
+    historyCount_++;
+  else
+    historyHead_ = (historyHead_ + 1) % RAM_LINES;
+}
+
+bool history(uint8_t i, const char*& line) {
+  if (i >= historyCount_) return false;
+  line = history_[(historyHead_ + i) % RAM_LINES];
+  return true;
+}
+
+// Records are copied out under the lock and formatted outside it
+void service() {
+  Record r;
+  for (uint8_t n = 0; n < DRAIN_BATCH; n++) {
+    lock_.lock();
+    if (count_ == 0) {
+      lock_.unlock();
+      break;
+    }
+    r     = queue_[head_];
+    head_ = (head_ + 1) % QUEUE_DEPTH;
+    count_--;
+    lock_.unlock();
+
+    format(r, line_, sizeof(line_));
+    const uint8_t level = r.level;
+
+    if (sinks_[SINK_SERIAL] && level >= levels_[SINK_SERIAL]) sinks_[SINK_SERIAL](line_);
+    if (level >= levels_[SINK_RAM]) toHistory(line_);
+    if (sinks_[SINK_MQTT] && level >= levels_[SINK_MQTT]) toMqtt(line_);
+  }
+}
+
+}  // namespace logger
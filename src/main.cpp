@@ -1,261 +1,247 @@
 /**
  * @file smart_ac_controller.ino
  * @brief ESP32 Smart AC Controller - IR Remote Learning, Sensor Monitoring, and MQTT Control
+ *
+ * Board wiring only: the application lives in app.cpp and reaches the
+ * hardware through the HAL objects created here. Its two domains run as
+ * FreeRTOS tasks, one per core.
  */
 
 // ======================= Libraries ==========================
 #include <WiFi.h>
 #include <IRremoteESP8266.h>
-#include <IRrecv.h>
-#include <IRutils.h>
-#include <IRsend.h>
 #include <EEPROM.h>
-#include <DHT.h>
 #include <PubSubClient.h>
 
+#include "app.h"
+#include "flash_esp32.h"
+#include "hal_esp32.h"
+#include "log.h"
+#include "metrics.h"
+#include "wifi_manager.h"
+
 // ======================= Configuration ======================
 // Wi-Fi Credentials
 const char* SSID         = "RJ";
 const char* PASS         = "Shikareni";
 
+// Device Identity: DEVICE_ID names the topic namespace (<id>/cmd, ...) and
+// must be unique per broker; nullptr derives "ac-<mac>". DEVICE_ZONE adds
+// fleet/<zone>/cmd next to fleet/all/cmd.
+const char* DEVICE_ID    = "ac1";
+const char* DEVICE_ZONE  = nullptr;
+
 // MQTT Broker Configuration
 const char* MQTT_SERVER  = "test.mosquitto.org";
 const int   MQTT_PORT    = 1883;
-const char* DEVICE_ID    = "ac1";
+constexpr uint16_t MQTT_BUFFER_SIZE       = 1024;  // fits a full telemetry batch
+constexpr uint16_t MQTT_CONNECT_TIMEOUT_S = 2;     // bounds one connect() call
+// PubSubClient's fixed header and topic length take 7 bytes of the buffer
+static_assert(MQTT_BUFFER_SIZE >= 7 + Topics::MAX_TOPIC + metrics::JSON_MAX,
+              "the MQTT buffer must fit a full metrics window");
 
 // Pin Configuration
 constexpr uint8_t DHTPIN           = 32;
-constexpr uint8_t DHTTYPE          = DHT21;
+constexpr uint8_t I2C_SDA_PIN      = 21;
+constexpr uint8_t I2C_SCL_PIN      = 22;
+constexpr uint8_t ONE_WIRE_PIN     = 27;
 constexpr uint8_t IR_RECV_PIN      = 33;
 constexpr uint8_t IR_LED_PIN       = 14;
 constexpr uint8_t BUTTON_PIN       = 26;
 
-// EEPROM Address Mapping
+// Sensors (compiled in with the SENSOR_* build flags, see hal_esp32.h).
+// Fusion weights follow the datasheet accuracy, roughly inverse variance.
+#if SENSOR_DHT
+constexpr uint8_t DHTTYPE          = DHT21;
+constexpr float   DHT_WEIGHT       = 1.0f;   // +-0.5 C
+#endif
+constexpr float   SHT3X_WEIGHT     = 4.0f;   // +-0.2 C
+constexpr float   BME280_WEIGHT    = 0.5f;   // +-1 C, and it self-heats
+constexpr float   DS18B20_WEIGHT   = 1.0f;   // +-0.5 C
+
+// IR Capture (AC remotes send long frames with short inter-frame gaps)
+constexpr uint16_t IR_CAPTURE_BUFFER    = ircode::MAX_RAW;
+constexpr uint8_t  IR_CAPTURE_TIMEOUT   = 50;   // ms of silence that ends a frame
+constexpr uint8_t  IR_CARRIER_KHZ       = 38;
+
+// Domain Tasks: the network domain shares core 0 with the WiFi driver and
+// lwIP; the control domain has core 1, above the Arduino loop task, so TCP
+// work never preempts an IR send or a control decision
+constexpr uint32_t    NET_STACK_BYTES      = 8192;
+constexpr uint32_t    CONTROL_STACK_BYTES  = 8192;
+constexpr UBaseType_t NET_PRIORITY         = 2;
+constexpr UBaseType_t CONTROL_PRIORITY     = 5;
+constexpr BaseType_t  NET_CORE             = 0;
+constexpr BaseType_t  CONTROL_CORE         = 1;
+constexpr uint32_t    MAX_IDLE_MS          = 100;  // bounds a missed wake-up
+
+// Code Store Partition
+const char* const CODE_PARTITION   = "ircodes";
+
+// Legacy EEPROM Layout (imported once into the code store)
 constexpr int EEPROM_SIZE          = 120;
-constexpr int ON_ADDR            = 0;
+constexpr int ON_ADDR              = 0;
 constexpr int OFF_ADDR             = 10;
 constexpr int SET_ADDR             = 20;
 
-// Control Thresholds
-constexpr float TEMP_HIGH          = 35.0;
-constexpr float TEMP_LOW           = 23.0;
-
 // ======================= Global Objects =====================
-WiFiClient espClient;
-PubSubClient mqtt(espClient);
-DHT     dht(DHTPIN, DHTTYPE);
-IRrecv  irrecv(IR_RECV_PIN);
-IRsend  irsend(IR_LED_PIN);
-decode_results results;
-
-// Control Variables
-bool mode = true;  // true = Auto, false = Learn
-
-// Debounce Variables
-const unsigned long debounceDelay = 50;
-bool lastStableState = HIGH;
-bool lastReadState   = HIGH;
-unsigned long lastDebounceTime = 0;
-
-// Learning Mode Steps
-enum IRStep {
-  STEP_ON = 0,
-  STEP_OFF  = 1,
-  STEP_SET  = 2
+WiFiClient      espClient;
+WifiManager     wifi(SSID, PASS);
+PubSubClient    mqtt(espClient);
+PartitionFlash  codeFlash(CODE_PARTITION);
+
+ArduinoClock    sysClock;
+ArduinoGpio     gpio;
+#if SENSOR_DHT
+DhtSensor       dht(DHTPIN, DHTTYPE);
+#endif
+#if SENSOR_SHT3X
+Sht3xSensor     sht3x(Wire);
+#endif
+#if SENSOR_BME280
+Bme280Sensor    bme280(Wire);
+#endif
+#if SENSOR_DS18B20
+Ds18b20Sensor   ds18b20(ONE_WIRE_PIN);
+#endif
+IrSender        irTx(IR_LED_PIN);
+IrReceiver      irRx(IR_RECV_PIN, IR_CAPTURE_BUFFER, IR_CAPTURE_TIMEOUT, IR_CARRIER_KHZ);
+PubSubTransport mqttTransport(mqtt);
+WifiNetwork     network(wifi);
+
+const hal::SensorSlot sensors[] = {
+#if SENSOR_DHT
+  { dht, DHT_WEIGHT },
+#endif
+#if SENSOR_SHT3X
+  { sht3x, SHT3X_WEIGHT },
+#endif
+#if SENSOR_BME280
+  { bme280, BME280_WEIGHT },
+#endif
+#if SENSOR_DS18B20
+  { ds18b20, DS18B20_WEIGHT },
+#endif
 };
 
-// =================== Function Prototypes ====================
-void sendIRData(int addr);
-void saveIRData(int addr, uint32_t code, uint16_t bits);
-void learnMode();
-void autoControlMode();
-
-// ======================= MQTT Handlers ======================
-void mqttCallback(char* topic, byte* payload, unsigned int len) {
-  char msg[128];
-  for (unsigned int i = 0; i < len && i < sizeof(msg) - 1; i++) {
-    msg[i] = (char)payload[i];
-  }
-  msg[len] = '\0';
-
-  // Debug: Print incoming topic and message
-  Serial.print("[DEBUG] MQTT Topic: ");
-  Serial.println(topic);
-  Serial.print("[DEBUG] MQTT Payload: ");
-  Serial.println(msg);
-
-  mqtt.publish("ac1/log", msg);
+const hal::Board board = {
+  sysClock, gpio, sensors, sizeof(sensors) / sizeof(sensors[0]), irTx, irRx, codeFlash,
+  mqttTransport, network,
+  []() -> uint32_t { return esp_random(); },
+  [](uint8_t mac[6]) { WiFi.macAddress(mac); },
+  BUTTON_PIN,
+  DEVICE_ID,
+  DEVICE_ZONE,
+};
 
-  if (strcmp(msg, "on") == 0) {
-    mqtt.publish("ac1/log", "[DEBUG] Received ON command.");
-    sendIRData(ON_ADDR);
-  } else if (strcmp(msg, "off") == 0) {
-    mqtt.publish("ac1/log", "[DEBUG] Received OFF command.");
-    sendIRData(OFF_ADDR);
-  } else if (strcmp(msg, "set") == 0) {
-    mqtt.publish("ac1/log", "[DEBUG] Received SET command.");
-    sendIRData(SET_ADDR);
-  } else if (strcmp(msg, "auto") == 0) {
-    mode = true;
-    mqtt.publish("ac1/log", "[DEBUG] Switched to AUTO MODE from MQTT.");
-  } else if (strcmp(msg, "learn") == 0) {
-    mode = false;
-    mqtt.publish("ac1/log", "[DEBUG] Switched to LEARN MODE from MQTT.");
-  } else {
-    mqtt.publish("ac1/log", "[DEBUG] Unknown MQTT command received.");
-  }
-}
+TaskHandle_t domainTasks[app::DOMAIN_COUNT] = {};
 
-void mqttReconnect() {
-  while (!mqtt.connected()) {
-    Serial.println("[DEBUG] Attempting MQTT connection...");
-    if (mqtt.connect(DEVICE_ID)) {
-      mqtt.subscribe("ac1/cmd");
-      mqtt.publish("ac1/log", "[DEBUG] MQTT connected and subscribed to ac1/cmd.");
-      Serial.println("[DEBUG] MQTT connected and subscribed to ac1/cmd.");
-    } else {
-      Serial.print("[DEBUG] Failed MQTT connection. State: ");
-      Serial.println(mqtt.state());
-      delay(1000);
-    }
-  }
-}
+// =================== Function Prototypes ====================
+void importLegacyCodes();
+void onWifiChange(bool connected);
+void startDomains();
 
-  // ======================= Setup ==============================
+// ======================= Setup ==============================
 void setup() {
   Serial.begin(115200);
+  logger::attach(logger::SINK_SERIAL, [](const char* line) { return Serial.println(line) > 0; });
+#if SENSOR_SHT3X || SENSOR_BME280
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+#endif
 
-  WiFi.begin(SSID, PASS);
-  Serial.print("Connecting to WiFi");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    Serial.print(".");
-  }
-  Serial.println();
-  Serial.print("WiFi connected. IP: ");
-  Serial.println(WiFi.localIP());
+  // Connects in the background; auto control runs offline meanwhile
+  LOG_INFO("Connecting to WiFi");
+  wifi.onChange(onWifiChange);
+  wifi.begin(millis());
 
   mqtt.setServer(MQTT_SERVER, MQTT_PORT);
-  mqtt.setCallback(mqttCallback);
+  mqtt.setSocketTimeout(MQTT_CONNECT_TIMEOUT_S);
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  espClient.setTimeout(MQTT_CONNECT_TIMEOUT_S);
 
-  EEPROM.begin(EEPROM_SIZE);
-  irrecv.enableIRIn();
-  irsend.begin();
-  dht.begin();
-  pinMode(BUTTON_PIN, INPUT_PULLUP);
+  bool havePartition = codeFlash.begin();
+  if (!havePartition) LOG_ERROR("Code store unavailable: check the '%s' partition", CODE_PARTITION);
+  app::begin(board);
+  if (havePartition) importLegacyCodes();
 
-  mqtt.publish("ac1/log", "[DEBUG] System Initialized. Press button to switch mode.");
-  Serial.println("[DEBUG] System Initialized. Press button to switch mode.");
+  LOG_INFO("System Initialized. Press button to switch mode.");
+  startDomains();
 }
 
 // ======================= Loop ===============================
+// The domain tasks do all the work
 void loop() {
-  if (!mqtt.connected()) mqttReconnect();
-  mqtt.loop();
-
-  // Debounce button
-  bool reading = digitalRead(BUTTON_PIN);
-  if (reading != lastReadState) lastDebounceTime = millis();
-  if ((millis() - lastDebounceTime) > debounceDelay) {
-    if (reading != lastStableState) {
-      lastStableState = reading;
-      if (lastStableState == HIGH) {
-        mode = !mode;
-        const char* msg = mode ? "Switched to AUTO CONTROL Mode" : "Switched to LEARNING Mode";
-        Serial.println(msg);
-        mqtt.publish("ac1/log", msg);
-      }
-    }
-  }
-  lastReadState = reading;
-
-  if (mode)
-    autoControlMode();
-  else
-    learnMode();
+  vTaskDelete(nullptr);
 }
 
-// ======================= Learn Mode =========================
-void learnMode() {
-  static IRStep step = STEP_ON;
-
-  if (irrecv.decode(&results)) {
-    char buf[64];
-    snprintf(buf, sizeof(buf), "[DEBUG] Received IR %d. Saving...", step + 1);
-    Serial.println(buf);
-    mqtt.publish("ac1/log", buf);
-
-    if (results.decode_type != decode_type_t::UNKNOWN) {
-      switch (step) {
-        case STEP_ON: saveIRData(ON_ADDR, results.value, results.bits); break;
-        case STEP_OFF:  saveIRData(OFF_ADDR,  results.value, results.bits); break;
-        case STEP_SET:  saveIRData(SET_ADDR,  results.value, results.bits); break;
-      }
-
-      step = static_cast<IRStep>(step + 1);
-      if (step > STEP_SET) {
-        mqtt.publish("ac1/log", "[DEBUG] All signals saved. Switching to AUTO.");
-        step = STEP_ON;
-        mode = true;
-      }
-    }
-
-    irrecv.resume();
+// ======================= Domain Tasks =======================
+// Sleeps until the domain's next periodic task is due or the other domain
+// queues something for it, but always yields at least one tick so the idle
+// task (and its watchdog) runs on both cores
+void runDomain(void* arg) {
+  const app::Domain domain = static_cast<app::Domain>(reinterpret_cast<uintptr_t>(arg));
+  for (;;) {
+    uint32_t idleMs = app::loop(domain) / 1000;
+    if (idleMs > MAX_IDLE_MS) idleMs = MAX_IDLE_MS;
+    TickType_t ticks = pdMS_TO_TICKS(idleMs);
+    ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
   }
 }
 
-// =================== Auto Control Mode ======================
-void autoControlMode() {
-  static unsigned long lastUpdate = 0;
-  if (millis() - lastUpdate < 5000) return;
-  lastUpdate = millis();
-
-  float temp = dht.readTemperature();
-  float hum  = dht.readHumidity();
-
-  // char logbuf[128];
-  // snprintf(logbuf, sizeof(logbuf), "[DEBUG] Temp: %.1fC, Hum: %.1f%%", temp, hum);
-  // Serial.println(logbuf);
-  // mqtt.publish("ac1/log", logbuf);
-
-  char jsonbuf[128];
-  snprintf(jsonbuf, sizeof(jsonbuf), "{\"temp\":%.1f,\"hum\":%.1f}", temp, hum);
-  mqtt.publish("ac1/status", jsonbuf);
-
-  if (temp >= TEMP_HIGH) {
-    mqtt.publish("ac1/log", "[DEBUG] Temp high. Sending ON signal.");
-    sendIRData(ON_ADDR);
-  } else if (temp <= TEMP_LOW) {
-    mqtt.publish("ac1/log", "[DEBUG] Temp low. Sending OFF signal.");
-    sendIRData(OFF_ADDR);
-  }
+// Everything app::begin() set up, the IR receive timer and the button
+// interrupt included, lives on this core (1)
+void startDomains() {
+  app::onWake([](app::Domain domain) {
+    TaskHandle_t task = domainTasks[static_cast<uint8_t>(domain)];
+    if (task) xTaskNotifyGive(task);  // null while the tasks are being created
+  });
+  xTaskCreatePinnedToCore(runDomain, "net", NET_STACK_BYTES,
+                          reinterpret_cast<void*>(static_cast<uintptr_t>(app::Domain::NETWORK)),
+                          NET_PRIORITY, &domainTasks[static_cast<uint8_t>(app::Domain::NETWORK)],
+                          NET_CORE);
+  xTaskCreatePinnedToCore(runDomain, "control", CONTROL_STACK_BYTES,
+                          reinterpret_cast<void*>(static_cast<uintptr_t>(app::Domain::CONTROL)),
+                          CONTROL_PRIORITY, &domainTasks[static_cast<uint8_t>(app::Domain::CONTROL)],
+                          CONTROL_CORE);
 }
 
-// ======================= EEPROM I/O =========================
-void saveIRData(int addr, uint32_t code, uint16_t bits) {
-  EEPROM.put(addr, code);         // 4 bytes
-  EEPROM.put(addr + 4, bits);     // 2 bytes
-  EEPROM.commit();
-
-  char buf[64];
-  snprintf(buf, sizeof(buf), "[DEBUG] Saved IR 0x%08X (%d bits) at %d", code, bits, addr);
-  Serial.println(buf);
-  mqtt.publish("ac1/log", buf);
+// ======================= Board Events =======================
+void onWifiChange(bool connected) {
+  if (!connected) {
+    LOG_WARN("WiFi lost. Reconnecting in background.");
+    return;
+  }
+  const WifiManager::Stats& ws = wifi.stats();
+  LOG_INFO("WiFi connected. IP: %s", WiFi.localIP().toString().c_str());
+  LOG_INFO("Time to connect: %lu ms (%s)", (unsigned long)ws.lastConnectMs,
+           ws.lastFast ? "cached BSSID/channel" : "full scan");
 }
 
-void sendIRData(int addr) {
-  uint32_t code;
-  uint16_t bits;
-  EEPROM.get(addr, code);
-  EEPROM.get(addr + 4, bits);
-    // Serial.print("Transmitting IR Code: 0x");
-    // Serial.println(code, HEX);
-    // Serial.print("Bit Length: ");
-    // Serial.println(bits);
-  irsend.sendNEC(code, bits);  // Use correct protocol here if not NEC
+// Moves codes learned by older firmware (raw EEPROM offsets) into the store
+void importLegacyCodes() {
+  // The store also holds settings, so look for the codes themselves
+  uint16_t len;
+  const RecordStore& store = app::codeStore();
+  if (store.get(app::SLOT_ON, len) || store.get(app::SLOT_OFF, len) || store.get(app::SLOT_SET, len)) {
+    return;
+  }
 
-  char buf[64];
-  snprintf(buf, sizeof(buf), "[DEBUG] Sent IR 0x%08X (%d bits) from EEPROM @%d", code, bits, addr);
-  Serial.println(buf);
-  mqtt.publish("ac1/log", buf);
+  EEPROM.begin(EEPROM_SIZE);
+  const int addrs[] = { ON_ADDR, OFF_ADDR, SET_ADDR };
+  const char* const slots[] = { app::SLOT_ON, app::SLOT_OFF, app::SLOT_SET };
+  for (uint8_t i = 0; i < 3; i++) {
+    uint32_t value;
+    uint16_t bits;
+    EEPROM.get(addrs[i], value);
+    EEPROM.get(addrs[i] + 4, bits);
+    if (bits == 0 || bits > 64 || value == 0xFFFFFFFF) continue;
+
+    IrCode code   = {};
+    code.format   = ircode::FORMAT_VALUE;
+    code.protocol = static_cast<int16_t>(decode_type_t::NEC);
+    code.bits     = bits;
+    code.value    = value;
+    app::saveCode(slots[i], code);
+  }
+  EEPROM.end();
 }
@@ -0,0 +1,149 @@
+/**
+ * @file metrics.cpp
+ * @brief Stage histograms and their JSON window
+ */
+
+#include "metrics.h"
+
+#include <stdio.h>
+
+#include <atomic>
+
+namespace metrics {
+
+static constexpr const char* STAGE_NAMES[STAGE_COUNT] = {
+  "mqtt", "auto", "ir", "ir_wait", "store", "sensor", "cmd_ir", "net_jit", "ctl_jit", "net_gap",
+  "ctl_gap",
+};
+static constexpr const char* COUNTER_NAMES[COUNTER_COUNT] = { "ir_col", "ir_txo", "ir_rxo", "ir_coa" };
+
+template <size_t N>
+static constexpr bool namesFit(const char* const (&names)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    size_t len = 0;
+    while (names[i][len]) len++;
+    if (len > NAME_MAX) return false;
+  }
+  return true;
+}
+static_assert(namesFit(STAGE_NAMES) && namesFit(COUNTER_NAMES), "JSON_MAX assumes NAME_MAX");
+
+struct Histogram {
+  std::atomic<uint32_t> buckets[BUCKETS];
+  std::atomic<uint32_t> max;
+};
+
+// ---- state ----
+static hal::Clock* clock_      = nullptr;
+static uint32_t    cyclesPerUs_ = 1;
+static Histogram   hist_[STAGE_COUNT];
+static uint32_t    reported_[STAGE_COUNT][BUCKETS];  // bucket counts at the last toJson()
+static std::atomic<uint32_t> counters_[COUNTER_COUNT];
+static uint32_t    reportedCounts_[COUNTER_COUNT];
+
+// Single writer per stage, so a relaxed load and store is enough
+static inline void bump(std::atomic<uint32_t>& c) {
+  c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static inline uint8_t bucketOf(uint32_t us) {
+  if (us == 0) return 0;
+  const uint8_t b = static_cast<uint8_t>(32 - __builtin_clz(us));
+  return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+void begin(hal::Clock& clock) {
+  clock_       = &clock;
+  cyclesPerUs_ = clock.cyclesPerUs() ? clock.cyclesPerUs() : 1;
+}
+
+uint32_t now() {
+  return clock_ ? clock_->cycles() : 0;
+}
+
+uint32_t elapsedUs(uint32_t since) {
+  return (now() - since) / cyclesPerUs_;
+}
+
+void record(Stage stage, uint32_t us) {
+  if (stage >= STAGE_COUNT) return;
+  Histogram& h = hist_[stage];
+  bump(h.buckets[bucketOf(us)]);
+  if (us > h.max.load(std::memory_order_relaxed)) h.max.store(us, std::memory_order_relaxed);
+}
+
+void increment(Counter counter) {
+  if (counter < COUNTER_COUNT) bump(counters_[counter]);
+}
+
+uint32_t count(Stage stage) {
+  if (stage >= STAGE_COUNT) return 0;
+  uint32_t n = 0;
+  for (const auto& b : hist_[stage].buckets) n += b.load(std::memory_order_relaxed);
+  return n;
+}
+
+uint32_t maxUs(Stage stage) {
+  return stage < STAGE_COUNT ? hist_[stage].max.load(std::memory_order_relaxed) : 0;
+}
+
+uint32_t total(Counter counter) {
+  return counter < COUNTER_COUNT ? counters_[counter].load(std::memory_order_relaxed) : 0;
+}
+
+// Upper bound of the bucket holding the q-th fraction of the window
+static uint32_t percentile(const uint32_t* window, uint32_t n, uint32_t permille, uint32_t max) {
+  const uint32_t rank = static_cast<uint32_t>((static_cast<uint64_t>(n) * permille + 999) / 1000);
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < BUCKETS; b++) {
+    seen += window[b];
+    if (seen < rank) continue;
+    if (b == 0) return 0;
+    const uint32_t upper = b == BUCKETS - 1 ? max : (1UL << b);
+    return upper < max ? upper : max;
+  }
+  return max;
+}
+
+size_t toJson(uint32_t nowMs, char* out, size_t cap) {
+  int n = snprintf(out, cap, "{\"ms\":%lu", (unsigned long)nowMs);
+  if (n < 0 || static_cast<size_t>(n) >= cap) return 0;
+  size_t pos = static_cast<size_t>(n);
+
+  uint32_t current[STAGE_COUNT][BUCKETS];
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    uint32_t window[BUCKETS];
+    uint32_t total = 0;
+    for (uint8_t b = 0; b < BUCKETS; b++) {
+      current[s][b] = hist_[s].buckets[b].load(std::memory_order_relaxed);
+      window[b]     = current[s][b] - reported_[s][b];
+      total        += window[b];
+    }
+    const uint32_t max = hist_[s].max.load(std::memory_order_relaxed);
+    n = snprintf(out + pos, cap - pos, ",\"%s\":[%lu,%lu,%lu,%lu]", STAGE_NAMES[s],
+                 (unsigned long)total, (unsigned long)percentile(window, total, 500, max),
+                 (unsigned long)percentile(window, total, 990, max), (unsigned long)max);
+    if (n < 0 || static_cast<size_t>(n) >= cap - pos) return 0;
+    pos += static_cast<size_t>(n);
+  }
+  uint32_t counts[COUNTER_COUNT];
+  for (uint8_t c = 0; c < COUNTER_COUNT; c++) {
+    counts[c] = counters_[c].load(std::memory_order_relaxed);
+    n = snprintf(out + pos, cap - pos, ",\"%s\":[%lu,%lu]", COUNTER_NAMES[c],
+                 (unsigned long)(counts[c] - reportedCounts_[c]), (unsigned long)counts[c]);
+    if (n < 0 || static_cast<size_t>(n) >= cap - pos) return 0;
+    pos += static_cast<size_t>(n);
+  }
+  if (pos + 1 >= cap) return 0;
+  out[pos++] = '}';
+  out[pos]   = '\0';
+
+  // The window only moves on once it was written out
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    for (uint8_t b = 0; b < BUCKETS; b++) reported_[s][b] = current[s][b];
+  }
+  for (uint8_t c = 0; c < COUNTER_COUNT; c++) reportedCounts_[c] = counts[c];
+  return pos;
+}
+
+}  // namespace metrics
@@ -0,0 +1,105 @@
+/**
+ * @file mqtt_link.cpp
+ * @brief MQTT connection state machine implementation
+ */
+
+#include "mqtt_link.h"
+
+#include <string.h>
+
+MqttLink::MqttLink(hal::MqttTransport& client, hal::Clock& clock, const char* clientId, RandomFn rnd)
+  : client_(client), clock_(clock), clientId_(clientId), rnd_(rnd) {}
+
+void MqttLink::setBackoff(uint32_t minMs, uint32_t maxMs) {
+  minBackoffMs_ = minMs ? minMs : 1;
+  maxBackoffMs_ = maxMs < minBackoffMs_ ? minBackoffMs_ : maxMs;
+}
+
+bool MqttLink::subscribe(const char* topic) {
+  for (uint8_t i = 0; i < subCount_; i++) {
+    if (strcmp(subs_[i], topic) == 0) return true;
+  }
+  if (subCount_ >= MAX_SUBSCRIPTIONS) return false;
+  subs_[subCount_++] = topic;
+  return connected() ? client_.subscribe(topic) : true;
+}
+
+uint32_t MqttLink::retryInMs(uint32_t nowMs) const {
+  if (state_ != State::BACKOFF) return 0;
+  int32_t left = static_cast<int32_t>(retryAtMs_ - nowMs);
+  return left > 0 ? static_cast<uint32_t>(left) : 0;
+}
+
+// Equal jitter: half the exponential delay is fixed, half is random, so a
+// fleet that lost the broker together does not reconnect in lockstep.
+void MqttLink::scheduleRetry(uint32_t nowMs) {
+  uint32_t delayMs = minBackoffMs_;
+  for (uint8_t i = 0; i < failStreak_ && delayMs < maxBackoffMs_; i++) delayMs <<= 1;
+  if (delayMs > maxBackoffMs_) delayMs = maxBackoffMs_;
+
+  uint32_t half = delayMs / 2;
+  retryAtMs_ = nowMs + half + (half ? rnd_() % (half + 1) : 0);
+  state_     = State::BACKOFF;
+}
+
+void MqttLink::attempt(uint32_t nowMs) {
+  stats_.attempts++;
+
+  // Bounded by the transport's connect timeout
+  uint32_t start = clock_.millis();
+  bool ok = client_.connect(clientId_);
+  stats_.lastAttemptMs = clock_.millis() - start;
+  if (stats_.lastAttemptMs > stats_.maxAttemptMs) stats_.maxAttemptMs = stats_.lastAttemptMs;
+
+  // A session that misses a subscription would never hear those topics,
+  // so it counts as a failed connect
+  for (uint8_t i = 0; ok && i < subCount_; i++) ok = client_.subscribe(subs_[i]);
+  if (!ok) {
+    client_.disconnect();
+    stats_.failures++;
+    if (failStreak_ < 31) failStreak_++;
+    scheduleRetry(nowMs + stats_.lastAttemptMs);
+    return;
+  }
+
+  stats_.connects++;
+  upSinceMs_ = nowMs + stats_.lastAttemptMs;
+  state_     = State::CONNECTED;
+  if (onConnect_) onConnect_();
+}
+
+void MqttLink::service(uint32_t nowMs, bool networkUp) {
+  switch (state_) {
+    case State::CONNECTED:
+      if (networkUp && client_.loop()) return;
+      // Session dropped: a stable one retries after the minimum backoff,
+      // a short-lived one counts as a failed connect
+      client_.disconnect();
+      if (nowMs - upSinceMs_ >= maxBackoffMs_) {
+        failStreak_ = 0;
+      } else {
+        stats_.failures++;
+        if (failStreak_ < 31) failStreak_++;
+      }
+      scheduleRetry(nowMs);
+      if (!networkUp) state_ = State::OFFLINE;
+      return;
+
+    case State::OFFLINE:
+      if (!networkUp) return;
+      if (static_cast<int32_t>(nowMs - retryAtMs_) < 0) {
+        state_ = State::BACKOFF;  // the retry pending before the drop
+        return;
+      }
+      attempt(nowMs);
+      return;
+
+    case State::BACKOFF:
+      if (!networkUp) {
+        state_ = State::OFFLINE;
+        return;
+      }
+      if (static_cast<int32_t>(nowMs - retryAtMs_) >= 0) attempt(nowMs);
+      return;
+  }
+}
@@ -0,0 +1,809 @@
+/**
+ * @file main.cpp
+ * @brief Host-native simulator: runs the application against fake hardware
+ *
+ * Built by `pio run -e native`. The program learns ON/OFF/SET codes through
+ * the MQTT and IR fakes, checks the button gestures and the AC state
+ * commands, then runs auto control against a room model, or against a
+ * recorded temperature trace, and reports what the device did.
+ *
+ *   program [--hours N] [--trace FILE] [--controller LAW|all]
+ *           [--setpoint C] [--faults N] [--verbose]
+ *   program --threads SECONDS [--verbose]
+ *   program --bench RATE[,RATE...] [--bench-seconds S] [--ir-frame-us US]
+ *
+ * The simulated unit has no configured ID, so its topics are derived from
+ * its MAC. LAW is one of hysteresis, pid, predictive and is written with
+ * the setpoint to <id>/config/set, like a remote would on the device. "all" runs every law in its own
+ * child process on the same scenario and prints one comparison row each:
+ * on-time is the energy proxy, comfort error is measured against the
+ * setpoint.
+ *
+ * Two simulated sensors are fused: a synchronous DHT-like one with
+ * humidity, and a DS18B20-like probe with a 750 ms conversion and a
+ * PROBE_OFFSET_C calibration error. --faults N makes every Nth read of the
+ * first fail and every (N+3)th spike by FAULT_SPIKE_C, to exercise the
+ * sensor service's filtering.
+ *
+ * A trace is CSV text with one "seconds,tempC" sample per line ('#' starts
+ * a comment); each temperature holds until the next sample. The recorded
+ * room does not react to the AC, so traces exercise the control decisions
+ * rather than the loop.
+ *
+ * The simulation runs both application domains from one thread. --threads
+ * instead gives each its own std::thread for SECONDS of real time, as the
+ * firmware gives each its own core, while the main thread plays the
+ * outside world at random: broker messages, button presses, room
+ * temperature. Built with ThreadSanitizer (pio run -e native_tsan) this
+ * checks that the domains only meet through their queues.
+ *
+ * --bench runs the same threads as a command latency benchmark: for each
+ * offered RATE (commands/s) it reports the achieved rate and the p50, p99
+ * and max latency from a command's arrival on <id>/cmd to the end of its
+ * IR send, and the first rate the unit could not keep up with. The fake
+ * transmitter returns at once unless --ir-frame-us gives it a frame time
+ * (an NEC frame is about 68000 us). Output is one row per rate, stable
+ * for CI logs.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "app.h"
+#include "hal_fake.h"
+#include "log.h"
+#include "metrics.h"
+
+// ======================= Room Model =========================
+// Two-node room: the air exchanges heat with the outdoors and with the
+// building mass, and the AC cools the air. The mass makes the room coast
+// on after the AC switches, which is what the predictive law anticipates.
+constexpr float AIR_OUTDOOR_TAU_S = 3600.0f;
+constexpr float AIR_MASS_TAU_S    = 900.0f;
+constexpr float MASS_AIR_TAU_S    = 5400.0f;
+constexpr float COOLING_C_PER_S   = 0.006f;
+constexpr float OUTDOOR_MEAN_C    = 33.0f;
+constexpr float OUTDOOR_SWING_C   = 6.0f;
+constexpr float START_C           = 30.0f;
+constexpr uint32_t STEP_MS        = 1;
+constexpr uint32_t MODEL_STEP_MS  = 1000;
+
+constexpr uint8_t  BUTTON_PIN     = 26;
+constexpr uint8_t  SIM_MAC[6]     = { 0x24, 0x0a, 0xc4, 0x00, 0x51, 0x4d };
+const char* const  SIM_ZONE       = "lab";
+constexpr float    FAULT_SPIKE_C  = 15.0f;
+constexpr uint8_t  BOUNCES        = 3;
+constexpr uint32_t BOUNCE_US      = 300;
+constexpr uint32_t PROBE_CONVERSION_MS = 750;
+constexpr float    PROBE_OFFSET_C = 0.3f;
+constexpr uint32_t NEC_ON         = 0x20DF10EF;
+constexpr uint32_t NEC_OFF        = 0x20DF906F;
+constexpr uint32_t NEC_SET        = 0x20DF40BF;
+constexpr uint8_t  LEARN_PRESSES  = 2;      // the unit's default learn_count
+constexpr uint32_t PRESS_MS       = 300;    // between presses, past the unit's learn gap
+constexpr uint32_t LEARN_STEP_MS  = 30000;  // and its default learn_ms
+
+// Threaded run: domain sleeps like the firmware's (one tick minimum) and
+// the pace of the outside world
+constexpr uint32_t MIN_IDLE_US    = 1000;
+constexpr uint32_t MAX_IDLE_US    = 100000;
+constexpr uint32_t STIMULUS_US    = 2000;
+
+// ======================= Fakes ==============================
+static FakeClock   clock_;
+static FakeGpio    gpio(&clock_);
+static FakeSensor  sensor("dht");
+static FakeSensor  probe("ds18b20", PROBE_CONVERSION_MS, false);
+
+static const hal::SensorSlot sensors[] = {
+  { sensor, 1.0f },
+  { probe, 1.0f },
+};
+static FakeIrTx    irTx;
+static FakeIrRx    irRx;
+static SimFlash<8> flash;
+static FakeMqtt    mqtt;
+static FakeNetwork network;
+
+static const hal::Board board = {
+  clock_, gpio, sensors, sizeof(sensors) / sizeof(sensors[0]), irTx, irRx, flash, mqtt, network,
+  []() -> uint32_t { return static_cast<uint32_t>(rand()); },
+  [](uint8_t mac[6]) { memcpy(mac, SIM_MAC, sizeof(SIM_MAC)); },
+  BUTTON_PIN,
+  nullptr,  // derive the ID from the MAC, as an unconfigured unit would
+  SIM_ZONE,
+};
+
+// The same unit in real time, for --threads
+static HostClock   hostClock;
+static FakeGpio    liveGpio(&hostClock);
+
+static const hal::Board liveBoard = {
+  hostClock, liveGpio, sensors, sizeof(sensors) / sizeof(sensors[0]), irTx, irRx, flash, mqtt,
+  network,
+  []() -> uint32_t { return static_cast<uint32_t>(rand()); },
+  [](uint8_t mac[6]) { memcpy(mac, SIM_MAC, sizeof(SIM_MAC)); },
+  BUTTON_PIN,
+  nullptr,
+  SIM_ZONE,
+};
+static bool realTime = false;  // run() sleeps instead of advancing the fake clock
+
+struct Counters {
+  uint32_t status;
+  uint32_t batch;
+  uint32_t log;
+  uint32_t metrics;
+  uint32_t learn;
+  uint32_t other;
+};
+static Counters published = {};
+static char     lastLearn[128];  // last learn event
+static bool     verbose   = false;
+
+struct TracePoint {
+  uint32_t ms;
+  float    tempC;
+};
+static std::vector<TracePoint> trace;
+
+struct Result {
+  uint32_t switches;
+  uint64_t onMs;
+  double   absErrSum;  // C * samples
+  double   sqErrSum;
+  uint32_t outside;    // samples more than 1 C from the setpoint
+  uint32_t samples;
+  float    finalC;
+};
+
+static void onPublish(const char* topic, const uint8_t* payload, unsigned int len) {
+  const Topics& t   = app::topics();
+  const size_t  len0 = strlen(t.status);
+  if (strcmp(topic, t.status) == 0) {
+    published.status++;
+  } else if (strncmp(topic, t.status, len0) == 0 && strcmp(topic + len0, "/batch") == 0) {
+    published.batch++;
+  } else if (strcmp(topic, t.log) == 0) {
+    published.log++;
+  } else if (strcmp(topic, t.metrics) == 0) {
+    published.metrics++;
+  } else if (strcmp(topic, t.learn) == 0) {
+    published.learn++;
+    const size_t n = len < sizeof(lastLearn) - 1 ? len : sizeof(lastLearn) - 1;
+    memcpy(lastLearn, payload, n);
+    lastLearn[n] = '\0';
+  } else {
+    published.other++;
+  }
+  if (verbose) printf("  mqtt %s (%u bytes)\n", topic, len);
+  (void)payload;
+}
+
+static void run(uint32_t ms) {
+  if (realTime) {
+    const uint32_t start = hostClock.millis();
+    while (hostClock.millis() - start < ms) {
+      app::loop();
+      std::this_thread::sleep_for(std::chrono::microseconds(MIN_IDLE_US));
+    }
+    return;
+  }
+  for (uint32_t t = 0; t < ms; t += STEP_MS) {
+    app::loop();
+    clock_.advanceMs(STEP_MS);
+  }
+}
+
+static IrCode necCode(uint32_t value) {
+  IrCode code   = {};
+  code.format   = ircode::FORMAT_VALUE;
+  code.protocol = 3;  // NEC
+  code.bits     = 32;
+  code.value    = value;
+  return code;
+}
+
+static bool loadTrace(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) return false;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    double sec;
+    float  temp;
+    if (sscanf(line, "%lf,%f", &sec, &temp) != 2) continue;
+    trace.push_back({ static_cast<uint32_t>(sec * 1000.0), temp });
+  }
+  fclose(f);
+  return !trace.empty();
+}
+
+static float traceAt(uint32_t ms) {
+  static size_t i = 0;
+  while (i + 1 < trace.size() && trace[i + 1].ms <= ms) i++;
+  return trace[i].tempC;
+}
+
+// ======================= Scenario ===========================
+// Learn mode is entered through the zone topic, as for a group of units.
+// A stray frame before the first code only costs one more press.
+static bool learnCodes() {
+  mqtt.inject(app::topics().zoneCmd, "learn");
+  run(100);
+  irRx.inject(necCode(NEC_SET));
+  run(PRESS_MS);
+  const uint32_t codes[] = { NEC_ON, NEC_OFF, NEC_SET };
+  for (uint32_t value : codes) {
+    for (uint8_t i = 0; i < LEARN_PRESSES; i++) {
+      irRx.inject(necCode(value));
+      run(PRESS_MS);
+    }
+  }
+  return app::autoMode() && app::codeStore().count() == 3 && strstr(lastLearn, "\"done\"");
+}
+
+// A named slot nobody presses times out back to auto mode, saving nothing
+static bool checkLearnTimeout() {
+  mqtt.inject(app::topics().cmd, "learn=swing");
+  run(100);
+  const bool learning = !app::autoMode();
+  run(LEARN_STEP_MS);
+  uint16_t len;
+  const bool timedOut = app::autoMode() && strstr(lastLearn, "\"timeout\"") &&
+                        strstr(lastLearn, "\"swing\"") && !app::codeStore().get("swing", len);
+  if (learning && timedOut) return true;
+  fprintf(stderr, "learn timeout failed: learning %d timed out %d\n", learning, timedOut);
+  return false;
+}
+
+// A code sent during a capture must not be learned from its own echo: the
+// receiver is off for the frame and its guard, and the send is counted as
+// a collision
+static bool checkIrEcho() {
+  irTx.onSend([](const IrCode& c) {
+    if (irRx.enabled()) irRx.inject(c);
+  });
+  const uint32_t collisions = metrics::total(metrics::IR_COLLISION);
+  const uint32_t learnMsgs  = published.learn;
+  mqtt.inject(app::topics().cmd, "learn=echo");
+  run(100);
+  const uint32_t started = published.learn;
+  const uint32_t sent    = irTx.sent();
+  mqtt.inject(app::topics().cmd, "send=off");
+  run(1000);
+  irTx.onSend(nullptr);
+  const bool quiet = irTx.sent() == sent + 1 && published.learn == started &&
+                     started == learnMsgs + 1;
+  const bool counted = metrics::total(metrics::IR_COLLISION) == collisions + 1;
+  mqtt.inject(app::topics().cmd, "auto");
+  run(100);
+  if (quiet && counted && app::autoMode()) return true;
+  fprintf(stderr, "IR echo failed: captured %lu events, collision counted %d\n",
+          (unsigned long)(published.learn - started), counted);
+  return false;
+}
+
+// A burst of power commands queued while nothing could go out sends only
+// the final state
+static bool checkCoalescing() {
+  const uint32_t sent      = irTx.sent();
+  const uint32_t coalesced = metrics::total(metrics::IR_COALESCED);
+  mqtt.inject(app::topics().cmd, "on");
+  mqtt.inject(app::topics().cmd, "on");
+  mqtt.inject(app::topics().cmd, "off");
+  run(100);
+  const bool once = irTx.sent() == sent + 1 && irTx.last().value == NEC_OFF &&
+                    metrics::total(metrics::IR_COALESCED) == coalesced + 2;
+  if (once && app::thermostat().state() == Thermostat::State::OFF) return true;
+  fprintf(stderr, "IR coalescing failed: %lu frames sent, %lu superseded\n",
+          (unsigned long)(irTx.sent() - sent),
+          (unsigned long)(metrics::total(metrics::IR_COALESCED) - coalesced));
+  return false;
+}
+
+// Contact bounce around a level change, as a mechanical button makes
+static void bounce(bool level) {
+  for (uint8_t i = 0; i < BOUNCES; i++) {
+    gpio.set(BUTTON_PIN, level);
+    clock_.advanceUs(BOUNCE_US);
+    gpio.set(BUTTON_PIN, !level);
+    clock_.advanceUs(BOUNCE_US);
+  }
+  gpio.set(BUTTON_PIN, level);
+}
+
+// A bouncy press of holdMs. The loop does not run meanwhile, as if it were
+// stuck in a reconnect: only the edge interrupts see the press.
+static void press(uint32_t holdMs) {
+  bounce(false);
+  clock_.advanceMs(holdMs);
+  bounce(true);
+}
+
+// Short presses toggle the mode, a long one enters learn mode and a double
+// press toggles the AC
+static bool checkButton() {
+  const uint32_t sent = irTx.sent();
+  press(120);
+  run(1000);
+  const bool shortToLearn = !app::autoMode();
+  press(120);
+  run(1000);
+  const bool shortToAuto = app::autoMode();
+  press(2000);
+  run(1000);
+  const bool longToLearn = !app::autoMode();
+  mqtt.inject(app::topics().fleetCmd, "auto");
+  run(100);
+  for (uint8_t i = 0; i < 2; i++) {
+    press(100);
+    clock_.advanceMs(150);
+    press(100);
+    run(1000);
+  }
+  const bool doubleToggles = irTx.sent() == sent + 2 && irTx.last().value == NEC_OFF;
+  if (shortToLearn && shortToAuto && longToLearn && doubleToggles && app::autoMode()) return true;
+  fprintf(stderr, "button gestures failed: short %d/%d long %d double %d\n", shortToLearn,
+          shortToAuto, longToLearn, doubleToggles);
+  return false;
+}
+
+// With the unit's protocol configured, one command sends the whole AC
+// state as one frame and on/off go through the model as well
+static bool checkAcState() {
+  const uint32_t sent   = irTx.sent();
+  const uint32_t acSent = irTx.acSent();
+  mqtt.inject(app::topics().configSet, "ac_protocol=16");  // DAIKIN
+  run(100);
+  mqtt.inject(app::topics().cmd, "set 22.5 heat high-fan swing");
+  run(100);
+  const AcState& s = irTx.lastAc();
+  const bool oneFrame = irTx.acSent() == acSent + 1 && s.protocol == 16 && s.power &&
+                        s.mode == AcState::Mode::HEAT && s.tempC == 22.5f &&
+                        s.fan == AcState::Fan::FAST && s.swing == AcState::Swing::ON;
+  mqtt.inject(app::topics().cmd, "off");
+  run(100);
+  const bool offFrame = irTx.acSent() == acSent + 2 && !irTx.lastAc().power &&
+                        irTx.lastAc().mode == AcState::Mode::HEAT;
+  mqtt.inject(app::topics().configSet, "ac_protocol=0");
+  run(100);
+  if (oneFrame && offFrame && irTx.sent() == sent) return true;
+  fprintf(stderr, "AC state failed: set %d off %d learned codes sent %lu\n", oneFrame, offFrame,
+          (unsigned long)(irTx.sent() - sent));
+  return false;
+}
+
+static bool simulate(const char* law, float setpoint, float hours, Result& r) {
+  logger::attach(logger::SINK_SERIAL, [](const char* line) { return puts(line) >= 0; });
+  logger::setLevel(logger::SINK_SERIAL, verbose ? LOG_LVL_DEBUG : LOG_LVL_WARN);
+  mqtt.onPublish(onPublish);
+  app::begin(board);
+
+  run(1000);
+  if (!learnCodes()) {
+    fprintf(stderr, "learning failed: %u codes stored\n", app::codeStore().count());
+    return false;
+  }
+  if (!checkButton() || !checkAcState() || !checkIrEcho() || !checkCoalescing() ||
+      !checkLearnTimeout()) {
+    return false;
+  }
+  char buf[64];
+  snprintf(buf, sizeof(buf), "setpoint=%.2f;law=%s", setpoint, law);
+  mqtt.inject(app::topics().configSet, buf);
+  run(100);
+  if (strcmp(Thermostat::lawName(app::thermostat().config().law), law) != 0) {
+    fprintf(stderr, "unknown control law %s\n", law);
+    return false;
+  }
+
+  float    air   = START_C;
+  float    mass  = START_C;
+  bool     acOn  = false;
+  uint32_t sends = irTx.sent();
+  const uint32_t totalMs = static_cast<uint32_t>(hours * 3600.0f * 1000.0f);
+  const float    dtS     = MODEL_STEP_MS / 1000.0f;
+
+  r = {};
+  for (uint32_t t = 0; t < totalMs; t += MODEL_STEP_MS) {
+    if (trace.empty()) {
+      const float outdoor = OUTDOOR_MEAN_C + OUTDOOR_SWING_C * sinf(2.0f * 3.14159265f * t / 86400000.0f);
+      const float dAir    = (outdoor - air) / AIR_OUTDOOR_TAU_S + (mass - air) / AIR_MASS_TAU_S -
+                            (acOn ? COOLING_C_PER_S : 0.0f);
+      mass += (air - mass) / MASS_AIR_TAU_S * dtS;
+      air  += dAir * dtS;
+    } else {
+      air = traceAt(t);
+    }
+    sensor.set(air, 50.0f);
+    probe.set(air, NAN);
+
+    run(MODEL_STEP_MS);
+
+    if (irTx.sent() != sends) {
+      sends = irTx.sent();
+      const bool on = irTx.last().value == NEC_ON;
+      if (on != acOn) r.switches++;
+      acOn = on;
+    }
+    if (acOn) r.onMs += MODEL_STEP_MS;
+
+    const double err = air - setpoint;
+    r.absErrSum += fabs(err);
+    r.sqErrSum  += err * err;
+    if (fabs(err) > 1.0) r.outside++;
+    r.samples++;
+  }
+  r.finalC = air;
+  return true;
+}
+
+static void printRow(const char* law, float hours, const Result& r) {
+  const double n = r.samples ? r.samples : 1;
+  printf("%-11s %7.1f%% %6.1f %9lu %9.2f %9.2f %8.1f%%\n", law, 100.0 * r.onMs / (hours * 3600000.0),
+         r.onMs / 3600000.0, (unsigned long)r.switches, r.absErrSum / n, sqrt(r.sqErrSum / n),
+         100.0 * r.outside / n);
+}
+
+static void printTasks() {
+  for (uint8_t d = 0; d < app::DOMAIN_COUNT; d++) {
+    const Scheduler& sched = app::scheduler(static_cast<app::Domain>(d));
+    for (Scheduler::TaskId id = 0; id < sched.taskCount(); id++) {
+      const Scheduler::TaskStats* st = sched.stats(id);
+      printf("  task %-10s runs=%lu max=%luus miss=%lu\n", sched.name(id), (unsigned long)st->runs,
+             (unsigned long)st->maxUs, (unsigned long)st->deadlineMisses);
+    }
+  }
+}
+
+static void report(const char* law, float setpoint, float hours, const Result& r) {
+  printf("Simulated %.1f h, %s law, setpoint %.1f C\n", hours, law, setpoint);
+  printf("IR sends: %lu (%lu AC state changes), AC on %.1f%% of the time\n",
+         (unsigned long)irTx.sent(), (unsigned long)r.switches, 100.0 * r.onMs / (hours * 3600000.0));
+  printf("MQTT: %lu messages, %lu bytes (status %lu, batch %lu, log %lu, metrics %lu, learn %lu, "
+         "other %lu)\n",
+         (unsigned long)mqtt.published(), (unsigned long)mqtt.bytes(), (unsigned long)published.status,
+         (unsigned long)published.batch, (unsigned long)published.log,
+         (unsigned long)published.metrics, (unsigned long)published.learn,
+         (unsigned long)published.other);
+  const SensorService& sv = app::sensors();
+  printf("Sensors: %lu rounds, %lu estimates, final room %.1f C, estimate %.1f C\n",
+         (unsigned long)sv.stats().rounds, (unsigned long)sv.stats().estimates, r.finalC,
+         sv.latest().tempC);
+  for (uint8_t i = 0; i < sv.sensorCount(); i++) {
+    const SensorService::SensorStats& st = sv.sensorStats(i);
+    printf("  sensor %-8s %lu reads, %lu values rejected, %lu outliers filtered, max %lu us\n",
+           sv.sensorName(i), (unsigned long)st.reads, (unsigned long)st.rejected,
+           (unsigned long)st.outliers, (unsigned long)st.maxUs);
+  }
+
+  const Thermostat& th = app::thermostat();
+  const Thermostat::Stats& ts = th.stats();
+  printf("Thermostat: %lu evaluations, %lu on, %lu off, %lu held by dwell, %lu invalid\n",
+         (unsigned long)ts.evaluations, (unsigned long)ts.turnOns, (unsigned long)ts.turnOffs,
+         (unsigned long)ts.dwellHolds, (unsigned long)ts.invalid);
+  printf("Room model: %lu fits, time constant %.0f s\n", (unsigned long)ts.modelFits, th.timeConstantS());
+
+  const double n = r.samples ? r.samples : 1;
+  printf("Comfort: mean |error| %.2f C, rms %.2f C, %.1f%% of the time beyond 1 C\n",
+         r.absErrSum / n, sqrt(r.sqErrSum / n), 100.0 * r.outside / n);
+
+  printTasks();
+}
+
+// The application is a single instance, so each law gets a fresh process
+static int compareAll(float setpoint, float hours) {
+  static const char* const LAWS[] = { "hysteresis", "pid", "predictive" };
+  printf("Simulated %.1f h per law, setpoint %.1f C\n", hours, setpoint);
+  printf("%-11s %8s %6s %9s %9s %9s %9s\n", "law", "on-time", "on-h", "switches", "mean|e|C",
+         "rms C", ">1C");
+  fflush(stdout);
+
+  for (const char* law : LAWS) {
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+      Result r;
+      if (!simulate(law, setpoint, hours, r)) _exit(1);
+      printRow(law, hours, r);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+  }
+  return 0;
+}
+
+// ======================= Threaded Run =======================
+struct DomainThread {
+  std::mutex              mutex;
+  std::condition_variable cv;
+  bool                    woken = false;
+};
+static DomainThread      domainThreads[app::DOMAIN_COUNT];
+static std::atomic<bool> stopping{ false };
+
+static void wakeDomain(app::Domain domain) {
+  DomainThread& d = domainThreads[static_cast<uint8_t>(domain)];
+  {
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.woken = true;
+  }
+  d.cv.notify_one();
+}
+
+// The host twin of the firmware's domain task
+static void runDomain(app::Domain domain) {
+  DomainThread& d = domainThreads[static_cast<uint8_t>(domain)];
+  while (!stopping) {
+    uint32_t idleUs = app::loop(domain);
+    if (idleUs < MIN_IDLE_US) idleUs = MIN_IDLE_US;
+    if (idleUs > MAX_IDLE_US) idleUs = MAX_IDLE_US;
+    std::unique_lock<std::mutex> lock(d.mutex);
+    d.cv.wait_for(lock, std::chrono::microseconds(idleUs), [&] { return d.woken || stopping; });
+    d.woken = false;
+  }
+}
+
+static std::thread domainRunners[app::DOMAIN_COUNT];
+
+// Learns the codes in real time from this thread, then hands the unit to
+// one thread per domain
+static bool startDomains() {
+  realTime = true;
+  logger::attach(logger::SINK_SERIAL, [](const char* line) { return puts(line) >= 0; });
+  logger::setLevel(logger::SINK_SERIAL, verbose ? LOG_LVL_DEBUG : LOG_LVL_ERROR);
+  mqtt.onPublish(onPublish);
+  app::begin(liveBoard);
+  run(200);
+  if (!learnCodes()) {
+    fprintf(stderr, "learning failed: %u codes stored\n", app::codeStore().count());
+    return false;
+  }
+
+  app::onWake(wakeDomain);
+  for (uint8_t d = 0; d < app::DOMAIN_COUNT; d++) {
+    domainRunners[d] = std::thread(runDomain, static_cast<app::Domain>(d));
+  }
+  return true;
+}
+
+static void stopDomains() {
+  stopping = true;
+  for (uint8_t d = 0; d < app::DOMAIN_COUNT; d++) {
+    wakeDomain(static_cast<app::Domain>(d));
+    domainRunners[d].join();
+  }
+}
+
+// Everything the outside world may do to the unit, at random
+static int runThreads(float seconds) {
+  static const char* const COMMANDS[] = {
+    "on", "off", "set", "auto", "mode=auto", "stats", "log=dump", "control=pid",
+    "control=hysteresis", "setpoint=25.5", "bogus",
+  };
+  static const char* const CONFIG_WRITES[] = { "get", "kp=0.6;ki=0.0002", "sample_ms=2000", "band=x",
+                                               "batch=12;batch_ms=2000", "batch=0" };
+  constexpr uint8_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+  constexpr uint8_t CONFIG_COUNT  = sizeof(CONFIG_WRITES) / sizeof(CONFIG_WRITES[0]);
+
+  if (!startDomains()) return 1;
+
+  std::minstd_rand rng(1);
+  uint32_t injected = 0, refused = 0, presses = 0;
+  const uint32_t runMs = static_cast<uint32_t>(seconds * 1000.0f);
+  const uint32_t start = hostClock.millis();
+  while (hostClock.millis() - start < runMs) {
+    const uint32_t pick = rng() % (COMMAND_COUNT + CONFIG_COUNT + 2);
+    bool queued = true;
+    if (pick < COMMAND_COUNT) {
+      queued = mqtt.inject(rng() % 2 ? app::topics().cmd : app::topics().fleetCmd, COMMANDS[pick]);
+      injected++;
+    } else if (pick < COMMAND_COUNT + CONFIG_COUNT) {
+      queued = mqtt.inject(app::topics().configSet, CONFIG_WRITES[pick - COMMAND_COUNT]);
+      injected++;
+    } else if (pick == COMMAND_COUNT + CONFIG_COUNT) {
+      liveGpio.set(BUTTON_PIN, false);
+      std::this_thread::sleep_for(std::chrono::milliseconds(80 + rng() % 100));
+      liveGpio.set(BUTTON_PIN, true);
+      presses++;
+    } else {
+      const float temp = 20.0f + (rng() % 120) / 10.0f;
+      sensor.set(temp, 50.0f);
+      probe.set(temp, NAN);
+    }
+    if (!queued) refused++;
+    std::this_thread::sleep_for(std::chrono::microseconds(STIMULUS_US));
+  }
+
+  stopDomains();
+
+  printf("Threaded run: %.1f s, %lu messages injected (%lu refused by the broker), %lu presses\n",
+         seconds, (unsigned long)injected, (unsigned long)refused, (unsigned long)presses);
+  printf("IR sends: %lu, MQTT: %lu messages (status %lu, log %lu, other %lu), sensor rounds %lu\n",
+         (unsigned long)irTx.sent(), (unsigned long)mqtt.published(), (unsigned long)published.status,
+         (unsigned long)published.log, (unsigned long)published.other,
+         (unsigned long)app::sensors().stats().rounds);
+  printTasks();
+
+  // The threads are gone, so the window can be read from here
+  char json[512];
+  if (metrics::toJson(hostClock.millis(), json, sizeof(json))) printf("Metrics: %s\n", json);
+  return 0;
+}
+
+// ======================= Latency Benchmark ==================
+// Per offered rate, alternating send=on/send=off commands are injected on
+// <id>/cmd at a fixed schedule and each is timed from its scheduled
+// arrival to the end of its IR send, so time spent waiting to inject
+// counts against the unit too. Raw sends are never coalesced, unlike the
+// power commands, so each command is one frame. At most BENCH_WINDOW commands are outstanding, which keeps
+// the app's inbox from dropping any: every send then answers the oldest
+// command. The room reads NaN meanwhile, so auto control sends nothing.
+constexpr uint32_t BENCH_WINDOW   = 4;     // the app's inbox depth
+constexpr float    SATURATED_AT   = 0.95f; // achieved/offered below this is saturation
+
+static std::vector<uint32_t> benchSentUs;  // written by the control thread
+static std::atomic<uint32_t> benchSent{ 0 };
+
+struct BenchRow {
+  uint32_t rate;
+  uint32_t commands;
+  double   achieved;
+  uint32_t p50Us, p99Us, maxUs;
+};
+
+static bool parseRates(const char* text, std::vector<uint32_t>& rates) {
+  rates.clear();
+  for (const char* p = text; *p;) {
+    char* end;
+    const unsigned long rate = strtoul(p, &end, 10);
+    if (end == p || rate == 0) return false;
+    rates.push_back(static_cast<uint32_t>(rate));
+    p = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',') return false;
+  }
+  return !rates.empty();
+}
+
+static BenchRow benchRate(uint32_t rate, float seconds) {
+  const uint32_t count    = static_cast<uint32_t>(rate * seconds) ? static_cast<uint32_t>(rate * seconds) : 1;
+  const uint32_t periodUs = 1000000UL / rate;
+  std::vector<uint32_t> dueUs(count);
+  benchSentUs.assign(count, 0);
+  benchSent = 0;
+
+  const uint32_t start = hostClock.micros();
+  for (uint32_t i = 0; i < count; i++) {
+    dueUs[i] = start + i * periodUs;
+    while (static_cast<int32_t>(hostClock.micros() - dueUs[i]) < 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    while (i - benchSent.load(std::memory_order_acquire) >= BENCH_WINDOW ||
+           !mqtt.inject(app::topics().cmd, i % 2 ? "send=off" : "send=on")) {
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+  }
+  while (benchSent.load(std::memory_order_acquire) < count) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  const uint32_t elapsedUs = hostClock.micros() - start;
+
+  std::vector<uint32_t> latency(count);
+  for (uint32_t i = 0; i < count; i++) latency[i] = benchSentUs[i] - dueUs[i];
+  std::sort(latency.begin(), latency.end());
+  BenchRow row;
+  row.rate     = rate;
+  row.commands = count;
+  row.achieved = elapsedUs ? count * 1e6 / elapsedUs : 0;
+  row.p50Us    = latency[(count - 1) / 2];
+  row.p99Us    = latency[(count - 1) * 99 / 100];
+  row.maxUs    = latency.back();
+  return row;
+}
+
+static int runBench(const std::vector<uint32_t>& rates, float seconds, uint32_t frameUs) {
+  if (!startDomains()) return 1;
+  sensor.set(NAN, NAN);
+  probe.set(NAN, NAN);
+  irTx.setFrameUs(frameUs);
+  irTx.onSend([](const IrCode&) {
+    const uint32_t n = benchSent.load(std::memory_order_relaxed);
+    if (n < benchSentUs.size()) benchSentUs[n] = hostClock.micros();
+    benchSent.store(n + 1, std::memory_order_release);
+  });
+
+  printf("Command latency, MQTT arrival to IR sent (%.1f s per rate, IR frame %lu us)\n", seconds,
+         (unsigned long)frameUs);
+  printf("%8s %8s %10s %9s %9s %9s\n", "rate/s", "commands", "achieved/s", "p50 us", "p99 us",
+         "max us");
+  uint32_t saturation = 0;
+  for (uint32_t rate : rates) {
+    const BenchRow r = benchRate(rate, seconds);
+    printf("%8lu %8lu %10.1f %9lu %9lu %9lu\n", (unsigned long)r.rate, (unsigned long)r.commands,
+           r.achieved, (unsigned long)r.p50Us, (unsigned long)r.p99Us, (unsigned long)r.maxUs);
+    if (!saturation && r.achieved < SATURATED_AT * r.rate) saturation = rate;
+  }
+  stopDomains();
+  irTx.onSend(nullptr);
+
+  if (saturation) {
+    printf("Saturated at %lu/s\n", (unsigned long)saturation);
+  } else {
+    printf("Not saturated up to %lu/s\n", (unsigned long)rates.back());
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  float       hours    = 24.0f;
+  float       setpoint = 26.0f;
+  const char* law      = "hysteresis";
+  float       threads  = 0;
+  float       benchSeconds = 2.0f;
+  uint32_t    frameUs  = 0;
+  std::vector<uint32_t> benchRates;
+  probe.setOffset(PROBE_OFFSET_C);
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc) {
+      hours = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      if (!loadTrace(argv[++i])) {
+        fprintf(stderr, "cannot read trace %s\n", argv[i]);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--controller") == 0 && i + 1 < argc) {
+      law = argv[++i];
+    } else if (strcmp(argv[i], "--setpoint") == 0 && i + 1 < argc) {
+      setpoint = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--faults") == 0 && i + 1 < argc) {
+      const uint32_t every = static_cast<uint32_t>(atoi(argv[++i]));
+      sensor.setFaults(every, every ? every + 3 : 0, FAULT_SPIKE_C);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      if (!parseRates(argv[++i], benchRates)) {
+        fprintf(stderr, "bad rate list %s\n", argv[i]);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--bench-seconds") == 0 && i + 1 < argc) {
+      benchSeconds = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--ir-frame-us") == 0 && i + 1 < argc) {
+      frameUs = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else {
+      fprintf(stderr, "usage: %s [--hours N] [--trace FILE] [--controller LAW|all] [--setpoint C] [--faults N] [--verbose]\n"
+                      "       %s --threads SECONDS [--verbose]\n"
+                      "       %s --bench RATE[,RATE...] [--bench-seconds S] [--ir-frame-us US]\n",
+              argv[0], argv[0], argv[0]);
+      return 2;
+    }
+  }
+  if (threads > 0) return runThreads(threads);
+  if (!benchRates.empty()) return runBench(benchRates, benchSeconds, frameUs);
+  if (!trace.empty()) hours = trace.back().ms / 3600000.0f;
+
+  if (strcmp(law, "all") == 0) return compareAll(setpoint, hours);
+
+  Result r;
+  if (!simulate(law, setpoint, hours, r)) return 1;
+  report(law, setpoint, hours, r);
+  return 0;
+}
@@ -0,0 +1,355 @@
+/**
+ * @file record_store.cpp
+ * @brief Log-structured record store implementation
+ */
+
+#include "record_store.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static constexpr uint32_t SECTOR_MAGIC  = 0x31535249;  // "IRS1"
+static constexpr uint16_t RECORD_MAGIC  = 0x5AC3;
+static constexpr uint32_t SECTOR_HEADER = 16;
+static constexpr uint32_t RECORD_HEADER = 12;
+static constexpr uint8_t  FLAG_LIVE     = 0xFF;
+static constexpr uint8_t  FLAG_DELETED  = 0xFE;
+
+struct SectorHeader {
+  uint32_t magic;
+  uint16_t layout;
+  uint16_t reserved;
+  uint32_t seq;
+  uint32_t crc;
+};
+static_assert(sizeof(SectorHeader) == SECTOR_HEADER, "sector header layout");
+
+struct RecordHeader {
+  uint16_t magic;
+  uint8_t  nameLen;
+  uint8_t  flags;
+  uint16_t dataLen;
+  uint16_t reserved;
+  uint32_t crc;
+};
+static_assert(sizeof(RecordHeader) == RECORD_HEADER, "record header layout");
+
+// CRC-32 (IEEE, reflected), nibble table to keep flash use small
+static uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+  static const uint32_t TABLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint32_t recordCrc(const RecordHeader& h, const char* name, const uint8_t* data) {
+  uint32_t crc = crc32(0, &h, offsetof(RecordHeader, crc));
+  crc = crc32(crc, name, h.nameLen);
+  return crc32(crc, data, h.dataLen);
+}
+
+uint32_t RecordStore::recordSize(uint8_t nameLen, uint16_t dataLen) {
+  return (RECORD_HEADER + nameLen + dataLen + 3u) & ~3u;
+}
+
+uint32_t RecordStore::liveBytes() const {
+  uint32_t n = 0;
+  for (uint8_t i = 0; i < count_; i++) n += recordSize(strlen(cache_[i].name), cache_[i].len);
+  return n;
+}
+
+// One sector is the compaction reserve and one may be partly filled
+uint32_t RecordStore::capacity() const {
+  uint16_t n = flash_.sectorCount();
+  return n > 2 ? (n - 2) * (flash_.sectorSize() - SECTOR_HEADER) : 0;
+}
+
+int RecordStore::find(const char* name, uint8_t nameLen) const {
+  for (uint8_t i = 0; i < count_; i++) {
+    if (strncmp(cache_[i].name, name, nameLen) == 0 && cache_[i].name[nameLen] == '\0') return i;
+  }
+  return -1;
+}
+
+void RecordStore::apply(const char* name, uint8_t nameLen, bool tombstone, const uint8_t* data,
+                        uint16_t len, uint16_t sector) {
+  int i = find(name, nameLen);
+  if (tombstone) {
+    if (i >= 0) cache_[i] = cache_[--count_];
+    return;
+  }
+  if (i < 0) {
+    if (count_ >= MAX_RECORDS) return;
+    i = count_++;
+    memcpy(cache_[i].name, name, nameLen);
+    cache_[i].name[nameLen] = '\0';
+  }
+  if (len) memmove(cache_[i].data, data, len);  // relocation passes the cached copy itself
+  cache_[i].len    = len;
+  cache_[i].sector = sector;
+}
+
+bool RecordStore::sectorValid(uint16_t sector, uint32_t& seq) {
+  SectorHeader h;
+  if (!flash_.read(sector * flash_.sectorSize(), &h, sizeof(h))) return false;
+  if (h.magic != SECTOR_MAGIC || h.layout != LAYOUT) return false;
+  if (h.crc != crc32(0, &h, offsetof(SectorHeader, crc))) return false;
+  seq = h.seq;
+  return true;
+}
+
+bool RecordStore::blank(uint32_t addr, uint32_t len) {
+  uint8_t chunk[64];
+  while (len) {
+    const uint32_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+    if (!flash_.read(addr, chunk, n)) return false;
+    for (uint32_t i = 0; i < n; i++) {
+      if (chunk[i] != 0xFF) return false;
+    }
+    addr += n;
+    len  -= n;
+  }
+  return true;
+}
+
+// Replays a sector's records into the cache; leaves headPos_ at its end.
+// Writes are sequential, so the log ends where the rest of the sector is
+// erased. Bytes of a torn write are stepped over word by word until the
+// next record with a valid CRC.
+bool RecordStore::scanSector(uint16_t sector) {
+  const uint32_t base = sector * flash_.sectorSize();
+  const uint32_t size = flash_.sectorSize();
+  char    name[MAX_NAME];
+  uint8_t data[MAX_VALUE];
+
+  uint32_t pos = SECTOR_HEADER;
+  while (pos + RECORD_HEADER <= size) {
+    RecordHeader h;
+    if (!flash_.read(base + pos, &h, sizeof(h))) return false;
+    if (h.magic == 0xFFFF && blank(base + pos, size - pos)) break;
+
+    const uint32_t rsize = recordSize(h.nameLen, h.dataLen);
+    if (h.magic != RECORD_MAGIC || h.nameLen == 0 || h.nameLen > MAX_NAME ||
+        h.dataLen > MAX_VALUE || pos + rsize > size) {
+      stats_.crcErrors++;
+      pos += 4;
+      continue;
+    }
+
+    if (!flash_.read(base + pos + RECORD_HEADER, name, h.nameLen) ||
+        !flash_.read(base + pos + RECORD_HEADER + h.nameLen, data, h.dataLen)) {
+      return false;
+    }
+    if (recordCrc(h, name, data) != h.crc) {
+      // Interrupted update; the previous copy stays current
+      stats_.crcErrors++;
+      pos += 4;
+      continue;
+    }
+    apply(name, h.nameLen, h.flags == FLAG_DELETED, data, h.dataLen, sector);
+    pos += rsize;
+  }
+  headPos_ = pos < size ? pos : size;
+  return true;
+}
+
+bool RecordStore::openSector(uint16_t sector, uint32_t seq) {
+  SectorHeader h = { SECTOR_MAGIC, LAYOUT, 0xFFFF, seq, 0 };
+  h.crc = crc32(0, &h, offsetof(SectorHeader, crc));
+  if (!flash_.write(sector * flash_.sectorSize(), &h, sizeof(h))) return false;
+  head_    = sector;
+  headSeq_ = seq;
+  headPos_ = SECTOR_HEADER;
+  return true;
+}
+
+bool RecordStore::begin() {
+  const uint16_t n = flash_.sectorCount();
+  count_   = 0;
+  mounted_ = false;
+  if (n < 3) return false;
+
+  // Refuse to touch a region written by a newer layout
+  for (uint16_t s = 0; s < n; s++) {
+    SectorHeader h;
+    if (!flash_.read(s * flash_.sectorSize(), &h, sizeof(h))) return false;
+    if (h.magic == SECTOR_MAGIC && h.layout != LAYOUT &&
+        h.crc == crc32(0, &h, offsetof(SectorHeader, crc))) {
+      return false;
+    }
+  }
+
+  // Replay valid sectors oldest first (selection by sequence number)
+  bool     any     = false;
+  uint32_t lastSeq = 0;
+  for (;;) {
+    int      next    = -1;
+    uint32_t nextSeq = 0;
+    for (uint16_t s = 0; s < n; s++) {
+      uint32_t seq;
+      if (!sectorValid(s, seq)) continue;
+      if (any && seq <= lastSeq) continue;
+      if (next < 0 || seq < nextSeq) {
+        next    = s;
+        nextSeq = seq;
+      }
+    }
+    if (next < 0) break;
+    if (!scanSector(next)) return false;
+    head_    = next;
+    headSeq_ = nextSeq;
+    lastSeq  = nextSeq;
+    any      = true;
+  }
+
+  // Sectors without a valid header may hold a torn erase or header: wipe them
+  for (uint16_t s = 0; s < n; s++) {
+    uint32_t seq;
+    if (sectorValid(s, seq) || blank(s * flash_.sectorSize(), flash_.sectorSize())) continue;
+    if (!flash_.erase(s)) return false;
+    stats_.erases++;
+  }
+
+  if (!any) {
+    if (!openSector(0, 1)) return false;
+  } else {
+    // A power cut during compaction can leave the reserve sector in use
+    uint32_t seq;
+    uint16_t reserve = (head_ + 1) % n;
+    if (sectorValid(reserve, seq) && !compact(reserve)) return false;
+  }
+
+  mounted_ = true;
+  return true;
+}
+
+bool RecordStore::appendRaw(const char* name, uint8_t nameLen, bool tombstone,
+                            const uint8_t* data, uint16_t len) {
+  uint8_t buf[RECORD_HEADER + MAX_NAME + MAX_VALUE + 3];
+  const uint32_t size = recordSize(nameLen, len);
+
+  RecordHeader h = { RECORD_MAGIC, nameLen, tombstone ? FLAG_DELETED : FLAG_LIVE, len, 0xFFFF, 0 };
+  h.crc = recordCrc(h, name, data);
+
+  memset(buf, 0xFF, size);
+  memcpy(buf, &h, sizeof(h));
+  memcpy(buf + RECORD_HEADER, name, nameLen);
+  if (len) memcpy(buf + RECORD_HEADER + nameLen, data, len);
+
+  const uint32_t addr = head_ * flash_.sectorSize() + headPos_;
+  headPos_ += size;  // a failed write still consumes the space
+  stats_.writes++;
+  if (!flash_.write(addr, buf, size)) return false;
+
+  apply(name, nameLen, tombstone, data, len, head_);
+  return true;
+}
+
+// Re-appends the live records of `sector` to the head, then erases it
+bool RecordStore::compact(uint16_t sector) {
+  stats_.compactions++;
+  for (uint8_t i = 0; i < count_; i++) {
+    Entry& e = cache_[i];
+    if (e.sector != sector) continue;
+    const uint8_t nameLen = strlen(e.name);
+    if (headPos_ + recordSize(nameLen, e.len) > flash_.sectorSize()) return false;
+    if (!appendRaw(e.name, nameLen, false, e.data, e.len)) return false;
+    stats_.relocated++;
+  }
+  // Tombstones here are dropped: older copies lived in sectors already erased
+  if (!flash_.erase(sector)) return false;
+  stats_.erases++;
+  return true;
+}
+
+bool RecordStore::advanceHead() {
+  const uint16_t n    = flash_.sectorCount();
+  const uint16_t next = (head_ + 1) % n;
+
+  // The reserve is erased unless a compaction failed to erase it or a
+  // header write was torn; either way it holds no live record by now
+  if (!blank(next * flash_.sectorSize(), flash_.sectorSize())) {
+    for (uint8_t i = 0; i < count_; i++) {
+      if (cache_[i].sector == next) return false;
+    }
+    if (!flash_.erase(next)) return false;
+    stats_.erases++;
+  }
+
+  const uint16_t prevHead = head_;
+  const uint32_t prevSeq  = headSeq_;
+  const uint32_t prevPos  = headPos_;
+  if (!openSector(next, headSeq_ + 1)) return false;
+
+  // Keep one erased sector in reserve by compacting the oldest into the new head
+  uint32_t seq;
+  const uint16_t oldest = (next + 1) % n;
+  if (!sectorValid(oldest, seq) || compact(oldest)) return true;
+
+  // Only the erase failed: every live record has moved, so carry on and
+  // erase the sector when the head comes round to it
+  bool moved = true;
+  for (uint8_t i = 0; i < count_ && moved; i++) moved = cache_[i].sector != oldest;
+  if (moved) return true;
+
+  // A relocation failed. The oldest sector is intact, so point the moved
+  // records back at it and return the new head to the reserve; otherwise
+  // the head would later be opened on top of the oldest sector's records.
+  for (uint8_t i = 0; i < count_; i++) {
+    if (cache_[i].sector == next) cache_[i].sector = oldest;
+  }
+  head_    = prevHead;
+  headSeq_ = prevSeq;
+  headPos_ = prevPos;
+  if (flash_.erase(next)) stats_.erases++;
+  return false;
+}
+
+bool RecordStore::append(const char* name, uint8_t nameLen, bool tombstone,
+                         const uint8_t* data, uint16_t len) {
+  const uint32_t size = recordSize(nameLen, len);
+  for (uint16_t tries = 0; tries <= flash_.sectorCount(); tries++) {
+    if (headPos_ + size <= flash_.sectorSize()) return appendRaw(name, nameLen, tombstone, data, len);
+    if (!advanceHead()) return false;
+  }
+  return false;
+}
+
+bool RecordStore::put(const char* name, const void* data, uint16_t len) {
+  const size_t nameLen = strlen(name);
+  if (!mounted_ || nameLen == 0 || nameLen > MAX_NAME || len > MAX_VALUE) return false;
+
+  const int i = find(name, nameLen);
+  if (i >= 0 && cache_[i].len == len && (len == 0 || memcmp(cache_[i].data, data, len) == 0)) return true;
+  if (i < 0 && count_ >= MAX_RECORDS) return false;
+
+  uint32_t live = liveBytes() + recordSize(nameLen, len);
+  if (i >= 0) live -= recordSize(nameLen, cache_[i].len);
+  if (live > capacity()) return false;
+
+  return append(name, nameLen, false, static_cast<const uint8_t*>(data), len);
+}
+
+bool RecordStore::remove(const char* name) {
+  const size_t nameLen = strlen(name);
+  if (!mounted_ || nameLen == 0 || nameLen > MAX_NAME) return false;
+  if (find(name, nameLen) < 0) return true;
+  return append(name, nameLen, true, nullptr, 0);
+}
+
+const uint8_t* RecordStore::get(const char* name, uint16_t& len) const {
+  const size_t nameLen = strlen(name);
+  if (nameLen == 0 || nameLen > MAX_NAME) return nullptr;
+  const int i = find(name, nameLen);
+  if (i < 0) return nullptr;
+  len = cache_[i].len;
+  return cache_[i].data;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file scheduler.cpp
+ * @brief Cooperative scheduler implementation
+ */
+
+#include "scheduler.h"
+
+#include <string.h>
+
+// Wrap-safe "a is at or after b" for a 32-bit microsecond clock
+static inline bool reached(uint32_t now, uint32_t when) {
+  return static_cast<int32_t>(now - when) >= 0;
+}
+
+Scheduler::Scheduler(ClockFn clock) : clock_(clock) {
+  memset(tasks_, 0, sizeof(tasks_));
+}
+
+Scheduler::TaskId Scheduler::add(const char* name, TaskFn fn, bool periodic,
+                                 uint32_t periodUs, uint32_t deadlineUs) {
+  if (count_ >= MAX_TASKS || fn == nullptr) return INVALID_TASK;
+
+  Task& t      = tasks_[count_];
+  t.name       = name;
+  t.fn         = fn;
+  t.periodUs   = periodUs;
+  t.deadlineUs = deadlineUs;
+  t.releaseUs  = clock_() + periodUs;
+  t.periodic   = periodic;
+  t.enabled    = true;
+  t.pending    = false;
+  memset(&t.stats, 0, sizeof(t.stats));
+  return static_cast<TaskId>(count_++);
+}
+
+Scheduler::TaskId Scheduler::addPeriodic(const char* name, TaskFn fn, uint32_t periodMs,
+                                         uint32_t deadlineUs) {
+  return add(name, fn, true, periodMs * 1000UL, deadlineUs);
+}
+
+Scheduler::TaskId Scheduler::addEvent(const char* name, TaskFn fn, uint32_t deadlineUs) {
+  return add(name, fn, false, 0, deadlineUs);
+}
+
+void Scheduler::signal(TaskId id) {
+  if (!valid(id)) return;
+  Task& t = tasks_[id];
+  if (t.periodic || t.pending) return;
+  t.releaseUs = clock_();
+  t.pending   = true;
+}
+
+void Scheduler::setEnabled(TaskId id, bool enabled) {
+  if (!valid(id)) return;
+  Task& t = tasks_[id];
+  // Re-phase periodic tasks so re-enabling does not fire a backlog at once
+  if (enabled && !t.enabled && t.periodic) t.releaseUs = clock_() + t.periodUs;
+  t.enabled = enabled;
+}
+
+void Scheduler::setPeriod(TaskId id, uint32_t periodMs) {
+  if (!valid(id) || !tasks_[id].periodic) return;
+  Task& t = tasks_[id];
+  t.periodUs  = periodMs * 1000UL;
+  t.releaseUs = clock_() + t.periodUs;
+}
+
+bool Scheduler::enabled(TaskId id) const {
+  return valid(id) && tasks_[id].enabled;
+}
+
+const char* Scheduler::name(TaskId id) const {
+  return valid(id) ? tasks_[id].name : nullptr;
+}
+
+const Scheduler::TaskStats* Scheduler::stats(TaskId id) const {
+  return valid(id) ? &tasks_[id].stats : nullptr;
+}
+
+void Scheduler::resetStats() {
+  for (uint8_t i = 0; i < count_; i++) memset(&tasks_[i].stats, 0, sizeof(TaskStats));
+}
+
+void Scheduler::execute(Task& t, uint32_t now) {
+  const uint32_t release = t.releaseUs;
+  const uint32_t late    = now - release;
+
+  t.fn();
+
+  const uint32_t end     = clock_();
+  const uint32_t elapsed = end - now;
+
+  TaskStats& s = t.stats;
+  s.runs++;
+  s.totalUs += elapsed;
+  s.lastUs   = elapsed;
+  if (elapsed > s.maxUs)   s.maxUs = elapsed;
+  if (late > s.maxLateUs)  s.maxLateUs = late;
+  if (t.deadlineUs && (end - release) > t.deadlineUs) s.deadlineMisses++;
+}
+
+uint32_t Scheduler::idleUs() const {
+  const uint32_t now = clock_();
+  uint32_t idle = UINT32_MAX;
+  for (uint8_t i = 0; i < count_; i++) {
+    const Task& t = tasks_[i];
+    if (!t.enabled) continue;
+    if (!t.periodic) {
+      if (t.pending) return 0;
+      continue;
+    }
+    if (reached(now, t.releaseUs)) return 0;
+    if (t.releaseUs - now < idle) idle = t.releaseUs - now;
+  }
+  return idle;
+}
+
+uint8_t Scheduler::run() {
+  uint8_t ran = 0;
+
+  for (uint8_t i = 0; i < count_; i++) {
+    Task& t = tasks_[i];
+    if (!t.enabled) continue;
+
+    const uint32_t now = clock_();
+    if (t.periodic) {
+      if (!reached(now, t.releaseUs)) continue;
+      execute(t, now);
+      // Keep a drift-free cadence, but skip missed periods instead of bursting
+      t.releaseUs += t.periodUs;
+      if (reached(clock_(), t.releaseUs + t.periodUs)) t.releaseUs = clock_() + t.periodUs;
+    } else {
+      if (!t.pending) continue;
+      t.pending = false;
+      execute(t, now);
+    }
+    ran++;
+  }
+  return ran;
+}
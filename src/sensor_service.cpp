@@ -0,0 +1,171 @@
+/**
+ * @file sensor_service.cpp
+ * @brief Sensor rounds, validation, median filtering and fusion
+ */
+
+#include "sensor_service.h"
+
+#include <string.h>
+
+#include "metrics.h"
+
+// Wrap-safe "a is at or after b" for a 32-bit millisecond clock
+static inline bool reached(uint32_t now, uint32_t when) {
+  return static_cast<int32_t>(now - when) >= 0;
+}
+
+// Insertion sort of at most MAX_SENSORS or WINDOW values
+static float medianOf(const float* values, uint8_t n) {
+  if (n == 0) return NAN;
+  float sorted[SensorService::MAX_SENSORS > SensorService::WINDOW ? SensorService::MAX_SENSORS
+                                                                   : SensorService::WINDOW];
+  for (uint8_t i = 0; i < n; i++) {
+    float   v = values[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+bool SensorService::Channel::accept(float v, float lo, float hi, float step, SensorStats& stats) {
+  if (isnan(v) || v < lo || v > hi) {
+    stats.rejected++;
+    return false;
+  }
+  if (count >= 3 && fabsf(v - median()) > step) stats.outliers++;
+  values[next] = v;
+  next = (next + 1) % WINDOW;
+  if (count < WINDOW) count++;
+  return true;
+}
+
+float SensorService::Channel::median() const {
+  return medianOf(values, count);
+}
+
+bool SensorService::add(hal::ClimateSensor& sensor, float weight) {
+  if (count_ >= MAX_SENSORS || weight <= 0) return false;
+  Source& s = sensors_[count_++];
+  memset(&s.stats, 0, sizeof(s.stats));
+  s.sensor   = &sensor;
+  s.weight   = weight;
+  s.pending  = false;
+  s.haveTemp = false;
+  return true;
+}
+
+void SensorService::begin() {
+  for (uint8_t i = 0; i < count_; i++) sensors_[i].sensor->begin();
+}
+
+bool SensorService::service(uint32_t nowMs) {
+  if (!converting_) {
+    if (started_ && !reached(nowMs, nextRoundMs_)) return false;
+    // Keep the cadence, but restart it after a stall instead of catching up
+    nextRoundMs_ = started_ && !reached(nowMs, nextRoundMs_ + periodMs_) ? nextRoundMs_ + periodMs_
+                                                                          : nowMs + periodMs_;
+    started_ = true;
+    startRound(nowMs);
+  }
+
+  bool done = true;
+  for (uint8_t i = 0; i < count_; i++) {
+    Source& s = sensors_[i];
+    if (!s.pending) continue;
+    if (reached(nowMs, s.readyAtMs)) {
+      collect(s, nowMs);
+    } else {
+      done = false;
+    }
+  }
+  if (!done) return false;
+
+  converting_ = false;
+  fuse(nowMs);
+  return true;
+}
+
+void SensorService::startRound(uint32_t nowMs) {
+  stats_.rounds++;
+  converting_ = true;
+  for (uint8_t i = 0; i < count_; i++) {
+    Source& s = sensors_[i];
+    const bool pause   = s.sensor->masksInterrupts();
+    const uint32_t t0  = clock_.micros();
+    if (pause) irRx_.disable();
+    s.readyAtMs = nowMs + s.sensor->start();
+    if (pause) irRx_.enable();
+    s.startUs = clock_.micros() - t0;
+    s.pending = true;
+  }
+}
+
+void SensorService::collect(Source& s, uint32_t nowMs) {
+  float tempC, humidity;
+  const bool pause  = s.sensor->masksInterrupts();
+  const uint32_t t0 = clock_.micros();
+  if (pause) irRx_.disable();
+  s.sensor->collect(tempC, humidity);
+  if (pause) irRx_.enable();
+  const uint32_t elapsed = clock_.micros() - t0 + s.startUs;
+  s.pending = false;
+
+  metrics::record(metrics::SENSOR_READ, elapsed);
+  SensorStats& st = s.stats;
+  st.reads++;
+  st.lastUs   = elapsed;
+  st.totalUs += elapsed;
+  if (elapsed > st.maxUs) st.maxUs = elapsed;
+
+  if (s.sensor->hasHumidity()) {
+    s.humidity.accept(humidity, HUMIDITY_MIN, HUMIDITY_MAX, HUMIDITY_STEP, st);
+  }
+  if (s.temp.accept(tempC, TEMP_MIN_C, TEMP_MAX_C, TEMP_STEP_C, st)) {
+    s.tempAtMs = nowMs;
+    s.haveTemp = true;
+  }
+}
+
+void SensorService::fuse(uint32_t nowMs) {
+  float   temps[MAX_SENSORS];
+  uint8_t fresh[MAX_SENSORS];
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < count_; i++) {
+    const Source& s = sensors_[i];
+    if (!s.haveTemp || nowMs - s.tempAtMs > staleMs_) continue;
+    temps[n]   = s.temp.median();
+    fresh[n++] = i;
+  }
+  if (n == 0) return;
+
+  // An even split leaves nobody near the median; fall back to all of them
+  const float mid = n >= 3 ? medianOf(temps, n) : NAN;
+  bool exclude = false;
+  for (uint8_t k = 0; k < n && n >= 3; k++) exclude |= fabsf(temps[k] - mid) <= FUSE_SPREAD_C;
+
+  float tSum = 0, tWeight = 0, hSum = 0, hWeight = 0;
+  for (uint8_t k = 0; k < n; k++) {
+    const Source& s = sensors_[fresh[k]];
+    if (exclude && fabsf(temps[k] - mid) > FUSE_SPREAD_C) {
+      stats_.excluded++;
+      continue;
+    }
+    tSum    += s.weight * temps[k];
+    tWeight += s.weight;
+    if (s.humidity.count) {
+      hSum    += s.weight * s.humidity.median();
+      hWeight += s.weight;
+    }
+  }
+
+  stats_.estimates++;
+  latest_.tempC    = tSum / tWeight;
+  latest_.humidity = hWeight > 0 ? hSum / hWeight : NAN;
+  latest_.atMs     = nowMs;
+  haveTemp_        = true;
+}
+
+bool SensorService::stale(uint32_t nowMs) const {
+  return !haveTemp_ || nowMs - latest_.atMs > staleMs_;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file settings.cpp
+ * @brief Settings registry parsing, validation and formatting
+ */
+
+#include "settings.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "commands.h"
+
+const Settings::Entry* Settings::find(const char* key, size_t keyLen) const {
+  for (uint8_t i = 0; i < count_; i++) {
+    if (strlen(entries_[i].key) == keyLen && memcmp(entries_[i].key, key, keyLen) == 0) {
+      return &entries_[i];
+    }
+  }
+  return nullptr;
+}
+
+// Parses and range-checks value into e's variable; with check, the
+// registry-wide check must pass too or the old value is put back
+Settings::Result Settings::assign(const Entry& e, const char* value, size_t valueLen, bool check) {
+  if (valueLen > UINT8_MAX) return Result::BAD_VALUE;
+  cmd::Arg arg = { value, static_cast<uint8_t>(valueLen) };
+  check = check && check_;
+
+  switch (e.type) {
+    case Type::FLOAT: {
+      float v;
+      if (!arg.toFloat(v) || v < e.min || v > e.max) return Result::BAD_VALUE;
+      float& slot = *static_cast<float*>(e.value);
+      const float old = slot;
+      slot = v;
+      if (check && !check_()) {
+        slot = old;
+        return Result::REJECTED;
+      }
+      break;
+    }
+    case Type::UINT: {
+      int32_t v;
+      if (!arg.toInt(v) || v < e.min || v > e.max) return Result::BAD_VALUE;
+      uint32_t& slot = *static_cast<uint32_t*>(e.value);
+      const uint32_t old = slot;
+      slot = static_cast<uint32_t>(v);
+      if (check && !check_()) {
+        slot = old;
+        return Result::REJECTED;
+      }
+      break;
+    }
+    case Type::ENUM: {
+      uint8_t i = 0;
+      while (i < e.nameCount && !arg.equals(e.names[i])) i++;
+      if (i == e.nameCount) return Result::BAD_VALUE;
+      uint8_t& slot = *static_cast<uint8_t*>(e.value);
+      const uint8_t old = slot;
+      slot = i;
+      if (check && !check_()) {
+        slot = old;
+        return Result::REJECTED;
+      }
+      break;
+    }
+  }
+  return Result::OK;
+}
+
+Settings::Result Settings::set(const char* key, size_t keyLen, const char* value, size_t valueLen) {
+  const Entry* e = find(key, keyLen);
+  if (e == nullptr) return Result::UNKNOWN_KEY;
+  Result r = assign(*e, value, valueLen, true);
+  if (r == Result::OK && e->apply) e->apply();
+  return r;
+}
+
+// Cuts the next non-empty key=value pair out of [p, end), trimming spaces
+// and CR around it. eq is nullptr when the pair has no '='.
+static bool nextPair(const char*& p, const char* end, const char*& a, const char*& b,
+                     const char*& eq) {
+  while (p < end) {
+    const char* stop = p;
+    while (stop < end && *stop != ';' && *stop != '\n') stop++;
+
+    a = p;
+    b = stop;
+    while (a < b && (*a == ' ' || *a == '\r')) a++;
+    while (b > a && (b[-1] == ' ' || b[-1] == '\r')) b--;
+    p = stop + 1;
+    if (a == b) continue;
+
+    eq = static_cast<const char*>(memchr(a, '=', b - a));
+    return true;
+  }
+  return false;
+}
+
+Settings::Result Settings::setAll(const char* text, size_t len, const char*& badKey,
+                                  size_t& badKeyLen) {
+  const char* p   = text;
+  const char* end = text + len;
+  const char *a, *b, *eq;
+  while (nextPair(p, end, a, b, eq)) {
+    badKey    = a;
+    badKeyLen = eq ? static_cast<size_t>(eq - a) : static_cast<size_t>(b - a);
+    if (eq == nullptr) return Result::BAD_VALUE;
+
+    Result r = set(a, eq - a, eq + 1, b - eq - 1);
+    if (r != Result::OK) return r;
+  }
+  badKey    = nullptr;
+  badKeyLen = 0;
+  return Result::OK;
+}
+
+Settings::Result Settings::load(const char* text, size_t len, const char*& badKey,
+                                size_t& badKeyLen) {
+  Result first = Result::OK;
+  badKey       = nullptr;
+  badKeyLen    = 0;
+
+  const char* p   = text;
+  const char* end = text + len;
+  const char *a, *b, *eq;
+  while (nextPair(p, end, a, b, eq)) {
+    const Entry* e = eq ? find(a, eq - a) : nullptr;
+    Result r = eq == nullptr ? Result::BAD_VALUE
+               : e == nullptr ? Result::UNKNOWN_KEY
+                              : assign(*e, eq + 1, b - eq - 1, false);
+    if (r == Result::OK || first != Result::OK) continue;
+    first     = r;
+    badKey    = a;
+    badKeyLen = eq ? static_cast<size_t>(eq - a) : static_cast<size_t>(b - a);
+  }
+  if (check_ && !check_()) return Result::REJECTED;
+  return first;
+}
+
+void Settings::applyAll() const {
+  for (uint8_t i = 0; i < count_; i++) {
+    if (entries_[i].apply) entries_[i].apply();
+  }
+}
+
+// key=value with the value as a plain decimal, since toFloat() reads back
+// nothing else: seven significant digits (about a float's precision), at
+// most FLOAT_DECIMALS of them after the point, trailing zeros trimmed
+static constexpr int FLOAT_DECIMALS = 9;
+
+static size_t formatDecimal(const char* key, float value, char* out, size_t cap) {
+  const double v = value;
+  int decimals = v == 0 ? 0 : 6 - static_cast<int>(floor(log10(fabs(v))));
+  if (decimals < 0) decimals = 0;
+  if (decimals > FLOAT_DECIMALS) decimals = FLOAT_DECIMALS;
+  int n = snprintf(out, cap, "%s=%.*f", key, decimals, v);
+  if (n < 0 || static_cast<size_t>(n) >= cap || decimals == 0) return n < 0 ? cap : n;
+  while (out[n - 1] == '0') n--;
+  if (out[n - 1] == '.') n--;
+  out[n] = '\0';
+  return n;
+}
+
+size_t Settings::format(const Entry& e, char* out, size_t cap, bool json) const {
+  switch (e.type) {
+    case Type::FLOAT: {
+      const float v = *static_cast<const float*>(e.value);
+      if (!json) return formatDecimal(e.key, v, out, cap);
+      return snprintf(out, cap, "\"%s\":%g", e.key, static_cast<double>(v));
+    }
+    case Type::UINT:
+      return snprintf(out, cap, json ? "\"%s\":%lu" : "%s=%lu", e.key,
+                      static_cast<unsigned long>(*static_cast<const uint32_t*>(e.value)));
+    case Type::ENUM: {
+      uint8_t i = *static_cast<const uint8_t*>(e.value);
+      const char* name = i < e.nameCount ? e.names[i] : "?";
+      return snprintf(out, cap, json ? "\"%s\":\"%s\"" : "%s=%s", e.key, name);
+    }
+  }
+  return 0;
+}
+
+size_t Settings::toText(char* out, size_t cap) const {
+  size_t pos = 0;
+  for (uint8_t i = 0; i < count_; i++) {
+    if (i) {
+      if (pos + 1 >= cap) return 0;
+      out[pos++] = ';';
+    }
+    size_t n = format(entries_[i], out + pos, cap - pos, false);
+    if (n >= cap - pos) return 0;
+    pos += n;
+  }
+  if (pos >= cap) return 0;
+  out[pos] = '\0';
+  return pos;
+}
+
+size_t Settings::toJson(char* out, size_t cap) const {
+  if (cap < 3) return 0;
+  size_t pos = 0;
+  out[pos++] = '{';
+  for (uint8_t i = 0; i < count_; i++) {
+    if (i) {
+      if (pos + 1 >= cap) return 0;
+      out[pos++] = ',';
+    }
+    size_t n = format(entries_[i], out + pos, cap - pos, true);
+    if (n >= cap - pos) return 0;
+    pos += n;
+  }
+  if (pos + 2 > cap) return 0;
+  out[pos++] = '}';
+  out[pos]   = '\0';
+  return pos;
+}
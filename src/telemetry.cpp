@@ -0,0 +1,282 @@
+/**
+ * @file telemetry.cpp
+ * @brief Store-and-forward telemetry queue implementation
+ */
+
+#include "telemetry.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if TELEMETRY_FLASH_SPILL
+#include <LittleFS.h>
+
+static constexpr const char* SPILL_PATH = "/telemetry.bin";
+#endif
+
+static int16_t toTenths(float v) {
+  if (isnan(v) || v > 3276.0f || v < -3276.0f) return Telemetry::NO_VALUE;
+  return static_cast<int16_t>(lroundf(v * 10.0f));
+}
+
+static uint16_t putVarint(uint8_t* out, uint16_t pos, uint16_t cap, uint32_t v) {
+  do {
+    if (pos >= cap) return cap + 1;
+    uint8_t b = v & 0x7F;
+    v >>= 7;
+    out[pos++] = v ? (b | 0x80) : b;
+  } while (v);
+  return pos;
+}
+
+static uint32_t zigzag(int32_t v) {
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static bool getVarint(const uint8_t* in, uint16_t len, uint16_t& pos, uint32_t& v) {
+  v = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return false;
+    const uint8_t b = in[pos++];
+    v |= static_cast<uint32_t>(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+void Telemetry::setBatching(uint8_t batchSize, uint32_t flushMs) {
+  batchSize_ = batchSize > MAX_BATCH_SIZE ? MAX_BATCH_SIZE : batchSize;
+  flushMs_   = flushMs;
+}
+
+void Telemetry::begin(const char* topic) {
+  topic_ = topic;
+  snprintf(batchTopic_, sizeof(batchTopic_), "%s/batch", topic);
+#if TELEMETRY_FLASH_SPILL
+  // Timestamps are uptime-relative, so a spill left over from the previous
+  // boot cannot be placed on the timeline any more.
+  if (LittleFS.begin(true)) LittleFS.remove(SPILL_PATH);
+#endif
+}
+
+uint32_t Telemetry::backlog() const {
+#if TELEMETRY_FLASH_SPILL
+  return ram_.size() + spillCount_;
+#else
+  return ram_.size();
+#endif
+}
+
+void Telemetry::record(uint32_t nowMs, float temp, float hum) {
+  Sample s = { nowMs, toTenths(temp), toTenths(hum) };
+  stats_.recorded++;
+
+#if TELEMETRY_FLASH_SPILL
+  if (ram_.full()) spill();
+#endif
+  if (!ram_.push(s)) stats_.dropped++;
+
+  uint32_t depth = backlog();
+  if (depth > stats_.maxBacklog) stats_.maxBacklog = depth;
+}
+
+#if TELEMETRY_FLASH_SPILL
+// Moves the oldest chunk of the RAM ring to the end of the spill file
+void Telemetry::spill() {
+  uint16_t n = SPILL_CHUNK;
+  if (n > ram_.size()) n = ram_.size();
+
+  if (spillCount_ + n > SPILL_MAX) {
+    stats_.dropped += n;
+    ram_.drop(n);
+    return;
+  }
+
+  File f = LittleFS.open(SPILL_PATH, "a");
+  if (!f) {
+    stats_.dropped += n;
+    ram_.drop(n);
+    return;
+  }
+  for (uint16_t i = 0; i < n; i++) {
+    const Sample& s = ram_.peek(i);
+    f.write(reinterpret_cast<const uint8_t*>(&s), sizeof(s));
+  }
+  f.close();
+
+  ram_.drop(n);
+  spillCount_     += n;
+  stats_.spilled  += n;
+}
+#endif
+
+// The spill file always holds older samples than the RAM ring
+uint8_t Telemetry::loadOldest(Sample* out, uint8_t max) {
+#if TELEMETRY_FLASH_SPILL
+  if (spillCount_) {
+    uint8_t n = spillCount_ < max ? spillCount_ : max;
+    File f = LittleFS.open(SPILL_PATH, "r");
+    if (!f || !f.seek(spillReadPos_)) return 0;
+    size_t got = f.read(reinterpret_cast<uint8_t*>(out), n * sizeof(Sample));
+    f.close();
+    return static_cast<uint8_t>(got / sizeof(Sample));
+  }
+#endif
+  uint8_t n = 0;
+  while (n < max && n < ram_.size()) {
+    out[n] = ram_.peek(n);
+    n++;
+  }
+  return n;
+}
+
+void Telemetry::consumeOldest(uint8_t n, bool fromFlash) {
+#if TELEMETRY_FLASH_SPILL
+  if (fromFlash) {
+    spillCount_   -= n;
+    spillReadPos_ += n * sizeof(Sample);
+    if (spillCount_ == 0) {
+      LittleFS.remove(SPILL_PATH);
+      spillReadPos_ = 0;
+    }
+    return;
+  }
+#else
+  (void)fromFlash;
+#endif
+  ram_.drop(n);
+}
+
+bool Telemetry::publishSample(const Sample& s, uint32_t nowMs) {
+  char temp[8] = "null";
+  char hum[8]  = "null";
+  if (s.temp10 != NO_VALUE) snprintf(temp, sizeof(temp), "%.1f", s.temp10 / 10.0f);
+  if (s.hum10 != NO_VALUE)  snprintf(hum, sizeof(hum), "%.1f", s.hum10 / 10.0f);
+
+  // "age" lets the pipeline place replayed samples: ms before publication
+  char json[80];
+  snprintf(json, sizeof(json), "{\"temp\":%s,\"hum\":%s,\"age\":%lu}",
+           temp, hum, (unsigned long)(nowMs - s.ms));
+  unsigned int len = strlen(json);
+  if (!publish_(topic_, reinterpret_cast<const uint8_t*>(json), len)) return false;
+  stats_.messages++;
+  stats_.bytes += len;
+  return true;
+}
+
+uint16_t Telemetry::encodeBatch(const Sample* samples, uint8_t n, uint32_t nowMs,
+                                uint8_t* out, uint16_t cap) {
+  if (n == 0 || cap < 2) return 0;
+
+  uint16_t pos = 0;
+  out[pos++] = BATCH_VERSION;
+  out[pos++] = n;
+  pos = putVarint(out, pos, cap, nowMs - samples[0].ms);
+
+  uint32_t prevMs = samples[0].ms;
+  int32_t  temp   = 0;
+  int32_t  hum    = 0;
+  for (uint8_t i = 0; i < n && pos <= cap; i++) {
+    const Sample& s = samples[i];
+    const bool noTemp = s.temp10 == NO_VALUE;
+    const bool noHum  = s.hum10 == NO_VALUE;
+    const uint32_t dt = (s.ms - prevMs + 5) / 10;
+    prevMs += dt * 10;  // track the decoder's view so rounding cannot accumulate
+
+    pos = putVarint(out, pos, cap, (dt << 2) | (noTemp << 1) | noHum);
+    if (!noTemp) {
+      pos  = putVarint(out, pos, cap, zigzag(s.temp10 - temp));
+      temp = s.temp10;
+    }
+    if (!noHum) {
+      pos = putVarint(out, pos, cap, zigzag(s.hum10 - hum));
+      hum = s.hum10;
+    }
+  }
+  return pos <= cap ? pos : 0;
+}
+
+uint8_t Telemetry::decodeBatch(const uint8_t* in, uint16_t len, uint32_t nowMs, Sample* out,
+                               uint8_t max) {
+  if (len < 3 || in[0] != BATCH_VERSION || in[1] == 0 || in[1] > max) return 0;
+  const uint8_t n = in[1];
+  uint16_t pos = 2;
+  uint32_t age;
+  if (!getVarint(in, len, pos, age)) return 0;
+
+  uint32_t ms   = nowMs - age;
+  int32_t  temp = 0;
+  int32_t  hum  = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    uint32_t head, z;
+    if (!getVarint(in, len, pos, head)) return 0;
+    ms += (head >> 2) * 10;
+    out[i].ms = ms;
+    if (head & 2) {
+      out[i].temp10 = NO_VALUE;
+    } else {
+      if (!getVarint(in, len, pos, z)) return 0;
+      temp         += unzigzag(z);
+      out[i].temp10 = static_cast<int16_t>(temp);
+    }
+    if (head & 1) {
+      out[i].hum10 = NO_VALUE;
+    } else {
+      if (!getVarint(in, len, pos, z)) return 0;
+      hum         += unzigzag(z);
+      out[i].hum10 = static_cast<int16_t>(hum);
+    }
+  }
+  return pos == len ? n : 0;
+}
+
+void Telemetry::service(uint32_t nowMs, bool online) {
+  if (!online) return;
+  if (batching())
+    serviceBatch(nowMs);
+  else
+    serviceJson(nowMs);
+}
+
+// Flushes full batches, or a partial one once its oldest sample is flushMs old
+void Telemetry::serviceBatch(uint32_t nowMs) {
+  for (uint8_t b = 0; b < BATCHES_PER_SERVICE; b++) {
+#if TELEMETRY_FLASH_SPILL
+    const bool fromFlash = spillCount_ != 0;
+#else
+    const bool fromFlash = false;
+#endif
+    uint8_t n = loadOldest(scratch_, batchSize_);
+    if (n == 0) return;
+    if (n < batchSize_ && nowMs - scratch_[0].ms < flushMs_) return;
+
+    uint16_t len = encodeBatch(scratch_, n, nowMs, encoded_, sizeof(encoded_));
+    if (len == 0 || !publish_(batchTopic_, encoded_, len)) return;
+
+    consumeOldest(n, fromFlash);
+    stats_.published += n;
+    stats_.messages++;
+    stats_.bytes += len;
+  }
+}
+
+void Telemetry::serviceJson(uint32_t nowMs) {
+#if TELEMETRY_FLASH_SPILL
+  const bool fromFlash = spillCount_ != 0;
+#else
+  const bool fromFlash = false;
+#endif
+  Sample batch[REPLAY_BATCH];
+  uint8_t n = loadOldest(batch, REPLAY_BATCH);
+
+  uint8_t sent = 0;
+  while (sent < n && publishSample(batch[sent], nowMs)) sent++;
+
+  if (sent) consumeOldest(sent, fromFlash);
+  stats_.published += sent;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file thermostat.cpp
+ * @brief Thermostat control laws and online room model
+ */
+
+#include "thermostat.h"
+
+#include <math.h>
+#include <string.h>
+
+// Model temperatures are centred here to keep the least-squares fit well conditioned
+static constexpr float MODEL_REF_C   = 25.0f;
+static constexpr float MODEL_FORGET  = 0.998f;  // per sample; ~8 h memory at 1/min
+static constexpr float MODEL_P0      = 1.0f;
+static constexpr float MODEL_P_MAX   = 1.0e4f;  // stops covariance wind-up without excitation
+static constexpr float MIN_TAU_S     = 60.0f;
+static constexpr float MAX_TAU_S     = 48.0f * 3600.0f;
+
+const char* const Thermostat::LAW_NAMES[LAW_COUNT] = { "hysteresis", "pid", "predictive" };
+
+const char* Thermostat::lawName(Law law) {
+  return static_cast<uint8_t>(law) < LAW_COUNT ? LAW_NAMES[static_cast<uint8_t>(law)] : "?";
+}
+
+void Thermostat::configure(const Config& cfg) {
+  if (cfg.law != cfg_.law) {
+    pidStarted_ = false;
+    integral_   = 0;
+    duty_       = 0;
+  }
+  cfg_ = cfg;
+}
+
+Thermostat::Action Thermostat::update(uint32_t nowMs, float tempC) {
+  stats_.evaluations++;
+  if (isnan(tempC)) {
+    stats_.invalid++;
+    return Action::NONE;
+  }
+
+  fitModel(nowMs, tempC);
+
+  State want;
+  switch (cfg_.law) {
+    case Law::PID:        want = wantPid(nowMs, tempC);    break;
+    case Law::PREDICTIVE: want = wantPredictive(tempC);    break;
+    default:              want = wantHysteresis(tempC);    break;
+  }
+  if (want == state_ || want == State::UNKNOWN) return Action::NONE;
+
+  if (state_ != State::UNKNOWN) {
+    const uint32_t dwell = state_ == State::ON ? cfg_.minOnMs : cfg_.minOffMs;
+    if (nowMs - sinceMs_ < dwell) {
+      stats_.dwellHolds++;
+      return Action::NONE;
+    }
+  }
+
+  assume(want, nowMs);
+  if (want == State::ON) {
+    stats_.turnOns++;
+    return Action::TURN_ON;
+  }
+  stats_.turnOffs++;
+  return Action::TURN_OFF;
+}
+
+void Thermostat::assume(State state, uint32_t nowMs) {
+  if (state == state_) return;
+  state_   = state;
+  sinceMs_ = nowMs;
+}
+
+// ---- control laws ----
+Thermostat::State Thermostat::wantHysteresis(float tempC) const {
+  if (tempC >= cfg_.onAboveC) return State::ON;
+  if (tempC <= cfg_.offBelowC) return State::OFF;
+  return state_;
+}
+
+// Derivative on measurement, and the integral only moves while the output
+// is not saturated in the same direction (anti-windup). The duty is
+// latched at the start of each window; on-times too short for the dwell
+// limits are rounded to a full-off or full-on window, and a zero duty is
+// always a full-off one.
+Thermostat::State Thermostat::wantPid(uint32_t nowMs, float tempC) {
+  const float error = tempC - cfg_.setpointC;
+  float dtS   = 0;
+  float slope = 0;
+  if (pidStarted_) {
+    dtS   = (nowMs - lastMs_) / 1000.0f;
+    slope = dtS > 0 ? (tempC - lastTemp_) / dtS : 0;
+  } else {
+    windowStart_ = nowMs - cfg_.windowMs;  // open a window right away
+    pidStarted_  = true;
+  }
+  lastMs_   = nowMs;
+  lastTemp_ = tempC;
+
+  float u = cfg_.kp * error + integral_ + cfg_.kd * slope;
+  if ((u < 1.0f || error < 0) && (u > 0.0f || error > 0)) {
+    integral_ += cfg_.ki * error * dtS;
+    if (integral_ > 1.0f) integral_ = 1.0f;
+    if (integral_ < 0.0f) integral_ = 0.0f;
+    u = cfg_.kp * error + integral_ + cfg_.kd * slope;
+  }
+  duty_ = u < 0.0f ? 0.0f : u > 1.0f ? 1.0f : u;
+
+  if (nowMs - windowStart_ >= cfg_.windowMs) {
+    windowStart_ = nowMs;
+    onTimeMs_    = static_cast<uint32_t>(duty_ * cfg_.windowMs);
+    if (onTimeMs_ < cfg_.minOnMs) onTimeMs_ = 0;
+    if (onTimeMs_ > 0 && cfg_.windowMs - onTimeMs_ < cfg_.minOffMs) onTimeMs_ = cfg_.windowMs;
+  }
+  return nowMs - windowStart_ < onTimeMs_ ? State::ON : State::OFF;
+}
+
+// Plain hysteresis around the setpoint until the model is trusted
+Thermostat::State Thermostat::wantPredictive(float tempC) const {
+  const float high = cfg_.setpointC + cfg_.bandC;
+  const float low  = cfg_.setpointC - cfg_.bandC;
+  if (!modelReady()) {
+    if (tempC >= high) return State::ON;
+    if (tempC <= low) return State::OFF;
+    return state_;
+  }
+
+  if (state_ == State::ON) {
+    return predict(tempC, true, cfg_.leadMs) <= low ? State::OFF : State::ON;
+  }
+  const float drift = predict(tempC, false, cfg_.leadMs);
+  if (drift >= high) return State::ON;
+  return state_ == State::UNKNOWN && tempC <= low ? State::OFF : state_;
+}
+
+// ---- room model ----
+void Thermostat::resetModel() {
+  memset(theta_, 0, sizeof(theta_));
+  memset(p_, 0, sizeof(p_));
+  for (uint8_t i = 0; i < 3; i++) p_[i][i] = MODEL_P0;
+  sampled_ = false;
+}
+
+// One RLS step per MODEL_SAMPLE_MS: regress the observed slope on
+// [1, T - ref, on]. Samples spanning an unknown AC state are skipped.
+void Thermostat::fitModel(uint32_t nowMs, float tempC) {
+  const bool on = state_ == State::ON;
+  if (!sampled_ || state_ == State::UNKNOWN) {
+    sampled_    = state_ != State::UNKNOWN;
+    sampleMs_   = nowMs;
+    sampleTemp_ = tempC;
+    sampleOn_   = on;
+    return;
+  }
+  const uint32_t elapsed = nowMs - sampleMs_;
+  if (elapsed < MODEL_SAMPLE_MS) return;
+
+  if (on == sampleOn_) {
+    const float y      = (tempC - sampleTemp_) / (elapsed / 1000.0f);
+    const float phi[3] = { 1.0f, sampleTemp_ - MODEL_REF_C, on ? 1.0f : 0.0f };
+
+    float pphi[3];
+    float denom = MODEL_FORGET;
+    for (uint8_t i = 0; i < 3; i++) {
+      pphi[i] = p_[i][0] * phi[0] + p_[i][1] * phi[1] + p_[i][2] * phi[2];
+      denom  += phi[i] * pphi[i];
+    }
+    const float err = y - (theta_[0] * phi[0] + theta_[1] * phi[1] + theta_[2] * phi[2]);
+
+    float trace = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+      theta_[i] += pphi[i] / denom * err;
+      for (uint8_t j = 0; j < 3; j++) p_[i][j] -= pphi[i] * pphi[j] / denom;
+      trace += p_[i][i];
+    }
+    if (trace < MODEL_P_MAX) {
+      for (uint8_t i = 0; i < 3; i++) {
+        for (uint8_t j = 0; j < 3; j++) p_[i][j] /= MODEL_FORGET;
+      }
+    }
+    stats_.modelFits++;
+  }
+
+  sampleMs_   = nowMs;
+  sampleTemp_ = tempC;
+  sampleOn_   = on;
+}
+
+bool Thermostat::modelReady() const {
+  if (stats_.modelFits < MODEL_MIN_FITS || theta_[1] >= 0 || theta_[2] >= 0) return false;
+  const float tau = -1.0f / theta_[1];
+  return tau >= MIN_TAU_S && tau <= MAX_TAU_S;
+}
+
+float Thermostat::timeConstantS() const {
+  return modelReady() ? -1.0f / theta_[1] : 0.0f;
+}
+
+float Thermostat::predict(float tempC, bool acOn, uint32_t aheadMs) const {
+  if (!modelReady()) return tempC;
+  const float b   = theta_[1];
+  const float eq  = -(theta_[0] + (acOn ? theta_[2] : 0.0f)) / b;
+  const float x   = tempC - MODEL_REF_C;
+  const float out = eq + (x - eq) * expf(b * (aheadMs / 1000.0f));
+  return out + MODEL_REF_C;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file topics.cpp
+ * @brief Topic namespace construction
+ */
+
+#include "topics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+bool Topics::validLevel(const char* s) {
+  if (s == nullptr) return false;
+  size_t len = strlen(s);
+  return len > 0 && len <= MAX_ID && strpbrk(s, "/+#") == nullptr;
+}
+
+void Topics::build(const char* deviceId, const uint8_t mac[6], const char* zone) {
+  if (validLevel(deviceId)) {
+    strcpy(id, deviceId);
+  } else {
+    snprintf(id, sizeof(id), "ac-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3],
+             mac[4], mac[5]);
+  }
+
+  snprintf(cmd, sizeof(cmd), "%s/cmd", id);
+  snprintf(log, sizeof(log), "%s/log", id);
+  snprintf(status, sizeof(status), "%s/status", id);
+  snprintf(metrics, sizeof(metrics), "%s/metrics", id);
+  snprintf(learn, sizeof(learn), "%s/learn", id);
+  snprintf(config, sizeof(config), "%s/config", id);
+  snprintf(configSet, sizeof(configSet), "%s/config/set", id);
+  strcpy(fleetCmd, "fleet/all/cmd");
+  if (validLevel(zone) && strcmp(zone, "all") != 0) {
+    snprintf(zoneCmd, sizeof(zoneCmd), "fleet/%s/cmd", zone);
+  } else {
+    zoneCmd[0] = '\0';
+  }
+}
+
+bool Topics::isCommand(const char* topic) const {
+  return strcmp(topic, cmd) == 0 || strcmp(topic, fleetCmd) == 0 ||
+         (zoneCmd[0] && strcmp(topic, zoneCmd) == 0);
+}
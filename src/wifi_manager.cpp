@@ -0,0 +1,117 @@
+/**
+ * @file wifi_manager.cpp
+ * @brief Background Wi-Fi station manager implementation
+ */
+
+#include "wifi_manager.h"
+
+#include <WiFi.h>
+#include <Preferences.h>
+
+static constexpr const char* NVS_NAMESPACE = "wifi";
+
+WifiManager::WifiManager(const char* ssid, const char* pass) : ssid_(ssid), pass_(pass) {}
+
+void WifiManager::loadCache() {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, true)) return;
+  cacheValid_ = prefs.getBytes("bssid", bssid_, sizeof(bssid_)) == sizeof(bssid_);
+  channel_    = prefs.getUChar("chan", 0);
+  cacheValid_ = cacheValid_ && channel_ != 0;
+  prefs.end();
+}
+
+// Only writes when the AP actually changed, to spare the flash
+void WifiManager::storeCache() {
+  const uint8_t* bssid = WiFi.BSSID();
+  uint8_t channel = static_cast<uint8_t>(WiFi.channel());
+  if (bssid == nullptr || channel == 0) return;
+  if (cacheValid_ && channel == channel_ && memcmp(bssid, bssid_, sizeof(bssid_)) == 0) return;
+
+  memcpy(bssid_, bssid, sizeof(bssid_));
+  channel_    = channel;
+  cacheValid_ = true;
+
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return;
+  prefs.putBytes("bssid", bssid_, sizeof(bssid_));
+  prefs.putUChar("chan", channel_);
+  prefs.end();
+}
+
+void WifiManager::begin(uint32_t nowMs) {
+  WiFi.persistent(false);        // we keep our own cache, skip SDK flash writes
+  WiFi.setAutoReconnect(false);  // reconnects are driven by service()
+  WiFi.mode(WIFI_STA);
+  loadCache();
+  outageAtMs_ = nowMs;
+  startAttempt(nowMs, cacheValid_);
+}
+
+void WifiManager::startAttempt(uint32_t nowMs, bool fast) {
+  WiFi.disconnect();
+  if (fast) {
+    WiFi.begin(ssid_, pass_, channel_, bssid_, true);
+    state_ = State::FAST_CONNECT;
+  } else {
+    WiFi.begin(ssid_, pass_);
+    state_ = State::SCAN_CONNECT;
+  }
+  stateAtMs_ = nowMs;
+}
+
+void WifiManager::joined(uint32_t nowMs) {
+  uint32_t took = nowMs - outageAtMs_;
+  stats_.connects++;
+  stats_.lastFast = state_ == State::FAST_CONNECT;
+  if (stats_.lastFast) stats_.fastConnects++;
+  stats_.lastConnectMs   = took;
+  stats_.totalConnectMs += took;
+  if (took > stats_.maxConnectMs) stats_.maxConnectMs = took;
+
+  state_ = State::CONNECTED;
+  storeCache();
+  if (onChange_) onChange_(true);
+}
+
+void WifiManager::service(uint32_t nowMs) {
+  const bool up      = WiFi.status() == WL_CONNECTED;
+  const uint32_t age = nowMs - stateAtMs_;
+
+  switch (state_) {
+    case State::IDLE:
+      return;
+
+    case State::CONNECTED:
+      if (up) return;
+      outageAtMs_ = nowMs;
+      if (onChange_) onChange_(false);
+      startAttempt(nowMs, cacheValid_);
+      return;
+
+    case State::FAST_CONNECT:
+      if (up) {
+        joined(nowMs);
+      } else if (age >= FAST_TIMEOUT_MS) {
+        // The cached AP may have moved channel or been replaced
+        stats_.fastMisses++;
+        startAttempt(nowMs, false);
+      }
+      return;
+
+    case State::SCAN_CONNECT:
+      if (up) {
+        joined(nowMs);
+      } else if (age >= SCAN_TIMEOUT_MS) {
+        stats_.failures++;
+        WiFi.disconnect();
+        state_     = State::BACKOFF;
+        stateAtMs_ = nowMs;
+      }
+      return;
+
+    case State::BACKOFF:
+      if (age >= RETRY_DELAY_MS) startAttempt(nowMs, cacheValid_);
+      return;
+  }
+}
@@ -0,0 +1,222 @@
+/**
+ * @file test_button.cpp
+ * @brief Button debounce and gestures from edges queued by the fake GPIO
+ *
+ * The button is active low. Edges are stamped with the fake clock as the
+ * interrupt handler would stamp them; service() runs every millisecond
+ * unless a test stands for a busy main task by not calling it.
+ */
+
+#include <unity.h>
+
+#include "button.h"
+#include "hal_fake.h"
+
+static constexpr uint8_t  PIN         = 0;
+static constexpr uint32_t DEBOUNCE_MS = 50;
+static constexpr uint32_t LONG_MS     = 2000;
+static constexpr uint32_t DOUBLE_MS   = 400;
+
+static FakeClock*      clock_;
+static FakeGpio*       gpio;
+static hal::EdgeQueue* edges;
+static Button*         button;
+
+static Button::Gesture gestures[8];
+static uint8_t         gestureCount;
+static uint32_t        gestureAtMs[8];
+
+static void onGesture(Button::Gesture g) {
+  if (gestureCount < 8) {
+    gestureAtMs[gestureCount] = clock_->millis();
+    gestures[gestureCount]    = g;
+  }
+  gestureCount++;
+}
+
+void setUp() {
+  clock_ = new FakeClock();
+  gpio   = new FakeGpio(clock_);
+  edges  = new hal::EdgeQueue();
+  button = new Button(DEBOUNCE_MS, LONG_MS, DOUBLE_MS, onGesture);
+  gpio->watch(PIN, *edges);
+  gestureCount = 0;
+  clock_->advanceMs(1000);
+}
+
+void tearDown() {
+  delete button;
+  delete edges;
+  delete gpio;
+  delete clock_;
+}
+
+static void service() { button->service(*edges, clock_->micros(), gpio->read(PIN)); }
+
+// Services every millisecond for ms
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    clock_->advanceMs(1);
+    service();
+  }
+}
+
+static void press() { gpio->set(PIN, false); }
+static void release() { gpio->set(PIN, true); }
+
+// A press held for ms, then released
+static void tap(uint32_t ms) {
+  press();
+  run(ms);
+  release();
+}
+
+static void test_short_press_waits_out_double_window() {
+  tap(100);
+  const uint32_t releasedMs = clock_->millis();
+  run(DOUBLE_MS);
+  TEST_ASSERT_EQUAL(0, gestureCount);
+  run(1);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[0]);
+  // Measured from the release edge, not from when it was confirmed
+  TEST_ASSERT_EQUAL(releasedMs + DOUBLE_MS + 1, gestureAtMs[0]);
+  TEST_ASSERT_EQUAL(1, button->stats().presses);
+}
+
+// A level counts once it held for the debounce time without another edge
+static void test_debounce_edges() {
+  press();
+  run(DEBOUNCE_MS - 1);
+  TEST_ASSERT_FALSE(button->pressed());
+  release();
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(0, button->stats().presses);
+  TEST_ASSERT_EQUAL(1, button->stats().bounces);
+  TEST_ASSERT_EQUAL(0, gestureCount);
+
+  press();
+  run(DEBOUNCE_MS);
+  TEST_ASSERT_TRUE(button->pressed());
+}
+
+// Contact chatter on press and release is one short press
+static void test_chatter_is_one_press() {
+  for (uint8_t i = 0; i < 5; i++) {
+    press();
+    run(3);
+    release();
+    run(2);
+  }
+  press();
+  run(150);
+  for (uint8_t i = 0; i < 4; i++) {
+    release();
+    run(2);
+    press();
+    run(3);
+  }
+  release();
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(1, button->stats().presses);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[0]);
+  TEST_ASSERT_EQUAL(9, button->stats().bounces);  // one per transition cut short
+}
+
+// LONG is reported while held, once, at exactly longMs from the press
+static void test_long_press_fires_while_held() {
+  const uint32_t pressedMs = clock_->millis();
+  press();
+  run(LONG_MS - 1);
+  TEST_ASSERT_EQUAL(0, gestureCount);
+  run(1);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::LONG, gestures[0]);
+  TEST_ASSERT_EQUAL(pressedMs + LONG_MS, gestureAtMs[0]);
+  run(3000);
+  release();
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+}
+
+// Edges queued while the task was busy keep their times: a 3 s hold seen
+// only after the release is still LONG, a 100 ms one still SHORT
+static void test_blocked_task_keeps_edge_times() {
+  press();
+  clock_->advanceMs(3000);
+  release();
+  clock_->advanceMs(10);
+  service();
+  run(DEBOUNCE_MS);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::LONG, gestures[0]);
+
+  press();
+  clock_->advanceMs(100);
+  release();
+  clock_->advanceMs(DEBOUNCE_MS + DOUBLE_MS + 10);
+  service();
+  run(1);
+  TEST_ASSERT_EQUAL(2, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[1]);
+}
+
+// A second press within doubleMs of a short release is a DOUBLE, reported
+// on its release; one later is a second SHORT
+static void test_double_press_window() {
+  tap(100);
+  run(DOUBLE_MS);
+  tap(100);
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::DOUBLE, gestures[0]);
+
+  tap(100);
+  run(DOUBLE_MS + 1);
+  tap(100);
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(3, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[1]);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[2]);
+}
+
+// Holding the second press of a double does not also make it LONG
+static void test_held_second_press_stays_double() {
+  tap(100);
+  run(200);
+  tap(LONG_MS + 500);
+  run(DEBOUNCE_MS + DOUBLE_MS + 10);
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::DOUBLE, gestures[0]);
+}
+
+// With no edge queued, the pin level read in service() is trusted, so a
+// lost edge or a board without interrupts still sees the press
+static void test_level_resyncs_without_edges() {
+  for (uint32_t i = 0; i < 100; i++) {
+    clock_->advanceMs(1);
+    button->service(*edges, clock_->micros(), false);
+  }
+  TEST_ASSERT_TRUE(button->pressed());
+  for (uint32_t i = 0; i < DEBOUNCE_MS + DOUBLE_MS + 10; i++) {
+    clock_->advanceMs(1);
+    button->service(*edges, clock_->micros(), true);
+  }
+  TEST_ASSERT_EQUAL(1, gestureCount);
+  TEST_ASSERT_EQUAL(Button::Gesture::SHORT, gestures[0]);
+  TEST_ASSERT_EQUAL(0, button->stats().edges);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_short_press_waits_out_double_window);
+  RUN_TEST(test_debounce_edges);
+  RUN_TEST(test_chatter_is_one_press);
+  RUN_TEST(test_long_press_fires_while_held);
+  RUN_TEST(test_blocked_task_keeps_edge_times);
+  RUN_TEST(test_double_press_window);
+  RUN_TEST(test_held_second_press_stays_double);
+  RUN_TEST(test_level_resyncs_without_edges);
+  return UNITY_END();
+}
@@ -0,0 +1,293 @@
+/**
+ * @file test_commands.cpp
+ * @brief Command parsing and perfect-hash dispatch over raw payloads
+ *
+ * The table carries the firmware's command names with recording handlers,
+ * so every name is dispatched exactly as app.cpp's table would. The
+ * dispatch bench prints nanoseconds per command (pio test -v shows it).
+ */
+
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "commands.h"
+
+static const char* called;
+static std::string argText;
+static bool        accept;
+
+// One recording handler per command, as the table keys on the function
+#define RECORDER(cmdName)                           \
+  [](cmd::Arg arg) {                                \
+    called = cmdName;                               \
+    argText.assign(arg.data, arg.len);              \
+    return accept;                                  \
+  }
+
+// The firmware's command list, app.cpp COMMAND_LIST
+static constexpr cmd::Command COMMAND_LIST[] = {
+  { "on",       RECORDER("on")       },
+  { "off",      RECORDER("off")      },
+  { "set",      RECORDER("set")      },
+  { "auto",     RECORDER("auto")     },
+  { "learn",    RECORDER("learn")    },
+  { "send",     RECORDER("send")     },
+  { "mode",     RECORDER("mode")     },
+  { "control",  RECORDER("control")  },
+  { "setpoint", RECORDER("setpoint") },
+  { "stats",    RECORDER("stats")    },
+  { "log",      RECORDER("log")      },
+};
+static constexpr auto COMMANDS = cmd::makeTable<64>(COMMAND_LIST);
+static_assert(COMMANDS.perfect, "the firmware's table must stay collision-free");
+
+static cmd::Result dispatch(const char* payload) {
+  return COMMANDS.dispatch(payload, strlen(payload));
+}
+
+void setUp() {
+  called = nullptr;
+  argText.clear();
+  accept = true;
+}
+
+void tearDown() {}
+
+static void test_each_command_reaches_its_handler() {
+  for (const cmd::Command& c : COMMAND_LIST) {
+    called = nullptr;
+    TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch(c.name));
+    TEST_ASSERT_EQUAL_STRING(c.name, called);
+    TEST_ASSERT_TRUE(argText.empty());
+  }
+}
+
+static void test_argument_after_equals_or_space() {
+  TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch("mode=learn"));
+  TEST_ASSERT_EQUAL_STRING("mode", called);
+  TEST_ASSERT_EQUAL_STRING("learn", argText.c_str());
+
+  TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch("set   24 cool auto-fan\r\n"));
+  TEST_ASSERT_EQUAL_STRING("set", called);
+  TEST_ASSERT_EQUAL_STRING("24 cool auto-fan", argText.c_str());
+
+  TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch("log=mqtt:warn"));
+  TEST_ASSERT_EQUAL_STRING("mqtt:warn", argText.c_str());
+
+  TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch("on\n"));
+  TEST_ASSERT_EQUAL_STRING("on", called);
+  TEST_ASSERT_TRUE(argText.empty());
+}
+
+// setpoint=<C> takes a decimal, mode= one of a few words
+static void test_parameterised_arguments() {
+  struct {
+    const char* payload;
+    bool        ok;
+    float       value;
+  } setpoints[] = {
+    { "setpoint=24",   true,  24.0f  },
+    { "setpoint=-1.5", true,  -1.5f  },
+    { "setpoint 22.5", true,  22.5f  },
+    { "setpoint=",     false, 0      },
+    { "setpoint=24C",  false, 0      },
+    { "setpoint=2 4",  false, 0      },
+    { "setpoint=123456789012345678", false, 0 },
+    { "setpoint=.5",   true,  0.5f   },
+    { "setpoint=-.",   false, 0      },
+    { "setpoint=nan",  false, 0      },
+    { "setpoint=-inf", false, 0      },
+    { "setpoint=1e1",  false, 0      },
+    { "setpoint=0x10", false, 0      },
+    { "setpoint=1.2.", false, 0      },
+  };
+  for (const auto& s : setpoints) {
+    TEST_ASSERT_EQUAL(cmd::Result::OK, dispatch(s.payload));
+    const cmd::Arg arg = { argText.data(), static_cast<uint8_t>(argText.size()) };
+    float v = 0;
+    TEST_ASSERT_EQUAL_MESSAGE(s.ok, arg.toFloat(v), s.payload);
+    if (s.ok) TEST_ASSERT_EQUAL_FLOAT(s.value, v);
+  }
+
+  const char* modes[] = { "auto", "learn" };
+  for (const char* m : modes) {
+    char payload[16];
+    snprintf(payload, sizeof(payload), "mode=%s", m);
+    dispatch(payload);
+    const cmd::Arg arg = { argText.data(), static_cast<uint8_t>(argText.size()) };
+    TEST_ASSERT_TRUE(arg.equals(m));
+    TEST_ASSERT_FALSE(arg.equals("aut"));
+    TEST_ASSERT_FALSE(arg.equals("learning"));
+  }
+}
+
+static void test_integer_arguments() {
+  struct {
+    const char* text;
+    bool        ok;
+    int32_t     value;
+  } cases[] = {
+    { "0", true, 0 },           { "+42", true, 42 },         { "-2147483648", true, INT32_MIN },
+    { "2147483647", true, INT32_MAX },                       { "2147483648", false, 0 },
+    { "-", false, 0 },          { "", false, 0 },            { "12a", false, 0 },
+    { "999999999999", false, 0 },
+  };
+  for (const auto& c : cases) {
+    const cmd::Arg arg = { c.text, static_cast<uint8_t>(strlen(c.text)) };
+    int32_t v = 0;
+    TEST_ASSERT_EQUAL_MESSAGE(c.ok, arg.toInt(v), c.text);
+    if (c.ok) TEST_ASSERT_EQUAL_INT32(c.value, v);
+  }
+}
+
+static void test_rejected_argument_is_bad_arg() {
+  accept = false;
+  TEST_ASSERT_EQUAL(cmd::Result::BAD_ARG, dispatch("send=../x"));
+  TEST_ASSERT_EQUAL_STRING("send", called);
+}
+
+static void test_empty_payloads_are_unknown() {
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, COMMANDS.dispatch("", 0));
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, COMMANDS.dispatch("on", 0));
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, dispatch("\r\n"));
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, dispatch("   "));
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, dispatch("=on"));
+  TEST_ASSERT_NULL(called);
+}
+
+// Payloads come straight from the MQTT client's buffer, with no NUL after
+// them: nothing past size may be read
+static void test_payload_is_not_terminated() {
+  const char buf[] = { 'o', 'f', 'f', 'x', 'y' };
+  TEST_ASSERT_EQUAL(cmd::Result::OK, COMMANDS.dispatch(buf, 3));
+  TEST_ASSERT_EQUAL_STRING("off", called);
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, COMMANDS.dispatch(buf, 2));
+
+  const char sp[] = { 's', 'e', 't', 'p', 'o', 'i', 'n', 't', '=', '2', '1', '9', '9' };
+  TEST_ASSERT_EQUAL(cmd::Result::OK, COMMANDS.dispatch(sp, 11));
+  const cmd::Arg arg = { sp + 9, 2 };
+  float v = 0;
+  TEST_ASSERT_TRUE(arg.toFloat(v));
+  TEST_ASSERT_EQUAL_FLOAT(21.0f, v);
+  int32_t i = 0;
+  TEST_ASSERT_TRUE(arg.toInt(i));
+  TEST_ASSERT_EQUAL_INT32(21, i);
+}
+
+// The inbox holds up to CONFIG_TEXT_MAX bytes; arguments longer than a
+// uint8_t and names longer than MAX_NAME are refused, not truncated
+static void test_long_payloads() {
+  std::string p = "set " + std::string(200, 'x');
+  TEST_ASSERT_EQUAL(cmd::Result::OK, COMMANDS.dispatch(p.data(), p.size()));
+  TEST_ASSERT_EQUAL(200, argText.size());
+
+  p = "set " + std::string(UINT8_MAX, 'x');
+  TEST_ASSERT_EQUAL(cmd::Result::OK, COMMANDS.dispatch(p.data(), p.size()));
+  p = "set " + std::string(UINT8_MAX + 1, 'x');
+  called = nullptr;
+  TEST_ASSERT_EQUAL(cmd::Result::BAD_ARG, COMMANDS.dispatch(p.data(), p.size()));
+  TEST_ASSERT_NULL(called);
+
+  p = std::string(300, 'o');
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, COMMANDS.dispatch(p.data(), p.size()));
+  p = "setpointsetpoints=1";  // a 17-character name
+  TEST_ASSERT_EQUAL(cmd::Result::UNKNOWN, dispatch(p.c_str()));
+}
+
+static void test_unknown_commands() {
+  const char* unknown[] = { "of", "onn", "ON", "Off", "setp", "setpoint2", "stat", "logs", "x", "mode_" };
+  for (const char* u : unknown) TEST_ASSERT_EQUAL_MESSAGE(cmd::Result::UNKNOWN, dispatch(u), u);
+  TEST_ASSERT_NULL(called);
+}
+
+// A name landing on a command's slot still has to match it in full
+static void test_slot_neighbours_are_unknown() {
+  using T = decltype(COMMANDS);
+  for (const cmd::Command& c : COMMAND_LIST) {
+    std::string twin = c.name;
+    twin.back() = twin.back() == 'z' ? 'y' : 'z';
+    TEST_ASSERT_EQUAL(T::hash(twin.size(), twin[0]), T::hash(strlen(c.name), c.name[0]));
+    TEST_ASSERT_EQUAL_MESSAGE(cmd::Result::UNKNOWN, dispatch(twin.c_str()), twin.c_str());
+  }
+}
+
+static bool nop(cmd::Arg) { return true; }
+
+// Same length and first letter share a slot: the table says so at compile time
+static void test_collisions_are_detected() {
+  static constexpr cmd::Command clash[] = { { "send", nop }, { "stop", nop } };
+  static constexpr auto collided = cmd::makeTable<64>(clash);
+  static_assert(!collided.perfect, "send and stop share a slot");
+
+  static constexpr cmd::Command longName[] = { { "abcdefghijklmnopq", nop } };
+  static_assert(!cmd::makeTable<4>(longName).perfect, "names past MAX_NAME are refused");
+  static constexpr cmd::Command noName[] = { { "", nop } };
+  static_assert(!cmd::makeTable<4>(noName).perfect, "empty names are refused");
+
+  // The later name wins the slot, so the earlier one would go deaf
+  TEST_ASSERT_TRUE(collided.find("stop", 4) != nullptr);
+  TEST_ASSERT_TRUE(collided.find("send", 4) == nullptr);
+}
+
+// Nanoseconds per dispatch, against a strcmp scan of the same list
+static void test_dispatch_bench() {
+  constexpr uint32_t ROUNDS = 200000;
+  const char* payloads[] = { "on", "off", "set 24 cool", "auto", "learn=swing", "send=on",
+                             "mode=auto", "control=pid", "setpoint=22.5", "stats", "log=warn",
+                             "bogus" };
+  constexpr size_t N = sizeof(payloads) / sizeof(payloads[0]);
+  size_t lens[N];
+  for (size_t i = 0; i < N; i++) lens[i] = strlen(payloads[i]);
+  using Clock = std::chrono::steady_clock;
+
+  uint32_t hits = 0;
+  Clock::time_point t0 = Clock::now();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < N; i++) hits += COMMANDS.dispatch(payloads[i], lens[i]) == cmd::Result::OK;
+  }
+  const double tableNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (ROUNDS * N);
+
+  uint32_t scanHits = 0;
+  t0 = Clock::now();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < N; i++) {
+      size_t nameLen = 0;
+      while (nameLen < lens[i] && payloads[i][nameLen] != '=' && payloads[i][nameLen] != ' ') nameLen++;
+      for (const cmd::Command& c : COMMAND_LIST) {
+        if (strlen(c.name) == nameLen && memcmp(c.name, payloads[i], nameLen) == 0) {
+          scanHits += c.fn(cmd::Arg{ payloads[i], 0 });
+          break;
+        }
+      }
+    }
+  }
+  const double scanNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (ROUNDS * N);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "dispatch: %.1f ns/command (strcmp scan %.1f ns)", tableNs, scanNs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(ROUNDS * (N - 1), hits);
+  TEST_ASSERT_EQUAL(hits, scanHits);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_each_command_reaches_its_handler);
+  RUN_TEST(test_argument_after_equals_or_space);
+  RUN_TEST(test_parameterised_arguments);
+  RUN_TEST(test_integer_arguments);
+  RUN_TEST(test_rejected_argument_is_bad_arg);
+  RUN_TEST(test_empty_payloads_are_unknown);
+  RUN_TEST(test_payload_is_not_terminated);
+  RUN_TEST(test_long_payloads);
+  RUN_TEST(test_unknown_commands);
+  RUN_TEST(test_slot_neighbours_are_unknown);
+  RUN_TEST(test_collisions_are_detected);
+  RUN_TEST(test_dispatch_bench);
+  return UNITY_END();
+}
@@ -0,0 +1,353 @@
+/**
+ * @file test_ir_arbiter.cpp
+ * @brief IrArbiter capture time-sharing around transmissions, and its
+ *        priority queues with coalescing, on the IR fakes
+ */
+
+#include <unity.h>
+
+#include <string.h>
+
+#include "hal_fake.h"
+#include "ir_arbiter.h"
+#include "metrics.h"
+
+static constexpr uint32_t GUARD_MS = 100;
+
+// A receiver whose buffer overflows on demand
+class OverflowingRx : public FakeIrRx {
+public:
+  uint32_t overflows() const override { return overflows_; }
+  void     overflow() { overflows_++; }
+
+private:
+  uint32_t overflows_ = 0;
+};
+
+static FakeClock*     clock_;
+static FakeIrTx*      tx;
+static OverflowingRx* rx;
+static IrArbiter*     arbiter;
+
+struct Done {
+  uint8_t            tag;
+  IrArbiter::Outcome outcome;
+};
+static Done    done[16];
+static uint8_t doneCount;
+
+// Slots named "bad" do not load; any other is a NEC code
+static bool load(const char* slot, IrCode& code) {
+  if (strcmp(slot, "bad") == 0) return false;
+  code.protocol = 3;  // decode_type_t::NEC
+  code.format   = ircode::FORMAT_VALUE;
+  code.bits     = 32;
+  code.value    = slot[0];
+  return true;
+}
+
+static void onDone(const IrArbiter::Frame& f, IrArbiter::Outcome outcome) {
+  if (doneCount < 16) done[doneCount] = { f.tag, outcome };
+  doneCount++;
+}
+
+void setUp() {
+  clock_    = new FakeClock();
+  tx        = new FakeIrTx();
+  rx        = new OverflowingRx();
+  arbiter   = new IrArbiter(*tx, *rx, *clock_, load, onDone, GUARD_MS);
+  doneCount = 0;
+  arbiter->begin();
+  clock_->advanceMs(1000);
+}
+
+void tearDown() {
+  delete arbiter;
+  delete rx;
+  delete tx;
+  delete clock_;
+}
+
+static IrArbiter::Frame code(const char* slot, IrArbiter::Priority priority, uint8_t tag = 0,
+                             uint8_t group = 0) {
+  IrArbiter::Frame f = {};
+  f.kind     = IrArbiter::Frame::CODE;
+  f.priority = priority;
+  f.group    = group;
+  f.tag      = tag;
+  strncpy(f.slot, slot, IrArbiter::MAX_SLOT);
+  return f;
+}
+
+static IrCode remote(uint32_t value) {
+  IrCode c = {};
+  c.protocol = 3;
+  c.format   = ircode::FORMAT_VALUE;
+  c.bits     = 32;
+  c.value    = value;
+  return c;
+}
+
+// Polls receive() every millisecond for ms; true if a frame came in
+static bool receiveFor(uint32_t ms, IrCode& got) {
+  for (uint32_t i = 0; i < ms; i++) {
+    if (arbiter->receive(got)) return true;
+    clock_->advanceMs(1);
+  }
+  return false;
+}
+
+// The receiver only runs while someone listens
+static void test_capture_follows_listen() {
+  TEST_ASSERT_FALSE(rx->enabled());
+  arbiter->listen(true);
+  TEST_ASSERT_TRUE(rx->enabled());
+
+  IrCode got = {};
+  rx->inject(remote(0x20DF10EF));
+  TEST_ASSERT_TRUE(arbiter->receive(got));
+  TEST_ASSERT_EQUAL_UINT32(0x20DF10EF, got.value);
+
+  arbiter->listen(false);
+  TEST_ASSERT_FALSE(rx->enabled());
+  rx->inject(remote(1));
+  TEST_ASSERT_FALSE(arbiter->receive(got));
+}
+
+// A transmission stops a live capture for its frame and guardMs after, so
+// the unit's own frame and its echo are not decoded
+static void test_send_pauses_capture_for_guard() {
+  const uint32_t collisions = metrics::total(metrics::IR_COLLISION);
+  arbiter->listen(true);
+  TEST_ASSERT_TRUE(arbiter->queue(code("on", IrArbiter::Priority::MANUAL)));
+  TEST_ASSERT_FALSE(arbiter->service());
+  TEST_ASSERT_EQUAL(1, tx->sent());
+  TEST_ASSERT_FALSE(rx->enabled());
+  TEST_ASSERT_EQUAL(1, arbiter->stats().collisions);
+  TEST_ASSERT_EQUAL(collisions + 1, metrics::total(metrics::IR_COLLISION));
+
+  rx->inject(tx->last());  // the echo
+  IrCode got = {};
+  TEST_ASSERT_FALSE(receiveFor(GUARD_MS, got));
+  TEST_ASSERT_FALSE(rx->enabled());
+
+  rx->inject(remote(0x20DF10EF));  // the next press of a remote
+  TEST_ASSERT_TRUE(arbiter->receive(got));  // resumed by this call
+  TEST_ASSERT_TRUE(rx->enabled());
+  TEST_ASSERT_EQUAL_UINT32(0x20DF10EF, got.value);
+  TEST_ASSERT_TRUE(arbiter->listening());
+}
+
+// Without a capture running, a send is not a collision, and capture stays off
+static void test_send_without_listener_is_no_collision() {
+  arbiter->queue(code("on", IrArbiter::Priority::AUTO));
+  arbiter->service();
+  TEST_ASSERT_EQUAL(0, arbiter->stats().collisions);
+  IrCode got = {};
+  clock_->advanceMs(GUARD_MS);
+  TEST_ASSERT_FALSE(arbiter->receive(got));
+  TEST_ASSERT_FALSE(rx->enabled());
+
+  // Listening during the guard waits for its end
+  arbiter->queue(code("on", IrArbiter::Priority::AUTO));
+  arbiter->service();
+  clock_->advanceMs(GUARD_MS / 2);
+  arbiter->listen(true);
+  TEST_ASSERT_FALSE(rx->enabled());
+  TEST_ASSERT_EQUAL(0, arbiter->stats().collisions);
+  clock_->advanceMs(GUARD_MS / 2);
+  arbiter->receive(got);
+  TEST_ASSERT_TRUE(rx->enabled());
+}
+
+// disable()/enable() nest, and hold capture off across a guard ending
+static void test_disable_holds_capture_off() {
+  arbiter->listen(true);
+  arbiter->disable();
+  arbiter->disable();
+  TEST_ASSERT_FALSE(rx->enabled());
+  arbiter->enable();
+  TEST_ASSERT_FALSE(rx->enabled());
+
+  arbiter->queue(code("on", IrArbiter::Priority::MANUAL));
+  arbiter->service();
+  TEST_ASSERT_EQUAL(0, arbiter->stats().collisions);  // already held off
+  clock_->advanceMs(GUARD_MS);
+  IrCode got = {};
+  TEST_ASSERT_FALSE(arbiter->receive(got));
+  TEST_ASSERT_FALSE(rx->enabled());
+
+  arbiter->enable();
+  TEST_ASSERT_TRUE(rx->enabled());
+  arbiter->enable();  // unmatched: ignored
+  arbiter->disable();
+  TEST_ASSERT_FALSE(rx->enabled());
+}
+
+// A frame that fails to load is not sent and leaves capture running
+static void test_failed_load_keeps_capture() {
+  arbiter->listen(true);
+  arbiter->queue(code("bad", IrArbiter::Priority::MANUAL, 7));
+  arbiter->service();
+  TEST_ASSERT_EQUAL(0, tx->sent());
+  TEST_ASSERT_TRUE(rx->enabled());
+  TEST_ASSERT_EQUAL(0, arbiter->stats().collisions);
+  TEST_ASSERT_EQUAL(1, arbiter->stats().failed);
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_EQUAL(7, done[0].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::FAILED, done[0].outcome);
+}
+
+// Receiver overflows are counted once each, as they are seen
+static void test_rx_overruns_are_counted() {
+  const uint32_t before = metrics::total(metrics::IR_RX_OVERRUN);
+  arbiter->listen(true);
+  IrCode got = {};
+  rx->overflow();
+  rx->overflow();
+  arbiter->receive(got);
+  TEST_ASSERT_EQUAL(2, arbiter->overflows());
+  arbiter->receive(got);
+  TEST_ASSERT_EQUAL(2, arbiter->stats().rxOverruns);
+  rx->overflow();
+  arbiter->receive(got);
+  TEST_ASSERT_EQUAL(3, arbiter->stats().rxOverruns);
+  TEST_ASSERT_EQUAL(before + 3, metrics::total(metrics::IR_RX_OVERRUN));
+}
+
+// ---- transmit queue ------------------------------------------------------
+
+static constexpr uint8_t POWER = 1;  // a coalescing group
+
+// Services until the queues are empty; returns the tags sent, in order
+static uint8_t drain(uint8_t* tags, uint8_t cap) {
+  const uint8_t from = doneCount;
+  while (arbiter->pending()) arbiter->service();
+  uint8_t n = 0;
+  for (uint8_t i = from; i < doneCount && i < 16; i++) {
+    if (done[i].outcome == IrArbiter::Outcome::SENT && n < cap) tags[n++] = done[i].tag;
+  }
+  return n;
+}
+
+// Every MANUAL frame goes before any AUTO one, in order within each, one
+// frame per service()
+static void test_manual_before_auto_in_order() {
+  arbiter->queue(code("a", IrArbiter::Priority::AUTO, 1));
+  arbiter->queue(code("a", IrArbiter::Priority::AUTO, 2));
+  arbiter->queue(code("m", IrArbiter::Priority::MANUAL, 3));
+  arbiter->queue(code("m", IrArbiter::Priority::MANUAL, 4));
+  TEST_ASSERT_TRUE(arbiter->service());
+  TEST_ASSERT_EQUAL(1, tx->sent());
+
+  arbiter->queue(code("m", IrArbiter::Priority::MANUAL, 5));  // overtakes the waiting AUTO frames
+  uint8_t tags[8];
+  TEST_ASSERT_EQUAL(4, drain(tags, 8));
+  const uint8_t order[] = { 4, 5, 1, 2 };
+  TEST_ASSERT_EQUAL_MEMORY(order, tags, 4);
+  TEST_ASSERT_EQUAL(3, done[0].tag);
+  TEST_ASSERT_EQUAL(5, arbiter->stats().sent);
+  TEST_ASSERT_FALSE(arbiter->service());
+}
+
+// A full queue drops its oldest frame for the new one; the other priority
+// is untouched
+static void test_full_queue_drops_oldest() {
+  const uint32_t before = metrics::total(metrics::IR_TX_OVERRUN);
+  arbiter->queue(code("m", IrArbiter::Priority::MANUAL, 9));
+  for (uint8_t i = 1; i <= IrArbiter::DEPTH; i++) {
+    TEST_ASSERT_TRUE(arbiter->queue(code("a", IrArbiter::Priority::AUTO, i)));
+  }
+  TEST_ASSERT_FALSE(arbiter->queue(code("a", IrArbiter::Priority::AUTO, 5)));
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_EQUAL(1, done[0].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::DROPPED, done[0].outcome);
+  TEST_ASSERT_EQUAL(1, arbiter->stats().overruns);
+  TEST_ASSERT_EQUAL(before + 1, metrics::total(metrics::IR_TX_OVERRUN));
+  TEST_ASSERT_EQUAL(IrArbiter::DEPTH, arbiter->stats().maxDepth);
+
+  uint8_t tags[8];
+  TEST_ASSERT_EQUAL(5, drain(tags, 8));
+  const uint8_t order[] = { 9, 2, 3, 4, 5 };
+  TEST_ASSERT_EQUAL_MEMORY(order, tags, 5);
+}
+
+// A newer power frame takes its group's place in the queue
+static void test_power_frames_coalesce_in_place() {
+  const uint32_t before = metrics::total(metrics::IR_COALESCED);
+  arbiter->queue(code("on", IrArbiter::Priority::AUTO, 1, POWER));
+  arbiter->queue(code("x", IrArbiter::Priority::AUTO, 2));
+  arbiter->queue(code("off", IrArbiter::Priority::AUTO, 3, POWER));
+  arbiter->queue(code("on", IrArbiter::Priority::AUTO, 4, POWER));
+  TEST_ASSERT_EQUAL(2, doneCount);
+  TEST_ASSERT_EQUAL(1, done[0].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::SUPERSEDED, done[0].outcome);
+  TEST_ASSERT_EQUAL(3, done[1].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::SUPERSEDED, done[1].outcome);
+  TEST_ASSERT_EQUAL(2, arbiter->stats().coalesced);
+  TEST_ASSERT_EQUAL(before + 2, metrics::total(metrics::IR_COALESCED));
+  TEST_ASSERT_EQUAL(0, arbiter->stats().overruns);
+
+  uint8_t tags[8];
+  TEST_ASSERT_EQUAL(2, drain(tags, 8));
+  const uint8_t order[] = { 4, 2 };
+  TEST_ASSERT_EQUAL_MEMORY(order, tags, 2);
+}
+
+// A manual power frame supersedes a queued automatic one; an automatic one
+// queued behind a manual one of its group is superseded at once
+static void test_power_frames_coalesce_across_priorities() {
+  arbiter->queue(code("on", IrArbiter::Priority::AUTO, 1, POWER));
+  arbiter->queue(code("off", IrArbiter::Priority::MANUAL, 2, POWER));
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_EQUAL(1, done[0].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::SUPERSEDED, done[0].outcome);
+
+  TEST_ASSERT_TRUE(arbiter->queue(code("on", IrArbiter::Priority::AUTO, 3, POWER)));
+  TEST_ASSERT_EQUAL(2, doneCount);
+  TEST_ASSERT_EQUAL(3, done[1].tag);
+  TEST_ASSERT_EQUAL(IrArbiter::Outcome::SUPERSEDED, done[1].outcome);
+
+  uint8_t tags[8];
+  TEST_ASSERT_EQUAL(1, drain(tags, 8));
+  TEST_ASSERT_EQUAL(2, tags[0]);
+  TEST_ASSERT_EQUAL(1, tx->sent());
+  TEST_ASSERT_EQUAL(2, arbiter->stats().coalesced);
+}
+
+// Group 0 frames are never coalesced, and AC state frames go through sendAc()
+static void test_ungrouped_and_ac_frames() {
+  for (uint8_t i = 1; i <= 3; i++) arbiter->queue(code("set", IrArbiter::Priority::MANUAL, i));
+  IrArbiter::Frame ac = {};
+  ac.kind     = IrArbiter::Frame::AC;
+  ac.priority = IrArbiter::Priority::AUTO;
+  ac.tag      = 4;
+  ac.group    = POWER;
+  ac.ac.power = true;
+  ac.ac.tempC = 22;
+  arbiter->queue(ac);
+
+  uint8_t tags[8];
+  TEST_ASSERT_EQUAL(4, drain(tags, 8));
+  TEST_ASSERT_EQUAL(0, arbiter->stats().coalesced);
+  TEST_ASSERT_EQUAL(3, tx->sent());
+  TEST_ASSERT_EQUAL(1, tx->acSent());
+  TEST_ASSERT_TRUE(tx->lastAc().power);
+  TEST_ASSERT_EQUAL_FLOAT(22, tx->lastAc().tempC);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_capture_follows_listen);
+  RUN_TEST(test_send_pauses_capture_for_guard);
+  RUN_TEST(test_send_without_listener_is_no_collision);
+  RUN_TEST(test_disable_holds_capture_off);
+  RUN_TEST(test_failed_load_keeps_capture);
+  RUN_TEST(test_rx_overruns_are_counted);
+  RUN_TEST(test_manual_before_auto_in_order);
+  RUN_TEST(test_full_queue_drops_oldest);
+  RUN_TEST(test_power_frames_coalesce_in_place);
+  RUN_TEST(test_power_frames_coalesce_across_priorities);
+  RUN_TEST(test_ungrouped_and_ac_frames);
+  return UNITY_END();
+}
@@ -0,0 +1,209 @@
+/**
+ * @file test_ir_code.cpp
+ * @brief ircode::encode/decode round trips, raw timing compression and
+ *        malformed input
+ */
+
+#include <unity.h>
+
+#include <string.h>
+
+#include "ir_code.h"
+
+static uint32_t seed;
+
+// Capture jitter of up to +-jitterUs, well inside the clustering tolerance
+static uint16_t jittered(uint16_t us, uint16_t jitterUs) {
+  seed = seed * 1103515245 + 12345;
+  return static_cast<uint16_t>(us - jitterUs + (seed >> 16) % (2 * jitterUs + 1));
+}
+
+// An NEC frame as captured: leader, 32 bits, stop mark
+static uint16_t necCapture(uint32_t value, uint16_t* raw) {
+  uint16_t n = 0;
+  raw[n++] = jittered(9000, 80);
+  raw[n++] = jittered(4500, 80);
+  for (uint8_t i = 0; i < 32; i++) {
+    raw[n++] = jittered(560, 60);
+    raw[n++] = jittered((value >> (31 - i)) & 1 ? 1690 : 560, 60);
+  }
+  raw[n++] = jittered(560, 60);
+  return n;
+}
+
+static IrCode rawCode(uint16_t* raw, uint16_t len) {
+  IrCode c = {};
+  c.format   = ircode::FORMAT_RAW;
+  c.protocol = -1;
+  c.raw      = raw;
+  c.rawLen   = len;
+  c.rawCap   = len;
+  c.freqKHz  = 38;
+  return c;
+}
+
+void setUp() { seed = 1; }
+void tearDown() {}
+
+static void test_value_round_trip() {
+  IrCode in = {};
+  in.format   = ircode::FORMAT_VALUE;
+  in.protocol = 3;  // NEC
+  in.bits     = 32;
+  in.value    = 0x20DF10EF;
+  uint8_t buf[32];
+  const uint16_t n = ircode::encode(in, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(13, n);
+  TEST_ASSERT_EQUAL(0, ircode::encode(in, buf, n - 1));
+
+  IrCode out = {};
+  TEST_ASSERT_TRUE(ircode::decode(buf, n, out));
+  TEST_ASSERT_TRUE(ircode::same(in, out));
+  TEST_ASSERT_EQUAL(3, out.protocol);
+  TEST_ASSERT_EQUAL(32, out.bits);
+  TEST_ASSERT_TRUE(out.value == 0x20DF10EF);
+}
+
+static void test_state_round_trip() {
+  IrCode in = {};
+  in.format   = ircode::FORMAT_STATE;
+  in.protocol = 62;
+  in.bits     = 13 * 8;
+  for (uint8_t i = 0; i < 13; i++) in.state[i] = static_cast<uint8_t>(0xC3 ^ (i * 17));
+  uint8_t buf[64];
+  const uint16_t n = ircode::encode(in, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(5 + 13, n);
+
+  IrCode out = {};
+  TEST_ASSERT_TRUE(ircode::decode(buf, n, out));
+  TEST_ASSERT_TRUE(ircode::same(in, out));
+  TEST_ASSERT_EQUAL_MEMORY(in.state, out.state, 13);
+
+  in.bits = (ircode::MAX_STATE + 1) * 8;
+  TEST_ASSERT_EQUAL(0, ircode::encode(in, buf, sizeof(buf)));
+}
+
+// Decoded timings are the cluster centres, each within tolerance of the
+// capture, and the frame packs to a fraction of its 2-byte timings
+static void test_raw_round_trip() {
+  uint16_t raw[80];
+  const uint16_t len = necCapture(0x20DF10EF, raw);
+  TEST_ASSERT_EQUAL(67, len);  // odd: ends on a mark
+  const IrCode in = rawCode(raw, len);
+
+  uint8_t buf[128];
+  const uint16_t n = ircode::encode(in, buf, sizeof(buf));
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_LESS_THAN(len / 2, n);
+
+  uint16_t back[80];
+  IrCode out = rawCode(back, 0);
+  out.rawCap = sizeof(back) / sizeof(back[0]);
+  TEST_ASSERT_TRUE(ircode::decode(buf, n, out));
+  TEST_ASSERT_EQUAL(ircode::FORMAT_RAW, out.format);
+  TEST_ASSERT_EQUAL(len, out.rawLen);
+  TEST_ASSERT_EQUAL(38, out.freqKHz);
+  TEST_ASSERT_TRUE(ircode::same(in, out));
+  TEST_ASSERT_UINT32_WITHIN(80, 9000, back[0]);
+  TEST_ASSERT_UINT32_WITHIN(60, 560, back[len - 1]);
+
+  // A second pass over the decoded timings is lossless
+  uint8_t again[128];
+  TEST_ASSERT_EQUAL(n, ircode::encode(out, again, sizeof(again)));
+  TEST_ASSERT_EQUAL_MEMORY(buf, again, n);
+}
+
+// Many distinct mark/space pairs need 8-bit symbols; still exact to tolerance
+static void test_raw_round_trip_wide_dictionary() {
+  static const uint16_t LEVELS[] = { 400, 800, 1300, 2000, 3000, 4500 };
+  uint16_t raw[ircode::MAX_RAW];
+  const uint16_t len = 600;
+  for (uint16_t i = 0; i < len; i++) raw[i] = jittered(LEVELS[(i * 7 + i / 5) % 6], 40);
+  const IrCode in = rawCode(raw, len);
+
+  static uint8_t buf[1024];
+  const uint16_t n = ircode::encode(in, buf, sizeof(buf));
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_GREATER_THAN(16, buf[1 + 1 + 2 + 1 + 2 * 6]);  // pairs in the dictionary
+
+  static uint16_t back[ircode::MAX_RAW];
+  IrCode out = rawCode(back, 0);
+  out.rawCap = ircode::MAX_RAW;
+  TEST_ASSERT_TRUE(ircode::decode(buf, n, out));
+  TEST_ASSERT_EQUAL(len, out.rawLen);
+  TEST_ASSERT_TRUE(ircode::same(in, out));
+}
+
+static void test_irregular_timings_are_refused() {
+  // Each 30% longer than the last, beyond the 20% tolerance: 17 clusters
+  uint16_t raw[ircode::MAX_CLUSTERS + 1];
+  float us = 600;
+  for (uint8_t i = 0; i <= ircode::MAX_CLUSTERS; i++, us *= 1.3f) raw[i] = static_cast<uint16_t>(us);
+  uint8_t buf[256];
+  TEST_ASSERT_EQUAL(0, ircode::encode(rawCode(raw, ircode::MAX_CLUSTERS + 1), buf, sizeof(buf)));
+  TEST_ASSERT_GREATER_THAN(0, ircode::encode(rawCode(raw, ircode::MAX_CLUSTERS), buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(0, ircode::encode(rawCode(raw, 0), buf, sizeof(buf)));
+
+  uint16_t nec[80];
+  const uint16_t len = necCapture(0x1234, nec);
+  const uint16_t n   = ircode::encode(rawCode(nec, len), buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(0, ircode::encode(rawCode(nec, len), buf, n - 1));
+}
+
+static void test_malformed_input_is_refused() {
+  uint16_t raw[80];
+  const uint16_t len = necCapture(0xA55A, raw);
+  uint8_t buf[128];
+  const uint16_t n = ircode::encode(rawCode(raw, len), buf, sizeof(buf));
+
+  uint16_t back[80];
+  IrCode out = rawCode(back, 0);
+  out.rawCap = sizeof(back) / sizeof(back[0]);
+  TEST_ASSERT_FALSE(ircode::decode(buf, 0, out));
+  for (uint16_t cut = 1; cut < n; cut++) TEST_ASSERT_FALSE(ircode::decode(buf, cut, out));
+  buf[n] = 0;
+  TEST_ASSERT_FALSE(ircode::decode(buf, n + 1, out));
+
+  out.rawCap = len - 1;  // no room for the timings
+  TEST_ASSERT_FALSE(ircode::decode(buf, n, out));
+  out.raw = nullptr;
+  out.rawCap = len;
+  TEST_ASSERT_FALSE(ircode::decode(buf, n, out));
+
+  const uint8_t unknown[] = { 9, 0, 0 };
+  TEST_ASSERT_FALSE(ircode::decode(unknown, sizeof(unknown), out));
+  const uint8_t shortValue[] = { ircode::FORMAT_VALUE, 3, 0, 32, 0 };
+  TEST_ASSERT_FALSE(ircode::decode(shortValue, sizeof(shortValue), out));
+  const uint8_t noState[] = { ircode::FORMAT_STATE, 62, 0, 0, 0 };
+  TEST_ASSERT_FALSE(ircode::decode(noState, sizeof(noState), out));
+}
+
+static void test_same_compares_within_tolerance() {
+  uint16_t a[80], b[80];
+  const uint16_t len = necCapture(0xF00F, a);
+  memcpy(b, a, sizeof(a));
+  IrCode ca = rawCode(a, len), cb = rawCode(b, len);
+  TEST_ASSERT_TRUE(ircode::same(ca, cb));
+  b[10] = static_cast<uint16_t>(a[10] + 90);
+  TEST_ASSERT_TRUE(ircode::same(ca, cb));
+  b[10] = static_cast<uint16_t>(a[10] + 400);
+  TEST_ASSERT_FALSE(ircode::same(ca, cb));
+  cb.rawLen = len - 2;
+  TEST_ASSERT_FALSE(ircode::same(ca, cb));
+
+  IrCode v = {};
+  v.format = ircode::FORMAT_VALUE;
+  TEST_ASSERT_FALSE(ircode::same(ca, v));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_value_round_trip);
+  RUN_TEST(test_state_round_trip);
+  RUN_TEST(test_raw_round_trip);
+  RUN_TEST(test_raw_round_trip_wide_dictionary);
+  RUN_TEST(test_irregular_timings_are_refused);
+  RUN_TEST(test_malformed_input_is_refused);
+  RUN_TEST(test_same_compares_within_tolerance);
+  return UNITY_END();
+}
@@ -0,0 +1,238 @@
+/**
+ * @file test_mqtt_link.cpp
+ * @brief MqttLink backoff, bounded connects and resubscription against FakeMqtt
+ */
+
+#include <unity.h>
+
+#include "hal_fake.h"
+#include "mqtt_link.h"
+
+static constexpr uint32_t MIN_MS     = 500;
+static constexpr uint32_t MAX_MS     = 30000;
+static constexpr uint32_t TIMEOUT_MS = 2000;  // the firmware's connect timeout
+
+static FakeClock* clock_;
+static FakeMqtt*  mqtt;
+static FakeNetwork* network;
+static uint32_t   random_;
+static uint32_t   connects;
+
+static uint32_t rnd() { return random_; }
+static void     onConnect() { connects++; }
+
+void setUp() {
+  clock_   = new FakeClock();
+  mqtt     = new FakeMqtt();
+  network  = new FakeNetwork();
+  random_  = 0;
+  connects = 0;
+}
+
+void tearDown() {
+  delete network;
+  delete mqtt;
+  delete clock_;
+}
+
+static MqttLink makeLink() {
+  MqttLink link(*mqtt, *clock_, "unit", rnd);
+  link.setBackoff(MIN_MS, MAX_MS);
+  link.onConnect(onConnect);
+  link.subscribe("a/cmd");
+  link.subscribe("a/config/set");
+  return link;
+}
+
+// Runs service() every stepMs of fake time for ms
+static void runFor(MqttLink& link, uint32_t ms, uint32_t stepMs = 10) {
+  const uint32_t end = clock_->millis() + ms;
+  while (static_cast<int32_t>(clock_->millis() - end) < 0) {
+    link.service(clock_->millis(), network->up());
+    clock_->advanceMs(stepMs);
+  }
+}
+
+static void test_connects_and_subscribes() {
+  MqttLink link = makeLink();
+  link.service(clock_->millis(), true);
+  TEST_ASSERT_TRUE(link.connected());
+  TEST_ASSERT_EQUAL(2, mqtt->subscribes());
+  TEST_ASSERT_EQUAL(1, connects);
+  TEST_ASSERT_TRUE(link.subscribe("a/cmd"));  // already known: not subscribed twice
+  TEST_ASSERT_EQUAL(2, mqtt->subscribes());
+}
+
+// With no jitter the retry lands on half the doubled delay, up to the cap
+static void test_backoff_doubles_up_to_the_cap() {
+  mqtt->setBrokerUp(false);
+  MqttLink link = makeLink();
+  const uint32_t expected[] = { 500, 1000, 2000, 4000, 8000, 15000, 15000 };
+  for (uint32_t want : expected) {
+    const uint32_t now = clock_->millis();
+    link.service(now, true);
+    TEST_ASSERT_EQUAL(MqttLink::State::BACKOFF, link.state());
+    TEST_ASSERT_EQUAL(want, link.retryInMs(now));
+    clock_->advanceMs(want);
+  }
+  TEST_ASSERT_EQUAL(7, link.stats().failures);
+}
+
+static void test_jitter_stays_within_the_delay() {
+  mqtt->setBrokerUp(false);
+  random_ = 0xFFFFFFFF;
+  MqttLink link = makeLink();
+  for (uint8_t i = 0; i < 10; i++) {
+    const uint32_t now = clock_->millis();
+    link.service(now, true);
+    const uint32_t left = link.retryInMs(now);
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_MS, left);
+    TEST_ASSERT_GREATER_OR_EQUAL(MIN_MS / 2, left);
+    clock_->advanceMs(left);
+  }
+}
+
+// A broker that times out costs one bounded attempt per backoff period,
+// never a connect loop inside one call
+static void test_outage_costs_one_bounded_attempt_per_retry() {
+  mqtt->setConnectTimeout(clock_, TIMEOUT_MS);
+  MqttLink link = makeLink();
+  runFor(link, 100);
+  mqtt->setBrokerUp(false);
+
+  uint32_t worstMs = 0, calls = 0;
+  const uint32_t end = clock_->millis() + 10 * 60 * 1000UL;
+  while (static_cast<int32_t>(clock_->millis() - end) < 0) {
+    const uint32_t t0 = clock_->millis();
+    link.service(t0, true);
+    const uint32_t took = clock_->millis() - t0;
+    if (took > worstMs) worstMs = took;
+    calls++;
+    clock_->advanceMs(10);
+  }
+  char msg[96];
+  snprintf(msg, sizeof(msg), "worst service() %lu ms over %lu calls, %lu attempts",
+           (unsigned long)worstMs, (unsigned long)calls, (unsigned long)link.stats().attempts);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(TIMEOUT_MS, worstMs);
+  TEST_ASSERT_EQUAL(TIMEOUT_MS, link.stats().maxAttemptMs);
+  // Without jitter, capped retries are MAX_MS / 2 + TIMEOUT_MS apart:
+  // the initial connect, the ramp and 10 minutes' worth of those
+  TEST_ASSERT_LESS_OR_EQUAL(1 + 6 + 600000 / (MAX_MS / 2 + TIMEOUT_MS) + 1, link.stats().attempts);
+
+  mqtt->setBrokerUp(true);
+  runFor(link, MAX_MS + TIMEOUT_MS);
+  TEST_ASSERT_TRUE(link.connected());
+}
+
+static void test_dropped_session_reconnects_and_resubscribes() {
+  MqttLink link = makeLink();
+  runFor(link, 100);
+  mqtt->setBrokerUp(false);
+  runFor(link, 100);
+  TEST_ASSERT_FALSE(link.connected());
+  mqtt->setBrokerUp(true);
+  runFor(link, MIN_MS);
+  TEST_ASSERT_TRUE(link.connected());
+  TEST_ASSERT_EQUAL(4, mqtt->subscribes());
+  TEST_ASSERT_EQUAL(2, connects);
+  TEST_ASSERT_EQUAL(2, link.stats().connects);
+}
+
+// A session that missed a subscription would stay deaf to that topic
+static void test_failed_resubscribe_is_a_failed_connect() {
+  mqtt->failSubscribes(1);
+  MqttLink link = makeLink();
+  link.service(clock_->millis(), true);
+  TEST_ASSERT_EQUAL(MqttLink::State::BACKOFF, link.state());
+  TEST_ASSERT_FALSE(mqtt->connected());
+  TEST_ASSERT_EQUAL(0, connects);
+  TEST_ASSERT_EQUAL(1, link.stats().failures);
+
+  runFor(link, MIN_MS * 2);
+  TEST_ASSERT_TRUE(link.connected());
+  TEST_ASSERT_EQUAL(1, connects);
+  TEST_ASSERT_EQUAL(2, mqtt->subscribes());
+}
+
+static void test_no_attempts_without_network() {
+  network->setUp(false);
+  MqttLink link = makeLink();
+  runFor(link, 5000);
+  TEST_ASSERT_EQUAL(MqttLink::State::OFFLINE, link.state());
+  TEST_ASSERT_EQUAL(0, link.stats().attempts);
+
+  network->setUp(true);
+  runFor(link, 100);
+  TEST_ASSERT_TRUE(link.connected());
+  network->setUp(false);
+  runFor(link, 100);
+  TEST_ASSERT_EQUAL(MqttLink::State::OFFLINE, link.state());
+  TEST_ASSERT_FALSE(mqtt->connected());
+}
+
+// A broker that takes the session and drops it at once is backed off like
+// one that refuses it; a session that stayed up starts the backoff over
+static void test_short_sessions_back_off() {
+  MqttLink link = makeLink();
+  const uint32_t expected[] = { 500, 1000, 2000, 4000, 8000, 15000, 15000 };
+  for (uint32_t want : expected) {
+    const uint32_t now = clock_->millis();
+    link.service(now, true);
+    TEST_ASSERT_TRUE(link.connected());
+    mqtt->kick();
+    link.service(now, true);
+    TEST_ASSERT_EQUAL(MqttLink::State::BACKOFF, link.state());
+    TEST_ASSERT_EQUAL(want, link.retryInMs(now));
+    clock_->advanceMs(want);
+  }
+  TEST_ASSERT_EQUAL(7, link.stats().failures);
+
+  link.service(clock_->millis(), true);
+  runFor(link, MAX_MS);
+  TEST_ASSERT_TRUE(link.connected());
+  mqtt->kick();
+  const uint32_t now = clock_->millis();
+  link.service(now, true);
+  TEST_ASSERT_EQUAL(MIN_MS / 2, link.retryInMs(now));
+  TEST_ASSERT_EQUAL(7, link.stats().failures);
+}
+
+// The network coming back does not cut a pending retry short
+static void test_network_flaps_during_backoff() {
+  mqtt->setBrokerUp(false);
+  MqttLink link = makeLink();
+  for (uint8_t i = 0; i < 4; i++) {
+    link.service(clock_->millis(), true);
+    clock_->advanceMs(link.retryInMs(clock_->millis()));
+  }
+  link.service(clock_->millis(), true);
+  const uint32_t attempts = link.stats().attempts;
+  const uint32_t retryMs  = link.retryInMs(clock_->millis());
+  TEST_ASSERT_EQUAL(8000, retryMs);
+
+  // Down and up every 100 ms until just before the retry is due
+  for (uint32_t t = 0; t + 100 < retryMs; t += 100) {
+    network->setUp((t / 100) % 2);
+    runFor(link, 100);
+  }
+  TEST_ASSERT_EQUAL(attempts, link.stats().attempts);
+
+  network->setUp(true);
+  runFor(link, 200);
+  TEST_ASSERT_EQUAL(attempts + 1, link.stats().attempts);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connects_and_subscribes);
+  RUN_TEST(test_backoff_doubles_up_to_the_cap);
+  RUN_TEST(test_jitter_stays_within_the_delay);
+  RUN_TEST(test_outage_costs_one_bounded_attempt_per_retry);
+  RUN_TEST(test_dropped_session_reconnects_and_resubscribes);
+  RUN_TEST(test_failed_resubscribe_is_a_failed_connect);
+  RUN_TEST(test_no_attempts_without_network);
+  RUN_TEST(test_short_sessions_back_off);
+  RUN_TEST(test_network_flaps_during_backoff);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test_outage.cpp
+ * @brief The whole application through a broker outage, on fake hardware
+ *
+ * The broker goes away for OUTAGE_MS while app::loop() keeps running. A
+ * connect to the missing broker blocks for the firmware's connect timeout,
+ * as PubSubClient's does, so the worst pass shows what an outage costs the
+ * loop; the control domain must keep sampling and deciding throughout.
+ */
+
+#include <unity.h>
+
+#include "app.h"
+#include "flash.h"
+#include "hal_fake.h"
+
+static constexpr uint32_t TIMEOUT_MS    = 2000;  // the firmware's connect timeout
+static constexpr uint32_t OUTAGE_MS     = 5 * 60 * 1000UL;
+static constexpr uint32_t SAMPLE_MS     = 5000;  // the unit's default sample_ms
+static constexpr uint32_t NEC_ON        = 0x20DF10EF;
+static constexpr uint8_t  BUTTON_PIN    = 26;
+static constexpr uint8_t  MAC[6]        = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02 };
+
+static FakeClock   clock_;
+static FakeGpio    gpio(&clock_);
+static FakeSensor  sensor("dht");
+static const hal::SensorSlot sensors[] = { { sensor, 1.0f } };
+static FakeIrTx    irTx;
+static FakeIrRx    irRx;
+static SimFlash<8> flash;
+static FakeMqtt    mqtt;
+static FakeNetwork network;
+
+static const hal::Board board = {
+  clock_, gpio, sensors, 1, irTx, irRx, flash, mqtt, network,
+  []() -> uint32_t { return 0; },
+  [](uint8_t mac[6]) { memcpy(mac, MAC, sizeof(MAC)); },
+  BUTTON_PIN,
+  "outage",
+  nullptr,
+};
+
+// Runs the loop 1 ms apart for ms of fake time; returns the longest pass
+static uint32_t run(uint32_t ms) {
+  uint32_t worst = 0;
+  const uint64_t end = clock_.nowUs() + static_cast<uint64_t>(ms) * 1000;
+  while (clock_.nowUs() < end) {
+    const uint64_t t0 = clock_.nowUs();
+    app::loop();
+    const uint32_t took = static_cast<uint32_t>((clock_.nowUs() - t0) / 1000);
+    if (took > worst) worst = took;
+    clock_.advanceMs(1);
+  }
+  return worst;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_connects_on_start() {
+  mqtt.setConnectTimeout(&clock_, TIMEOUT_MS);
+  sensor.set(30.0f, 50.0f);
+  app::begin(board);
+  IrCode on = {};
+  on.format   = ircode::FORMAT_VALUE;
+  on.protocol = 3;  // NEC
+  on.bits     = 32;
+  on.value    = NEC_ON;
+  TEST_ASSERT_TRUE(app::saveCode(app::SLOT_ON, on));
+  run(1000);
+  TEST_ASSERT_TRUE(mqtt.connected());
+}
+
+// Every pass is bounded by one connect attempt, and sampling and control
+// decisions carry on at their own rate
+static void test_control_runs_through_outage() {
+  const uint32_t rounds = app::sensors().stats().rounds;
+  const uint32_t evals  = app::thermostat().stats().evaluations;
+  mqtt.setBrokerUp(false);
+  const uint32_t worst = run(OUTAGE_MS);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "worst loop() pass %lu ms over a %lu s outage", (unsigned long)worst,
+           (unsigned long)(OUTAGE_MS / 1000));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_FALSE(mqtt.connected());
+  TEST_ASSERT_LESS_OR_EQUAL(TIMEOUT_MS, worst);
+  // A blocked connect may push a round back by up to one timeout
+  const uint32_t expected = OUTAGE_MS / SAMPLE_MS;
+  TEST_ASSERT_UINT32_WITHIN(OUTAGE_MS / (SAMPLE_MS + TIMEOUT_MS) / 3, expected,
+                            app::sensors().stats().rounds - rounds);
+  TEST_ASSERT_EQUAL(app::sensors().stats().rounds - rounds,
+                    app::thermostat().stats().evaluations - evals);
+}
+
+// The session comes back subscribed, so commands work again
+static void test_commands_work_after_reconnect() {
+  mqtt.setBrokerUp(true);
+  run(30000 + TIMEOUT_MS);  // past the longest backoff
+  TEST_ASSERT_TRUE(mqtt.connected());
+
+  const uint32_t sent = irTx.sent();
+  TEST_ASSERT_TRUE(mqtt.inject(app::topics().cmd, "on"));
+  run(100);
+  TEST_ASSERT_EQUAL(sent + 1, irTx.sent());
+  TEST_ASSERT_EQUAL_UINT32(NEC_ON, irTx.last().value);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connects_on_start);
+  RUN_TEST(test_control_runs_through_outage);
+  RUN_TEST(test_commands_work_after_reconnect);
+  return UNITY_END();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file test_record_store.cpp
+ * @brief RecordStore wear levelling and power cuts on SimFlash
+ *
+ * A power cut is SimFlash::failAfter(): the write in progress stops part-way
+ * and nothing more is written. Remounting a fresh store on the same flash
+ * then has to find every record at its last committed value.
+ */
+
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+
+#include "flash.h"
+#include "record_store.h"
+
+static constexpr char     NAMES[][2]  = { "a", "b", "c", "k" };
+static constexpr uint8_t  KEYS        = sizeof(NAMES) / sizeof(NAMES[0]);
+static constexpr uint8_t  KEPT        = KEYS - 1;  // written once, then only moved by compaction
+static constexpr uint16_t VALUE_BYTES = 20;
+
+// Small sectors, so a few dozen puts go round the region several times
+using SmallFlash = SimFlash<4, 256>;
+
+struct Model {
+  uint8_t values[KEYS][VALUE_BYTES];
+  bool    present[KEYS];
+};
+
+static void valueFor(uint32_t put, uint8_t (&out)[VALUE_BYTES]) {
+  for (uint16_t i = 0; i < VALUE_BYTES; i++) out[i] = static_cast<uint8_t>(put * 7 + i);
+}
+
+// Put 0 writes the kept record, later ones rotate over the others; the
+// model follows only what put() committed
+static bool doPut(RecordStore& store, Model& model, uint32_t put) {
+  uint8_t v[VALUE_BYTES];
+  valueFor(put, v);
+  const uint8_t k = put == 0 ? KEPT : put % KEPT;
+  if (!store.put(NAMES[k], v, sizeof(v))) return false;
+  memcpy(model.values[k], v, sizeof(v));
+  model.present[k] = true;
+  return true;
+}
+
+static void assertMatches(const RecordStore& store, const Model& model) {
+  for (uint8_t k = 0; k < KEYS; k++) {
+    uint16_t len = 0;
+    const uint8_t* got = store.get(NAMES[k], len);
+    if (!model.present[k]) {
+      TEST_ASSERT_NULL(got);
+      continue;
+    }
+    TEST_ASSERT_NOT_NULL(got);
+    TEST_ASSERT_EQUAL(VALUE_BYTES, len);
+    TEST_ASSERT_EQUAL_MEMORY(model.values[k], got, VALUE_BYTES);
+  }
+}
+
+static void assertRemounts(Flash& flash, const Model& model) {
+  std::unique_ptr<RecordStore> store(new RecordStore(flash));
+  TEST_ASSERT_TRUE(store->begin());
+  assertMatches(*store, model);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_put_get_remove_survive_remount() {
+  SmallFlash flash;
+  std::unique_ptr<RecordStore> store(new RecordStore(flash));
+  TEST_ASSERT_TRUE(store->begin());
+  Model model = {};
+  for (uint32_t p = 0; p < 5; p++) TEST_ASSERT_TRUE(doPut(*store, model, p));
+  TEST_ASSERT_TRUE(store->remove("b"));
+  model.present[1] = false;
+  assertMatches(*store, model);
+  assertRemounts(flash, model);
+
+  uint16_t len;
+  TEST_ASSERT_NULL(store->get("", len));
+  TEST_ASSERT_FALSE(store->put("sixteen-chars-xx", "x", 1));
+  uint8_t big[RecordStore::MAX_VALUE + 1] = {};
+  TEST_ASSERT_FALSE(store->put("big", big, sizeof(big)));
+}
+
+// The log rotates over every sector, so erases stay within one of each other
+static void test_erases_spread_over_all_sectors() {
+  static SimFlash<8> flash;
+  std::unique_ptr<RecordStore> store(new RecordStore(flash));
+  TEST_ASSERT_TRUE(store->begin());
+  uint8_t v[200];
+  for (uint32_t p = 0; p < 20000; p++) {
+    memset(v, static_cast<uint8_t>(p), sizeof(v));
+    char name[4];
+    snprintf(name, sizeof(name), "r%u", static_cast<unsigned>(p % 5));
+    TEST_ASSERT_TRUE(store->put(name, v, sizeof(v)));
+  }
+
+  uint32_t lo = UINT32_MAX, hi = 0;
+  for (uint16_t s = 0; s < flash.sectorCount(); s++) {
+    if (flash.erases(s) < lo) lo = flash.erases(s);
+    if (flash.erases(s) > hi) hi = flash.erases(s);
+  }
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%lu erases over %u sectors, %lu..%lu each",
+           (unsigned long)flash.totalErases(), flash.sectorCount(), (unsigned long)lo,
+           (unsigned long)hi);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_GREATER_THAN(100, lo);
+  TEST_ASSERT_LESS_OR_EQUAL(lo + 1, hi);
+  TEST_ASSERT_EQUAL(flash.totalErases(), store->stats().erases);
+}
+
+// Cuts power at every word of every put in turn, covering both the record
+// write and the relocations of the compaction some puts trigger
+static void test_power_cut_keeps_last_committed_value() {
+  constexpr uint32_t PUTS = 24;
+  uint32_t duringCompaction = 0;
+  for (uint32_t cutAt = 0; cutAt < PUTS; cutAt++) {
+    for (long cut = 0;; cut += 4) {
+      SmallFlash flash;
+      std::unique_ptr<RecordStore> store(new RecordStore(flash));
+      TEST_ASSERT_TRUE(store->begin());
+      Model model = {};
+      for (uint32_t p = 0; p < cutAt; p++) TEST_ASSERT_TRUE(doPut(*store, model, p));
+
+      const uint32_t compactions = store->stats().compactions;
+      flash.failAfter(cut);
+      const bool done = doPut(*store, model, cutAt);
+      flash.failAfter(-1);
+      if (!done && store->stats().compactions > compactions) duringCompaction++;
+
+      assertRemounts(flash, model);
+      if (done) break;
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(0, duringCompaction);
+}
+
+// A failed write that is not a power cut: the store keeps running on the
+// same mount, and later puts and a remount must still agree
+static void test_store_recovers_from_failed_compaction() {
+  constexpr uint32_t PUTS = 24;
+  uint32_t rolledBack = 0;
+  for (uint32_t failAt = 0; failAt < PUTS; failAt++) {
+    for (long cut = 0; cut <= 64; cut += 4) {
+      SmallFlash flash;
+      std::unique_ptr<RecordStore> store(new RecordStore(flash));
+      TEST_ASSERT_TRUE(store->begin());
+      Model model = {};
+      for (uint32_t p = 0; p < failAt; p++) TEST_ASSERT_TRUE(doPut(*store, model, p));
+
+      const uint32_t compactions = store->stats().compactions;
+      flash.failAfter(cut);
+      const bool done = doPut(*store, model, failAt);
+      flash.failAfter(-1);
+      if (!done && store->stats().compactions > compactions) rolledBack++;
+
+      assertMatches(*store, model);
+      for (uint32_t p = failAt + 1; p < failAt + 1 + 3 * PUTS; p++) {
+        TEST_ASSERT_TRUE(doPut(*store, model, p));
+      }
+      assertMatches(*store, model);
+      assertRemounts(flash, model);
+      if (done) break;
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(0, rolledBack);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_put_get_remove_survive_remount);
+  RUN_TEST(test_erases_spread_over_all_sectors);
+  RUN_TEST(test_power_cut_keeps_last_committed_value);
+  RUN_TEST(test_store_recovers_from_failed_compaction);
+  return UNITY_END();
+}
@@ -0,0 +1,243 @@
+/**
+ * @file test_scheduler.cpp
+ * @brief Scheduler timing against a fake microsecond clock
+ *
+ * Tasks advance the clock themselves to stand for the time they take, so
+ * lateness, runtime and deadline accounting are exact.
+ */
+
+#include <unity.h>
+
+#include "scheduler.h"
+
+static uint32_t nowUs;
+static uint32_t clockUs() { return nowUs; }
+
+static uint32_t runs;
+static uint32_t runAtUs[16];
+static uint32_t taskCostUs;
+
+static void task() {
+  if (runs < sizeof(runAtUs) / sizeof(runAtUs[0])) runAtUs[runs] = nowUs;
+  runs++;
+  nowUs += taskCostUs;
+}
+
+void setUp() {
+  nowUs      = 0;
+  runs       = 0;
+  taskCostUs = 0;
+}
+
+void tearDown() {}
+
+// Runs one pass every stepUs until untilUs
+static void runUntil(Scheduler& s, uint32_t untilUs, uint32_t stepUs) {
+  while (static_cast<int32_t>(nowUs - untilUs) < 0) {
+    s.run();
+    nowUs += stepUs;
+  }
+}
+
+static void test_first_release_is_one_period_after_registration() {
+  Scheduler s(clockUs);
+  s.addPeriodic("p", task, 10);
+  nowUs = 9999;
+  TEST_ASSERT_EQUAL(0, s.run());
+  nowUs = 10000;
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(0, s.run());
+}
+
+// Lateness and runtime must not push later releases back
+static void test_fixed_period_does_not_drift() {
+  Scheduler s(clockUs);
+  s.addPeriodic("p", task, 10);
+  taskCostUs = 700;
+  runUntil(s, 100500, 300);
+  TEST_ASSERT_EQUAL(10, runs);
+  for (uint32_t i = 0; i < 10; i++) {
+    const uint32_t release = (i + 1) * 10000;
+    TEST_ASSERT_GREATER_OR_EQUAL(release, runAtUs[i]);
+    TEST_ASSERT_LESS_THAN(release + 300, runAtUs[i]);
+  }
+}
+
+// A stall longer than a period costs the missed runs, not a burst of them
+static void test_missed_periods_are_skipped() {
+  Scheduler s(clockUs);
+  s.addPeriodic("p", task, 10);
+  nowUs = 10000;
+  s.run();
+  nowUs = 55000;
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(0, s.run());
+  TEST_ASSERT_EQUAL(65000, nowUs + s.idleUs());
+}
+
+static void test_event_runs_once_per_signal_and_merges() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addEvent("e", task);
+  TEST_ASSERT_EQUAL(0, s.run());
+  s.signal(id);
+  s.signal(id);
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(0, s.run());
+  TEST_ASSERT_EQUAL(1, runs);
+}
+
+static Scheduler*        selfSched;
+static Scheduler::TaskId selfId;
+static void resignal() {
+  task();
+  if (runs < 3) selfSched->signal(selfId);
+}
+
+// A signal raised by the task itself runs it again on the next pass
+static void test_event_signalled_while_running_runs_next_pass() {
+  Scheduler s(clockUs);
+  selfSched = &s;
+  selfId    = s.addEvent("e", resignal);
+  s.signal(selfId);
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(1, s.run());
+  TEST_ASSERT_EQUAL(0, s.run());
+  TEST_ASSERT_EQUAL(3, runs);
+}
+
+static void test_signal_ignores_periodic_and_invalid_tasks() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addPeriodic("p", task, 10);
+  s.signal(id);
+  s.signal(Scheduler::INVALID_TASK);
+  s.signal(5);
+  TEST_ASSERT_EQUAL(0, s.run());
+}
+
+static void test_deadline_counts_lateness_plus_runtime() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addEvent("e", task, 1000);
+  s.signal(id);
+  nowUs += 400;
+  taskCostUs = 500;  // finishes 900 us after release
+  s.run();
+  TEST_ASSERT_EQUAL(0, s.stats(id)->deadlineMisses);
+  s.signal(id);
+  nowUs += 600;      // 1100 us
+  s.run();
+  TEST_ASSERT_EQUAL(1, s.stats(id)->deadlineMisses);
+}
+
+static void test_zero_deadline_is_never_missed() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addEvent("e", task);
+  taskCostUs = 1000000;
+  s.signal(id);
+  s.run();
+  TEST_ASSERT_EQUAL(0, s.stats(id)->deadlineMisses);
+}
+
+static void test_stats_track_runtime_and_lateness() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addEvent("e", task);
+  taskCostUs = 100;
+  s.signal(id);
+  nowUs += 50;
+  s.run();
+  taskCostUs = 300;
+  s.signal(id);
+  nowUs += 20;
+  s.run();
+  const Scheduler::TaskStats* st = s.stats(id);
+  TEST_ASSERT_EQUAL(2, st->runs);
+  TEST_ASSERT_EQUAL(400, st->totalUs);
+  TEST_ASSERT_EQUAL(300, st->lastUs);
+  TEST_ASSERT_EQUAL(300, st->maxUs);
+  TEST_ASSERT_EQUAL(50, st->maxLateUs);
+
+  s.resetStats();
+  TEST_ASSERT_EQUAL(0, s.stats(id)->runs);
+  TEST_ASSERT_EQUAL(0, s.stats(id)->maxUs);
+  TEST_ASSERT_NULL(s.stats(3));
+}
+
+static void test_idle_is_time_to_the_nearest_release() {
+  Scheduler s(clockUs);
+  s.addPeriodic("slow", task, 50);
+  Scheduler::TaskId fast = s.addPeriodic("fast", task, 20);
+  Scheduler::TaskId e    = s.addEvent("e", task);
+  TEST_ASSERT_EQUAL(20000, s.idleUs());
+  nowUs = 15000;
+  TEST_ASSERT_EQUAL(5000, s.idleUs());
+  s.setEnabled(fast, false);
+  TEST_ASSERT_EQUAL(35000, s.idleUs());
+  s.signal(e);
+  TEST_ASSERT_EQUAL(0, s.idleUs());
+  s.run();
+  nowUs = 50000;
+  TEST_ASSERT_EQUAL(0, s.idleUs());
+}
+
+static void test_idle_without_periodic_tasks_is_unbounded() {
+  Scheduler s(clockUs);
+  s.addEvent("e", task);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, s.idleUs());
+}
+
+// Re-enabling re-phases instead of firing the backlog at once
+static void test_reenabled_task_waits_a_full_period() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addPeriodic("p", task, 10);
+  s.setEnabled(id, false);
+  nowUs = 100000;
+  TEST_ASSERT_EQUAL(0, s.run());
+  s.setEnabled(id, true);
+  TEST_ASSERT_EQUAL(0, s.run());
+  TEST_ASSERT_EQUAL(10000, s.idleUs());
+}
+
+static void test_set_period_takes_effect_from_now() {
+  Scheduler s(clockUs);
+  Scheduler::TaskId id = s.addPeriodic("p", task, 10);
+  nowUs = 5000;
+  s.setPeriod(id, 30);
+  TEST_ASSERT_EQUAL(30000, s.idleUs());
+}
+
+static void test_release_survives_clock_wrap() {
+  nowUs = UINT32_MAX - 4999;
+  Scheduler s(clockUs);
+  s.addPeriodic("p", task, 10);
+  runUntil(s, 26000, 1000);  // releases at 5000, 15000 and 25000, across the wrap
+  TEST_ASSERT_EQUAL(3, runs);
+}
+
+static void test_registration_is_bounded() {
+  Scheduler s(clockUs);
+  for (uint8_t i = 0; i < Scheduler::MAX_TASKS; i++) {
+    TEST_ASSERT_NOT_EQUAL(Scheduler::INVALID_TASK, s.addEvent("e", task));
+  }
+  TEST_ASSERT_EQUAL(Scheduler::INVALID_TASK, s.addEvent("e", task));
+  TEST_ASSERT_EQUAL(Scheduler::INVALID_TASK, Scheduler(clockUs).addEvent("e", nullptr));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_release_is_one_period_after_registration);
+  RUN_TEST(test_fixed_period_does_not_drift);
+  RUN_TEST(test_missed_periods_are_skipped);
+  RUN_TEST(test_event_runs_once_per_signal_and_merges);
+  RUN_TEST(test_event_signalled_while_running_runs_next_pass);
+  RUN_TEST(test_signal_ignores_periodic_and_invalid_tasks);
+  RUN_TEST(test_deadline_counts_lateness_plus_runtime);
+  RUN_TEST(test_zero_deadline_is_never_missed);
+  RUN_TEST(test_stats_track_runtime_and_lateness);
+  RUN_TEST(test_idle_is_time_to_the_nearest_release);
+  RUN_TEST(test_idle_without_periodic_tasks_is_unbounded);
+  RUN_TEST(test_reenabled_task_waits_a_full_period);
+  RUN_TEST(test_set_period_takes_effect_from_now);
+  RUN_TEST(test_release_survives_clock_wrap);
+  RUN_TEST(test_registration_is_bounded);
+  return UNITY_END();
+}
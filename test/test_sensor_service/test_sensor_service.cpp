@@ -0,0 +1,233 @@
+/**
+ * @file test_sensor_service.cpp
+ * @brief SensorService validation, median filtering and fusion on fake sensors
+ */
+
+#include <unity.h>
+
+#include <math.h>
+
+#include "hal_fake.h"
+#include "sensor_service.h"
+
+static constexpr uint32_t PERIOD_MS = 5000;
+static constexpr uint32_t STALE_MS  = 3 * PERIOD_MS;
+
+static FakeClock* clock_;
+static FakeIrRx*  irRx;
+static uint32_t   nowMs;
+
+void setUp() {
+  clock_ = new FakeClock();
+  irRx   = new FakeIrRx();
+  nowMs  = 0;
+}
+
+void tearDown() {
+  delete irRx;
+  delete clock_;
+}
+
+// Runs n rounds of zero-conversion sensors, one per period
+static void rounds(SensorService& s, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    TEST_ASSERT_TRUE(s.service(nowMs));
+    nowMs += PERIOD_MS;
+  }
+}
+
+static void test_weighted_mean_of_sensors() {
+  FakeSensor a("a"), b("b"), dry("ds18b20", 0, false);
+  a.set(21.0f, 40.0f);
+  b.set(23.0f, 60.0f);
+  dry.set(22.0f, 0);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  TEST_ASSERT_TRUE(s.add(a, 1.0f));
+  TEST_ASSERT_TRUE(s.add(b, 3.0f));
+  TEST_ASSERT_TRUE(s.add(dry, 1.0f));
+  s.begin();
+  rounds(s, 1);
+
+  // 21 * 1 + 23 * 3 + 22 * 1 over 5; humidity only from the sensors with it
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.4f, s.latest().tempC);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 55.0f, s.latest().humidity);
+  TEST_ASSERT_EQUAL(0, s.stats().excluded);
+  TEST_ASSERT_FALSE(s.stale(nowMs));
+}
+
+static void test_registration_is_bounded() {
+  FakeSensor f[SensorService::MAX_SENSORS + 1];
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  TEST_ASSERT_FALSE(s.add(f[0], 0.0f));
+  for (uint8_t i = 0; i < SensorService::MAX_SENSORS; i++) TEST_ASSERT_TRUE(s.add(f[i], 1.0f));
+  TEST_ASSERT_FALSE(s.add(f[SensorService::MAX_SENSORS], 1.0f));
+}
+
+// A spike every third read never gets past the median of the window
+static void test_spikes_are_filtered_and_counted() {
+  FakeSensor a("a");
+  a.set(22.0f, 50.0f);
+  a.setFaults(0, 3, 8.0f);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.begin();
+  for (uint8_t i = 0; i < 30; i++) {
+    rounds(s, 1);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+  }
+  TEST_ASSERT_EQUAL(0, s.sensorStats(0).rejected);
+  TEST_ASSERT_GREATER_OR_EQUAL(8, s.sensorStats(0).outliers);
+}
+
+// NaN and out-of-range values are rejected per channel
+static void test_implausible_values_are_rejected() {
+  FakeSensor a("a");
+  a.set(22.0f, 50.0f);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.begin();
+  rounds(s, 2);
+
+  a.set(120.0f, 150.0f);
+  rounds(s, 1);
+  TEST_ASSERT_EQUAL(2, s.sensorStats(0).rejected);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 50.0f, s.latest().humidity);
+
+  a.set(22.0f, 50.0f);
+  a.setFaults(1, 0, 0);  // every read fails
+  rounds(s, 1);
+  TEST_ASSERT_EQUAL(4, s.sensorStats(0).rejected);
+  TEST_ASSERT_EQUAL(4, s.sensorStats(0).reads);
+}
+
+// With three or more sensors, one far from their median is left out
+static void test_outlier_sensor_is_excluded() {
+  FakeSensor a("a"), b("b"), c("c");
+  a.set(22.0f, 50.0f);
+  b.set(22.0f, 50.0f);
+  c.set(22.0f, 50.0f);
+  a.setOffset(-0.5f);
+  b.setOffset(0.5f);
+  c.setOffset(6.0f);  // e.g. mounted above a radiator
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.add(b, 1.0f);
+  s.add(c, 5.0f);
+  s.begin();
+  rounds(s, 4);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+  TEST_ASSERT_EQUAL(4, s.stats().excluded);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 28.0f, s.sensorTempC(2));
+}
+
+// Two sensors cannot outvote each other, and an even split has no majority
+static void test_no_exclusion_without_a_majority() {
+  FakeSensor a("a"), b("b");
+  a.set(20.0f, 50.0f);
+  b.set(30.0f, 50.0f);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.add(b, 1.0f);
+  s.begin();
+  rounds(s, 1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 25.0f, s.latest().tempC);
+
+  FakeSensor c("c"), d("d");
+  c.set(20.0f, 50.0f);
+  d.set(30.0f, 50.0f);
+  SensorService four(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  four.add(a, 1.0f);
+  four.add(b, 1.0f);
+  four.add(c, 1.0f);
+  four.add(d, 1.0f);
+  four.begin();
+  rounds(four, 1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 25.0f, four.latest().tempC);
+  TEST_ASSERT_EQUAL(0, four.stats().excluded);
+}
+
+// A sensor that stops delivering keeps its last value in the mean until
+// it is STALE_MS old, then drops out and the estimate follows the others
+static void test_stale_sensor_drops_out_of_fusion() {
+  FakeSensor a("a"), b("b");
+  a.set(20.0f, 40.0f);
+  b.set(24.0f, 60.0f);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.add(b, 1.0f);
+  s.begin();
+  rounds(s, 2);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+
+  const uint32_t lastGood = nowMs - PERIOD_MS;
+  a.setFaults(1, 0, 0);
+  while (nowMs - lastGood <= STALE_MS) {
+    rounds(s, 1);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 50.0f, s.latest().humidity);
+  }
+  rounds(s, 1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 24.0f, s.latest().tempC);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 60.0f, s.latest().humidity);
+
+  // Back with fresh values, it counts again at once
+  a.setFaults(0, 0, 0);
+  rounds(s, 1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+}
+
+// With no sensor delivering, rounds fuse the last value until it is
+// STALE_MS old; after that the estimate is kept but marked stale
+static void test_estimate_goes_stale() {
+  FakeSensor a("a");
+  a.set(22.0f, 50.0f);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(a, 1.0f);
+  s.begin();
+  TEST_ASSERT_TRUE(s.stale(nowMs));
+  rounds(s, 1);
+  const uint32_t at = s.latest().atMs;
+
+  a.setFaults(1, 0, 0);
+  rounds(s, 6);
+  TEST_ASSERT_EQUAL(at + STALE_MS, s.latest().atMs);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+  TEST_ASSERT_TRUE(s.stale(nowMs));
+  TEST_ASSERT_EQUAL(1 + STALE_MS / PERIOD_MS, s.stats().estimates);
+  TEST_ASSERT_EQUAL(7, s.stats().rounds);
+}
+
+// A slow conversion is collected once ready; the round ends with it
+static void test_round_waits_for_the_slowest_conversion() {
+  FakeSensor fast("sht"), slow("ds18b20", 750, false);
+  fast.set(21.0f, 50.0f);
+  slow.set(23.0f, 0);
+  SensorService s(*clock_, *irRx, PERIOD_MS, STALE_MS);
+  s.add(fast, 1.0f);
+  s.add(slow, 1.0f);
+  s.begin();
+  TEST_ASSERT_FALSE(s.service(0));
+  TEST_ASSERT_EQUAL(1, fast.reads());
+  TEST_ASSERT_FALSE(s.service(749));
+  TEST_ASSERT_EQUAL(0, slow.reads());
+  TEST_ASSERT_TRUE(s.service(750));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 22.0f, s.latest().tempC);
+  TEST_ASSERT_FALSE(s.service(4999));
+  TEST_ASSERT_FALSE(s.service(5000));
+  TEST_ASSERT_EQUAL(2, fast.starts());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_weighted_mean_of_sensors);
+  RUN_TEST(test_registration_is_bounded);
+  RUN_TEST(test_spikes_are_filtered_and_counted);
+  RUN_TEST(test_implausible_values_are_rejected);
+  RUN_TEST(test_outlier_sensor_is_excluded);
+  RUN_TEST(test_no_exclusion_without_a_majority);
+  RUN_TEST(test_stale_sensor_drops_out_of_fusion);
+  RUN_TEST(test_estimate_goes_stale);
+  RUN_TEST(test_round_waits_for_the_slowest_conversion);
+  return UNITY_END();
+}
@@ -0,0 +1,288 @@
+/**
+ * @file test_settings.cpp
+ * @brief Settings writes, persistence text and restore, and the firmware's
+ *        settings round trip over MQTT and the record store
+ *
+ * The local registry mirrors the firmware's thermostat entries in the same
+ * order and with the same cross-check (temp_low below temp_high), so the
+ * text it persists has the firmware's ordering pitfalls.
+ */
+
+#include <unity.h>
+
+#include <string.h>
+
+#include <string>
+
+#include "app.h"
+#include "flash.h"
+#include "hal_fake.h"
+#include "record_store.h"
+#include "settings.h"
+
+static const char* const LAWS[] = { "hysteresis", "pid", "predictive" };
+
+static uint8_t  law;
+static float    tempHigh;
+static float    tempLow;
+static float    setpoint;
+static uint32_t sampleMs;
+static uint32_t applies;
+
+static void countApply() { applies++; }
+static bool check() { return tempLow < tempHigh; }
+
+static const Settings::Entry ENTRIES[] = {
+  { "law",       Settings::Type::ENUM,  &law,      0,    0,      LAWS,    3, countApply },
+  { "temp_high", Settings::Type::FLOAT, &tempHigh, 10,   45,     nullptr, 0, countApply },
+  { "temp_low",  Settings::Type::FLOAT, &tempLow,  10,   45,     nullptr, 0, countApply },
+  { "setpoint",  Settings::Type::FLOAT, &setpoint, 16,   32,     nullptr, 0, countApply },
+  { "sample_ms", Settings::Type::UINT,  &sampleMs, 2000, 600000, nullptr, 0, countApply },
+};
+static Settings settings(ENTRIES, sizeof(ENTRIES) / sizeof(ENTRIES[0]), check);
+
+// The firmware's defaults
+static void defaults() {
+  law      = 0;
+  tempHigh = 35;
+  tempLow  = 23;
+  setpoint = 26;
+  sampleMs = 5000;
+}
+
+static const char WIRE[] = "temp_low=15;temp_high=20;setpoint=20;sample_ms=10000";
+
+static Settings::Result load(const char* text, std::string* badKey = nullptr) {
+  const char* bad;
+  size_t badLen;
+  const Settings::Result r = settings.load(text, strlen(text), bad, badLen);
+  if (badKey) *badKey = bad ? std::string(bad, badLen) : std::string();
+  return r;
+}
+
+static void assertWireValues() {
+  TEST_ASSERT_EQUAL_FLOAT(20, tempHigh);
+  TEST_ASSERT_EQUAL_FLOAT(15, tempLow);
+  TEST_ASSERT_EQUAL_FLOAT(20, setpoint);
+  TEST_ASSERT_EQUAL(10000, sampleMs);
+}
+
+void setUp() {
+  defaults();
+  applies = 0;
+}
+
+void tearDown() {}
+
+// Written over the wire, persisted in registry order, restored at boot.
+// temp_high=20 comes before temp_low=15 in the stored text, below the
+// default temp_low of 23: checked pair by pair it would be refused.
+static void test_wire_write_round_trips_through_persistence() {
+  const char* bad;
+  size_t badLen;
+  TEST_ASSERT_EQUAL(Settings::Result::OK, settings.setAll(WIRE, strlen(WIRE), bad, badLen));
+  TEST_ASSERT_EQUAL(4, applies);
+
+  char text[128];
+  TEST_ASSERT_GREATER_THAN(0, settings.toText(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("law=hysteresis;temp_high=20;temp_low=15;setpoint=20;sample_ms=10000", text);
+
+  defaults();
+  applies = 0;
+  TEST_ASSERT_EQUAL(Settings::Result::OK, load(text));
+  assertWireValues();
+  TEST_ASSERT_EQUAL(0, applies);  // the caller applies once, after loading
+}
+
+// Later pairs still load past the ones this firmware refuses
+static void test_load_skips_bad_pairs() {
+  std::string bad;
+  TEST_ASSERT_EQUAL(Settings::Result::UNKNOWN_KEY,
+                    load("temp_high=30;retired=1;temp_low=99;setpoint=abc;noequals;sample_ms=10000;law=pid",
+                         &bad));
+  TEST_ASSERT_EQUAL_STRING("retired", bad.c_str());
+  TEST_ASSERT_EQUAL_FLOAT(30, tempHigh);
+  TEST_ASSERT_EQUAL_FLOAT(23, tempLow);
+  TEST_ASSERT_EQUAL_FLOAT(26, setpoint);
+  TEST_ASSERT_EQUAL(10000, sampleMs);
+  TEST_ASSERT_EQUAL(1, law);
+
+  TEST_ASSERT_EQUAL(Settings::Result::BAD_VALUE, load("temp_low=5;setpoint=21", &bad));
+  TEST_ASSERT_EQUAL_STRING("temp_low", bad.c_str());
+  TEST_ASSERT_EQUAL_FLOAT(21, setpoint);
+}
+
+// The check runs on the complete result; the caller decides what to keep
+static void test_load_checks_the_result() {
+  TEST_ASSERT_EQUAL(Settings::Result::REJECTED, load("temp_high=20;temp_low=25"));
+  TEST_ASSERT_EQUAL_FLOAT(20, tempHigh);
+  TEST_ASSERT_EQUAL_FLOAT(25, tempLow);
+
+  defaults();
+  TEST_ASSERT_EQUAL(Settings::Result::REJECTED, load("temp_high=20;retired=1"));
+  TEST_ASSERT_EQUAL(Settings::Result::OK, load("temp_high=24;temp_low=12"));
+}
+
+// Live writes keep checking each pair and stop at the first failure
+static void test_wire_write_checks_each_pair() {
+  const char* bad;
+  size_t badLen;
+  const char text[] = "law=pid;temp_low=40;setpoint=20";
+  TEST_ASSERT_EQUAL(Settings::Result::REJECTED, settings.setAll(text, strlen(text), bad, badLen));
+  TEST_ASSERT_EQUAL_STRING_LEN("temp_low", bad, badLen);
+  TEST_ASSERT_EQUAL(1, law);
+  TEST_ASSERT_EQUAL_FLOAT(23, tempLow);
+  TEST_ASSERT_EQUAL_FLOAT(26, setpoint);
+  TEST_ASSERT_EQUAL(1, applies);
+
+  const char unknown[] = "retired=1";
+  TEST_ASSERT_EQUAL(Settings::Result::UNKNOWN_KEY,
+                    settings.setAll(unknown, strlen(unknown), bad, badLen));
+}
+
+// Only plain decimals: strtof's "nan" would pass every range check, and
+// "inf" and exponents are not what the config topic documents
+static void test_non_decimal_floats_are_bad_values() {
+  const char* const texts[] = { "setpoint=nan", "setpoint=NAN", "temp_high=inf",
+                                "setpoint=-infinity", "setpoint=1e3", "setpoint=2.4e1" };
+  for (const char* text : texts) {
+    const char* bad;
+    size_t badLen;
+    TEST_ASSERT_EQUAL_MESSAGE(Settings::Result::BAD_VALUE,
+                              settings.setAll(text, strlen(text), bad, badLen), text);
+  }
+  TEST_ASSERT_EQUAL(Settings::Result::BAD_VALUE, load("setpoint=nan"));
+  TEST_ASSERT_EQUAL_FLOAT(26, setpoint);
+  TEST_ASSERT_EQUAL_FLOAT(35, tempHigh);
+  TEST_ASSERT_EQUAL(0, applies);
+}
+
+// Persisted floats are plain decimals, so load() reads back what toText()
+// wrote across the firmware's ranges: PID gains reach 1e-5 and 1e4
+static void test_float_text_round_trips() {
+  float ki = 0.00005f, kd = 9876.5f, band = 0.1f;
+  const Settings::Entry entries[] = {
+    { "ki",   Settings::Type::FLOAT, &ki,   0,    0.1f,  nullptr, 0, nullptr },
+    { "kd",   Settings::Type::FLOAT, &kd,   0,    10000, nullptr, 0, nullptr },
+    { "band", Settings::Type::FLOAT, &band, 0.1f, 5,     nullptr, 0, nullptr },
+  };
+  Settings gains(entries, 3, nullptr);
+
+  char text[128];
+  TEST_ASSERT_GREATER_THAN(0, gains.toText(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("ki=0.00005;kd=9876.5;band=0.1", text);
+
+  const float cases[][3] = { { 0.00005f, 9876.5f, 0.1f }, { 0.0000123f, 10000, 5 }, { 0, 0.25f, 4.75f } };
+  for (const auto& c : cases) {
+    ki = c[0], kd = c[1], band = c[2];
+    TEST_ASSERT_GREATER_THAN(0, gains.toText(text, sizeof(text)));
+    ki = kd = band = -1;
+    const char* bad;
+    size_t badLen;
+    TEST_ASSERT_EQUAL_MESSAGE(Settings::Result::OK, gains.load(text, strlen(text), bad, badLen), text);
+    TEST_ASSERT_FLOAT_WITHIN(c[0] * 1e-6f, c[0], ki);
+    TEST_ASSERT_FLOAT_WITHIN(c[1] * 1e-6f, c[1], kd);
+    TEST_ASSERT_FLOAT_WITHIN(c[2] * 1e-6f, c[2], band);
+  }
+
+  // The config topic's JSON keeps %g
+  TEST_ASSERT_GREATER_THAN(0, gains.toJson(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("{\"ki\":0,\"kd\":0.25,\"band\":4.75}", text);
+}
+
+// ---- The firmware itself, on fake hardware --------------------------------
+
+static constexpr uint8_t MAC[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x03 };
+
+static FakeClock   clock_;
+static FakeGpio    gpio(&clock_);
+static FakeSensor  sensor("dht");
+static const hal::SensorSlot sensors[] = { { sensor, 1.0f } };
+static FakeIrTx    irTx;
+static FakeIrRx    irRx;
+static SimFlash<8> flash;
+static FakeMqtt    mqtt;
+static FakeNetwork network;
+
+static const hal::Board board = {
+  clock_, gpio, sensors, 1, irTx, irRx, flash, mqtt, network,
+  []() -> uint32_t { return 0; },
+  [](uint8_t mac[6]) { memcpy(mac, MAC, sizeof(MAC)); },
+  26,
+  "settings",
+  nullptr,
+};
+
+static constexpr const char* CONFIG_RECORD = "cfg";  // app.cpp's record name
+
+static void run(uint32_t ms) {
+  const uint64_t end = clock_.nowUs() + static_cast<uint64_t>(ms) * 1000;
+  while (clock_.nowUs() < end) {
+    app::loop();
+    clock_.advanceMs(1);
+  }
+}
+
+// Boots on a record saved after the wire write above, then takes a new
+// write over MQTT and restores what it persisted
+static void test_firmware_restores_and_persists_settings() {
+  const char* bad;
+  size_t badLen;
+  TEST_ASSERT_EQUAL(Settings::Result::OK, settings.setAll(WIRE, strlen(WIRE), bad, badLen));
+  char text[128];
+  const size_t n = settings.toText(text, sizeof(text));
+  {
+    RecordStore seed(flash);
+    TEST_ASSERT_TRUE(seed.begin());
+    TEST_ASSERT_TRUE(seed.put(CONFIG_RECORD, text, n));
+  }
+
+  sensor.set(22.0f, 50.0f);
+  app::begin(board);
+  const Thermostat::Config& cfg = app::thermostat().config();
+  TEST_ASSERT_EQUAL_FLOAT(20, cfg.onAboveC);
+  TEST_ASSERT_EQUAL_FLOAT(15, cfg.offBelowC);
+  TEST_ASSERT_EQUAL_FLOAT(20, cfg.setpointC);
+  run(1000);
+  const uint32_t rounds = app::sensors().stats().rounds;
+  run(60000);
+  TEST_ASSERT_UINT32_WITHIN(1, 6, app::sensors().stats().rounds - rounds);  // every 10 s
+
+  TEST_ASSERT_TRUE(mqtt.connected());
+  TEST_ASSERT_TRUE(mqtt.inject(app::topics().configSet, "temp_high=32;temp_low=30;sample_ms=20000"));
+  run(100);
+  TEST_ASSERT_EQUAL_FLOAT(32, cfg.onAboveC);
+
+  // A PID window that cannot hold both dwell times is refused
+  const uint32_t windowMs = cfg.windowMs;
+  TEST_ASSERT_TRUE(mqtt.inject(app::topics().configSet, "window_ms=60000"));
+  run(100);
+  TEST_ASSERT_EQUAL(windowMs, cfg.windowMs);
+  TEST_ASSERT_TRUE(mqtt.inject(app::topics().configSet, "min_on_ms=0;min_off_ms=60000;window_ms=60000"));
+  run(100);
+  TEST_ASSERT_EQUAL(60000, cfg.windowMs);
+
+  uint16_t len = 0;
+  const uint8_t* stored = app::codeStore().get(CONFIG_RECORD, len);
+  TEST_ASSERT_NOT_NULL(stored);
+  defaults();
+  // The firmware's other keys are unknown here and skipped
+  TEST_ASSERT_EQUAL(Settings::Result::UNKNOWN_KEY,
+                    settings.load(reinterpret_cast<const char*>(stored), len, bad, badLen));
+  TEST_ASSERT_EQUAL_FLOAT(32, tempHigh);
+  TEST_ASSERT_EQUAL_FLOAT(30, tempLow);
+  TEST_ASSERT_EQUAL_FLOAT(20, setpoint);
+  TEST_ASSERT_EQUAL(20000, sampleMs);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_wire_write_round_trips_through_persistence);
+  RUN_TEST(test_load_skips_bad_pairs);
+  RUN_TEST(test_load_checks_the_result);
+  RUN_TEST(test_wire_write_checks_each_pair);
+  RUN_TEST(test_non_decimal_floats_are_bad_values);
+  RUN_TEST(test_float_text_round_trips);
+  RUN_TEST(test_firmware_restores_and_persists_settings);
+  return UNITY_END();
+}
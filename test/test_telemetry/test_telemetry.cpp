@@ -0,0 +1,306 @@
+/**
+ * @file test_telemetry.cpp
+ * @brief Telemetry store-and-forward: recording through an outage and replay,
+ *        and the delta-encoded batch format against its reference decoder
+ *
+ * test_batch_vs_json prints the two formats' cost for the same hour of
+ * samples (pio test -v shows it).
+ */
+
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "telemetry.h"
+
+static constexpr const char* TOPIC     = "unit/status";
+static constexpr uint32_t    PERIOD_MS = 5000;
+
+struct Message {
+  std::string topic;
+  std::string payload;
+};
+
+static std::vector<Message> sent;
+static uint32_t acceptLeft;  // publishes that succeed before the broker fails
+
+static bool publish(const char* topic, const uint8_t* payload, unsigned int len) {
+  if (acceptLeft == 0) return false;
+  acceptLeft--;
+  sent.push_back({ topic, std::string(reinterpret_cast<const char*>(payload), len) });
+  return true;
+}
+
+struct Json {
+  float    temp;  // NAN for null
+  float    hum;
+  uint32_t age;
+};
+
+static Json parse(const Message& m) {
+  char temp[16], hum[16];
+  unsigned long age = 0;
+  Json j = { NAN, NAN, 0 };
+  TEST_ASSERT_EQUAL(3, sscanf(m.payload.c_str(), "{\"temp\":%15[^,],\"hum\":%15[^,],\"age\":%lu}",
+                              temp, hum, &age));
+  if (strcmp(temp, "null") != 0) j.temp = static_cast<float>(atof(temp));
+  if (strcmp(hum, "null") != 0) j.hum = static_cast<float>(atof(hum));
+  j.age = static_cast<uint32_t>(age);
+  return j;
+}
+
+// Sample i reads 20.0 + i/10 C and 40 + i %, so its index can be read back
+static void recordSamples(Telemetry& t, uint32_t& nowMs, uint32_t count, uint32_t first = 0) {
+  for (uint32_t i = first; i < first + count; i++) {
+    t.record(nowMs, 20.0f + i / 10.0f, 40.0f + i);
+    nowMs += PERIOD_MS;
+  }
+}
+
+static uint32_t indexOf(const Json& j) {
+  return static_cast<uint32_t>(j.hum - 40.0f + 0.5f);
+}
+
+void setUp() {
+  sent.clear();
+  acceptLeft = UINT32_MAX;
+}
+
+void tearDown() {}
+
+static void test_online_sample_goes_out_at_once() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  t.record(1000, 24.56f, 51.0f);
+  t.service(1200, true);
+  TEST_ASSERT_EQUAL(1, sent.size());
+  TEST_ASSERT_EQUAL_STRING(TOPIC, sent[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"temp\":24.6,\"hum\":51.0,\"age\":200}", sent[0].payload.c_str());
+  TEST_ASSERT_EQUAL(0, t.backlog());
+}
+
+static void test_failed_read_is_null() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  t.record(0, NAN, 50.0f);
+  t.record(10, 25.0f, NAN);
+  t.service(10, true);
+  TEST_ASSERT_EQUAL_STRING("{\"temp\":null,\"hum\":50.0,\"age\":10}", sent[0].payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"temp\":25.0,\"hum\":null,\"age\":0}", sent[1].payload.c_str());
+}
+
+// Nothing is lost or reordered across an outage, and each replayed sample
+// says how old it is
+static void test_outage_replays_oldest_first_with_age() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  uint32_t now = 0;
+  const uint32_t count = 50;
+  for (uint32_t i = 0; i < count; i++) {
+    recordSamples(t, now, 1, i);
+    t.service(now, false);
+  }
+  TEST_ASSERT_EQUAL(0, sent.size());
+  TEST_ASSERT_EQUAL(count, t.backlog());
+
+  // One bounded batch per call
+  t.service(now, true);
+  TEST_ASSERT_EQUAL(Telemetry::REPLAY_BATCH, sent.size());
+  while (t.backlog()) t.service(now, true);
+  TEST_ASSERT_EQUAL(count, sent.size());
+  for (uint32_t i = 0; i < count; i++) {
+    const Json j = parse(sent[i]);
+    TEST_ASSERT_EQUAL(i, indexOf(j));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 20.0f + i / 10.0f, j.temp);
+    TEST_ASSERT_EQUAL(now - i * PERIOD_MS, j.age);
+  }
+  TEST_ASSERT_EQUAL(count, t.stats().published);
+  TEST_ASSERT_EQUAL(count, t.stats().messages);
+  TEST_ASSERT_EQUAL(count, t.stats().maxBacklog);
+  TEST_ASSERT_EQUAL(0, t.stats().dropped);
+}
+
+// A full ring keeps the newest samples and counts what it evicted
+static void test_overflow_drops_oldest_and_counts() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  uint32_t now = 0;
+  const uint32_t extra = 40;
+  recordSamples(t, now, Telemetry::RAM_SAMPLES + extra);
+  TEST_ASSERT_EQUAL(Telemetry::RAM_SAMPLES, t.backlog());
+  TEST_ASSERT_EQUAL(extra, t.stats().dropped);
+  TEST_ASSERT_EQUAL(Telemetry::RAM_SAMPLES + extra, t.stats().recorded);
+
+  while (t.backlog()) t.service(now, true);
+  TEST_ASSERT_EQUAL(Telemetry::RAM_SAMPLES, sent.size());
+  TEST_ASSERT_EQUAL(extra, indexOf(parse(sent.front())));
+  TEST_ASSERT_EQUAL(Telemetry::RAM_SAMPLES + extra - 1, indexOf(parse(sent.back())));
+}
+
+// A publish that fails part-way keeps the rest, in order, for the next call
+static void test_failed_publish_keeps_the_rest() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  uint32_t now = 0;
+  recordSamples(t, now, 6);
+  acceptLeft = 2;
+  t.service(now, true);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  TEST_ASSERT_EQUAL(4, t.backlog());
+
+  acceptLeft = UINT32_MAX;
+  t.service(now, true);
+  TEST_ASSERT_EQUAL(6, sent.size());
+  for (uint32_t i = 0; i < 6; i++) TEST_ASSERT_EQUAL(i, indexOf(parse(sent[i])));
+  TEST_ASSERT_EQUAL(6, t.stats().published);
+}
+
+// Samples on and off the 10 ms grid, both channels missing in turn, and
+// steps large enough to need multi-byte varints
+static void test_batch_round_trip() {
+  const Telemetry::Sample in[] = {
+    { 100000, 245, 512 },
+    { 105003, 246, Telemetry::NO_VALUE },
+    { 110000, Telemetry::NO_VALUE, 509 },
+    { 110000, Telemetry::NO_VALUE, Telemetry::NO_VALUE },
+    { 170020, -120, 1000 },
+    { 900000, 3276, 0 },
+    { 900010, -3276, 999 },
+  };
+  const uint8_t n   = sizeof(in) / sizeof(in[0]);
+  const uint32_t now = 901234;
+  uint8_t buf[Telemetry::BATCH_BYTES];
+  const uint16_t len = Telemetry::encodeBatch(in, n, now, buf, sizeof(buf));
+  TEST_ASSERT_GREATER_THAN(0, len);
+
+  Telemetry::Sample out[Telemetry::MAX_BATCH_SIZE];
+  TEST_ASSERT_EQUAL(n, Telemetry::decodeBatch(buf, len, now, out, Telemetry::MAX_BATCH_SIZE));
+  for (uint8_t i = 0; i < n; i++) {
+    TEST_ASSERT_UINT32_WITHIN(5, in[i].ms, out[i].ms);
+    TEST_ASSERT_EQUAL(in[i].temp10, out[i].temp10);
+    TEST_ASSERT_EQUAL(in[i].hum10, out[i].hum10);
+  }
+}
+
+// Rounding to 10 ms ticks does not accumulate over a batch
+static void test_batch_times_do_not_drift() {
+  Telemetry::Sample in[Telemetry::MAX_BATCH_SIZE];
+  for (uint8_t i = 0; i < Telemetry::MAX_BATCH_SIZE; i++) in[i] = { 1000u + i * 5004u, 250, 500 };
+  uint8_t buf[Telemetry::BATCH_BYTES];
+  const uint32_t now = in[Telemetry::MAX_BATCH_SIZE - 1].ms + 7;
+  const uint16_t len = Telemetry::encodeBatch(in, Telemetry::MAX_BATCH_SIZE, now, buf, sizeof(buf));
+  Telemetry::Sample out[Telemetry::MAX_BATCH_SIZE];
+  TEST_ASSERT_EQUAL(Telemetry::MAX_BATCH_SIZE,
+                    Telemetry::decodeBatch(buf, len, now, out, Telemetry::MAX_BATCH_SIZE));
+  for (uint8_t i = 0; i < Telemetry::MAX_BATCH_SIZE; i++) TEST_ASSERT_UINT32_WITHIN(5, in[i].ms, out[i].ms);
+}
+
+static void test_decoder_rejects_malformed() {
+  const Telemetry::Sample in[] = { { 0, 245, 512 }, { 5000, 250, 500 } };
+  uint8_t buf[Telemetry::BATCH_BYTES];
+  const uint16_t len = Telemetry::encodeBatch(in, 2, 5000, buf, sizeof(buf));
+  Telemetry::Sample out[2];
+  TEST_ASSERT_EQUAL(2, Telemetry::decodeBatch(buf, len, 5000, out, 2));
+  TEST_ASSERT_EQUAL(0, Telemetry::decodeBatch(buf, len - 1, 5000, out, 2));  // truncated
+  TEST_ASSERT_EQUAL(0, Telemetry::decodeBatch(buf, len, 5000, out, 1));      // too many
+  buf[len] = 0;
+  TEST_ASSERT_EQUAL(0, Telemetry::decodeBatch(buf, len + 1, 5000, out, 2));  // trailing byte
+  buf[0] = Telemetry::BATCH_VERSION + 1;
+  TEST_ASSERT_EQUAL(0, Telemetry::decodeBatch(buf, len, 5000, out, 2));
+}
+
+// A batch goes out when full, or when its oldest sample is flushMs old
+static void test_batch_flush_by_size_and_age() {
+  static Telemetry t(publish);
+  t.begin(TOPIC);
+  t.setBatching(4, 60000);
+  TEST_ASSERT_TRUE(t.batching());
+  uint32_t now = 0;
+  recordSamples(t, now, 5);
+  t.service(now, true);
+  TEST_ASSERT_EQUAL(1, sent.size());
+  TEST_ASSERT_EQUAL_STRING("unit/status/batch", sent[0].topic.c_str());
+
+  Telemetry::Sample out[4];
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(sent[0].payload.data());
+  TEST_ASSERT_EQUAL(4, Telemetry::decodeBatch(payload, sent[0].payload.size(), now, out, 4));
+  for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL(400 + i * 10, out[i].hum10);
+
+  now = 4 * PERIOD_MS + 59999;
+  t.service(now, true);
+  TEST_ASSERT_EQUAL(1, sent.size());
+  t.service(now + 1, true);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  TEST_ASSERT_EQUAL(0, t.backlog());
+  TEST_ASSERT_EQUAL(5, t.stats().published);
+  TEST_ASSERT_EQUAL(2, t.stats().messages);
+
+  t.setBatching(1, 60000);
+  TEST_ASSERT_FALSE(t.batching());
+}
+
+struct Cost {
+  uint32_t samples;
+  uint32_t messages;
+  uint32_t bytes;
+};
+
+// An hour at the default 5 s cadence, slow drift plus sensor noise and an
+// occasional failed read, serviced at the task's 250 ms period
+static Cost runHour(uint8_t batchSize, uint32_t flushMs) {
+  static Telemetry t(publish);
+  t = Telemetry(publish);
+  t.begin(TOPIC);
+  t.setBatching(batchSize, flushMs);
+  uint32_t seed = 1;
+  for (uint32_t now = 0; now < 3600000; now += 250) {
+    if (now % PERIOD_MS == 0) {
+      seed = seed * 1103515245 + 12345;
+      const float noise = ((seed >> 16) % 5) / 10.0f - 0.2f;
+      const bool  fail  = (seed >> 8) % 50 == 0;
+      t.record(now, fail ? NAN : 26.0f + 2.0f * sinf(now / 600000.0f) + noise,
+               55.0f + noise * 5.0f);
+    }
+    t.service(now, true);
+  }
+  return { t.stats().published, t.stats().messages, t.stats().bytes };
+}
+
+static void test_batch_vs_json() {
+  const Cost json  = runHour(0, 0);
+  const Cost batch = runHour(12, 60000);
+  char msg[128];
+  snprintf(msg, sizeof(msg), "json:  %.1f bytes/sample, %lu publishes/hour",
+           json.bytes / static_cast<double>(json.samples), (unsigned long)json.messages);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "batch: %.1f bytes/sample, %lu publishes/hour (12 samples, 60 s)",
+           batch.bytes / static_cast<double>(batch.samples), (unsigned long)batch.messages);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL(720, json.samples);
+  TEST_ASSERT_EQUAL(720, json.messages);
+  TEST_ASSERT_EQUAL(720, batch.samples);
+  TEST_ASSERT_EQUAL(60, batch.messages);
+  TEST_ASSERT_LESS_THAN(json.bytes / 5, batch.bytes);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_online_sample_goes_out_at_once);
+  RUN_TEST(test_failed_read_is_null);
+  RUN_TEST(test_outage_replays_oldest_first_with_age);
+  RUN_TEST(test_overflow_drops_oldest_and_counts);
+  RUN_TEST(test_failed_publish_keeps_the_rest);
+  RUN_TEST(test_batch_round_trip);
+  RUN_TEST(test_batch_times_do_not_drift);
+  RUN_TEST(test_decoder_rejects_malformed);
+  RUN_TEST(test_batch_flush_by_size_and_age);
+  RUN_TEST(test_batch_vs_json);
+  return UNITY_END();
+}
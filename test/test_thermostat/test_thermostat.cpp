@@ -0,0 +1,391 @@
+/**
+ * @file test_thermostat.cpp
+ * @brief Thermostat decisions against a recorded trace: band crossings,
+ *        compressor dwell, invalid readings and resynchronisation; the PID
+ *        windows and the predictive law against a simulated room
+ */
+
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+
+#include "thermostat.h"
+#include "trace.h"
+
+static constexpr uint32_t DWELL_MS = 180000;
+
+static Thermostat::Config hysteresis() {
+  Thermostat::Config c = {};
+  c.law       = Thermostat::Law::HYSTERESIS;
+  c.onAboveC  = 26.0f;
+  c.offBelowC = 23.0f;
+  c.minOnMs   = DWELL_MS;
+  c.minOffMs  = DWELL_MS;
+  c.setpointC = 24.5f;
+  c.bandC     = 1.0f;
+  c.windowMs  = 20 * 60 * 1000UL;
+  return c;
+}
+
+struct Sample {
+  uint32_t ms;
+  float    tempC;
+};
+
+// Parses TRACE_CSV as the simulator's loadTrace() does
+static uint16_t loadTrace(Sample* out, uint16_t cap) {
+  uint16_t n = 0;
+  const char* p = TRACE_CSV;
+  while (*p && n < cap) {
+    double sec;
+    float  temp;
+    if (*p != '#' && sscanf(p, "%lf,%f", &sec, &temp) == 2) {
+      out[n++] = { static_cast<uint32_t>(sec * 1000.0), temp };
+    }
+    while (*p && *p != '\n') p++;
+    if (*p) p++;
+  }
+  return n;
+}
+
+struct Transition {
+  uint32_t           ms;
+  float              tempC;
+  Thermostat::Action action;
+};
+
+// Replays the trace, collecting the actions taken
+static uint8_t replay(Thermostat& t, Transition* out, uint8_t cap) {
+  Sample trace[64];
+  const uint16_t n = loadTrace(trace, 64);
+  uint8_t count = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    const Thermostat::Action a = t.update(trace[i].ms, trace[i].tempC);
+    if (a != Thermostat::Action::NONE && count < cap) out[count++] = { trace[i].ms, trace[i].tempC, a };
+  }
+  return count;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_trace_parses() {
+  Sample trace[64];
+  TEST_ASSERT_EQUAL(31, loadTrace(trace, 64));
+  TEST_ASSERT_EQUAL(0, trace[0].ms);
+  TEST_ASSERT_EQUAL(900000, trace[30].ms);
+  TEST_ASSERT_TRUE(isnan(trace[5].tempC));
+}
+
+// The AC only changes when the reading leaves the band, never inside it
+static void test_transitions_only_on_band_crossings() {
+  Thermostat t(hysteresis());
+  Transition tr[16];
+  const uint8_t n = replay(t, tr, 16);
+  TEST_ASSERT_GREATER_THAN(0, n);
+  for (uint8_t i = 0; i < n; i++) {
+    if (tr[i].action == Thermostat::Action::TURN_ON) {
+      TEST_ASSERT_GREATER_OR_EQUAL(26.0f, tr[i].tempC);
+    } else {
+      TEST_ASSERT_LESS_OR_EQUAL(23.0f, tr[i].tempC);
+    }
+    if (i) TEST_ASSERT_NOT_EQUAL(static_cast<int>(tr[i - 1].action), static_cast<int>(tr[i].action));
+  }
+  // 480..750 s wander between 23.1 and 25.9: nothing is sent
+  for (uint8_t i = 0; i < n; i++) TEST_ASSERT_FALSE(tr[i].ms > 450000 && tr[i].ms < 780000);
+}
+
+// The exact schedule: the first crossing is sent at once, later ones wait
+// out the dwell and go at the first reading after it
+static void test_dwell_holds_transitions_back() {
+  Thermostat t(hysteresis());
+  Transition tr[16];
+  TEST_ASSERT_EQUAL(4, replay(t, tr, 16));
+
+  const uint32_t at[] = { 90000, 270000, 450000, 780000 };
+  for (uint8_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(at[i], tr[i].ms);
+    TEST_ASSERT_EQUAL(i % 2 ? Thermostat::Action::TURN_OFF : Thermostat::Action::TURN_ON, tr[i].action);
+  }
+  // 240 s: on for 150 s; 360, 390 and 420 s: off for 90..150 s
+  TEST_ASSERT_EQUAL(4, t.stats().dwellHolds);
+  TEST_ASSERT_EQUAL(2, t.stats().turnOns);
+  TEST_ASSERT_EQUAL(2, t.stats().turnOffs);
+  TEST_ASSERT_EQUAL(Thermostat::State::OFF, t.state());
+}
+
+// Dropouts are counted and change nothing, dwell included
+static void test_nan_readings_are_counted_and_ignored() {
+  Thermostat t(hysteresis());
+  Transition tr[16];
+  replay(t, tr, 16);
+  TEST_ASSERT_EQUAL(31, t.stats().evaluations);
+  TEST_ASSERT_EQUAL(2, t.stats().invalid);
+
+  Thermostat u(hysteresis());
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, u.update(0, NAN));
+  TEST_ASSERT_EQUAL(Thermostat::State::UNKNOWN, u.state());
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, u.update(1000, 30.0f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, u.update(DWELL_MS + 1000, NAN));
+  TEST_ASSERT_EQUAL(Thermostat::State::ON, u.state());
+  TEST_ASSERT_EQUAL(0, u.stats().dwellHolds);
+}
+
+// Unknown after boot: nothing is sent inside the band, and the first
+// decision outside it goes regardless of dwell
+static void test_unknown_state_resynchronises() {
+  Thermostat t(hysteresis());
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(0, 24.0f));
+  TEST_ASSERT_EQUAL(Thermostat::State::UNKNOWN, t.state());
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(1000, 22.0f));
+  TEST_ASSERT_EQUAL(1000, t.inStateMs(2000));
+
+  // So does the first decision after a reset
+  t.reset();
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(2000, 22.0f));
+  TEST_ASSERT_EQUAL(0, t.stats().dwellHolds);
+}
+
+// The application resets the belief when an automatic power frame fails to
+// send, so the same decision is retried on the next reading, not after
+// the dwell of a state the AC never entered
+static void test_failed_send_is_retried() {
+  Thermostat t(hysteresis());
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(0, 22.0f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(DWELL_MS, 24.0f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, t.update(DWELL_MS + 5000, 27.0f));
+  t.reset();  // the ON frame failed
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, t.update(DWELL_MS + 10000, 27.0f));
+  TEST_ASSERT_EQUAL(2, t.stats().turnOns);
+
+  // Without the reset the belief stays ON and nothing is resent
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(DWELL_MS + 15000, 27.0f));
+}
+
+// A manual command starts its own dwell
+static void test_assumed_state_starts_dwell() {
+  Thermostat t(hysteresis());
+  t.assume(Thermostat::State::OFF, 0);
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(60000, 28.0f));
+  TEST_ASSERT_EQUAL(1, t.stats().dwellHolds);
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, t.update(DWELL_MS, 28.0f));
+
+  // Assuming the current state again does not restart it
+  t.assume(Thermostat::State::ON, DWELL_MS + 60000);
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(2 * DWELL_MS, 22.0f));
+}
+
+// New thresholds apply to the next reading; the belief and its dwell stay
+static void test_configure_keeps_state() {
+  Thermostat t(hysteresis());
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, t.update(0, 27.0f));
+  Thermostat::Config c = hysteresis();
+  c.offBelowC = 25.0f;
+  c.onAboveC  = 28.0f;
+  t.configure(c);
+  TEST_ASSERT_EQUAL(Thermostat::State::ON, t.state());
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(60000, 24.5f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(DWELL_MS, 24.5f));
+}
+
+// ---- PID ----------------------------------------------------------------
+
+static constexpr uint32_t WINDOW_MS = 20 * 60 * 1000UL;
+static constexpr uint32_t STEP_MS   = 10000;
+
+// Proportional only, so a constant reading gives a constant duty:
+// 0.5 per C above a 24 C setpoint
+static Thermostat::Config pid() {
+  Thermostat::Config c = hysteresis();
+  c.law       = Thermostat::Law::PID;
+  c.setpointC = 24.0f;
+  c.kp        = 0.5f;
+  c.windowMs  = WINDOW_MS;
+  return c;
+}
+
+// Holds tempC for the given number of windows; returns the time the AC
+// was believed on, in ms
+static uint32_t holdPid(Thermostat& t, float tempC, uint32_t windows) {
+  uint32_t onMs = 0;
+  for (uint32_t now = 0; now < windows * t.config().windowMs; now += STEP_MS) {
+    t.update(now, tempC);
+    if (t.state() == Thermostat::State::ON) onMs += STEP_MS;
+  }
+  return onMs;
+}
+
+// Duty 0 is off for whole windows and duty 1 on for whole windows
+static void test_pid_saturated_windows() {
+  Thermostat cold(pid());
+  TEST_ASSERT_EQUAL(0, holdPid(cold, 22.0f, 3));
+  TEST_ASSERT_EQUAL_FLOAT(0, cold.duty());
+  TEST_ASSERT_EQUAL(0, cold.stats().turnOns);
+  TEST_ASSERT_EQUAL(1, cold.stats().turnOffs);  // the resync
+
+  Thermostat hot(pid());
+  TEST_ASSERT_EQUAL(3 * WINDOW_MS, holdPid(hot, 28.0f, 3));
+  TEST_ASSERT_EQUAL_FLOAT(1, hot.duty());
+  TEST_ASSERT_EQUAL(1, hot.stats().turnOns);
+  TEST_ASSERT_EQUAL(0, hot.stats().turnOffs);
+}
+
+// Windows shorter than the dwell times (which the settings refuse) still
+// never run the compressor at duty 0
+static void test_pid_zero_duty_in_short_window() {
+  Thermostat::Config c = pid();
+  c.windowMs = 60000;
+  c.minOnMs  = 0;
+  Thermostat t(c);
+  TEST_ASSERT_EQUAL(0, holdPid(t, 22.0f, 30));
+  TEST_ASSERT_EQUAL(0, t.stats().turnOns);
+}
+
+// Between the saturations the on-time is the duty's share of each window,
+// rounded to all or nothing where the dwell would not fit
+static void test_pid_time_proportioning() {
+  Thermostat half(pid());
+  TEST_ASSERT_EQUAL(3 * WINDOW_MS / 2, holdPid(half, 25.0f, 3));
+  TEST_ASSERT_EQUAL(3, half.stats().turnOns);
+
+  Thermostat low(pid());  // 2 minutes on is shorter than min_on_ms
+  TEST_ASSERT_EQUAL(0, holdPid(low, 24.2f, 3));
+
+  Thermostat high(pid());  // 2 minutes off is shorter than min_off_ms
+  TEST_ASSERT_EQUAL(3 * WINDOW_MS, holdPid(high, 25.8f, 3));
+}
+
+// ---- Predictive -----------------------------------------------------------
+
+// A first-order room: drifts to 32 C with the AC off, 18 C with it on,
+// with a 30-minute time constant
+static constexpr float ROOM_TAU_S = 1800.0f;
+
+static float roomStep(float tempC, bool on, uint32_t ms, float tauS = ROOM_TAU_S) {
+  const float eq = on ? 18.0f : 32.0f;
+  return eq + (tempC - eq) * expf(-(ms / 1000.0f) / tauS);
+}
+
+static Thermostat::Config predictive() {
+  Thermostat::Config c = hysteresis();
+  c.law       = Thermostat::Law::PREDICTIVE;
+  c.setpointC = 24.0f;
+  c.bandC     = 1.0f;
+  c.leadMs    = 5 * 60 * 1000UL;
+  return c;
+}
+
+// Closes the loop over the room for the given time; returns the lowest
+// and highest temperatures seen while the model was trusted
+static void runRoom(Thermostat& t, float& tempC, uint32_t& now, uint32_t ms, float& lo, float& hi,
+                    float tauS = ROOM_TAU_S) {
+  for (const uint32_t end = now + ms; now < end; now += STEP_MS) {
+    t.update(now, tempC);
+    tempC = roomStep(tempC, t.state() == Thermostat::State::ON, STEP_MS, tauS);
+    if (t.timeConstantS() > 0) {
+      if (tempC < lo) lo = tempC;
+      if (tempC > hi) hi = tempC;
+    }
+  }
+}
+
+// Untrusted, the law is hysteresis around setpoint +- band
+static void test_predictive_falls_back_to_band() {
+  Thermostat t(predictive());
+  TEST_ASSERT_EQUAL(0, t.timeConstantS());
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(0, 24.5f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_ON, t.update(1000, 25.0f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::NONE, t.update(DWELL_MS, 23.5f));
+  TEST_ASSERT_EQUAL(Thermostat::Action::TURN_OFF, t.update(DWELL_MS + 1000, 23.0f));
+  TEST_ASSERT_EQUAL_FLOAT(27.0f, t.predict(27.0f, true, 600000));
+}
+
+// The model fits under any law, so a switch to the predictive one starts
+// warm. Once fitted it knows the room's time constant and switches ahead
+// of the band, so the room stays inside it.
+static void test_predictive_switches_ahead_of_band() {
+  Thermostat::Config c = hysteresis();
+  c.onAboveC  = 28.0f;
+  c.offBelowC = 20.0f;
+  Thermostat t(c);
+  float    tempC = 26.0f;
+  uint32_t now   = 0;
+  float    lo = 100, hi = -100;
+  runRoom(t, tempC, now, 2 * 3600 * 1000UL, lo, hi);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(Thermostat::MODEL_MIN_FITS, t.stats().modelFits);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f * ROOM_TAU_S, ROOM_TAU_S, t.timeConstantS());
+  TEST_ASSERT_FLOAT_WITHIN(0.25f, roomStep(25.0f, true, 600000), t.predict(25.0f, true, 600000));
+  TEST_ASSERT_FLOAT_WITHIN(0.25f, roomStep(23.0f, false, 600000), t.predict(23.0f, false, 600000));
+
+  t.configure(predictive());
+  const uint32_t ons = t.stats().turnOns;
+  runRoom(t, tempC, now, 30 * 60 * 1000UL, lo, hi);  // into the band
+  lo = 100;
+  hi = -100;
+  runRoom(t, tempC, now, 4 * 3600 * 1000UL, lo, hi);
+  TEST_ASSERT_GREATER_THAN(23.0f, lo);
+  TEST_ASSERT_LESS_THAN(25.0f, hi);
+  TEST_ASSERT_GREATER_THAN(ons + 4, t.stats().turnOns);
+}
+
+// A room as slow as the simulator's, where PID's windows are not the limit
+static constexpr float SLOW_TAU_S = 3600.0f;
+
+static uint32_t switches(const Thermostat& t) {
+  return t.stats().turnOns + t.stats().turnOffs;
+}
+
+// With the unit's defaults (a 1.25 C band, a 2-minute lead) the law cycles
+// the compressor no more often than PID on the same room, and holds it in
+// a narrower swing. A longer lead would stop it short of the band edges
+// and cycle it more.
+static void test_predictive_cycles_no_more_than_pid() {
+  Thermostat::Config c = pid();
+  c.ki = 0.0003f;
+  Thermostat p(c);
+  float    tempC = 26.0f;
+  uint32_t now   = 0;
+  float    lo = 100, hi = -100;
+  runRoom(p, tempC, now, 2 * 3600 * 1000UL, lo, hi, SLOW_TAU_S);  // settle and fit
+  const uint32_t pidStart = switches(p);
+  lo = 100;
+  hi = -100;
+  runRoom(p, tempC, now, 8 * 3600 * 1000UL, lo, hi, SLOW_TAU_S);
+  const uint32_t pidSwitches = switches(p) - pidStart;
+  const float    pidSwing    = hi - lo;
+
+  c = predictive();
+  c.bandC  = 1.25f;
+  c.leadMs = 2 * 60 * 1000UL;
+  p.configure(c);
+  runRoom(p, tempC, now, 30 * 60 * 1000UL, lo, hi, SLOW_TAU_S);
+  const uint32_t start = switches(p);
+  lo = 100;
+  hi = -100;
+  runRoom(p, tempC, now, 8 * 3600 * 1000UL, lo, hi, SLOW_TAU_S);
+  TEST_ASSERT_LESS_OR_EQUAL(pidSwitches, switches(p) - start);
+  TEST_ASSERT_GREATER_THAN(c.setpointC - c.bandC, lo);
+  TEST_ASSERT_LESS_THAN(c.setpointC + c.bandC, hi);
+  TEST_ASSERT_LESS_THAN(pidSwing, hi - lo);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_parses);
+  RUN_TEST(test_transitions_only_on_band_crossings);
+  RUN_TEST(test_dwell_holds_transitions_back);
+  RUN_TEST(test_nan_readings_are_counted_and_ignored);
+  RUN_TEST(test_unknown_state_resynchronises);
+  RUN_TEST(test_failed_send_is_retried);
+  RUN_TEST(test_assumed_state_starts_dwell);
+  RUN_TEST(test_configure_keeps_state);
+  RUN_TEST(test_pid_saturated_windows);
+  RUN_TEST(test_pid_zero_duty_in_short_window);
+  RUN_TEST(test_pid_time_proportioning);
+  RUN_TEST(test_predictive_falls_back_to_band);
+  RUN_TEST(test_predictive_switches_ahead_of_band);
+  RUN_TEST(test_predictive_cycles_no_more_than_pid);
+  return UNITY_END();
+}
@@ -0,0 +1,44 @@
+/**
+ * @file trace.h
+ * @brief A recorded afternoon for the thermostat tests, in the simulator's
+ *        --trace format ("seconds,tempC" per line, '#' starts a comment)
+ *
+ * The room warms through the 23..26 C band, the sensor drops out twice,
+ * then the temperature swings back and forth faster than the compressor's
+ * three-minute dwell allows before wandering inside the band.
+ */
+#pragma once
+
+static const char TRACE_CSV[] = R"(# seconds,tempC
+0,24.0
+30,25.0
+60,25.9
+90,26.0
+120,25.5
+150,nan
+180,nan
+210,24.5
+240,22.8
+270,22.5
+300,23.5
+330,25.0
+360,26.5
+390,26.8
+420,27.0
+450,27.0
+480,25.0
+510,25.8
+540,23.2
+570,24.0
+600,25.9
+630,23.1
+660,24.4
+690,25.7
+720,23.5
+750,24.9
+780,23.0
+810,23.4
+840,25.2
+870,25.9
+900,24.0
+)";